@@ -0,0 +1,1221 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "ffeffects.h"
+#include "ffbench.h"
+
+#define min( a, b )    ( ( (a) < (b)) ? (a) : (b) )
+#define max( a, b )    ( ( (a) > (b)) ? (a) : (b) )
+
+#define testBit(bit, array)    ((array[(bit) / 8] >> ((bit) % 8)) & 1)
+
+/* Used when we're not yet performing the choke test: 50ms */
+#define SAFE_UPDATE_PERIOD  50000
+/* Time for the last kernel log messages to arrive: 200ms */
+#define KMSG_SETTLE_TIME    200000
+/* Time for the virtual device to apply the final effect, before it is considered lost: 10s */
+#define FINAL_TIMEOUT       10000
+/* Marks the final effect, in a field that devices ignore (there is no trigger button) */
+#define FINAL_MARKER        0x7eed
+
+const char* ffbench_pacing_names[N_FFBENCH_PACINGS] = { "sleep", "deadline", "absolute", "adaptive" };
+
+static unsigned long get_utime()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return 1000000 * tv.tv_sec + tv.tv_usec;
+}
+
+static unsigned long long get_ntime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+/* Sleep until the CLOCK_MONOTONIC time 'ntime' (in nanoseconds), if it's not past yet */
+static void sleep_until(unsigned long long ntime)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ntime / 1000000000ull;
+	ts.tv_nsec = ntime % 1000000000ull;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+/* User and system CPU time of the process so far (including io_uring workers), in microseconds */
+static void get_cpu_time(unsigned long* cpu_time, unsigned long* system_time)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	*system_time = 1000000 * usage.ru_stime.tv_sec + usage.ru_stime.tv_usec;
+	*cpu_time = *system_time + 1000000 * usage.ru_utime.tv_sec + usage.ru_utime.tv_usec;
+}
+
+/* Resident set size of the process, in kB, -1 if unknown */
+static long get_rss()
+{
+	long pages = -1;
+	FILE* file = fopen("/proc/self/statm", "r");
+
+	if (!file)
+		return -1;
+	if (fscanf(file, "%*d %ld", &pages) != 1)
+		pages = -1;
+	fclose(file);
+	return (pages < 0 ? -1 : pages * (sysconf(_SC_PAGESIZE) / 1024));
+}
+
+
+
+/* Called from the thread of the virtual device, for each command it applied */
+static void on_device_apply(void* data, const struct ff_command* cmd, unsigned long long apply_time)
+{
+	struct ffbench* bench = data;
+
+	if (cmd->type == FF_CMD_UPLOAD && cmd->effect.trigger.interval == FINAL_MARKER && !bench->final_seen) {
+		bench->final_received_time = cmd->timestamp;
+		bench->final_applied_time = apply_time;
+		bench->applied_before_final = bench->n_applied;
+		__sync_synchronize();
+		bench->final_seen = 1;
+	}
+	bench->n_applied++;
+}
+
+int ffbench_open(struct ffbench* bench, const char* device)
+{
+	int n_slots;
+
+	memset(bench, 0, sizeof(*bench));
+	snprintf(bench->device, sizeof(bench->device), "%s", device);
+	bench->latency_window = -1;
+	bench->submit_backend = -1;
+
+	bench->fd = open(device, O_RDWR);
+	if (bench->fd == -1)
+		return -1;
+
+	/* Force feedback effects */
+	if (ioctl(bench->fd, EVIOCGBIT(EV_FF, sizeof(bench->ff_features)), bench->ff_features) == -1)
+		goto error;
+
+	/* Number of effects the device can play at the same time */
+	if (ffslots_init(&bench->slot_pool, bench->fd, 0) == -1)
+		goto error;
+	n_slots = (bench->slot_pool.n_slots ? bench->slot_pool.n_slots : 1);
+	bench->effect_slots = calloc(n_slots, sizeof(*bench->effect_slots));
+	bench->slots = calloc(n_slots, sizeof(*bench->slots));
+	bench->slot_latency_hist = calloc(n_slots, sizeof(*bench->slot_latency_hist));
+	if (!bench->effect_slots || !bench->slots || !bench->slot_latency_hist) {
+		errno = ENOMEM;
+		goto error_slots;
+	}
+
+	init_effects();
+	return 0;
+
+error_slots:
+	free(bench->effect_slots);
+	free(bench->slots);
+	free(bench->slot_latency_hist);
+	ffslots_free(&bench->slot_pool);
+error:
+	close(bench->fd);
+	return -1;
+}
+
+int ffbench_open_emulated(struct ffbench* bench, const struct ffdevsim_config* config)
+{
+	struct ffdevsim* sim;
+	int err;
+
+	sim = malloc(sizeof(*sim));
+	if (!sim)
+		return -1;
+	if (ffdevsim_create(sim, config) == -1) {
+		free(sim);
+		return -1;
+	}
+	if (ffbench_open(bench, sim->devnode) == -1)
+		goto error;
+	bench->sim = sim;
+	sim->on_apply = on_device_apply;
+	sim->on_apply_data = bench;
+	if (ffdevsim_start(sim) == -1) {
+		bench->sim = NULL;
+		ffbench_close(bench);
+		goto error;
+	}
+	return 0;
+
+error:
+	err = errno;
+	ffdevsim_destroy(sim);
+	free(sim);
+	errno = err;
+	return -1;
+}
+
+void ffbench_close(struct ffbench* bench)
+{
+	if (bench->inprobe_started)
+		ffinprobe_stop(&bench->inprobe);
+	if (bench->kmsg_started)
+		ffkmsg_watch_stop(&bench->kmsg);
+	if (bench->perf_opened)
+		ffperf_close(&bench->perf);
+	if (bench->ktrace_opened)
+		ffktrace_close(&bench->ktrace);
+	ffsched_free(&bench->sched);
+	ffbench_set_trace(bench, NULL);
+	if (bench->submit_backend >= 0)
+		ffsubmit_free(&bench->submitter);
+	ffslots_free(&bench->slot_pool);
+	close(bench->fd);
+	free(bench->effect_slots);
+	free(bench->slots);
+	free(bench->slot_latency_hist);
+	free(bench->timeline);
+	if (bench->sim) {
+		ffdevsim_stop(bench->sim);
+		ffdevsim_destroy(bench->sim);
+		free(bench->sim);
+	}
+}
+
+/* The operations that upload and start effects in the slots */
+static int effect_operation(int option)
+{
+	return (option == FFBENCH_UPDATE || option == FFBENCH_RESTART || option == FFBENCH_MIX);
+}
+
+/* Effect template of simultaneous effect 'i' */
+static int slot_effect(const struct ffbench_scenario* scenario, int i)
+{
+	return (scenario->operation == FFBENCH_MIX ? scenario->streams[i].effect_idx : scenario->effect_idx);
+}
+
+int ffbench_supported(const struct ffbench* bench, const struct ffbench_scenario* scenario)
+{
+	int i;
+
+	switch (scenario->operation) {
+	case FFBENCH_UPDATE:
+	case FFBENCH_RESTART:
+		return (scenario->effect_idx >= 0 && scenario->effect_idx < N_EFFECTS &&
+		        effect_supported(scenario->effect_idx, bench->ff_features));
+	case FFBENCH_MIX:
+		for (i = 0; i < scenario->n_effects; i++) {
+			if (scenario->streams[i].effect_idx < 0 || scenario->streams[i].effect_idx >= N_EFFECTS ||
+			    !effect_supported(scenario->streams[i].effect_idx, bench->ff_features))
+				return 0;
+		}
+		return 1;
+	case FFBENCH_GAIN:
+		return testBit(FF_GAIN, bench->ff_features);
+	case FFBENCH_AUTOCENTER:
+		return testBit(FF_AUTOCENTER, bench->ff_features);
+	}
+	return 0;
+}
+
+void ffbench_default_scenario(struct ffbench_scenario* scenario, int operation)
+{
+	memset(scenario, 0, sizeof(*scenario));
+	scenario->operation = operation;
+	scenario->effect_idx = 0;           /* Constant Force */
+	scenario->n_effects = 4;
+	scenario->direction = -1;
+	scenario->burst = 1;
+	scenario->change_params = 1;
+	scenario->update_period = 20000;    /* 20ms */
+	scenario->duration = 2000000;       /* 2 seconds */
+	scenario->effect_duration = 2000;   /* 2 seconds */
+	scenario->pacing = FFBENCH_SLEEP;
+	scenario->submit_backend = FFSUBMIT_WRITE_EACH;
+}
+
+
+
+static void reset_latency_hists(struct ffbench* bench)
+{
+	int i;
+
+	ffhist_reset(&bench->result->upload_latency_hist);
+	ffhist_reset(&bench->result->write_latency_hist);
+	for (i = 0; i < bench->slot_pool.n_slots; i++)
+		ffhist_reset(&bench->slot_latency_hist[i]);
+	ffhist_reset(&bench->window_latency_hist[0]);
+	ffhist_reset(&bench->window_latency_hist[1]);
+	ffhist_reset(&bench->soak_latency_hist);
+}
+
+/* Record the latency of a syscall started at 'start_ntime', 'slot' is -1 if not related to an effect slot */
+static void record_latency(struct ffbench* bench, struct ffhist* hist, int slot, unsigned long long start_ntime)
+{
+	unsigned long long latency = get_ntime() - start_ntime;
+
+	ffhist_add(hist, latency);
+	if (slot >= 0)
+		ffhist_add(&bench->slot_latency_hist[slot], latency);
+	if (bench->latency_window >= 0)
+		ffhist_add(&bench->window_latency_hist[bench->latency_window], latency);
+	ffhist_add(&bench->soak_latency_hist, latency);
+}
+
+/* Handle a failed syscall in the choke loop */
+static void choke_error(struct ffbench* bench, const char* msg)
+{
+	if (bench->stop_on_error && !bench->stopped) {
+		perror(msg);
+		bench->stopped = 1;
+	}
+	bench->result->n_errors++;
+}
+
+
+
+/* Whether to measure the input reports around this choke-test, the probe is started on first use */
+static int use_input_probe(struct ffbench* bench, const struct ffbench_scenario* scenario)
+{
+	if (!scenario->input_probe)
+		return 0;
+	if (!bench->inprobe_started) {
+		if (ffinprobe_start(&bench->inprobe, bench->device) == -1) {
+			perror("Start input probe");
+			return 0;
+		}
+		bench->inprobe_started = 1;
+	}
+	return 1;
+}
+
+/* Whether to watch the kernel log during this choke-test, the watch is started on first use */
+static int use_kmsg_watch(struct ffbench* bench, const struct ffbench_scenario* scenario)
+{
+	if (!scenario->kmsg_watch)
+		return 0;
+	if (!bench->kmsg_started) {
+		if (ffkmsg_watch_start(&bench->kmsg, FFBENCH_MAX_KMSG_ERRORS) == -1) {
+			perror("Watch /dev/kmsg (needs root or CAP_SYSLOG, or kernel.dmesg_restrict=0)");
+			return 0;
+		}
+		bench->kmsg_started = 1;
+	}
+	return 1;
+}
+
+/* Open the performance counters once, they fall back to rusage where perf is unavailable */
+static int use_perf_counters(struct ffbench* bench, const struct ffbench_scenario* scenario)
+{
+	if (!scenario->perf_counters)
+		return 0;
+	if (!bench->perf_opened) {
+		if (ffperf_open(&bench->perf) == 0 && scenario->verbose)
+			printf("Warning: no performance counters (perf_event_open), only rusage is available.\n");
+		bench->perf_opened = 1;
+	}
+	return 1;
+}
+
+/*
+ * Open the kernel trace once, the commands sent by ffpace can't be marked,
+ * and the writes of io_uring run in its workers instead of the choke thread. Needs the submitter.
+ */
+static int use_kernel_trace(struct ffbench* bench, const struct ffbench_scenario* scenario)
+{
+	if (!scenario->kernel_trace)
+		return 0;
+	if (scenario->pacing == FFBENCH_ADAPTIVE) {
+		printf("Warning: the kernel trace is not available with adaptive pacing.\n");
+		return 0;
+	}
+	if (bench->submit_backend == FFSUBMIT_IO_URING) {
+		printf("Warning: the kernel trace is not available with '%s' submission.\n",
+				ffsubmit_backend_names[FFSUBMIT_IO_URING]);
+		return 0;
+	}
+	if (!bench->ktrace_opened) {
+		if (ffktrace_open(&bench->ktrace) == -1) {
+			perror("Kernel trace (needs root, and tracefs with kprobe events)");
+			return 0;
+		}
+		bench->ktrace_opened = 1;
+	}
+	return 1;
+}
+
+/* Mark the start of a command of the choke thread in the kernel trace */
+static void ktrace_mark(struct ffbench* bench, int command, int slot)
+{
+	if (bench->ktracing)
+		ffktrace_mark(&bench->ktrace, bench->trace_tick, command, slot);
+}
+
+/* Forget earlier messages, and prepare the timeline of the salvo */
+static void start_kmsg_timeline(struct ffbench* bench, const struct ffbench_scenario* scenario)
+{
+	while (ffkmsg_watch_take(&bench->kmsg, bench->kmsg_errors, FFBENCH_MAX_KMSG_ERRORS))
+		;
+	bench->n_kmsg_errors = 0;
+	/* The kernel log clock stops during suspend, e.g. in-between two runs */
+	if (ffkmsg_watch_calibrate(&bench->kmsg) == -1 && scenario->verbose)
+		perror("Warning: could not calibrate the kernel log clock (writing /dev/kmsg needs root)");
+
+	size_t n_commands = 0;
+	int i;
+
+	/* All commands of the salvo, at most a million */
+	free(bench->timeline);
+	if (scenario->operation == FFBENCH_MIX) {
+		for (i = 0; i < scenario->n_effects; i++)
+			n_commands += scenario->duration / max(scenario->streams[i].period, 1ul) + 2;
+	} else {
+		n_commands = (scenario->duration / max(scenario->update_period, 1ul) + 2) * (scenario->n_effects + 1);
+	}
+	bench->timeline_size = min(1ul << 20, n_commands);
+	bench->timeline = malloc(bench->timeline_size * sizeof(*bench->timeline));
+	if (!bench->timeline)
+		bench->timeline_size = 0;
+	bench->timeline_len = 0;
+	bench->timeline_frozen = 0;
+}
+
+/* Wait for the driver's last messages, instead of the user waiting for them in dmesg */
+static void collect_kmsg_errors(struct ffbench* bench)
+{
+	usleep(KMSG_SETTLE_TIME);
+	bench->n_kmsg_errors = ffkmsg_watch_take(&bench->kmsg, bench->kmsg_errors, FFBENCH_MAX_KMSG_ERRORS);
+	/* Only the timeline of the last salvo is kept */
+	bench->timeline_frozen = 1;
+}
+
+/* Print each driver error, and the command that preceded it */
+static void print_kmsg_errors(const struct ffbench* bench)
+{
+	const struct ffkmsg_entry* entry;
+	const struct fftrace_record* r;
+	unsigned long long time;
+	long idx;
+	int i;
+
+	printf("Kernel log: %d driver error(s) during the choke-test%s\n", bench->n_kmsg_errors,
+			bench->n_kmsg_errors ? ":" : ".");
+	if (bench->n_kmsg_errors && !bench->kmsg.calibrated)
+		printf("  (the kernel log clock could not be calibrated, the mapping onto the commands is approximate)\n");
+	for (i = 0; i < bench->n_kmsg_errors && i < 20; i++) {
+		entry = &bench->kmsg_errors[i];
+		printf("  [%5llu.%06llu] %s: %s\n", entry->time / 1000000000ull,
+				entry->time % 1000000000ull / 1000, entry->pattern, entry->text);
+		time = ffkmsg_watch_time(&bench->kmsg, entry);
+		idx = ffkmsg_preceding(bench->timeline, bench->timeline_len, time);
+		if (idx < 0)
+			continue;
+		r = &bench->timeline[idx];
+		printf("\t%lluus after update %llu: %s", (time - r->send_time) / 1000,
+				(unsigned long long)r->tick, fftrace_command_names[r->command]);
+		if (r->slot >= 0)
+			printf(" of slot %d (effect id %d)", r->slot, r->effect_id);
+		printf(" with value %d\n", r->value);
+	}
+	if (bench->n_kmsg_errors > 20)
+		printf("  ... and %d more\n", bench->n_kmsg_errors - 20);
+}
+
+int ffbench_set_trace(struct ffbench* bench, const char* path)
+{
+	if (bench->tracing) {
+		bench->tracing = 0;
+		if (fftrace_close(&bench->trace) == -1)
+			perror("Write trace file");
+		if (bench->trace.n_dropped)
+			printf("Warning: %lu trace records were dropped, the disk couldn't keep up.\n", bench->trace.n_dropped);
+	}
+	if (!path)
+		return 0;
+	if (fftrace_open(&bench->trace, path, get_ntime()) == -1)
+		return -1;
+	bench->tracing = 1;
+	return 0;
+}
+
+/* Trace a command of which the syscall started at 'send_time' and just returned */
+static void trace_command(struct ffbench* bench, int command, int slot, int effect_id, int value, int flags,
+                          unsigned long long send_time)
+{
+	struct fftrace_record record;
+
+	if (!bench->tracing && (bench->timeline_frozen || bench->timeline_len == bench->timeline_size))
+		return;
+	record.tick = bench->trace_tick;
+	record.scheduled_time = bench->trace_scheduled_time;
+	record.send_time = send_time;
+	record.syscall_duration = (flags & FFTRACE_QUEUED ? 0 : get_ntime() - send_time);
+	record.value = value;
+	record.slot = slot;
+	record.effect_id = effect_id;
+	record.command = command;
+	record.flags = flags;
+	record.reserved = 0;
+	if (bench->tracing)
+		fftrace_add(&bench->trace, &record);
+	if (!bench->timeline_frozen && bench->timeline_len < bench->timeline_size)
+		bench->timeline[bench->timeline_len++] = record;
+}
+
+
+
+/* (Re)create the submitter for 'backend' if needed, falling back to a write per event */
+static void init_submitter(struct ffbench* bench, int backend)
+{
+	if (bench->submit_backend == backend)
+		return;
+	if (bench->submit_backend >= 0)
+		ffsubmit_free(&bench->submitter);
+	bench->submit_backend = backend;
+	if (ffsubmit_init(&bench->submitter, bench->fd, backend) == -1) {
+		perror("Warning: submit_backend not available");
+		printf("Using '%s' instead.\n", ffsubmit_backend_names[FFSUBMIT_WRITE_EACH]);
+		bench->submit_backend = FFSUBMIT_WRITE_EACH;
+		ffsubmit_init(&bench->submitter, bench->fd, FFSUBMIT_WRITE_EACH);
+	}
+}
+
+/* Queue a write, and record its latency if it was sent right away */
+static void submit_write(struct ffbench* bench, int command, int slot, int code, int value)
+{
+	unsigned long long syscall_start;
+	int ret;
+
+	if (bench->submit_backend == FFSUBMIT_WRITE_EACH)
+		ktrace_mark(bench, command, slot);
+	else if (ffsubmit_pending(&bench->submitter) == FFSUBMIT_MAX_EVENTS)
+		ktrace_mark(bench, FFTRACE_FLUSH, -1);     /* the full batch is flushed first */
+	syscall_start = get_ntime();
+	ret = ffsubmit_add(&bench->submitter, EV_FF, code, value);
+
+	trace_command(bench, command, slot, (command == FFTRACE_PLAY ? code : -1), value,
+	              (ret < 0 ? FFTRACE_ERROR : 0) | (ffsubmit_pending(&bench->submitter) ? FFTRACE_QUEUED : 0),
+	              syscall_start);
+	if (ret < 0)
+		choke_error(bench, "Write error");
+	if (bench->submit_backend == FFSUBMIT_WRITE_EACH)
+		record_latency(bench, &bench->result->write_latency_hist, slot, syscall_start);
+	bench->result->n_commands++;
+}
+
+/* Send the writes queued during this update, in one go */
+static void submit_flush(struct ffbench* bench)
+{
+	unsigned long long syscall_start;
+	int n_events = ffsubmit_pending(&bench->submitter), ret;
+
+	if (!n_events)
+		return;
+	ktrace_mark(bench, FFTRACE_FLUSH, -1);
+	syscall_start = get_ntime();
+	ret = ffsubmit_flush(&bench->submitter);
+	trace_command(bench, FFTRACE_FLUSH, -1, -1, n_events, (ret < 0 ? FFTRACE_ERROR : 0), syscall_start);
+	if (ret < 0)
+		choke_error(bench, "Write error");
+	record_latency(bench, &bench->result->write_latency_hist, -1, syscall_start);
+}
+
+/* Upload the effect of slot 'i', and record its latency unless the upload cache skipped it */
+static void upload_slot(struct ffbench* bench, int i, int effect_idx)
+{
+	unsigned long long syscall_start;
+	int ret;
+
+	ktrace_mark(bench, FFTRACE_UPLOAD, i);
+	syscall_start = get_ntime();
+	ret = ffslots_upload(&bench->slot_pool, bench->slots[i], &bench->effect_slots[i]);
+
+	trace_command(bench, FFTRACE_UPLOAD, i, bench->effect_slots[i].id,
+	              get_effect_parameter(&bench->effect_slots[i], effect_idx),
+	              (ret < 0 ? FFTRACE_ERROR : 0) | (ret == 0 ? FFTRACE_SKIPPED : 0), syscall_start);
+	if (ret < 0)
+		choke_error(bench, "Upload effect error");
+	if (ret != 0) {
+		record_latency(bench, &bench->result->upload_latency_hist, i, syscall_start);
+		bench->result->n_commands++;
+	}
+}
+
+/* Called by ffpace after each syscall it made, with FFBENCH_ADAPTIVE */
+static void pace_sent(void* data, int command, int slot, int code, int value, int ret, unsigned long long send_time)
+{
+	static const int trace_commands[N_FFPACE_COMMANDS] = { FFTRACE_UPLOAD, FFTRACE_PLAY, FFTRACE_GAIN, FFTRACE_AUTOCENTER };
+	struct ffbench* bench = data;
+
+	if (command == FFPACE_UPLOAD)
+		value = get_effect_parameter(&bench->effect_slots[slot], bench->effect_idx);
+	trace_command(bench, trace_commands[command], slot, (slot >= 0 ? code : -1), value,
+	              (ret < 0 ? FFTRACE_ERROR : 0), send_time);
+	if (ret < 0)
+		choke_error(bench, (command == FFPACE_UPLOAD ? "Upload effect error" : "Write error"));
+	record_latency(bench, (command == FFPACE_UPLOAD ? &bench->result->upload_latency_hist :
+	                                                  &bench->result->write_latency_hist), slot, send_time);
+	bench->result->n_commands++;
+}
+
+
+
+static void start_soak_window(struct ffbench* bench, const struct ffbench_scenario* scenario,
+                              unsigned long n_updates, unsigned long n_missed, unsigned long long now)
+{
+	bench->soak.start_time = now;
+	bench->soak.next_report_time = now + 1000000000ull * scenario->report_interval;
+	bench->soak.n_updates = n_updates;
+	bench->soak.n_commands = bench->result->n_commands;
+	bench->soak.n_errors = bench->result->n_errors;
+	bench->soak.n_missed = n_missed;
+	get_cpu_time(&bench->soak.cpu_time, &bench->soak.system_time);
+	ffhist_reset(&bench->soak_latency_hist);
+}
+
+/* Summarize the window that just ended, to spot a slow drift of the driver or of this tool itself */
+static void report_soak_window(struct ffbench* bench, const struct ffbench_scenario* scenario,
+                               unsigned long n_updates, unsigned long n_missed,
+                               unsigned long long salvo_start, unsigned long long now)
+{
+	const struct ffbench_result* result = bench->result;
+	double window = (now - bench->soak.start_time) / 1e9;
+	unsigned long long p99 = ffhist_percentile(&bench->soak_latency_hist, 0.99);
+	unsigned long cpu_time, system_time;
+	long rss = get_rss();
+
+	get_cpu_time(&cpu_time, &system_time);
+	if (!bench->soak.first_p99_latency)
+		bench->soak.first_p99_latency = p99;
+	printf("[%6llus] %.1f updates/s, %.1f commands/s, %lu errors, %lu missed deadlines | "
+	       "latency p50=%.1fus p99=%.1fus max=%.1fus (p99 x%.2f of the first window) | "
+	       "RSS %ldkB (%+ldkB) | CPU %.1f%% (%.0f%% in the kernel)\n",
+			(now - salvo_start) / 1000000000ull,
+			(n_updates - bench->soak.n_updates) / window, (result->n_commands - bench->soak.n_commands) / window,
+			result->n_errors - bench->soak.n_errors, n_missed - bench->soak.n_missed,
+			ffhist_percentile(&bench->soak_latency_hist, 0.50) / 1e3, p99 / 1e3, bench->soak_latency_hist.max / 1e3,
+			bench->soak.first_p99_latency ? (double)p99 / bench->soak.first_p99_latency : 0.0,
+			rss, rss - bench->soak.first_rss,
+			(cpu_time - bench->soak.cpu_time) / (10000.0 * window),
+			cpu_time > bench->soak.cpu_time ?
+				100.0 * (system_time - bench->soak.system_time) / (cpu_time - bench->soak.cpu_time) : 0.0);
+	fflush(stdout);
+	start_soak_window(bench, scenario, n_updates, n_missed, now);
+}
+
+/* Upload the effect of the first slot at maximum strength, marked for the virtual device. Returns 0 or -1. */
+static int send_final_effect(struct ffbench* bench, unsigned long long* sent_time)
+{
+	struct ff_effect final;
+	int ret;
+
+	final = bench->effect_slots[0];
+	set_effect_parameters(&final, bench->effect_idx, 0);
+	final.trigger.interval = FINAL_MARKER;
+
+	*sent_time = get_ntime();
+	ret = ffslots_upload(&bench->slot_pool, bench->slots[0], &final);
+	trace_command(bench, FFTRACE_UPLOAD, 0, final.id, get_effect_parameter(&final, bench->effect_idx),
+	              (ret < 0 ? FFTRACE_ERROR : 0), *sent_time);
+	if (ret < 0) {
+		choke_error(bench, "Upload final effect error");
+		return -1;
+	}
+	return 0;
+}
+
+/* Send the final effect right after the salvo, and wait until the virtual device applied it */
+static void measure_lag(struct ffbench* bench, unsigned long dropped_before)
+{
+	struct ffbench_result* result = bench->result;
+	struct ffdevsim_stats stats;
+	unsigned long long sent_time;
+	unsigned long applied_at_send;
+	int waited;
+
+	bench->final_seen = 0;
+	__sync_synchronize();
+	applied_at_send = bench->n_applied;
+	if (send_final_effect(bench, &sent_time) == -1)
+		return;
+
+	for (waited = 0; !bench->final_seen && waited < FINAL_TIMEOUT; waited++)
+		usleep(1000);
+	__sync_synchronize();
+	ffdevsim_get_stats(bench->sim, &stats);
+
+	result->lag_measured = 1;
+	result->lost = !bench->final_seen;
+	result->dropped = stats.dropped - dropped_before;
+	if (bench->final_seen) {
+		result->received_lag = (bench->final_received_time - sent_time) / 1e6;
+		result->applied_lag = (bench->final_applied_time - sent_time) / 1e6;
+		result->stale_updates = bench->applied_before_final - applied_at_send;
+	}
+}
+
+/* Stop and remove the effects of the first 'n' slots, waiting 'delay' microseconds in-between */
+static void remove_effects(struct ffbench* bench, int n, unsigned long delay)
+{
+	struct input_event ie;
+	int i;
+
+	memset(&ie, 0, sizeof(ie));
+	ie.type = EV_FF;
+	for (i = 0; i < n; i++) {
+		/* Not uploaded */
+		if (bench->effect_slots[i].id < 0)
+			continue;
+		usleep(SAFE_UPDATE_PERIOD);
+		ie.code = bench->effect_slots[i].id;
+		ie.value = 0;
+		if (write(bench->fd, &ie, sizeof(ie)) < 0)
+			perror("Stop effect error");
+	}
+	if (delay)
+		usleep(delay);
+	for (i = 0; i < n; i++) {
+		usleep(SAFE_UPDATE_PERIOD);
+		if (ffslots_release(&bench->slot_pool, bench->slots[i]) < 0)
+			perror("Remove effect error");
+	}
+}
+
+
+
+int ffbench_run(struct ffbench* bench, const struct ffbench_scenario* scenario, struct ffbench_result* result)
+{
+	int i, ret, n_setup = 0;
+	int option = scenario->operation;
+	int upload_and_start_without_delay_inbetween = 0;
+	int verbose = scenario->verbose;
+	int probe, watch, perf, ktrace;
+	unsigned long start_time, current_time, update_time, stop_time;
+	unsigned long progress_counter;
+	unsigned long n_updates, n_skipped_uploads, n_syscalls;
+	unsigned long cpu_time, system_time;
+	unsigned long dropped_before = 0;
+	unsigned long long salvo_start, report_time, final_sent_time;
+	struct ffdevsim_stats stats;
+	struct ffpace_config pace_config;
+	struct ffpace* pace = &bench->pace;
+	struct ffpacer* pacer = &result->pacer;
+	struct input_event ie;
+
+	memset(result, 0, sizeof(*result));
+	if (option < FFBENCH_UPDATE || option > FFBENCH_MIX || scenario->pacing < 0 ||
+	    scenario->pacing >= N_FFBENCH_PACINGS) {
+		errno = EINVAL;
+		return -1;
+	}
+	/* Each stream of a mix has its own absolute deadlines */
+	if (option == FFBENCH_MIX) {
+		if (!scenario->streams || scenario->n_effects < 1 || scenario->pacing != FFBENCH_ABSOLUTE) {
+			errno = EINVAL;
+			return -1;
+		}
+		for (i = 0; i < scenario->n_effects; i++) {
+			if (!scenario->streams[i].period) {
+				errno = EINVAL;
+				return -1;
+			}
+		}
+	}
+	/* The input core silently ignores an unsupported gain or autocenter, as with ffchoke */
+	if (effect_operation(option) &&
+	    (!ffbench_supported(bench, scenario) || scenario->n_effects > bench->slot_pool.n_slots)) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	bench->result = result;
+	bench->effect_idx = slot_effect(scenario, 0);
+	bench->stop_on_error = scenario->stop_on_error;
+	bench->stopped = 0;
+	init_submitter(bench, scenario->submit_backend);
+	probe = use_input_probe(bench, scenario);
+	watch = use_kmsg_watch(bench, scenario);
+	perf = use_perf_counters(bench, scenario);
+	ktrace = use_kernel_trace(bench, scenario);
+	if (option == FFBENCH_MIX) {
+		ffsched_free(&bench->sched);
+		if (ffsched_init(&bench->sched, scenario->n_effects, scenario->spin_margin) == -1)
+			return -1;
+		for (i = 0; i < scenario->n_effects; i++)
+			ffsched_set_stream(&bench->sched, i, scenario->streams[i].period, scenario->streams[i].phase,
+			                   scenario->streams[i].jitter);
+	}
+
+	memset(&ie, 0, sizeof(ie));
+	ie.type = EV_FF;
+
+	if (effect_operation(option)) {
+		/* Upload effects, and initialize at maximum strength/magnitude */
+		bench->slot_pool.cache_enabled = scenario->upload_cache;
+		for (n_setup = 0; n_setup < scenario->n_effects; n_setup++) {
+			i = n_setup;
+			bench->slots[i] = ffslots_alloc(&bench->slot_pool);
+			/* A step of the parameter trajectory per update (if out of memory, the coarser one will do) */
+			prepare_effect_trajectory(slot_effect(scenario, i), scenario->duration /
+			        max(option == FFBENCH_MIX ? scenario->streams[i].period : scenario->update_period, 1ul));
+			memcpy(&bench->effect_slots[i], &effects[slot_effect(scenario, i)], sizeof(effects[0]));
+			bench->effect_slots[i].replay.length = scenario->effect_duration;
+			if (scenario->direction >= 0)
+				bench->effect_slots[i].direction = scenario->direction;
+			if (scenario->quiet_updates)
+				set_effect_level(&bench->effect_slots[i], slot_effect(scenario, i), 0);
+			else
+				set_effect_parameters(&bench->effect_slots[i], slot_effect(scenario, i), 0);
+
+			if (ffslots_upload(&bench->slot_pool, bench->slots[i], &bench->effect_slots[i]) < 0) {
+				perror("Upload effect error");
+			}
+
+			usleep(SAFE_UPDATE_PERIOD);
+		}
+		if (verbose)
+			printf("Uploaded all effects, ready to start them.\n");
+
+		/* Start effects */
+		for (i = 0; i < scenario->n_effects; i++) {
+			ie.code = bench->effect_slots[i].id;
+			ie.value = 1;
+
+			if (verbose)
+				printf("Starting '%s' with id: %d\n", effect_names[slot_effect(scenario, i)], bench->effect_slots[i].id);
+			if (write(bench->fd, &ie, sizeof(ie)) < 0) {
+				ret = errno;
+				perror("Play effect error");
+				remove_effects(bench, n_setup, 0);
+				errno = ret;
+				return -1;
+			}
+
+			usleep(SAFE_UPDATE_PERIOD);
+		}
+		if (verbose)
+			printf("Started all effects, ready to choke.\n");
+
+		/* Warn about some special case */
+		upload_and_start_without_delay_inbetween = (option == FFBENCH_RESTART && scenario->change_params);
+		if (upload_and_start_without_delay_inbetween && verbose) {
+			printf("Warning: because the effect-parameters have to be changed on each update,\n");
+			printf("\tand because you've chosen to restart the effects on each update,\n");
+			printf("\tan 'upload' will be performed directly before a 'start',\n");
+			printf("\tand the average update-period (reported at the end) will not take this into account.\n");
+		}
+
+		/* Wait 1 second before starting the choking, to be able to differentiate from setup msgs in dmesg */
+		if (verbose) {
+			if (probe)
+				ffinprobe_set_phase(&bench->inprobe, FFINPROBE_BEFORE);
+			/* Not needed when the kernel log is correlated for the user */
+			if (!watch || probe) {
+				printf("Waiting 1 second to make it easier to differentiate between dmesg timestamps...\n");
+				usleep(1e6);
+			}
+		}
+	}
+	else {
+		/* Set master gain or autocenter to 100% */
+		ie.code = (option == FFBENCH_GAIN ? FF_GAIN : FF_AUTOCENTER);
+		ie.value = 0xFFFF;
+	}
+
+	/* Measure the input reports of the idle device first */
+	if (probe && (option == FFBENCH_GAIN || option == FFBENCH_AUTOCENTER)) {
+		ffinprobe_set_phase(&bench->inprobe, FFINPROBE_BEFORE);
+		printf("Waiting 1 second to measure the input reports before choking...\n");
+		usleep(1e6);
+	}
+
+	if (verbose)
+		printf("\nStarted the choke-test...\n");
+
+	/* Before entering realtime mode and starting the observers, so there is nothing to undo */
+	if (scenario->pacing == FFBENCH_ADAPTIVE) {
+		/* Effects change every update_period, the library decides when to send them */
+		ffpace_default_config(&pace_config);
+		pace_config.min_period = scenario->update_period;
+		pace_config.initial_period = scenario->update_period;
+		pace_config.max_period = max(pace_config.max_period, scenario->update_period);
+		if (ffpace_init(pace, bench->fd, scenario->n_effects, &pace_config, pace_sent, bench) == -1) {
+			ret = errno;
+			perror("Initialize adaptive pacing");
+			if (n_setup)
+				remove_effects(bench, n_setup, 0);
+			bench->result = NULL;
+			errno = ret;
+			return -1;
+		}
+	}
+
+	reset_latency_hists(bench);
+	if (bench->sim) {
+		ffdevsim_get_stats(bench->sim, &stats);
+		dropped_before = stats.dropped;
+	}
+	if (scenario->pacing >= FFBENCH_ABSOLUTE && scenario->realtime_priority > 0 &&
+	    ffpacer_enter_realtime(scenario->realtime_priority) == -1)
+		printf("Warning: could not fully enter realtime mode, are you root?\n");
+	start_time = get_utime();
+	salvo_start = get_ntime();
+	ffpacer_init(pacer, salvo_start, scenario->update_period, scenario->spin_margin);
+	if (option == FFBENCH_MIX)
+		ffsched_start(&bench->sched, salvo_start);
+	update_time = start_time;
+	current_time = start_time;
+	n_updates = 0;
+	n_skipped_uploads = bench->slot_pool.n_skipped;
+	n_syscalls = bench->submitter.n_syscalls;
+	get_cpu_time(&cpu_time, &system_time);
+	if (perf)
+		ffperf_start(&bench->perf);
+	if (ktrace) {
+		if (ffktrace_start(&bench->ktrace, syscall(SYS_gettid)) == -1)
+			perror("Start kernel trace");
+		else
+			bench->ktracing = 1;
+	}
+	i = 0;
+	if (watch)
+		start_kmsg_timeline(bench, scenario);
+	if (probe)
+		ffinprobe_set_phase(&bench->inprobe, FFINPROBE_DURING);
+	if (scenario->report_interval) {
+		bench->soak.first_rss = get_rss();
+		bench->soak.first_p99_latency = 0;
+		start_soak_window(bench, scenario, 0, 0, salvo_start);
+	}
+
+	while (current_time - start_time < scenario->duration && !bench->stopped) {
+		current_time = get_utime();
+		progress_counter = max(0ul, min(0xFFFFul, 0xFFFFul * (current_time - start_time) / scenario->duration));
+		bench->latency_window = (progress_counter < 0x4000 ? 0 : (progress_counter >= 0xC000 ? 1 : -1));
+		if (option == FFBENCH_MIX) {
+			bench->trace_scheduled_time = ffsched_next_deadline(&bench->sched);
+			i = ffsched_wait(&bench->sched, NULL);
+		} else if (scenario->pacing >= FFBENCH_ABSOLUTE) {
+			bench->trace_scheduled_time = pacer->next_deadline;
+			ffpacer_wait(pacer);
+		} else if (scenario->pacing == FFBENCH_DEADLINE) {
+			update_time += scenario->update_period;
+			bench->trace_scheduled_time = salvo_start + 1000ull * (update_time - start_time);
+			if (update_time > current_time)
+				usleep(update_time - current_time);
+		} else {
+			usleep(scenario->update_period);
+			bench->trace_scheduled_time = get_ntime();  /* no schedule, only a sleep in-between */
+		}
+		bench->trace_tick = n_updates;
+
+		/* Choke-command-body */
+		switch (option) {
+		case FFBENCH_UPDATE:
+		case FFBENCH_RESTART:
+			if (scenario->burst) i = 0;
+			for (; i < scenario->n_effects; i++) {
+				/* Upload after updating parameters, if wanted */
+				if (option == FFBENCH_UPDATE || upload_and_start_without_delay_inbetween) {
+					if (scenario->change_params && scenario->quiet_updates)
+						set_effect_level(&bench->effect_slots[i], scenario->effect_idx, n_updates % 2);
+					else if (scenario->change_params)
+						set_effect_parameters(&bench->effect_slots[i], scenario->effect_idx, progress_counter);
+
+					if (scenario->pacing == FFBENCH_ADAPTIVE) {
+						ffpace_upload(pace, i, &bench->effect_slots[i], get_ntime());
+					} else {
+						upload_slot(bench, i, scenario->effect_idx);
+					}
+				}
+
+				/* Start */
+				if (option == FFBENCH_RESTART && scenario->pacing == FFBENCH_ADAPTIVE)
+					ffpace_play(pace, i, ie.value, get_ntime());
+				else if (option == FFBENCH_RESTART)
+					submit_write(bench, FFTRACE_PLAY, i, bench->effect_slots[i].id, ie.value);
+
+				if (!scenario->burst) {
+					i = (i+1) % scenario->n_effects;
+					break;
+				}
+			}
+			break;
+		case FFBENCH_MIX:
+			/* Only the slot whose deadline is due */
+			if (scenario->change_params)
+				set_effect_parameters(&bench->effect_slots[i], scenario->streams[i].effect_idx, progress_counter);
+			upload_slot(bench, i, scenario->streams[i].effect_idx);
+			break;
+		case FFBENCH_GAIN:
+		case FFBENCH_AUTOCENTER:
+			if (scenario->change_params)
+				ie.value = 0xFFFF - progress_counter;
+
+			if (scenario->pacing == FFBENCH_ADAPTIVE && option == FFBENCH_GAIN)
+				ffpace_set_gain(pace, ie.value, get_ntime());
+			else if (scenario->pacing == FFBENCH_ADAPTIVE)
+				ffpace_set_autocenter(pace, ie.value, get_ntime());
+			else
+				submit_write(bench, (option == FFBENCH_GAIN ? FFTRACE_GAIN : FFTRACE_AUTOCENTER), -1, ie.code, ie.value);
+			break;
+		}
+		if (scenario->pacing == FFBENCH_ADAPTIVE) {
+			/* Send as soon as the adaptive rate allows, also in-between two updates */
+			if (ffpace_next_send_time(pace) < pacer->next_deadline)
+				sleep_until(ffpace_next_send_time(pace));
+			ffpace_poll(pace, get_ntime());     /* failed syscalls are handled by pace_sent() */
+		}
+		else
+			submit_flush(bench);
+
+		n_updates++;
+		if (scenario->report_interval && (report_time = get_ntime()) >= bench->soak.next_report_time)
+			report_soak_window(bench, scenario, n_updates, pacer->n_missed, salvo_start, report_time);
+	}
+	bench->latency_window = -1;
+	/* io_uring only reports failed writes once they completed */
+	if (ffsubmit_drain(&bench->submitter) < 0)
+		choke_error(bench, "Write error");
+	if (perf) {
+		ffperf_stop(&bench->perf, &result->perf);
+		result->perf_measured = 1;
+	}
+	if (bench->ktracing) {
+		bench->ktracing = 0;
+		if (ffktrace_stop(&bench->ktrace) == -1)
+			perror("Read kernel trace");
+		else
+			result->kernel_traced = 1;
+	}
+	bench->trace_tick = n_updates;
+	if (bench->sim && effect_operation(option))
+		measure_lag(bench, dropped_before);
+	else if (scenario->final_effect && effect_operation(option))
+		send_final_effect(bench, &final_sent_time);
+	if (watch) {
+		collect_kmsg_errors(bench);
+		result->n_kmsg_errors = bench->n_kmsg_errors;
+	}
+
+	/* Statistics */
+	stop_time = get_utime();
+	result->cpu_time = cpu_time;
+	result->system_time = system_time;
+	get_cpu_time(&cpu_time, &system_time);
+	result->cpu_time = cpu_time - result->cpu_time;
+	result->system_time = system_time - result->system_time;
+	if (probe)
+		ffinprobe_set_phase(&bench->inprobe, FFINPROBE_AFTER);
+	if (scenario->pacing >= FFBENCH_ABSOLUTE && scenario->realtime_priority > 0)
+		ffpacer_leave_realtime();
+	result->n_updates = n_updates;
+	result->n_skipped_uploads = bench->slot_pool.n_skipped - n_skipped_uploads;
+	result->n_syscalls = bench->submitter.n_syscalls - n_syscalls + result->upload_latency_hist.n;
+	if (scenario->pacing == FFBENCH_ADAPTIVE) {
+		result->n_syscalls = result->n_commands;
+		result->pace = *pace;
+		result->pace.slots = NULL;
+		ffpace_free(pace);
+	}
+	result->duration = stop_time - start_time;
+	result->early_p90_latency = ffhist_percentile(&bench->window_latency_hist[0], 0.90);
+	result->late_p90_latency = ffhist_percentile(&bench->window_latency_hist[1], 0.90);
+	if (n_updates)
+		result->avg_update_period = (stop_time - start_time) / n_updates;
+	if (verbose)
+		ffbench_print_result(bench, scenario, result);
+
+	if (effect_operation(option)) {
+		if (scenario->final_effect && scenario->final_hold)
+			usleep(scenario->final_hold);
+
+		/* Wait 1 second before stopping and removing effects, to be able to differentiate from setup msgs in dmesg */
+		if (verbose && (!watch || probe)) {
+			usleep(1e6);
+			printf("\nInfo: I again waited during 1 second to make it easier to differentiate between dmesg timestamps.\n");
+		}
+
+		remove_effects(bench, n_setup, scenario->removal_delay);
+
+		if (verbose)
+			printf("Stopped and Removed all effects, done.\n");
+	}
+	else if (probe) {
+		printf("\nWaiting 1 second to measure the input reports after choking...\n");
+		usleep(1e6);
+	}
+
+	if (probe)
+		ffinprobe_print(&bench->inprobe);
+
+	bench->result = NULL;
+	return 0;
+}
+
+/* Achieved rate and lateness of each stream of a mix, and the upload latency of its slot */
+static void print_streams(const struct ffbench* bench, const struct ffbench_scenario* scenario,
+                          const struct ffbench_result* result)
+{
+	const struct ffbench_stream* stream;
+	const struct ffsched_stream* s;
+	int i;
+
+	printf("Streams (lateness of the dispatch after its deadline, upload latency of the slot):\n");
+	printf("  %4s %-24s %9s %9s %9s %10s %10s %10s %7s %7s %10s %10s\n", "slot", "effect", "period", "target/s",
+			"actual/s", "late p50", "late p99", "late max", "missed", "skipped", "upload p50", "upload p99");
+	for (i = 0; i < scenario->n_effects; i++) {
+		stream = &scenario->streams[i];
+		s = &bench->sched.streams[i];
+		printf("  %4d %-24s %7luus %9.1f %9.1f %8.1fus %8.1fus %8.1fus %7lu %7lu %8.1fus %8.1fus\n",
+				i, effect_names[stream->effect_idx], stream->period, 1e6 / stream->period,
+				result->duration ? 1e6 * s->n_dispatched / result->duration : 0.0,
+				ffhist_percentile(&s->lateness_hist, 0.50) / 1e3, ffhist_percentile(&s->lateness_hist, 0.99) / 1e3,
+				s->lateness_hist.max / 1e3, s->n_missed, s->n_skipped,
+				ffhist_percentile(&bench->slot_latency_hist[i], 0.50) / 1e3,
+				ffhist_percentile(&bench->slot_latency_hist[i], 0.99) / 1e3);
+	}
+}
+
+void ffbench_print_result(const struct ffbench* bench, const struct ffbench_scenario* scenario,
+                          const struct ffbench_result* result)
+{
+	int option = scenario->operation;
+	char label[32];
+	int i;
+
+	if (!result->n_updates) {
+		printf("Failed to send any update.\n");
+		return;
+	}
+
+	printf("Done, average update-period was %luus.\n", result->avg_update_period);
+	if (option == FFBENCH_MIX)
+		print_streams(bench, scenario, result);
+	else if (scenario->pacing >= FFBENCH_ABSOLUTE)
+		ffpacer_print(&result->pacer);
+	if (scenario->pacing == FFBENCH_ADAPTIVE)
+		ffpace_print(&result->pace);
+	if (scenario->upload_cache && (option == FFBENCH_UPDATE || option == FFBENCH_MIX ||
+	                               (option == FFBENCH_RESTART && scenario->change_params)))
+		printf("Upload cache: skipped %lu identical uploads (syscalls saved), sent %lu commands.\n",
+				result->n_skipped_uploads, result->n_commands);
+	if (result->n_commands)
+		printf("Submission (%s): %.2f syscalls per update, %.2fus CPU time per command (%.0f%% in the kernel).\n",
+				ffsubmit_backend_names[bench->submit_backend], (double)result->n_syscalls / result->n_updates,
+				(double)result->cpu_time / result->n_commands,
+				result->cpu_time ? 100.0 * result->system_time / result->cpu_time : 0.0);
+	if (result->perf_measured)
+		ffperf_print(&result->perf, result->n_commands, result->n_syscalls);
+
+	printf("Syscall latencies:\n");
+	if (result->upload_latency_hist.n)
+		ffhist_print(&result->upload_latency_hist, "  EVIOCSFF");
+	if (result->write_latency_hist.n)
+		ffhist_print(&result->write_latency_hist, "  write");
+	if ((option == FFBENCH_UPDATE || option == FFBENCH_RESTART) && scenario->n_effects > 1) {
+		printf("Per effect slot:\n");
+		for (i = 0; i < scenario->n_effects; i++) {
+			snprintf(label, sizeof(label), "  slot %d", i);
+			ffhist_print(&bench->slot_latency_hist[i], label);
+		}
+	}
+
+	if (result->kernel_traced)
+		ffktrace_print(&bench->ktrace);
+	if (scenario->kmsg_watch && bench->kmsg_started)
+		print_kmsg_errors(bench);
+	if (result->lag_measured && result->lost)
+		printf("The device never applied the final effect, %lu commands were dropped.\n", result->dropped);
+	else if (result->lag_measured)
+		printf("The device received the final effect after %.3fms, and applied it after %.3fms,\n"
+		       "\tafter first applying %lu stale updates (%lu commands were dropped).\n",
+				result->received_lag, result->applied_lag, result->stale_updates, result->dropped);
+}
+
+int ffbench_saturated(const struct ffbench_scenario* scenario, const struct ffbench_result* result)
+{
+	if (result->n_errors || result->n_kmsg_errors || !result->n_updates)
+		return 1;
+	if (result->avg_update_period > scenario->update_period + scenario->update_period / 10)
+		return 1;
+	if (result->late_p90_latency > 2 * result->early_p90_latency &&
+	    result->late_p90_latency - result->early_p90_latency > 100000)
+		return 1;
+	return 0;
+}
+
+unsigned long ffbench_find_knee(struct ffbench* bench, const struct ffbench_scenario* scenario,
+                                struct ffbench_result* best)
+{
+	struct ffbench_scenario s = *scenario;
+	unsigned long lo = FFBENCH_MIN_UPDATE_PERIOD, hi = scenario->update_period, mid;
+	struct ffbench_result* result;
+
+	result = malloc(sizeof(*result));
+	if (!result)
+		return 0;
+
+	s.update_period = hi;
+	if (ffbench_run(bench, &s, result) == -1 || ffbench_saturated(&s, result)) {
+		hi = 0;
+		goto out;
+	}
+	*best = *result;
+	/* Already at (or below) the shortest period we try */
+	if (hi <= lo)
+		goto out;
+
+	s.update_period = lo;
+	if (ffbench_run(bench, &s, result) == 0 && !ffbench_saturated(&s, result)) {
+		*best = *result;
+		hi = lo;
+		goto out;
+	}
+
+	while (hi - lo > hi / 10) {
+		mid = lo + (hi - lo) / 2;
+		s.update_period = mid;
+		if (ffbench_run(bench, &s, result) == 0 && !ffbench_saturated(&s, result)) {
+			hi = mid;
+			*best = *result;
+		} else {
+			lo = mid;
+		}
+	}
+
+out:
+	free(result);
+	return hi;
+}
@@ -0,0 +1,261 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFBENCH_H
+#define FFBENCH_H
+
+#include <stddef.h>
+#include <linux/input.h>
+
+#include "ffhist.h"
+#include "ffpacer.h"
+#include "ffslots.h"
+#include "ffinprobe.h"
+#include "ffsubmit.h"
+#include "fftrace.h"
+#include "ffkmsg.h"
+#include "ffpace.h"
+#include "ffdevsim.h"
+#include "ffperf.h"
+#include "ffsched.h"
+#include "ffktrace.h"
+
+/*
+ * The choke-test of ffchoke as a library: a scenario describes what to send to a device, at what rate,
+ * and for how long; ffbench_run() performs it and returns structured results, without prompting.
+ * ffchoke, fftest_buffer_overrun and ffregress are front-ends of it.
+ *
+ * A bench keeps the device open across runs, with the state that outlives a single run
+ * (effect slots, trace file, input probe and kernel log threads).
+ * It can also run against a virtual device (see ffdevsim), which then measures the lag of a final effect.
+ */
+
+enum ffbench_operation {
+	FFBENCH_UPDATE = 1,     /* start the effects once, and repeatedly update them */
+	FFBENCH_RESTART,        /* repeatedly start the effects */
+	FFBENCH_GAIN,           /* repeatedly set the gain */
+	FFBENCH_AUTOCENTER,     /* repeatedly set the autocenter */
+	FFBENCH_MIX,            /* start the effects once, and update each of them at its own rate, see ffbench_stream */
+};
+
+enum ffbench_pacing {
+	FFBENCH_SLEEP,          /* always sleep 'update_period' between updates */
+	FFBENCH_DEADLINE,       /* sleep until the next deadline, relative to the start */
+	FFBENCH_ABSOLUTE,       /* absolute CLOCK_MONOTONIC deadlines, see ffpacer */
+	FFBENCH_ADAPTIVE,       /* as FFBENCH_ABSOLUTE, but sent through the adaptive pacing of ffpace */
+	N_FFBENCH_PACINGS
+};
+
+extern const char* ffbench_pacing_names[N_FFBENCH_PACINGS];
+
+/*
+ * The updates of one effect slot with FFBENCH_MIX, e.g. a 1kHz constant force, 60Hz rumble,
+ * and a spring or damper changed now and then. All slots are dispatched by ffsched, on absolute deadlines.
+ */
+struct ffbench_stream {
+	int effect_idx;                     /* effect template, see ffeffects.h */
+	unsigned long period;               /* in microseconds */
+	unsigned long phase;                /* in microseconds, offset of the deadlines from the start */
+	unsigned long jitter;               /* in microseconds, each deadline is delayed by a random amount up to this */
+};
+
+struct ffbench_scenario {
+	int operation;                      /* one of enum ffbench_operation */
+	int effect_idx;                     /* effect template, see ffeffects.h, for FFBENCH_UPDATE and FFBENCH_RESTART */
+	int n_effects;                      /* simultaneous effects */
+	int direction;                      /* of the effects, 0x0000 to 0xFFFF, -1 = the template's */
+	const struct ffbench_stream* streams;   /* 'n_effects' of them, for FFBENCH_MIX (which needs FFBENCH_ABSOLUTE) */
+	int burst;                          /* update all effects each update, otherwise one after the other */
+	int change_params;                  /* change the effect parameters (or gain, autocenter) on each update */
+	int quiet_updates;                  /* with change_params, alternate the effects between magnitude 0 and 1,
+	                                       instead of decreasing them from maximum strength */
+	unsigned long update_period;        /* in microseconds */
+	unsigned long duration;             /* of the salvo, in microseconds */
+	unsigned long effect_duration;      /* in milliseconds */
+	int pacing;                         /* one of enum ffbench_pacing */
+	int realtime_priority;              /* SCHED_FIFO priority with FFBENCH_ABSOLUTE or FFBENCH_ADAPTIVE, 0 = none */
+	unsigned long spin_margin;          /* in microseconds, with FFBENCH_ABSOLUTE or FFBENCH_ADAPTIVE */
+	int upload_cache;                   /* skip uploads identical to the previous one of the slot */
+	int submit_backend;                 /* one of enum ffsubmit_backend */
+	int final_effect;                   /* upload the first effect at maximum strength right after the salvo
+	                                       (always done on a virtual device, to measure its lag) */
+	unsigned long final_hold;           /* in microseconds, play the final effect this long before stopping it */
+	unsigned long removal_delay;        /* in microseconds, wait between stopping the effects and removing them */
+
+	/* Observation */
+	int input_probe;                    /* measure the input reports before, during and after the salvo */
+	int kmsg_watch;                     /* map driver errors in the kernel log onto the commands of the salvo */
+	unsigned long report_interval;      /* in seconds, summarize each window of a long salvo, 0 = don't */
+	int perf_counters;                  /* count the CPU cost of the salvo (cycles, instructions, context switches...) */
+	int kernel_trace;                   /* break the commands down into kernel stages, see ffktrace (needs root) */
+	int verbose;                        /* print progress, and wait 1 second around the salvo for dmesg */
+	int stop_on_error;                  /* end the salvo at the first failed syscall, instead of counting them */
+};
+
+struct ffbench_result {
+	unsigned long n_updates;
+	unsigned long n_commands;           /* commands sent during the salvo */
+	unsigned long n_syscalls;           /* syscalls needed to send them */
+	unsigned long n_errors;             /* syscalls that failed during the salvo */
+	unsigned long n_skipped_uploads;    /* uploads skipped by the upload cache, i.e. syscalls saved */
+	unsigned long duration;             /* in microseconds */
+	unsigned long avg_update_period;    /* in microseconds */
+	unsigned long n_kmsg_errors;        /* driver errors in the kernel log */
+	unsigned long long early_p90_latency;   /* p90 syscall latency during the first quarter of the salvo, in ns */
+	unsigned long long late_p90_latency;    /* p90 syscall latency during the last quarter of the salvo, in ns */
+	unsigned long cpu_time;             /* user and system CPU time of the salvo, in microseconds */
+	unsigned long system_time;
+	int perf_measured;
+	struct ffperf_counts perf;          /* CPU cost of the salvo on the choke thread, with 'perf_counters' */
+	int kernel_traced;                  /* the kernel stages of the salvo are in the bench's 'ktrace' */
+
+	/* Lag of an effect sent right after the salvo, only measured on a virtual device */
+	int lag_measured;
+	int lost;                           /* the device never applied it */
+	double received_lag;                /* in milliseconds, until the device received it */
+	double applied_lag;                 /* in milliseconds, until the device applied it */
+	unsigned long stale_updates;        /* commands the device applied in-between, sent before it */
+	unsigned long dropped;              /* commands dropped by the device during the salvo */
+
+	/* Latencies of the syscalls, in nanoseconds */
+	struct ffhist upload_latency_hist;
+	struct ffhist write_latency_hist;
+	struct ffpacer pacer;               /* with FFBENCH_ABSOLUTE and FFBENCH_ADAPTIVE */
+	struct ffpace pace;                 /* statistics only, with FFBENCH_ADAPTIVE */
+};
+
+#define FFBENCH_MAX_KMSG_ERRORS 1024
+
+struct ffbench {
+	char device[256];
+	int fd;
+	unsigned char ff_features[1 + FF_MAX / 8];
+
+	/* Effect slots of the device, and the simultaneous effects of a run with the pool slot each of them uses */
+	struct ffslots slot_pool;
+	struct ff_effect* effect_slots;
+	int* slots;
+	int effect_idx;
+
+	/* Latencies of the current run */
+	struct ffbench_result* result;
+	struct ffhist* slot_latency_hist;   /* per simultaneous effect */
+	struct ffhist window_latency_hist[2];   /* first and last quarter of the salvo */
+	int latency_window;
+	struct ffhist soak_latency_hist;    /* since the last periodic report */
+
+	struct ffsubmit submitter;
+	int submit_backend;
+	struct ffpace pace;
+	struct ffsched sched;               /* with FFBENCH_MIX, and the achieved rate and lateness of each stream */
+	int stop_on_error;
+	int stopped;                        /* a syscall failed, with 'stop_on_error' */
+
+	/* Trace of all commands of the runs */
+	struct fftrace trace;
+	int tracing;
+	unsigned long trace_tick;
+	unsigned long long trace_scheduled_time;
+
+	struct ffinprobe inprobe;
+	int inprobe_started;
+
+	/* Driver errors in the kernel log, and the commands of the salvo to map them onto */
+	struct ffkmsg_watch kmsg;
+	int kmsg_started;
+	struct ffkmsg_entry kmsg_errors[FFBENCH_MAX_KMSG_ERRORS];
+	int n_kmsg_errors;
+	struct fftrace_record* timeline;
+	size_t timeline_len, timeline_size;
+	int timeline_frozen;                /* the salvo ended, the timeline is kept until the next one */
+
+	/* Performance counters of the choke thread */
+	struct ffperf perf;
+	int perf_opened;
+
+	/* Kernel stages of the commands of the choke thread */
+	struct ffktrace ktrace;
+	int ktrace_opened;
+	int ktracing;                       /* during the salvo */
+
+	/* State at the start of the current reporting window of a long (soak) run */
+	struct {
+		unsigned long long start_time, next_report_time;    /* in nanoseconds */
+		unsigned long n_updates, n_commands, n_errors, n_missed;
+		unsigned long cpu_time, system_time;
+		long first_rss;                                     /* in kB, at the start of the run */
+		unsigned long long first_p99_latency;               /* of the first window, in nanoseconds */
+	} soak;
+
+	/* Virtual device, and what it saw of the final effect (written by its thread) */
+	struct ffdevsim* sim;
+	volatile unsigned long n_applied;
+	volatile unsigned long applied_before_final;
+	volatile unsigned long long final_received_time, final_applied_time;
+	volatile int final_seen;
+};
+
+/* Open the device. Returns 0 on success, -1 on error (errno is set). */
+int ffbench_open(struct ffbench* bench, const char* device);
+
+/*
+ * Create a virtual device with 'config', and open it.
+ * Runs on it also measure the lag of a final effect. Returns 0 on success, -1 on error (errno is set).
+ */
+int ffbench_open_emulated(struct ffbench* bench, const struct ffdevsim_config* config);
+
+void ffbench_close(struct ffbench* bench);
+
+/* Whether the device supports the operation (and effect) of 'scenario' */
+int ffbench_supported(const struct ffbench* bench, const struct ffbench_scenario* scenario);
+
+/* Fill in the default scenario of ffchoke, for 'operation' */
+void ffbench_default_scenario(struct ffbench_scenario* scenario, int operation);
+
+/* (Re)open the trace of all commands of the next runs to 'path', NULL to stop tracing. Returns 0 or -1. */
+int ffbench_set_trace(struct ffbench* bench, const char* path);
+
+/*
+ * Perform the choke-test of 'scenario'. Returns 0 if it was performed (results in 'result'),
+ * -1 if the scenario is not supported by the device or the setup failed (errno is set).
+ */
+int ffbench_run(struct ffbench* bench, const struct ffbench_scenario* scenario, struct ffbench_result* result);
+
+/* Print the statistics of a run, as ffchoke does */
+void ffbench_print_result(const struct ffbench* bench, const struct ffbench_scenario* scenario,
+                          const struct ffbench_result* result);
+
+/*
+ * Whether the device(-driver) could not keep up during the salvo:
+ * either syscalls failed, the requested update-rate could not be achieved,
+ * or the command latency kept growing during the salvo.
+ */
+int ffbench_saturated(const struct ffbench_scenario* scenario, const struct ffbench_result* result);
+
+/* Shortest update_period tried by ffbench_find_knee(), in microseconds */
+#define FFBENCH_MIN_UPDATE_PERIOD 50
+
+/*
+ * Bisect the update_period of 'scenario' between FFBENCH_MIN_UPDATE_PERIOD and its update_period,
+ * until the shortest sustainable period is known within 10%.
+ * Returns that period, or 0 if even the longest is not sustainable; the salvo's results are stored in 'best'.
+ * An update_period of at most FFBENCH_MIN_UPDATE_PERIOD is only checked itself.
+ */
+unsigned long ffbench_find_knee(struct ffbench* bench, const struct ffbench_scenario* scenario,
+                                struct ffbench_result* best);
+
+#endif /* FFBENCH_H */
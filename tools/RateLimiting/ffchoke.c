@@ -1,24 +1,15 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <time.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <sys/ioctl.h>
+#include <errno.h>
+#include <limits.h>
 #include <linux/input.h>
 
-#define min( a, b )    ( ( (a) < (b)) ? (a) : (b) )
-#define max( a, b )    ( ( (a) > (b)) ? (a) : (b) )
+#include "ffeffects.h"
+#include "ffbench.h"
+#include "ffdiscover.h"
 
-/* Number of bits for 1 unsigned char */
-#define nBitsPerUchar          (sizeof(unsigned char) * 8)
-/* Index=Offset of given bit in 1 unsigned char */
-#define bitOffsetInUchar(bit)  ((bit)%nBitsPerUchar)
-/* Index=Offset of the unsigned char associated to the bit
-   at the given index=offset */
-#define ucharIndexForBit(bit)  ((bit)/nBitsPerUchar)
-/* Test the bit with given index=offset in an unsigned char array */
-#define testBit(bit, array)    ((array[ucharIndexForBit(bit)] >> bitOffsetInUchar(bit)) & 1)
+#define min( a, b )    ( ( (a) < (b)) ? (a) : (b) )
 
 
 
@@ -31,289 +22,177 @@ unsigned long choke_salvo_duration = 2000000;             /*    2 seconds   */
 unsigned long effect_duration = 2000;                     /*    2 seconds   */
 int effect_type = 0;                                      /* Constant Force */
 int compensate_delays = 0;                    /*   force fixed delay between each salvo  */
-/* Corresponding extended cmd-line: "./ffchoke /dev/input/event0 20000us 2 1 1 2000000us 2000ms 0 0" */
-
-unsigned long safe_update_period = 50000; /* Used when we're not yet performing the choke test: 50ms */
-
+int realtime_priority = 0;                                /* no SCHED_FIFO  */
+unsigned long busy_spin_margin = 0;                       /*   never spin   */
+int upload_cache = 0;                                     /* always upload  */
+int input_probe = 0;                                      /* don't read input */
+int submit_backend = FFSUBMIT_WRITE_EACH;                 /* one write per event */
+char trace_file[256] = "-";                               /*    no trace    */
+int kmsg_watch = 0;                                       /* user checks dmesg */
+unsigned long report_interval = 0;                        /* only report at the end */
+int perf_counters = 0;                                    /* no CPU cost */
+int kernel_trace = 0;                                     /* no kernel stages */
+/* Corresponding extended cmd-line: "./ffchoke auto 20000us 2 1 1 2000000us 2000ms 0 0 0 0us 0 0 0 - 0 0s 0 0" */
 
 
-#define N_EFFECTS 4
 
-char* effect_names[] = {
-	"Constant Force",
-	"Sine Vibration",
-	"Spring Condition",
-	"Strong and Weak Rumble",
-};
+const char* device_file_name = "auto";                    /* first force feedback device */
+struct ffbench bench;
 
-struct ff_effect effects[N_EFFECTS];
+/* Set when running non-interactively (e.g. a sweep): less output, and syscall errors are counted instead of fatal */
+int sweep_mode = 0;
 
-void init_effects()
+/*
+ * Describe the choke-test of the current parameters for the benchmark library.
+ * @option :
+ *     1) Start an effect once, and repeatedly update it at the choke update-rate, during choke-salvo-duration-secs
+ *     2) Repeatedly start an effect at the choke update-rate, during choke-salvo-duration-secs
+ *     3) Repeatedly set the gain at the choke update-rate, during choke-salvo-duration-secs
+ *     4) Repeatedly set the autocenter at the choke update-rate, during choke-salvo-duration-secs
+ */
+void make_scenario(int option, int effect_idx, struct ffbench_scenario* scenario)
 {
-	/* constant effect */
-	memset(&effects[0], 0, sizeof(effects[0]));
-	effects[0].type = FF_CONSTANT;
-	effects[0].direction = 0x0000;	/* Along Y axis */
-
-	/* periodic sinusoidal effect */
-	memset(&effects[1], 0, sizeof(effects[1]));
-	effects[1].type = FF_PERIODIC;
-	effects[1].u.periodic.waveform = FF_SINE;
-	effects[1].u.periodic.period = 1000;	/* 1 second */
-	effects[1].direction = 0xC000;	/* Along X axis */
-
-	/* condition spring effect */
-	memset(&effects[2], 0, sizeof(effects[2]));
-	effects[2].type = FF_SPRING;
-	effects[2].u.condition[0].right_saturation = 0xFFFF;	/* No clipping */
-	effects[2].u.condition[0].left_saturation = 0xFFFF;	/* No clipping */
-	effects[2].u.condition[0].deadband = 0x0;
-	effects[2].u.condition[0].center = 0x0;
-	effects[2].u.condition[1] = effects[2].u.condition[0];
-
-	/* a rumbling effect */
-	memset(&effects[3], 0, sizeof(effects[3]));
-	effects[3].type = FF_RUMBLE;
+	ffbench_default_scenario(scenario, option);
+	scenario->effect_idx = effect_idx;
+	scenario->n_effects = simultaneous_effects_amount;
+	scenario->burst = simultaneous_effects_burstmode;
+	scenario->change_params = continually_change_efct_params;
+	scenario->update_period = update_period;
+	scenario->duration = choke_salvo_duration;
+	scenario->effect_duration = effect_duration;
+	scenario->pacing = compensate_delays;
+	scenario->realtime_priority = realtime_priority;
+	scenario->spin_margin = busy_spin_margin;
+	scenario->upload_cache = upload_cache;
+	scenario->submit_backend = submit_backend;
+	scenario->input_probe = input_probe && !sweep_mode;
+	scenario->kmsg_watch = kmsg_watch;
+	scenario->report_interval = report_interval;
+	scenario->perf_counters = perf_counters;
+	scenario->kernel_trace = kernel_trace;
+	scenario->verbose = !sweep_mode;
+	scenario->stop_on_error = !sweep_mode;
 }
 
+/* (Re)open the trace for 'trace_file', "-" for none */
+void open_trace()
+{
+	if (ffbench_set_trace(&bench, strcmp(trace_file, "-") ? trace_file : NULL) == -1)
+		perror("Open trace file");
+}
 
+/* Find and print the force feedback devices, returns the event node of the first one (NULL if none) */
+const char* discover_device()
+{
+	static char path[64];
+	struct ffdiscover_device* devices;
+	char cache[PATH_MAX];
+	int n;
 
-#define MAX_N_EFFECT_SLOTS 16
-
-struct ff_effect effect_slots[MAX_N_EFFECT_SLOTS];
+	n = ffdiscover_scan(&devices, FFDISCOVER_DEFAULT_TIMEOUT, ffdiscover_default_cache(cache, sizeof(cache)));
+	if (n == -1) {
+		perror("Scan /dev/input");
+		exit(1);
+	}
+	printf("Force feedback devices:\n");
+	ffdiscover_print(devices, n, 1);
+	if (n)
+		snprintf(path, sizeof(path), "%s", devices[0].path);
+	else
+		printf("None found, check the permissions of /dev/input/event*.\n");
+	free(devices);
+	return (n ? path : NULL);
+}
 
-void update_effect_slot_parameters(int i, unsigned long progress_counter)
+/* Perform the choke-test of 'option' with the current parameters */
+void handle_option(int option, int effect_idx)
 {
-	switch (effect_type) {
-	case 0:
-		effect_slots[i].u.constant.level = 0x7FFF - progress_counter/2;
-		return;
-	case 1:
-		effect_slots[i].u.periodic.magnitude = 0x7FFF - progress_counter/2;
-		return;
-	case 2:
-		effect_slots[i].u.condition[0].right_coeff = 0x7FFF - progress_counter/2;
-		effect_slots[i].u.condition[0].left_coeff = 0x7FFF - progress_counter/2;
-		effect_slots[i].u.condition[1] = effect_slots[i].u.condition[0];
-		return;
-	case 3:
-		effect_slots[i].u.rumble.strong_magnitude = 0xFFFF - progress_counter;
-		effect_slots[i].u.rumble.weak_magnitude = 0xFFFF - progress_counter;
+	struct ffbench_scenario scenario;
+	static struct ffbench_result result;
+
+	make_scenario(option, effect_idx, &scenario);
+	if (ffbench_run(&bench, &scenario, &result) == -1) {
+		if (errno == EOPNOTSUPP)
+			printf("This effect type is not supported by this device.\n");
+		else
+			perror("Choke-test");
 		return;
 	}
+	if (result.n_errors)
+		printf("The choke-test was stopped because of the syscall error above.\n");
+	/* Not known before the salvo ran: e.g. io_uring may not be available */
+	submit_backend = bench.submit_backend;
 }
 
 
 
-unsigned long get_utime()
+void print_sweep_row(int option, int effect_idx, int amount, int burstmode, unsigned long knee,
+                     const struct ffbench_result* result)
 {
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
-	unsigned long time_in_micros = 1000000 * tv.tv_sec + tv.tv_usec;
-	return time_in_micros;
+	printf("%-6d %-24s %-5d %-5d ", option, effect_idx >= 0 ? effect_names[effect_idx] : "-", amount, burstmode);
+	if (!knee)
+		printf("%10s %12s %12s\n", "-", "-", "-");
+	else
+		printf("%8luus %12.1f %12.1f\n", knee,
+				1e6 * result->n_updates / result->duration, 1e6 * result->n_commands / result->duration);
 }
 
-int fd;
-unsigned char ffFeatures[1 + FF_MAX/8/sizeof(unsigned char)];
-
 /*
- * @option :
- *     1) Start an effect once, and repeatedly update it at the choke update-rate, during choke-salvo-duration-secs
- *     2) Repeatedly start an effect at the choke update-rate, during choke-salvo-duration-secs
- *     3) Repeatedly set the gain at the choke update-rate, during choke-salvo-duration-secs
- *     4) Repeatedly set the autocenter at the choke update-rate, during choke-salvo-duration-secs
+ * Non-interactive sweep over options 1-4, effect_type, simultaneous_effects_amount (powers of two)
+ * and simultaneous_effects_burstmode: report the maximum sustainable rate of each configuration.
  */
-void handle_option(int option, int effect_idx)
+void run_sweep()
 {
-	int i;
-	int upload_and_start_without_delay_inbetween;
-	unsigned long start_time, current_time, update_time, stop_time;
-	unsigned long progress_counter;
-	unsigned long n_updates;
-	struct input_event ie;
-	
-	memset(&ie, 0, sizeof(ie));
-	ie.type = EV_FF;
-	
-	if (option == 1 || option == 2) {
-		if (!testBit(effects[effect_idx].type, ffFeatures)) {
-			printf("This effect type is not supported by this device.\n");
-			return;
-		}
-		
-		/* Upload effects, and initialize at maximum strength/magnitude */
-		for (i = 0; i < simultaneous_effects_amount; i++) {
-			memcpy(&effect_slots[i], &effects[effect_idx], sizeof(effects[effect_idx]));
-			effect_slots[i].id = -1;
-			effect_slots[i].replay.length = effect_duration;
-			update_effect_slot_parameters(i, 0);
-			
-			if (ioctl(fd, EVIOCSFF, &effect_slots[i]) < 0) {
-				perror("Upload effect error");
-			}
-			
-			usleep(safe_update_period);
-		}
-		printf("Uploaded all effects, ready to start them.\n");
-		
-		/* Start effects */
-		for (i = 0; i < simultaneous_effects_amount; i++) {
-			ie.code = effect_slots[i].id;
-			ie.value = 1;
-			
-			printf("Starting '%s' with id: %d\n", effect_names[effect_idx], effect_slots[i].id);
-			if (write(fd, &ie, sizeof(ie)) < 0) {
-				perror("Play effect error");
-				exit(1);
-			}
-			
-			usleep(safe_update_period);
-		}
-		printf("Started all effects, ready to choke.\n");
-		
-		/* Warn about some special case */
-		upload_and_start_without_delay_inbetween = (option == 2 && continually_change_efct_params);
-		if (upload_and_start_without_delay_inbetween) {
-			printf("Warning: because the effect-parameters have to be changed on each update,\n");
-			printf("\tand because you've chosen to restart the effects on each update,\n");
-			printf("\tan 'upload' will be performed directly before a 'start',\n");
-			printf("\tand the average update-period (reported at the end) will not take this into account.\n");
-		}
-		
-		/* Wait 1 second before starting the choking, to be able to differentiate from setup msgs in dmesg */
-		printf("Waiting 1 second to make it easier to differentiate between dmesg timestamps...\n");
-		usleep(1e6);
-	}
-	else if (option == 3) {
-		if (!testBit(FF_GAIN, ffFeatures)) {
-			printf("Setting gain is not supported by this device.\n");
-			return;
-		}
-		
-		/* Set master gain to 100% */
-		ie.code = FF_GAIN;
-		ie.value = 0xFFFF;
-	}
-	else if (option == 4) {
-		if (!testBit(FF_AUTOCENTER, ffFeatures)) {
-			printf("Setting autocenter is not supported by this device.\n");
-			return;
-		}
-		
-		/* Set autocenter to 100% */
-		ie.code = FF_AUTOCENTER;
-		ie.value = 0xFFFF;
-	}
-	
-	printf("\nStarted the choke-test...\n");
-	
-	start_time = get_utime();
-	update_time = start_time;
-	current_time = start_time;
-	n_updates = 0;
-	i = 0;
-	
-	while (current_time - start_time < choke_salvo_duration) {
-		current_time = get_utime();
-		progress_counter = max(0ul, min(0xFFFFul, 0xFFFFul * (current_time - start_time) / choke_salvo_duration));
-		if (compensate_delays) {
-			update_time += update_period;
-			if (update_time > current_time)
-				usleep(update_time - current_time);
-		} else {
-			usleep(update_period);
+	unsigned long knee;
+	int max_amount = simultaneous_effects_amount;
+	int option, effect_idx, amount, burstmode;
+	struct ffbench_scenario scenario;
+	static struct ffbench_result result;
+
+	sweep_mode = 1;
+	if (!compensate_delays)
+		compensate_delays = FFBENCH_ABSOLUTE;
+
+	printf("Sweeping update_period from %luus down to %dus, with salvos of %luus...\n\n",
+			update_period, FFBENCH_MIN_UPDATE_PERIOD, choke_salvo_duration);
+	printf("%-6s %-24s %-5s %-5s %10s %12s %12s\n",
+			"option", "effect", "slots", "burst", "min_period", "updates/s", "commands/s");
+
+	for (option = FFBENCH_UPDATE; option <= FFBENCH_AUTOCENTER; option++) {
+		if (option >= FFBENCH_GAIN) {
+			make_scenario(option, -1, &scenario);
+			knee = ffbench_find_knee(&bench, &scenario, &result);
+			print_sweep_row(option, -1, 1, 0, knee, &result);
+			continue;
 		}
-		
-		/* Choke-command-body */
-		switch (option) {
-		case 1:
-		case 2:
-			if (simultaneous_effects_burstmode) i = 0;
-			for (; i < simultaneous_effects_amount; i++) {
-				/* Upload after updating parameters, if wanted */
-				if (option == 1 || upload_and_start_without_delay_inbetween) {
-					if (continually_change_efct_params)
-						update_effect_slot_parameters(i, progress_counter);
-					
-					if (ioctl(fd, EVIOCSFF, &effect_slots[i]) < 0) {
-						perror("Upload effect error");
-						exit(1);
-					}
-				}
-				
-				/* Start */
-				if (option == 2) {
-					ie.code = effect_slots[i].id;
-					
-					if (write(fd, &ie, sizeof(ie)) < 0) {
-						perror("Write error");
-						exit(1);
-					}
+
+		for (effect_idx = 0; effect_idx < N_EFFECTS; effect_idx++) {
+			if (!effect_supported(effect_idx, bench.ff_features))
+				continue;
+			amount = 1;
+			while (amount <= max_amount) {
+				/* Burst mode makes no difference for a single effect */
+				for (burstmode = 1; burstmode >= (amount > 1 ? 0 : 1); burstmode--) {
+					simultaneous_effects_amount = amount;
+					simultaneous_effects_burstmode = burstmode;
+					make_scenario(option, effect_idx, &scenario);
+					knee = ffbench_find_knee(&bench, &scenario, &result);
+					print_sweep_row(option, effect_idx, amount, burstmode, knee, &result);
 				}
-				
-				if (!simultaneous_effects_burstmode) {
-					i = (i+1) % simultaneous_effects_amount;
+				if (amount == max_amount)
 					break;
-				}
-			}
-			break;
-		case 3:
-		case 4:
-			if (continually_change_efct_params)
-				ie.value = 0xFFFF - progress_counter;
-			
-			if (write(fd, &ie, sizeof(ie)) < 0) {
-				perror("Write error");
-				exit(1);
-			}
-			break;
-		}
-		
-		n_updates++;
-	}
-	
-	/* Report statistics */
-	stop_time = get_utime();
-	if (n_updates)
-		printf("Done, average update-period was %luus.\n", (stop_time - start_time) / n_updates);
-	else
-		printf("Failed to send any update.\n");
-	
-	if (option == 1 || option == 2) {
-		/* Wait 1 second before stopping and removing effects, to be able to differentiate from setup msgs in dmesg */
-		usleep(1e6);
-		printf("\nInfo: I again waited during 1 second to make it easier to differentiate between dmesg timestamps.\n");
-		
-		/* Stop the effects */
-		for (i = 0; i < simultaneous_effects_amount; i++) {
-			usleep(safe_update_period);
-			
-			ie.code = effect_slots[i].id;
-			ie.value = 0;
-			
-			if (write(fd, &ie, sizeof(ie)) < 0) {
-				perror("Stop effect error");
-				exit(1);
-			}
-		}
-		
-		/* Remove the effects */
-		for (i = 0; i < simultaneous_effects_amount; i++) {
-			usleep(safe_update_period);
-			
-			if (ioctl(fd, EVIOCRMFF, effect_slots[i].id) < 0) {
-				perror("Remove effect error");
-				exit(1);
+				amount = min(2 * amount, max_amount);
 			}
 		}
-		
-		printf("Stopped and Removed all effects, done.\n");
 	}
+
+	printf("\n'-' means that even an update_period of %luus could not be sustained.\n", update_period);
 }
 
 int main(int argc, char** argv)
 {
-	const char * device_file_name = "/dev/input/event0";
+	int list_devices = 0;
+	char cache[PATH_MAX];
 	int i, j;
 	
 	printf("Force feedback test program to choke a device(-driver) with commands.\n");
@@ -322,7 +201,7 @@ int main(int argc, char** argv)
 	/* Show help message */
 	for (i = 1; i < argc; i++) {
 		if (strncmp(argv[i], "--help", 64) == 0) {
-			printf("Usage: %s [/dev/input/eventXX \n", argv[0]);
+			printf("Usage: %s [--sweep] [--devices] [auto | /dev/input/eventXX \n", argv[0]);
 			printf("           \t\t[<update_period=%luus> \n", update_period);
 			printf("           \t\t[<simultaneous_effects_amount=%d> \n", simultaneous_effects_amount);
 			printf("           \t\t[<simultaneous_effects_burstmode=%d> \n", simultaneous_effects_burstmode);
@@ -331,7 +210,17 @@ int main(int argc, char** argv)
 			printf("           \t\t[<effect_duration=%lums> \n", effect_duration);
 			printf("           \t\t[<effect_type=%d> \n", effect_type);
 			printf("           \t\t[<compensate_delays=%d> \n", compensate_delays);
-			printf("           ]]]]]]] ]\n");
+			printf("           \t\t[<realtime_priority=%d> \n", realtime_priority);
+			printf("           \t\t[<busy_spin_margin=%luus> \n", busy_spin_margin);
+			printf("           \t\t[<upload_cache=%d> \n", upload_cache);
+			printf("           \t\t[<input_probe=%d> \n", input_probe);
+			printf("           \t\t[<submit_backend=%d> \n", submit_backend);
+			printf("           \t\t[<trace_file=%s> \n", trace_file);
+			printf("           \t\t[<kmsg_watch=%d> \n", kmsg_watch);
+			printf("           \t\t[<report_interval=%lus> \n", report_interval);
+			printf("           \t\t[<perf_counters=%d> \n", perf_counters);
+			printf("           \t\t[<kernel_trace=%d> \n", kernel_trace);
+			printf("           ]]]]]]]]]]]]]]]]] ]\n");
 			printf("Tests the ratelimiting of the force feedback driver, check dmesg for USB buffer overruns\n\n");
 			
 			printf("Global mode of operation:\n");
@@ -344,7 +233,7 @@ int main(int argc, char** argv)
 			
 			printf("Additional details on some parameters:\n");
 			printf("\tupdate_period:\t (to choke), in microseconds\n");
-			printf("\tsimultaneous_effects_amount:\t a number from '0' to max('%d', <max number defined by device & driver>)\n", MAX_N_EFFECT_SLOTS);
+			printf("\tsimultaneous_effects_amount:\t a number from '0' to <max number defined by device & driver>\n");
 			printf("\tsimultaneous_effects_burstmode:\n");
 				printf("\t\tif '1', all simultaneous effects will be sent in one update,\n");
 				printf("\t\taverage update-period (reported at end of choke-test) will not take this into account;\n");
@@ -356,57 +245,146 @@ int main(int argc, char** argv)
 			printf("\tcompensate_delays:\n");
 				printf("\t\tif '1', deadlines are forced to be achieved,\n");
 				printf("\t\totherwise when '0', we *always* sleep an amount 'update_period' of time between updates;\n");
-				printf("\t\tremember that most real simulation-games will have this set to '1' instead of '0'.\n\n");
+				printf("\t\tremember that most real simulation-games will have this set to '1' instead of '0';\n");
+				printf("\t\tif '2', updates are scheduled on absolute deadlines (clock_nanosleep on CLOCK_MONOTONIC),\n");
+				printf("\t\twhich doesn't drift, and deadline misses and wake-up jitter are reported;\n");
+				printf("\t\tif '3', effects are changed as with '2', but sent through the adaptive pacing of ffpace,\n");
+				printf("\t\twhich keeps only their newest parameters, and backs off (AIMD) when the syscall latency\n");
+				printf("\t\tshows the device saturating; compare its throughput and lag with '2'.\n");
+			printf("\trealtime_priority:\t only used when 'compensate_delays' is '2' or '3':\n");
+				printf("\t\tif not '0', run the choke-test with SCHED_FIFO at this priority (1-99),\n");
+				printf("\t\twith all memory locked and a minimal timer slack (needs root or CAP_SYS_NICE).\n");
+			printf("\tbusy_spin_margin:\t only used when 'compensate_delays' is '2' or '3':\n");
+				printf("\t\tbusy-wait instead of sleeping during the last microseconds before each deadline.\n");
+			printf("\tupload_cache:\n");
+				printf("\t\tif '1', uploads of an effect that is byte-identical to its previous upload are skipped\n");
+				printf("\t\t(e.g. when 'continually_change_efct_params' is '0', or the parameter didn't change),\n");
+				printf("\t\tand the amount of syscalls saved is reported; compare with '0' to benchmark it.\n");
+			printf("\tinput_probe:\n");
+				printf("\t\tif '1', a separate thread reads the input reports (e.g. the steering axis) of the device,\n");
+				printf("\t\tand their rate and delivery latency (kernel timestamp to userspace) are reported\n");
+				printf("\t\tduring 1 second before, during, and 1 second after the choke-test;\n");
+				printf("\t\tmove the wheel meanwhile, or use 'ffemu' with an 'input_period'.\n");
+			printf("\tsubmit_backend:\t how the starts, gain and autocenter changes of an update are written, one of:\n");
+				for (j=0; j<N_FFSUBMIT_BACKENDS; ++j) printf("\t\t%d: %s\n", j, ffsubmit_backend_names[j]);
+				printf("\t\tthe syscalls per update and the CPU time per command are reported, to compare them;\n");
+				printf("\t\twith '3', the write latency is the submission time, the write itself completes asynchronously.\n");
+			printf("\ttrace_file:\t if not '-', every command of the choke-tests is written to this file, with its update index,\n");
+				printf("\t\tscheduled and actual send time (CLOCK_MONOTONIC), syscall duration, slot, effect id and parameter;\n");
+				printf("\t\tbinary (convert with fftrace2csv), or CSV if the name ends with '.csv'.\n");
+			printf("\tkmsg_watch:\n");
+				printf("\t\tif '1', /dev/kmsg is read during the choke-tests (needs root or CAP_SYSLOG),\n");
+				printf("\t\tand driver errors (USB buffer overruns, failed URB submissions, -EPIPE, -ENOSPC, ...)\n");
+				printf("\t\tare reported with the command that preceded them, instead of waiting 1 second\n");
+				printf("\t\tbefore and after each test to tell them apart in dmesg;\n");
+				printf("\t\twhile sweeping, an update_period that causes driver errors is not sustainable.\n");
+			printf("\treport_interval:\t in seconds, for long (soak) runs of e.g. 'choke_salvo_duration=14400000000us' (4 hours):\n");
+				printf("\t\tif not '0', the rates, errors, latency percentiles, RSS and CPU usage of each window\n");
+				printf("\t\tof this many seconds are reported during the choke-test, to spot a slow drift.\n");
+			printf("\tperf_counters:\n");
+				printf("\t\tif '1', the CPU cost of each salvo on the choke thread is reported, in total, per command\n");
+				printf("\t\tand per syscall: task-clock, cycles, instructions, context switches and page faults\n");
+				printf("\t\t(perf_event_open), and the voluntary and involuntary context switches of getrusage;\n");
+				printf("\t\twithout hardware counters (e.g. in a VM) or without perf at all, the software counters\n");
+				printf("\t\tor rusage are used instead, and the kernel is only counted if kernel.perf_event_paranoid allows it.\n");
+			printf("\tkernel_trace:\n");
+				printf("\t\tif '1', kprobes are put on the evdev, input force feedback, uinput, uhid, HID output report\n");
+				printf("\t\tand usbhid functions through tracefs (needs root), and the time each command spends in each stage\n");
+				printf("\t\tof the kernel is reported, with the wait in the queue of the uinput or uhid client or of the URBs,\n");
+				printf("\t\tand the slowest commands with their tick (as in the trace_file); not with 'compensate_delays' '3',\n");
+				printf("\t\tand with 'submit_backend' '3' only the submissions are traced.\n\n");
+			
+			printf("Non-interactive mode:\n");
+			printf("\t--sweep:\t instead of showing the interactive menu, search the shortest sustainable update_period\n");
+				printf("\t\tfor each option, supported effect_type, simultaneous_effects_burstmode,\n");
+				printf("\t\tand simultaneous_effects_amount (powers of two up to the given amount),\n");
+				printf("\t\tstarting from the given update_period, with salvos of 'choke_salvo_duration';\n");
+				printf("\t\ta rate is not sustainable if syscalls fail, if the update_period can't be achieved,\n");
+				printf("\t\tor if the syscall latency keeps growing during the salvo;\n");
+				printf("\t\tif 'compensate_delays' is '0', '2' is used instead.\n");
+			printf("\t--devices:\t list the force feedback devices (name, phys, id, effects and slots), and exit.\n\n");
+
+			printf("With 'auto' instead of an event node, the first force feedback device is used:\n");
+			printf("all /dev/input/event* nodes are probed in parallel (each within %dms),\n", FFDISCOVER_DEFAULT_TIMEOUT);
+			printf("and the results are cached (in %s), so only new or reconnected devices are probed again.\n\n",
+					ffdiscover_default_cache(cache, sizeof(cache)));
 			
-			printf("Example (extended) usage: '%s %s %luus %d %d %d %luus %lums %d %d'\n",
+			printf("Example (extended) usage: '%s %s %luus %d %d %d %luus %lums %d %d %d %luus %d %d %d %s %d %lus %d %d'\n",
 					argv[0], device_file_name, update_period, simultaneous_effects_amount, simultaneous_effects_burstmode,
-					continually_change_efct_params, choke_salvo_duration, effect_duration, effect_type, compensate_delays);
+					continually_change_efct_params, choke_salvo_duration, effect_duration, effect_type, compensate_delays,
+					realtime_priority, busy_spin_margin, upload_cache, input_probe, submit_backend, trace_file, kmsg_watch,
+					report_interval, perf_counters, kernel_trace);
 				printf("\t(this corresponds to the default parameters)\n");
 			
 			exit(1);
 		}
 	}
 	
+	/* Strip the flags, the remaining arguments are positional */
+	for (i = 1, j = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--sweep", 64) == 0)
+			sweep_mode = 1;
+		else if (strncmp(argv[i], "--devices", 64) == 0)
+			list_devices = 1;
+		else
+			argv[j++] = argv[i];
+	}
+	argc = j;
+	
 	/* Parse cmd arguments and set parameters */
 	i=1; if (argc > i) device_file_name               = argv[i];
 	i++; if (argc > i) update_period                  = atoi(argv[i]);
 	i++; if (argc > i) simultaneous_effects_amount    = atoi(argv[i]);
 	i++; if (argc > i) simultaneous_effects_burstmode = atoi(argv[i]);
 	i++; if (argc > i) continually_change_efct_params = atoi(argv[i]);
-	i++; if (argc > i) choke_salvo_duration           = atoi(argv[i]);
+	i++; if (argc > i) choke_salvo_duration           = strtoul(argv[i], NULL, 10);
 	i++; if (argc > i) effect_duration                = atoi(argv[i]);
 	i++; if (argc > i) effect_type                    = atoi(argv[i]);
 	i++; if (argc > i) compensate_delays              = atoi(argv[i]);
+	i++; if (argc > i) realtime_priority              = atoi(argv[i]);
+	i++; if (argc > i) busy_spin_margin               = atoi(argv[i]);
+	i++; if (argc > i) upload_cache                   = atoi(argv[i]);
+	i++; if (argc > i) input_probe                    = atoi(argv[i]);
+	i++; if (argc > i) submit_backend                 = atoi(argv[i]);
+	i++; if (argc > i) snprintf(trace_file, sizeof(trace_file), "%s", argv[i]);
+	i++; if (argc > i) kmsg_watch                     = atoi(argv[i]);
+	i++; if (argc > i) report_interval                = atoi(argv[i]);
+	i++; if (argc > i) perf_counters                  = atoi(argv[i]);
+	i++; if (argc > i) kernel_trace                   = atoi(argv[i]);
+	
+	/* Find the device */
+	if (list_devices) {
+		discover_device();
+		exit(0);
+	}
+	if (strcmp(device_file_name, "auto") == 0) {
+		device_file_name = discover_device();
+		if (!device_file_name)
+			exit(1);
+	}
 	
 	/* Open device */
 	printf("Opening %s ...\n", device_file_name);
-	fd = open(device_file_name, O_RDWR);
-	if (fd == -1) {
+	if (ffbench_open(&bench, device_file_name) == -1) {
 		perror("Open device file");
 		exit(1);
 	}
 	printf("Device opened\n");
 	
-	/* Force feedback effects */
-	memset(ffFeatures, 0, sizeof(ffFeatures)*sizeof(unsigned char));
-	if (ioctl(fd, EVIOCGBIT(EV_FF, sizeof(ffFeatures)*sizeof(unsigned char)), ffFeatures) == -1) {
-		perror("Ioctl force feedback features query");
-		exit(1);
-	}
-	
 	/* Number of effects the device can play at the same time */
-	printf("Info: Maximum number of simultaneous effects: ");
-	int n_effects;
-	if (ioctl(fd, EVIOCGEFFECTS, &n_effects) == -1) {
-		perror("Ioctl number of effects");
-	}
-	printf("%d\n", n_effects);
-	if (simultaneous_effects_amount > max(MAX_N_EFFECT_SLOTS, n_effects)) {
-		printf("Warning: A too high simultaneous_effects_amount was set, I'll set it to the maximum (%d) instead.\n", max(MAX_N_EFFECT_SLOTS, n_effects));
-		simultaneous_effects_amount = max(MAX_N_EFFECT_SLOTS, n_effects);
+	printf("Info: Maximum number of simultaneous effects: %d\n", bench.slot_pool.n_slots);
+	if (simultaneous_effects_amount > bench.slot_pool.n_slots) {
+		printf("Warning: A too high simultaneous_effects_amount was set, I'll set it to the maximum (%d) instead.\n", bench.slot_pool.n_slots);
+		simultaneous_effects_amount = bench.slot_pool.n_slots;
 	}
 	
-	init_effects();
+	open_trace();
+	
+	if (sweep_mode) {
+		run_sweep();
+		ffbench_close(&bench);
+		exit(0);
+	}
 	
 	/* Ask user what options to execute */
 	do {
@@ -420,6 +398,16 @@ int main(int argc, char** argv)
 			printf("\t5. effect_duration=%lums;", effect_duration);
 			printf("\t6. effect_type=%d;", effect_type);
 			printf("\t7. compensate_delays=%d;", compensate_delays);
+			printf("\t8. realtime_priority=%d;", realtime_priority);
+			printf("\t9. busy_spin_margin=%luus;", busy_spin_margin);
+			printf("\t10. upload_cache=%d;", upload_cache);
+			printf("\t11. input_probe=%d;", input_probe);
+			printf("\t12. submit_backend=%d;", submit_backend);
+			printf("\t13. trace_file=%s;", trace_file);
+			printf("\t14. kmsg_watch=%d;", kmsg_watch);
+			printf("\t15. report_interval=%lus;", report_interval);
+			printf("\t16. perf_counters=%d;", perf_counters);
+			printf("\t17. kernel_trace=%d;", kernel_trace);
 			printf("\n");
 		float choke_salvo_duration_secs = ((float)choke_salvo_duration) / 1e6;
 		printf("\t1) Start an effect once, and repeatedly update it at the choke update-rate, during %.3f second(s)\n", choke_salvo_duration_secs);
@@ -443,7 +431,7 @@ int main(int argc, char** argv)
 				if (scanf("%d", &j) == EOF) {
 					printf("Read error\n");
 				}
-				else if (j >= 0 && j <= 7) {
+				else if (j >= 0 && j <= 17) {
 					printf("Enter new value of that parameter: ");
 					if      (j == 0) {if (scanf("%lu", &update_period                 ) == EOF) printf("Read error\n");}
 					else if (j == 1) {if (scanf("%d",  &simultaneous_effects_amount   ) == EOF) printf("Read error\n");}
@@ -453,12 +441,24 @@ int main(int argc, char** argv)
 					else if (j == 5) {if (scanf("%lu", &effect_duration               ) == EOF) printf("Read error\n");}
 					else if (j == 6) {if (scanf("%d",  &effect_type                   ) == EOF) printf("Read error\n");}
 					else if (j == 7) {if (scanf("%d",  &compensate_delays             ) == EOF) printf("Read error\n");}
+					else if (j == 8) {if (scanf("%d",  &realtime_priority             ) == EOF) printf("Read error\n");}
+					else if (j == 9) {if (scanf("%lu", &busy_spin_margin              ) == EOF) printf("Read error\n");}
+					else if (j == 10){if (scanf("%d",  &upload_cache                  ) == EOF) printf("Read error\n");}
+					else if (j == 11){if (scanf("%d",  &input_probe                   ) == EOF) printf("Read error\n");}
+					else if (j == 12){if (scanf("%d",  &submit_backend                ) == EOF) printf("Read error\n");}
+					else if (j == 13){if (scanf("%255s", trace_file                   ) == EOF) printf("Read error\n");}
+					else if (j == 14){if (scanf("%d",  &kmsg_watch                    ) == EOF) printf("Read error\n");}
+					else if (j == 15){if (scanf("%lu", &report_interval               ) == EOF) printf("Read error\n");}
+					else if (j == 16){if (scanf("%d",  &perf_counters                 ) == EOF) printf("Read error\n");}
+					else if (j == 17){if (scanf("%d",  &kernel_trace                  ) == EOF) printf("Read error\n");}
 					
 					if (j == 6 && !(effect_type >= 0 && effect_type < N_EFFECTS))
 						printf("Warning: You set an invalid effect_type.\n");
-					else if (j == 1 && simultaneous_effects_amount > max(MAX_N_EFFECT_SLOTS, n_effects)) {
-						simultaneous_effects_amount = max(MAX_N_EFFECT_SLOTS, n_effects);
-						printf("Warning: You set a too high simultaneous_effects_amount, I set it to the maximum (%d) instead.\n", max(MAX_N_EFFECT_SLOTS, n_effects));
+					else if (j == 13)
+						open_trace();
+					else if (j == 1 && simultaneous_effects_amount > bench.slot_pool.n_slots) {
+						simultaneous_effects_amount = bench.slot_pool.n_slots;
+						printf("Warning: You set a too high simultaneous_effects_amount, I set it to the maximum (%d) instead.\n", bench.slot_pool.n_slots);
 					}
 					
 					break;
@@ -480,5 +480,7 @@ int main(int argc, char** argv)
 		}
 	} while (i >= 0);
 	
+	ffbench_close(&bench);
+	
 	exit(0);
 }
@@ -0,0 +1,298 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "ffdevsim.h"
+
+#define max( a, b )    ( ( (a) > (b)) ? (a) : (b) )
+#define min( a, b )    ( ( (a) < (b)) ? (a) : (b) )
+
+const char* ffdevsim_overflow_policy_names[N_FFDEVSIM_OVERFLOW_POLICIES] = {
+	"drop",
+	"block",
+};
+
+static unsigned long long get_ntime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+int ffdevsim_create(struct ffdevsim* sim, const struct ffdevsim_config* config)
+{
+	memset(sim, 0, sizeof(*sim));
+	sim->config = *config;
+	if (sim->config.queue_depth < 1)
+		sim->config.queue_depth = 1;
+	if (sim->config.n_effects < 1)
+		sim->config.n_effects = 1;
+
+	/* Allocate everything up front, the device thread should never allocate */
+	sim->queue = calloc(sim->config.queue_depth, sizeof(*sim->queue));
+	sim->effects = calloc(sim->config.n_effects, sizeof(*sim->effects));
+	sim->playing = calloc(sim->config.n_effects, sizeof(*sim->playing));
+	if (!sim->queue || !sim->effects || !sim->playing)
+		goto error;
+	sim->gain = 0xFFFF;
+	sim->axis_step = 257;
+	pthread_mutex_init(&sim->stats_lock, NULL);
+
+	sim->ufd = ffuinput_create(sim->config.name, sim->config.n_effects);
+	if (sim->ufd == -1)
+		goto error;
+	if (ffuinput_get_devnode(sim->ufd, sim->devnode, sizeof(sim->devnode)) == -1) {
+		ffuinput_destroy(sim->ufd);
+		goto error;
+	}
+
+	return 0;
+
+error:
+	free(sim->queue);
+	free(sim->effects);
+	free(sim->playing);
+	return -1;
+}
+
+static void apply_command(struct ffdevsim* sim, const struct ff_command* cmd, unsigned long long apply_time)
+{
+	unsigned long long queue_time = apply_time - cmd->timestamp;
+	int valid_id = (cmd->id >= 0 && cmd->id < sim->config.n_effects);
+
+	switch (cmd->type) {
+	case FF_CMD_UPLOAD:
+		if (valid_id)
+			sim->effects[cmd->id] = cmd->effect;
+		break;
+	case FF_CMD_ERASE:
+		if (valid_id)
+			sim->playing[cmd->id] = 0;
+		break;
+	case FF_CMD_PLAY:
+		if (valid_id)
+			sim->playing[cmd->id] = cmd->value;
+		break;
+	case FF_CMD_GAIN:
+		sim->gain = cmd->value;
+		break;
+	case FF_CMD_AUTOCENTER:
+		sim->autocenter = cmd->value;
+		break;
+	}
+
+	pthread_mutex_lock(&sim->stats_lock);
+	sim->stats.applied[cmd->type]++;
+	sim->stats.total_queue_time += queue_time;
+	sim->stats.max_queue_time = max(sim->stats.max_queue_time, queue_time);
+	pthread_mutex_unlock(&sim->stats_lock);
+
+	if (sim->on_apply)
+		sim->on_apply(sim->on_apply_data, cmd, apply_time);
+}
+
+/* Process all commands of which the device has finished by 'now' */
+static void service_queue(struct ffdevsim* sim, unsigned long long now)
+{
+	unsigned long long service_time = 1000ull * sim->config.service_period;
+	struct ff_command* head;
+
+	while (sim->queue_length && now >= sim->head_done_time) {
+		apply_command(sim, &sim->queue[sim->queue_head], sim->head_done_time);
+		sim->queue_head = (sim->queue_head + 1) % sim->config.queue_depth;
+		sim->queue_length--;
+
+		/* The device only starts on the next command when it finished the previous one */
+		if (sim->queue_length) {
+			head = &sim->queue[sim->queue_head];
+			sim->head_done_time = max(sim->head_done_time, head->timestamp) + service_time;
+		}
+	}
+}
+
+static void enqueue_command(struct ffdevsim* sim, const struct ff_command* cmd)
+{
+	int tail;
+
+	pthread_mutex_lock(&sim->stats_lock);
+	sim->stats.received[cmd->type]++;
+	if (sim->queue_length == sim->config.queue_depth) {
+		sim->stats.dropped++;
+		pthread_mutex_unlock(&sim->stats_lock);
+		return;
+	}
+	sim->stats.max_queue_length = max(sim->stats.max_queue_length, sim->queue_length + 1);
+	pthread_mutex_unlock(&sim->stats_lock);
+
+	tail = (sim->queue_head + sim->queue_length) % sim->config.queue_depth;
+	sim->queue[tail] = *cmd;
+	if (!sim->queue_length)
+		sim->head_done_time = cmd->timestamp + 1000ull * sim->config.service_period;
+	sim->queue_length++;
+}
+
+/* Report the steering axis if it is time to */
+static void report_input(struct ffdevsim* sim, unsigned long long now)
+{
+	unsigned long long input_period = 1000ull * sim->config.input_period;
+
+	if (!input_period || now < sim->next_input_time)
+		return;
+
+	/* Sweep from end to end, a value equal to the previous one would be filtered by the kernel */
+	if (sim->axis_value + sim->axis_step > 32767 || sim->axis_value + sim->axis_step < -32768)
+		sim->axis_step = -sim->axis_step;
+	sim->axis_value += sim->axis_step;
+	if (ffuinput_report_axis(sim->ufd, ABS_X, sim->axis_value) < 0) {
+		perror("Device input report error");
+	} else {
+		pthread_mutex_lock(&sim->stats_lock);
+		sim->stats.input_reports++;
+		pthread_mutex_unlock(&sim->stats_lock);
+	}
+
+	/* Keep the pace, but don't catch up on missed reports */
+	sim->next_input_time += input_period;
+	if (sim->next_input_time <= now)
+		sim->next_input_time = now + input_period;
+}
+
+static void* device_thread(void* arg)
+{
+	struct ffdevsim* sim = arg;
+	struct ff_command cmd;
+	struct pollfd pfd;
+	struct timespec timeout;
+	unsigned long long now, wait_time;
+	int accepting, ret;
+
+	sim->next_input_time = get_ntime();
+	while (sim->running) {
+		now = get_ntime();
+		service_queue(sim, now);
+		report_input(sim, now);
+
+		/* When blocking, the kernel (and thus the application) has to wait until there is room again */
+		accepting = (sim->config.overflow_policy != FFDEVSIM_BLOCK ||
+		             sim->queue_length < sim->config.queue_depth);
+
+		/* Sleep until new commands arrive, or until the device finished the current command */
+		wait_time = 100000000ull;
+		if (sim->queue_length)
+			wait_time = (sim->head_done_time > now ? sim->head_done_time - now : 0);
+		if (sim->config.input_period)
+			wait_time = min(wait_time, sim->next_input_time > now ? sim->next_input_time - now : 0);
+		timeout.tv_sec = wait_time / 1000000000ull;
+		timeout.tv_nsec = wait_time % 1000000000ull;
+		pfd.fd = sim->ufd;
+		pfd.events = (accepting ? POLLIN : 0);
+		pfd.revents = 0;
+		if (ppoll(&pfd, 1, &timeout, NULL) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("Device poll error");
+			break;
+		}
+		if (!(pfd.revents & POLLIN))
+			continue;
+
+		/* Read everything the kernel has for us, as long as we can accept it */
+		while (accepting && (ret = ffuinput_read_command(sim->ufd, &cmd)) >= 0) {
+			if (!ret)
+				continue;
+			service_queue(sim, cmd.timestamp);
+			enqueue_command(sim, &cmd);
+			if (ffuinput_complete(sim->ufd, &cmd, 0) < 0)
+				perror("Device complete request error");
+			if (!sim->config.service_period)
+				service_queue(sim, cmd.timestamp);
+			accepting = (sim->config.overflow_policy != FFDEVSIM_BLOCK ||
+			             sim->queue_length < sim->config.queue_depth);
+		}
+	}
+
+	return NULL;
+}
+
+int ffdevsim_start(struct ffdevsim* sim)
+{
+	int err;
+
+	sim->running = 1;
+	err = pthread_create(&sim->thread, NULL, device_thread, sim);
+	if (err) {
+		sim->running = 0;
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+void ffdevsim_stop(struct ffdevsim* sim)
+{
+	if (!sim->running)
+		return;
+	sim->running = 0;
+	pthread_join(sim->thread, NULL);
+}
+
+void ffdevsim_get_stats(struct ffdevsim* sim, struct ffdevsim_stats* stats)
+{
+	pthread_mutex_lock(&sim->stats_lock);
+	*stats = sim->stats;
+	pthread_mutex_unlock(&sim->stats_lock);
+}
+
+void ffdevsim_print_stats(struct ffdevsim* sim)
+{
+	struct ffdevsim_stats stats;
+	unsigned long n_applied = 0;
+	int i;
+
+	ffdevsim_get_stats(sim, &stats);
+
+	printf("%-12s %10s %10s\n", "command", "received", "applied");
+	for (i = 0; i < N_FF_CMD_TYPES; i++) {
+		printf("%-12s %10lu %10lu\n", ff_command_names[i], stats.received[i], stats.applied[i]);
+		n_applied += stats.applied[i];
+	}
+	printf("Dropped (buffer overrun): %lu\n", stats.dropped);
+	printf("Maximum queue length: %d/%d\n", stats.max_queue_length, sim->config.queue_depth);
+	if (sim->config.input_period)
+		printf("Input reports: %lu\n", stats.input_reports);
+	if (n_applied)
+		printf("Queue time: average %lluus, maximum %lluus\n",
+				stats.total_queue_time / n_applied / 1000, stats.max_queue_time / 1000);
+}
+
+void ffdevsim_destroy(struct ffdevsim* sim)
+{
+	ffdevsim_stop(sim);
+	ffuinput_destroy(sim->ufd);
+	pthread_mutex_destroy(&sim->stats_lock);
+	free(sim->queue);
+	free(sim->effects);
+	free(sim->playing);
+}
@@ -0,0 +1,108 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFDEVSIM_H
+#define FFDEVSIM_H
+
+#include <pthread.h>
+
+#include "ffuinput.h"
+
+/*
+ * Simulated force feedback device, backed by a uinput device.
+ *
+ * Every command the kernel sends to the device (upload, erase, play, gain, autocenter)
+ * is put in a queue of 'queue_depth' commands, which the device consumes at a rate of
+ * one command per 'service_period'. This mimics a USB device that is polled at a fixed interval,
+ * with a driver that buffers commands instead of rate-limiting them.
+ *
+ * Optionally, the device reports its steering axis every 'input_period', like a wheel does,
+ * to see how input is affected while the force feedback path is saturated.
+ */
+
+enum ffdevsim_overflow_policy {
+	FFDEVSIM_DROP,      /* drop commands when the queue is full (USB buffer overrun) */
+	FFDEVSIM_BLOCK,     /* stop accepting commands when the queue is full (uploads will block) */
+	N_FFDEVSIM_OVERFLOW_POLICIES
+};
+
+struct ffdevsim_config {
+	const char* name;
+	int n_effects;                      /* maximum number of simultaneous effects */
+	unsigned long service_period;       /* time to process one command, in microseconds, 0 = instantly */
+	int queue_depth;                    /* maximum number of queued commands */
+	int overflow_policy;                /* one of enum ffdevsim_overflow_policy */
+	unsigned long input_period;         /* steering axis report interval, in microseconds, 0 = no input reports */
+};
+
+struct ffdevsim_stats {
+	unsigned long received[N_FF_CMD_TYPES];
+	unsigned long applied[N_FF_CMD_TYPES];
+	unsigned long dropped;
+	int max_queue_length;
+	unsigned long long total_queue_time;    /* in nanoseconds, summed over all applied commands */
+	unsigned long long max_queue_time;      /* in nanoseconds */
+	unsigned long input_reports;
+};
+
+/* Called from the device thread each time a command has been processed by the device */
+typedef void (*ffdevsim_apply_callback)(void* data, const struct ff_command* cmd, unsigned long long apply_time);
+
+struct ffdevsim {
+	struct ffdevsim_config config;
+	int ufd;
+	char devnode[64];
+
+	pthread_t thread;
+	volatile int running;
+
+	/* Queue, as a ring buffer */
+	struct ff_command* queue;
+	int queue_head, queue_length;
+	unsigned long long head_done_time;
+
+	/* Device state, as seen by the device after processing the commands */
+	struct ff_effect* effects;
+	int* playing;
+	int gain, autocenter;
+
+	/* Steering axis, swept back and forth so that each report has a new value */
+	unsigned long long next_input_time;
+	int axis_value, axis_step;
+
+	pthread_mutex_t stats_lock;
+	struct ffdevsim_stats stats;
+
+	ffdevsim_apply_callback on_apply;
+	void* on_apply_data;
+};
+
+extern const char* ffdevsim_overflow_policy_names[N_FFDEVSIM_OVERFLOW_POLICIES];
+
+/* Create the uinput device, and wait for its event node. Returns 0 on success, -1 on error. */
+int ffdevsim_create(struct ffdevsim* sim, const struct ffdevsim_config* config);
+
+/* Start/stop the device thread */
+int ffdevsim_start(struct ffdevsim* sim);
+void ffdevsim_stop(struct ffdevsim* sim);
+
+void ffdevsim_get_stats(struct ffdevsim* sim, struct ffdevsim_stats* stats);
+void ffdevsim_print_stats(struct ffdevsim* sim);
+
+void ffdevsim_destroy(struct ffdevsim* sim);
+
+#endif /* FFDEVSIM_H */
@@ -0,0 +1,367 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "ffdiscover.h"
+
+#define nBitsPerUlong          (sizeof(unsigned long) * 8)
+#define testBit(bit, array)    ((array[(bit) / nBitsPerUlong] >> ((bit) % nBitsPerUlong)) & 1)
+#define testByteBit(bit, array)    ((array[(bit) / 8] >> ((bit) % 8)) & 1)
+
+#define CACHE_HEADER "# ffdiscover cache 1\n"
+
+/* A node, as probed or as found in the cache */
+struct node {
+	struct ffdiscover_device device;
+	int is_ff;
+	int valid;                          /* probed successfully, or cached */
+};
+
+/* A probe in its own thread; whoever is last, the thread or the scan that gave up on it, frees it */
+struct probe {
+	struct node node;
+	int done, ok, abandoned;
+};
+
+/* Shared by all probes, so an abandoned probe never refers to the stack of a finished scan */
+static pthread_mutex_t probe_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t probe_done = PTHREAD_COND_INITIALIZER;
+
+char* ffdiscover_default_cache(char* buf, size_t size)
+{
+	const char* dir = getenv("XDG_CACHE_HOME");
+
+	if (dir && dir[0])
+		snprintf(buf, size, "%s/ffdiscover", dir);
+	else
+		snprintf(buf, size, "%s/.cache/ffdiscover", getenv("HOME") ? getenv("HOME") : "/tmp");
+	return buf;
+}
+
+/* Tabs and newlines would break the cache format */
+static void sanitize(char* s)
+{
+	for (; *s; s++)
+		if (*s == '\t' || *s == '\n')
+			*s = ' ';
+}
+
+static void* probe_thread(void* data)
+{
+	struct probe* probe = data;
+	struct ffdiscover_device* device = &probe->node.device;
+	unsigned long ev_bits[1 + EV_MAX / nBitsPerUlong];
+	int fd, ok = 0;
+
+	fd = open(device->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	memset(ev_bits, 0, sizeof(ev_bits));
+	if (fd != -1 && ioctl(fd, EVIOCGBIT(0, sizeof(ev_bits)), ev_bits) >= 0) {
+		ok = 1;
+		probe->node.is_ff = testBit(EV_FF, ev_bits);
+		if (probe->node.is_ff) {
+			ioctl(fd, EVIOCGNAME(sizeof(device->name) - 1), device->name);
+			ioctl(fd, EVIOCGPHYS(sizeof(device->phys) - 1), device->phys);
+			ioctl(fd, EVIOCGID, &device->id);
+			ioctl(fd, EVIOCGBIT(EV_FF, sizeof(device->ff_features)), device->ff_features);
+			if (ioctl(fd, EVIOCGEFFECTS, &device->n_slots) == -1)
+				device->n_slots = 0;
+			sanitize(device->name);
+			sanitize(device->phys);
+		}
+	}
+	if (fd != -1)
+		close(fd);
+
+	pthread_mutex_lock(&probe_lock);
+	if (probe->abandoned) {
+		pthread_mutex_unlock(&probe_lock);
+		free(probe);
+		return NULL;
+	}
+	probe->ok = ok;
+	probe->done = 1;
+	pthread_cond_broadcast(&probe_done);
+	pthread_mutex_unlock(&probe_lock);
+	return NULL;
+}
+
+/* Read the cache, returns the number of entries stored in '*nodes' (to be freed) */
+static int read_cache(const char* cache_path, struct node** nodes)
+{
+	struct node* n;
+	struct ffdiscover_device* d;
+	char line[1024], *s, *field[9];
+	unsigned int bus, vendor, product, version, byte;
+	int n_nodes = 0, size = 0, i;
+	FILE* file;
+
+	*nodes = NULL;
+	file = fopen(cache_path, "r");
+	if (!file)
+		return 0;
+	if (!fgets(line, sizeof(line), file) || strcmp(line, CACHE_HEADER)) {
+		fclose(file);
+		return 0;
+	}
+	while (fgets(line, sizeof(line), file)) {
+		line[strcspn(line, "\n")] = '\0';
+		s = line;
+		for (i = 0; i < 9 && s; i++)
+			field[i] = strsep(&s, "\t");
+		if (i < 9)
+			continue;
+		if (n_nodes == size) {
+			size = (size ? 2 * size : 64);
+			n = realloc(*nodes, size * sizeof(**nodes));
+			if (!n)
+				break;
+			*nodes = n;
+		}
+		n = &(*nodes)[n_nodes];
+		d = &n->device;
+		memset(n, 0, sizeof(*n));
+		snprintf(d->sysfs, sizeof(d->sysfs), "%s", field[0]);
+		d->rdev = strtoul(field[1], NULL, 16);
+		snprintf(d->path, sizeof(d->path), "%s", field[2]);
+		n->is_ff = atoi(field[3]);
+		if (sscanf(field[4], "%x %x %x %x", &bus, &vendor, &product, &version) != 4)
+			continue;
+		d->id.bustype = bus;
+		d->id.vendor = vendor;
+		d->id.product = product;
+		d->id.version = version;
+		d->n_slots = atoi(field[5]);
+		for (i = 0; i < (int)sizeof(d->ff_features) && sscanf(field[6] + 2 * i, "%2x", &byte) == 1; i++)
+			d->ff_features[i] = byte;
+		snprintf(d->name, sizeof(d->name), "%s", field[7]);
+		snprintf(d->phys, sizeof(d->phys), "%s", field[8]);
+		d->cached = 1;
+		n->valid = 1;
+		n_nodes++;
+	}
+	fclose(file);
+	return n_nodes;
+}
+
+/* Replace the cache with 'nodes', atomically so a concurrent scan never reads half of it */
+static void write_cache(const char* cache_path, const struct node* nodes, int n_nodes)
+{
+	const struct ffdiscover_device* d;
+	char tmp_path[PATH_MAX], dir[PATH_MAX], *slash;
+	FILE* file;
+	int i, j;
+
+	snprintf(dir, sizeof(dir), "%s", cache_path);
+	slash = strrchr(dir, '/');
+	if (slash && slash != dir) {
+		*slash = '\0';
+		mkdir(dir, 0755);
+	}
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%d", cache_path, getpid());
+	file = fopen(tmp_path, "w");
+	if (!file)
+		return;
+	fputs(CACHE_HEADER, file);
+	for (i = 0; i < n_nodes; i++) {
+		d = &nodes[i].device;
+		if (!d->sysfs[0])
+			continue;
+		fprintf(file, "%s\t%lx\t%s\t%d\t%04x %04x %04x %04x\t%d\t", d->sysfs, (unsigned long)d->rdev, d->path,
+				nodes[i].is_ff, d->id.bustype, d->id.vendor, d->id.product, d->id.version, d->n_slots);
+		for (j = 0; j < (int)sizeof(d->ff_features); j++)
+			fprintf(file, "%02x", d->ff_features[j]);
+		fprintf(file, "\t%s\t%s\n", d->name, d->phys);
+	}
+	if (fclose(file) == 0)
+		rename(tmp_path, cache_path);
+	else
+		unlink(tmp_path);
+}
+
+static int is_event_node(const struct dirent* entry)
+{
+	return strncmp(entry->d_name, "event", 5) == 0;
+}
+
+int ffdiscover_scan(struct ffdiscover_device** devices, int timeout, const char* cache_path)
+{
+	struct dirent** entries;
+	struct node* cache = NULL;
+	struct node* nodes;
+	struct probe** probes;
+	struct ffdiscover_device* d;
+	struct stat st;
+	struct timespec deadline;
+	pthread_t thread;
+	pthread_attr_t attr;
+	char sysfs_path[300];
+	int n_entries, n_cache = 0, n_nodes = 0, n_found = 0, n_pending = 0, n_probed = 0;
+	int i, j;
+
+	*devices = NULL;
+	n_entries = scandir("/dev/input", &entries, is_event_node, versionsort);
+	if (n_entries < 0)
+		return -1;
+	nodes = calloc(n_entries ? n_entries : 1, sizeof(*nodes));
+	probes = calloc(n_entries ? n_entries : 1, sizeof(*probes));
+	*devices = calloc(n_entries ? n_entries : 1, sizeof(**devices));
+	if (!nodes || !probes || !*devices) {
+		free(nodes);
+		free(probes);
+		free(*devices);
+		*devices = NULL;
+		for (i = 0; i < n_entries; i++)
+			free(entries[i]);
+		free(entries);
+		errno = ENOMEM;
+		return -1;
+	}
+	if (cache_path)
+		n_cache = read_cache(cache_path, &cache);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout / 1000;
+	deadline.tv_nsec += (timeout % 1000) * 1000000l;
+	if (deadline.tv_nsec >= 1000000000l) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000l;
+	}
+
+	for (i = 0; i < n_entries; i++) {
+		d = &nodes[i].device;
+		snprintf(d->path, sizeof(d->path), "/dev/input/%.50s", entries[i]->d_name);
+		snprintf(sysfs_path, sizeof(sysfs_path), "/sys/class/input/%s", entries[i]->d_name);
+		if (stat(d->path, &st) == -1 || !S_ISCHR(st.st_mode))
+			continue;
+		d->rdev = st.st_rdev;
+		/* Without sysfs, the node is probed on each scan */
+		if (!realpath(sysfs_path, d->sysfs))
+			d->sysfs[0] = '\0';
+
+		/* Same node of the same device as when it was cached */
+		for (j = 0; j < n_cache && d->sysfs[0]; j++) {
+			if (cache[j].device.rdev == d->rdev && strcmp(cache[j].device.sysfs, d->sysfs) == 0 &&
+			    strcmp(cache[j].device.path, d->path) == 0)
+				break;
+		}
+		if (d->sysfs[0] && j < n_cache) {
+			nodes[i] = cache[j];
+			continue;
+		}
+
+		probes[i] = calloc(1, sizeof(*probes[i]));
+		if (!probes[i])
+			continue;
+		probes[i]->node = nodes[i];
+		if (pthread_create(&thread, &attr, probe_thread, probes[i]) != 0) {
+			free(probes[i]);
+			probes[i] = NULL;
+			continue;
+		}
+		n_pending++;
+		n_probed++;
+	}
+	pthread_attr_destroy(&attr);
+
+	/* Wait for all probes, but at most 'timeout': then the remaining ones are abandoned */
+	pthread_mutex_lock(&probe_lock);
+	while (n_pending) {
+		for (i = 0, n_pending = 0; i < n_entries; i++)
+			if (probes[i] && !probes[i]->done)
+				n_pending++;
+		if (n_pending && pthread_cond_timedwait(&probe_done, &probe_lock, &deadline) == ETIMEDOUT)
+			break;
+	}
+	for (i = 0; i < n_entries; i++) {
+		if (!probes[i])
+			continue;
+		if (!probes[i]->done) {
+			fprintf(stderr, "Warning: probing %s timed out, skipped\n", nodes[i].device.path);
+			probes[i]->abandoned = 1;
+		} else if (probes[i]->ok) {
+			nodes[i] = probes[i]->node;
+			nodes[i].valid = 1;
+		}
+		if (probes[i]->done)
+			free(probes[i]);
+		probes[i] = NULL;
+	}
+	pthread_mutex_unlock(&probe_lock);
+
+	/* Nodes that were probed successfully or cached, in order */
+	for (i = 0; i < n_entries; i++) {
+		if (nodes[i].valid)
+			nodes[n_nodes++] = nodes[i];
+		free(entries[i]);
+	}
+	free(entries);
+	for (i = 0; i < n_nodes; i++)
+		if (nodes[i].is_ff)
+			(*devices)[n_found++] = nodes[i].device;
+
+	/* Only rewrite the cache if a node was probed, or disappeared */
+	if (cache_path && (n_probed || n_nodes != n_cache))
+		write_cache(cache_path, nodes, n_nodes);
+
+	free(cache);
+	free(nodes);
+	free(probes);
+	return n_found;
+}
+
+void ffdiscover_print(const struct ffdiscover_device* devices, int n, int numbered)
+{
+	static const struct { int bit; const char* name; } features[] = {
+		{ FF_CONSTANT, "constant" }, { FF_PERIODIC, "periodic" }, { FF_RAMP, "ramp" }, { FF_SPRING, "spring" },
+		{ FF_FRICTION, "friction" }, { FF_DAMPER, "damper" }, { FF_INERTIA, "inertia" }, { FF_RUMBLE, "rumble" },
+		{ FF_CUSTOM, "custom" }, { FF_GAIN, "gain" }, { FF_AUTOCENTER, "autocenter" },
+	};
+	const struct ffdiscover_device* d;
+	unsigned int i;
+	int j, first;
+
+	for (j = 0; j < n; j++) {
+		d = &devices[j];
+		if (numbered)
+			printf("%2d) ", j);
+		printf("%-18s %-32.32s %04x:%04x:%04x %-24.24s %3d slots%s\n\t",
+				d->path, d->name, d->id.bustype, d->id.vendor, d->id.product, d->phys[0] ? d->phys : "-",
+				d->n_slots, d->cached ? " (cached)" : "");
+		for (i = 0, first = 1; i < sizeof(features) / sizeof(features[0]); i++) {
+			if (!testByteBit(features[i].bit, d->ff_features))
+				continue;
+			printf("%s%s", first ? "" : ", ", features[i].name);
+			first = 0;
+		}
+		printf("\n");
+	}
+}
@@ -0,0 +1,62 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFDISCOVER_H
+#define FFDISCOVER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <linux/input.h>
+
+/*
+ * Discovery of the force feedback devices among all /dev/input/event* nodes.
+ *
+ * The nodes are probed concurrently, one thread each, so a node that hangs on open() or ioctl()
+ * (e.g. a device in a bad state) delays the scan by at most the timeout, and is skipped.
+ * The results are cached, keyed by the sysfs identity of each node (its resolved sysfs path and device number,
+ * which change when a device is reconnected): a later scan only opens nodes that weren't seen before.
+ */
+
+struct ffdiscover_device {
+	char path[64];                      /* event node, e.g. "/dev/input/event5" */
+	char sysfs[256];                    /* resolved path of /sys/class/input/eventX */
+	dev_t rdev;
+	char name[128];
+	char phys[128];
+	struct input_id id;
+	unsigned char ff_features[1 + FF_MAX / 8];
+	int n_slots;                        /* simultaneous effects, from EVIOCGEFFECTS */
+	int cached;                         /* taken from the cache instead of probed */
+};
+
+/* Per node, in milliseconds */
+#define FFDISCOVER_DEFAULT_TIMEOUT 500
+
+/* Write the default cache path to 'buf': $XDG_CACHE_HOME/ffdiscover, or ~/.cache/ffdiscover. Returns 'buf'. */
+char* ffdiscover_default_cache(char* buf, size_t size);
+
+/*
+ * Find all devices with force feedback, each node probed within 'timeout' milliseconds,
+ * using and updating the cache at 'cache_path' (NULL for none).
+ * Returns the number of devices, sorted by event node, stored in '*devices' (to be freed), or -1 on error.
+ */
+int ffdiscover_scan(struct ffdiscover_device** devices, int timeout, const char* cache_path);
+
+/* Print a table of 'devices', with the first column prefixed by its index if 'numbered' */
+void ffdiscover_print(const struct ffdiscover_device* devices, int n, int numbered);
+
+#endif /* FFDISCOVER_H */
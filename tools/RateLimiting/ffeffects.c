@@ -0,0 +1,275 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffeffects.h"
+
+char* effect_names[N_EFFECTS] = {
+	"Constant Force",
+	"Sine Vibration",
+	"Spring Condition",
+	"Strong and Weak Rumble",
+	"Square Vibration",
+	"Triangle Vibration",
+	"Sawtooth Up Vibration",
+	"Sawtooth Down Vibration",
+	"Custom Waveform",
+	"Ramp Force",
+	"Damper Condition",
+	"Friction Condition",
+	"Inertia Condition",
+	"Constant with Envelope",
+	"Delayed Sine Vibration",
+};
+
+struct ff_effect effects[N_EFFECTS];
+
+/* One period of the custom waveform: a sine, in 16 samples */
+static __s16 custom_waveform[16] = {
+	0, 12539, 23170, 30273, 32767, 30273, 23170, 12539,
+	0, -12539, -23170, -30273, -32767, -30273, -23170, -12539,
+};
+
+/* The parameters that change along a trajectory, with the layout of 'u' in struct ff_effect */
+union effect_parameters {
+	struct ff_constant_effect constant;
+	struct ff_ramp_effect ramp;
+	struct ff_periodic_effect periodic;
+	struct ff_condition_effect condition[2];
+	struct ff_rumble_effect rumble;
+};
+
+/* The trajectory of each template has 0x10000 >> shift steps, the default ones are static */
+static union effect_parameters default_trajectories[N_EFFECTS][N_EFFECT_STEPS];
+static union effect_parameters* trajectories[N_EFFECTS];
+static unsigned int trajectory_shifts[N_EFFECTS];
+#define DEFAULT_TRAJECTORY_SHIFT 4      /* N_EFFECT_STEPS */
+
+static void init_periodic(struct ff_effect* effect, int waveform)
+{
+	memset(effect, 0, sizeof(*effect));
+	effect->type = FF_PERIODIC;
+	effect->u.periodic.waveform = waveform;
+	effect->u.periodic.period = 1000;	/* 1 second */
+	effect->direction = 0xC000;	/* Along X axis */
+}
+
+static void init_condition(struct ff_effect* effect, int type)
+{
+	memset(effect, 0, sizeof(*effect));
+	effect->type = type;
+	effect->u.condition[0].right_saturation = 0xFFFF;	/* No clipping */
+	effect->u.condition[0].left_saturation = 0xFFFF;	/* No clipping */
+	effect->u.condition[0].deadband = 0x0;
+	effect->u.condition[0].center = 0x0;
+	effect->u.condition[1] = effect->u.condition[0];
+}
+
+/* The parameters of 'effect' (a copy of template 'effect_idx') at 'progress_counter' */
+static void compute_parameters(struct ff_effect* effect, int effect_idx, unsigned long progress_counter)
+{
+	switch (effects[effect_idx].type) {
+	case FF_CONSTANT:
+		effect->u.constant.level = 0x7FFF - progress_counter/2;
+		/* The envelope fades in less, and out to half the level */
+		if (effect->u.constant.envelope.attack_length) {
+			effect->u.constant.envelope.attack_level = progress_counter/2;
+			effect->u.constant.envelope.fade_level = effect->u.constant.level / 2;
+		}
+		return;
+	case FF_PERIODIC:
+		effect->u.periodic.magnitude = 0x7FFF - progress_counter/2;
+		return;
+	case FF_RAMP:
+		effect->u.ramp.start_level = 0x7FFF - progress_counter/2;
+		effect->u.ramp.end_level = -effect->u.ramp.start_level;
+		return;
+	case FF_SPRING:
+	case FF_DAMPER:
+	case FF_FRICTION:
+	case FF_INERTIA:
+		effect->u.condition[0].right_coeff = 0x7FFF - progress_counter/2;
+		effect->u.condition[0].left_coeff = 0x7FFF - progress_counter/2;
+		effect->u.condition[1] = effect->u.condition[0];
+		return;
+	case FF_RUMBLE:
+		effect->u.rumble.strong_magnitude = 0xFFFF - progress_counter;
+		effect->u.rumble.weak_magnitude = 0xFFFF - progress_counter;
+		return;
+	}
+}
+
+static void compute_trajectory(union effect_parameters* trajectory, int effect_idx, unsigned int shift)
+{
+	struct ff_effect effect = effects[effect_idx];
+	unsigned long step;
+
+	for (step = 0; step < (0x10000ul >> shift); step++) {
+		compute_parameters(&effect, effect_idx, step << shift);
+		memcpy(&trajectory[step], &effect.u, sizeof(effect.u));
+	}
+}
+
+void init_effects()
+{
+	int i;
+
+	/* constant effect */
+	memset(&effects[0], 0, sizeof(effects[0]));
+	effects[0].type = FF_CONSTANT;
+	effects[0].direction = 0x0000;	/* Along Y axis */
+
+	/* periodic sinusoidal effect */
+	init_periodic(&effects[1], FF_SINE);
+
+	/* condition spring effect */
+	init_condition(&effects[2], FF_SPRING);
+
+	/* a rumbling effect */
+	memset(&effects[3], 0, sizeof(effects[3]));
+	effects[3].type = FF_RUMBLE;
+
+	/* the other periodic waveforms */
+	init_periodic(&effects[4], FF_SQUARE);
+	init_periodic(&effects[5], FF_TRIANGLE);
+	init_periodic(&effects[6], FF_SAW_UP);
+	init_periodic(&effects[7], FF_SAW_DOWN);
+	init_periodic(&effects[8], FF_CUSTOM);
+	effects[8].u.periodic.custom_len = sizeof(custom_waveform) / sizeof(custom_waveform[0]);
+	effects[8].u.periodic.custom_data = custom_waveform;
+
+	/* ramp effect, from left to right */
+	memset(&effects[9], 0, sizeof(effects[9]));
+	effects[9].type = FF_RAMP;
+	effects[9].direction = 0xC000;	/* Along X axis */
+
+	/* the other condition effects */
+	init_condition(&effects[10], FF_DAMPER);
+	init_condition(&effects[11], FF_FRICTION);
+	init_condition(&effects[12], FF_INERTIA);
+
+	/* constant effect with an envelope */
+	effects[13] = effects[0];
+	effects[13].u.constant.envelope.attack_length = 100;	/* 100 ms */
+	effects[13].u.constant.envelope.fade_length = 100;	/* 100 ms */
+
+	/* periodic sinusoidal effect that starts after a delay */
+	init_periodic(&effects[14], FF_SINE);
+	effects[14].replay.delay = 50;	/* 50 ms */
+
+	/* Compute the trajectories once, so that the choke loops only copy them */
+	for (i = 0; i < N_EFFECTS; i++) {
+		if (trajectories[i] != default_trajectories[i])
+			free(trajectories[i]);
+		trajectories[i] = default_trajectories[i];
+		trajectory_shifts[i] = DEFAULT_TRAJECTORY_SHIFT;
+		compute_trajectory(trajectories[i], i, trajectory_shifts[i]);
+	}
+}
+
+int prepare_effect_trajectory(int effect_idx, unsigned long n_updates)
+{
+	union effect_parameters* trajectory;
+	unsigned int shift = trajectory_shifts[effect_idx];
+
+	while (shift > 0 && (0x10000ul >> shift) < n_updates)
+		shift--;
+	if (shift == trajectory_shifts[effect_idx])
+		return 0;
+
+	trajectory = malloc((0x10000ul >> shift) * sizeof(*trajectory));
+	if (!trajectory)
+		return -1;
+	compute_trajectory(trajectory, effect_idx, shift);
+	if (trajectories[effect_idx] != default_trajectories[effect_idx])
+		free(trajectories[effect_idx]);
+	trajectories[effect_idx] = trajectory;
+	trajectory_shifts[effect_idx] = shift;
+	return 0;
+}
+
+void set_effect_parameters(struct ff_effect* effect, int effect_idx, unsigned long progress_counter)
+{
+	if (progress_counter > 0xFFFF)
+		progress_counter = 0xFFFF;
+	memcpy(&effect->u, &trajectories[effect_idx][progress_counter >> trajectory_shifts[effect_idx]], sizeof(effect->u));
+}
+
+void set_effect_level(struct ff_effect* effect, int effect_idx, int level)
+{
+	switch (effects[effect_idx].type) {
+	case FF_CONSTANT:
+		effect->u.constant.level = level;
+		if (effect->u.constant.envelope.attack_length) {
+			effect->u.constant.envelope.attack_level = level;
+			effect->u.constant.envelope.fade_level = level;
+		}
+		return;
+	case FF_PERIODIC:
+		effect->u.periodic.magnitude = level;
+		return;
+	case FF_RAMP:
+		effect->u.ramp.start_level = level;
+		effect->u.ramp.end_level = -level;
+		return;
+	case FF_SPRING:
+	case FF_DAMPER:
+	case FF_FRICTION:
+	case FF_INERTIA:
+		effect->u.condition[0].right_coeff = level;
+		effect->u.condition[0].left_coeff = level;
+		effect->u.condition[1] = effect->u.condition[0];
+		return;
+	case FF_RUMBLE:
+		effect->u.rumble.strong_magnitude = level;
+		effect->u.rumble.weak_magnitude = level;
+		return;
+	}
+}
+
+int get_effect_parameter(const struct ff_effect* effect, int effect_idx)
+{
+	switch (effects[effect_idx].type) {
+	case FF_CONSTANT:
+		return effect->u.constant.level;
+	case FF_PERIODIC:
+		return effect->u.periodic.magnitude;
+	case FF_RAMP:
+		return effect->u.ramp.start_level;
+	case FF_SPRING:
+	case FF_DAMPER:
+	case FF_FRICTION:
+	case FF_INERTIA:
+		return effect->u.condition[0].right_coeff;
+	case FF_RUMBLE:
+		return effect->u.rumble.strong_magnitude;
+	}
+	return 0;
+}
+
+int effect_supported(int effect_idx, const unsigned char* ff_features)
+{
+	int type = effects[effect_idx].type;
+
+	if (!((ff_features[type / 8] >> (type % 8)) & 1))
+		return 0;
+	if (type == FF_PERIODIC)
+		type = effects[effect_idx].u.periodic.waveform;
+	return (ff_features[type / 8] >> (type % 8)) & 1;
+}
@@ -0,0 +1,67 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFEFFECTS_H
+#define FFEFFECTS_H
+
+#include <linux/input.h>
+
+/*
+ * Effect templates used by the choke-tests, see init_effects(): every effect type of linux/input.h,
+ * all periodic waveforms, and effects with an envelope or a replay delay.
+ * The first 4 are the original templates, their indices are used on the command line of the tools.
+ */
+
+#define N_EFFECTS 15
+
+extern char* effect_names[N_EFFECTS];
+extern struct ff_effect effects[N_EFFECTS];
+
+/* Steps of the precomputed parameter trajectory of each template, unless prepare_effect_trajectory() refined it */
+#define N_EFFECT_STEPS 4096
+
+/* Initialize the templates, and compute their parameter trajectories */
+void init_effects();
+
+/*
+ * Refine the trajectory of template 'effect_idx' for a salvo of 'n_updates' updates,
+ * so that successive updates don't share a step (and aren't skipped by an upload cache as identical);
+ * from 65536 updates on, there is a step per 'progress_counter'. Not to be called while other threads
+ * call set_effect_parameters(). Returns 0 on success, -1 if out of memory (the trajectory is kept).
+ */
+int prepare_effect_trajectory(int effect_idx, unsigned long n_updates);
+
+/*
+ * Set the magnitude parameters of 'effect' (a copy of template 'effect_idx'),
+ * from maximum strength down to zero as 'progress_counter' goes from 0 to 0xFFFF;
+ * only copies the precomputed parameters of the nearest step.
+ */
+void set_effect_parameters(struct ff_effect* effect, int effect_idx, unsigned long progress_counter);
+
+/*
+ * Set the magnitude parameters of 'effect' (a copy of template 'effect_idx') to 'level',
+ * e.g. the almost unnoticeable 0 or 1 of the bogus updates of fftest_buffer_overrun.
+ */
+void set_effect_level(struct ff_effect* effect, int effect_idx, int level);
+
+/* Whether a device with the force feedback bits 'ff_features' (from EVIOCGBIT) supports template 'effect_idx' */
+int effect_supported(int effect_idx, const unsigned char* ff_features);
+
+/* The magnitude parameter that set_effect_parameters() changes */
+int get_effect_parameter(const struct ff_effect* effect, int effect_idx);
+
+#endif /* FFEFFECTS_H */
@@ -0,0 +1,143 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "ffdevsim.h"
+
+/* Default device: polled every 2ms, with the output FIFO size of usbhid */
+unsigned long service_period = 2000;                      /*       2ms      */
+int queue_depth = 256;
+int overflow_policy = FFDEVSIM_DROP;
+int n_effects = 16;
+unsigned long input_period = 0;                           /* no input reports */
+/* Corresponding extended cmd-line: "./ffemu 2000us 256 0 16 0us" */
+
+volatile sig_atomic_t quit = 0;
+
+void handle_signal(int sig)
+{
+	quit = 1;
+}
+
+int main(int argc, char** argv)
+{
+	struct ffdevsim sim;
+	struct ffdevsim_config config;
+	struct ffdevsim_stats stats, prev_stats;
+	int i;
+
+	printf("Virtual force feedback device, to test applications and drivers without hardware.\n\n");
+
+	/* Show help message */
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--help", 64) == 0) {
+			printf("Usage: %s [<service_period=%luus> \n", argv[0], service_period);
+			printf("           \t\t[<queue_depth=%d> \n", queue_depth);
+			printf("           \t\t[<overflow_policy=%d> \n", overflow_policy);
+			printf("           \t\t[<n_effects=%d> \n", n_effects);
+			printf("           \t\t[<input_period=%luus> \n", input_period);
+			printf("           ]]]]]\n");
+			printf("Creates a uinput device with force feedback support, which processes commands at a limited rate.\n");
+			printf("Point ffchoke or fftest_buffer_overrun to the printed event node, press Ctrl-C to quit.\n\n");
+
+			printf("Additional details on some parameters:\n");
+			printf("\tservice_period:\t time the device needs to process one command, in microseconds,\n");
+				printf("\t\t'0' processes all commands immediately\n");
+			printf("\tqueue_depth:\t number of commands the device (driver) can buffer\n");
+			printf("\toverflow_policy:\t what happens when the queue is full, should be one of the following:\n");
+				printf("\t\t0: drop the command, like a USB buffer overrun\n");
+				printf("\t\t1: block, uploads will only return when there is room in the queue again\n");
+			printf("\tn_effects:\t maximum number of simultaneous effects\n");
+			printf("\tinput_period:\t interval at which the device reports its steering axis, in microseconds,\n");
+				printf("\t\t'0' reports no input, try '1000us' with the input_probe of ffchoke\n\n");
+
+			printf("Example (extended) usage: '%s %luus %d %d %d %luus'\n",
+					argv[0], service_period, queue_depth, overflow_policy, n_effects, input_period);
+				printf("\t(this corresponds to the default parameters)\n");
+
+			exit(1);
+		}
+	}
+
+	/* Parse cmd arguments and set parameters */
+	i=1; if (argc > i) service_period  = atoi(argv[i]);
+	i++; if (argc > i) queue_depth     = atoi(argv[i]);
+	i++; if (argc > i) overflow_policy = atoi(argv[i]);
+	i++; if (argc > i) n_effects       = atoi(argv[i]);
+	i++; if (argc > i) input_period    = atoi(argv[i]);
+
+	if (!(overflow_policy >= 0 && overflow_policy < N_FFDEVSIM_OVERFLOW_POLICIES)) {
+		printf("Invalid overflow_policy.\n");
+		exit(1);
+	}
+
+	memset(&config, 0, sizeof(config));
+	config.name = "ffemu virtual force feedback device";
+	config.n_effects = n_effects;
+	config.service_period = service_period;
+	config.queue_depth = queue_depth;
+	config.overflow_policy = overflow_policy;
+	config.input_period = input_period;
+
+	if (ffdevsim_create(&sim, &config) == -1) {
+		perror("Create uinput device");
+		exit(1);
+	}
+	printf("Device created: %s\n", sim.devnode);
+	printf("Service period: %luus (%.1f commands/s), queue depth: %d, overflow policy: %s\n",
+			service_period, service_period ? 1e6 / service_period : 0.0,
+			sim.config.queue_depth, ffdevsim_overflow_policy_names[overflow_policy]);
+	if (input_period)
+		printf("Input reports every %luus (%.1f reports/s)\n", input_period, 1e6 / input_period);
+	printf("Try: './ffchoke %s'\n\n", sim.devnode);
+
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+
+	if (ffdevsim_start(&sim) == -1) {
+		perror("Start device thread");
+		ffdevsim_destroy(&sim);
+		exit(1);
+	}
+
+	/* Report once per second, whenever something happened */
+	memset(&prev_stats, 0, sizeof(prev_stats));
+	while (!quit) {
+		sleep(1);
+		ffdevsim_get_stats(&sim, &stats);
+		prev_stats.input_reports = stats.input_reports;     /* input reports alone are no news */
+		if (memcmp(&stats, &prev_stats, sizeof(stats)) == 0)
+			continue;
+		printf("Received %lu uploads, %lu plays; applied %lu uploads, %lu plays; dropped %lu; max queue length %d\n",
+				stats.received[FF_CMD_UPLOAD], stats.received[FF_CMD_PLAY],
+				stats.applied[FF_CMD_UPLOAD], stats.applied[FF_CMD_PLAY],
+				stats.dropped, stats.max_queue_length);
+		prev_stats = stats;
+	}
+
+	ffdevsim_stop(&sim);
+	printf("\nFinal statistics:\n");
+	ffdevsim_print_stats(&sim);
+	ffdevsim_destroy(&sim);
+
+	exit(0);
+}
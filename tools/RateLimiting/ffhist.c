@@ -0,0 +1,123 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ffhist.h"
+
+static int bucket_index(unsigned long long value)
+{
+	int shift;
+
+	if (value < 2 * FFHIST_SUB_BUCKETS)
+		return (int)value;
+
+	/* Position of the most significant bit, minus the bits kept for the sub-bucket */
+	shift = 63 - __builtin_clzll(value) - FFHIST_SUB_BITS;
+	return (shift + 1) * FFHIST_SUB_BUCKETS + (int)(value >> shift) - FFHIST_SUB_BUCKETS;
+}
+
+static unsigned long long bucket_lower_bound(int idx)
+{
+	int shift;
+
+	if (idx < 2 * FFHIST_SUB_BUCKETS)
+		return idx;
+
+	shift = idx / FFHIST_SUB_BUCKETS - 1;
+	return (unsigned long long)(FFHIST_SUB_BUCKETS + idx % FFHIST_SUB_BUCKETS) << shift;
+}
+
+void ffhist_reset(struct ffhist* h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+void ffhist_add(struct ffhist* h, unsigned long long value)
+{
+	if (!h->n || value < h->min)
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+	h->n++;
+	h->sum += value;
+	h->counts[bucket_index(value)]++;
+}
+
+void ffhist_merge(struct ffhist* dst, const struct ffhist* src)
+{
+	int i;
+
+	if (!src->n)
+		return;
+	if (!dst->n || src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->n += src->n;
+	dst->sum += src->sum;
+	for (i = 0; i < FFHIST_N_BUCKETS; i++)
+		dst->counts[i] += src->counts[i];
+}
+
+unsigned long long ffhist_percentile(const struct ffhist* h, double p)
+{
+	unsigned long rank, seen = 0;
+	unsigned long long lower, upper;
+	int i;
+
+	if (!h->n)
+		return 0;
+	if (p <= 0.0)
+		return h->min;
+	if (p >= 1.0)
+		return h->max;
+
+	rank = (unsigned long)(p * h->n);
+	if (rank >= h->n)
+		rank = h->n - 1;
+
+	for (i = 0; i < FFHIST_N_BUCKETS; i++) {
+		seen += h->counts[i];
+		if (seen > rank) {
+			/* Report the middle of the bucket, but never outside the observed range */
+			lower = bucket_lower_bound(i);
+			upper = (i + 1 < FFHIST_N_BUCKETS ? bucket_lower_bound(i + 1) : h->max + 1);
+			lower += (upper - lower) / 2;
+			if (lower < h->min)
+				return h->min;
+			if (lower > h->max)
+				return h->max;
+			return lower;
+		}
+	}
+	return h->max;
+}
+
+void ffhist_print(const struct ffhist* h, const char* label)
+{
+	if (!h->n) {
+		printf("%-16s n=0\n", label);
+		return;
+	}
+	printf("%-16s n=%-8lu avg=%.1fus p50=%.1fus p90=%.1fus p99=%.1fus p99.9=%.1fus max=%.1fus\n",
+			label, h->n, (double)h->sum / h->n / 1e3,
+			ffhist_percentile(h, 0.50) / 1e3, ffhist_percentile(h, 0.90) / 1e3,
+			ffhist_percentile(h, 0.99) / 1e3, ffhist_percentile(h, 0.999) / 1e3,
+			h->max / 1e3);
+}
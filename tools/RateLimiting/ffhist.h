@@ -0,0 +1,49 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFHIST_H
+#define FFHIST_H
+
+/*
+ * Log-bucketed latency histogram, with a fixed-size bucket array.
+ *
+ * Each power of two is split into 2^FFHIST_SUB_BITS linear sub-buckets,
+ * giving a relative error of at most 1/2^FFHIST_SUB_BITS over the full 64-bit range.
+ * Adding a value never allocates, so it is safe to call from a measurement loop.
+ */
+
+#define FFHIST_SUB_BITS     4
+#define FFHIST_SUB_BUCKETS  (1 << FFHIST_SUB_BITS)
+#define FFHIST_N_BUCKETS    ((64 - FFHIST_SUB_BITS + 1) * FFHIST_SUB_BUCKETS)
+
+struct ffhist {
+	unsigned long n;
+	unsigned long long min, max, sum;
+	unsigned long counts[FFHIST_N_BUCKETS];
+};
+
+void ffhist_reset(struct ffhist* h);
+void ffhist_add(struct ffhist* h, unsigned long long value);
+void ffhist_merge(struct ffhist* dst, const struct ffhist* src);
+
+/* Value below which a fraction 'p' (0.0 to 1.0) of the values lie, within the bucket precision */
+unsigned long long ffhist_percentile(const struct ffhist* h, double p);
+
+/* Print a one-line summary, interpreting the values as nanoseconds and reporting microseconds */
+void ffhist_print(const struct ffhist* h, const char* label);
+
+#endif /* FFHIST_H */
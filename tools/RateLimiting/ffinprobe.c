@@ -0,0 +1,214 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <linux/input.h>
+
+#include "ffinprobe.h"
+
+const char* ffinprobe_phase_names[N_FFINPROBE_PHASES] = {
+	"before",
+	"during",
+	"after",
+};
+
+static unsigned long long get_ntime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+static void* probe_thread(void* arg)
+{
+	struct ffinprobe* probe = arg;
+	struct input_event events[64];
+	struct epoll_event ready[2];
+	struct ffinprobe_stats* stats;
+	unsigned long long now, timestamp;
+	ssize_t n;
+	int i, n_ready, n_frame_events = 0;
+
+	for (;;) {
+		n_ready = epoll_wait(probe->epoll_fd, ready, 2, -1);
+		if (n_ready < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("Input probe poll error");
+			break;
+		}
+		for (i = 0; i < n_ready; i++) {
+			if (ready[i].data.fd == probe->stop_fd)
+				return NULL;
+		}
+
+		while ((n = read(probe->fd, events, sizeof(events))) > 0) {
+			now = get_ntime();
+
+			pthread_mutex_lock(&probe->lock);
+			stats = &probe->stats[probe->phase];
+			for (i = 0; i < n / (ssize_t)sizeof(events[0]); i++) {
+				if (events[i].type != EV_SYN) {
+					n_frame_events++;
+					continue;
+				}
+				if (events[i].code == SYN_DROPPED) {
+					stats->n_dropped++;
+				} else if (events[i].code == SYN_REPORT) {
+					timestamp = 1000000000ull * events[i].input_event_sec + 1000ull * events[i].input_event_usec;
+					ffhist_add(&stats->delivery_hist, now > timestamp ? now - timestamp : 0);
+					stats->n_reports++;
+					stats->n_events += n_frame_events;
+				}
+				n_frame_events = 0;
+			}
+			pthread_mutex_unlock(&probe->lock);
+		}
+		if (n < 0 && errno != EAGAIN && errno != EINTR) {
+			perror("Input probe read error");
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+int ffinprobe_start(struct ffinprobe* probe, const char* device_file_name)
+{
+	struct epoll_event event;
+	int clock_id = CLOCK_MONOTONIC;
+	int err;
+
+	memset(probe, 0, sizeof(*probe));
+	probe->stop_fd = -1;
+	probe->epoll_fd = -1;
+	probe->fd = open(device_file_name, O_RDONLY | O_NONBLOCK);
+	if (probe->fd == -1)
+		return -1;
+
+	/* Same clock as get_ntime(), instead of the default CLOCK_REALTIME */
+	if (ioctl(probe->fd, EVIOCSCLOCKID, &clock_id) < 0)
+		goto error;
+
+	probe->stop_fd = eventfd(0, EFD_NONBLOCK);
+	probe->epoll_fd = epoll_create1(0);
+	if (probe->stop_fd == -1 || probe->epoll_fd == -1)
+		goto error;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = probe->fd;
+	if (epoll_ctl(probe->epoll_fd, EPOLL_CTL_ADD, probe->fd, &event) == -1)
+		goto error;
+	event.data.fd = probe->stop_fd;
+	if (epoll_ctl(probe->epoll_fd, EPOLL_CTL_ADD, probe->stop_fd, &event) == -1)
+		goto error;
+
+	pthread_mutex_init(&probe->lock, NULL);
+	probe->phase = FFINPROBE_BEFORE;
+	probe->phase_start = get_ntime();
+
+	err = pthread_create(&probe->thread, NULL, probe_thread, probe);
+	if (err) {
+		pthread_mutex_destroy(&probe->lock);
+		errno = err;
+		goto error;
+	}
+	return 0;
+
+error:
+	err = errno;
+	if (probe->epoll_fd != -1)
+		close(probe->epoll_fd);
+	if (probe->stop_fd != -1)
+		close(probe->stop_fd);
+	close(probe->fd);
+	errno = err;
+	return -1;
+}
+
+void ffinprobe_set_phase(struct ffinprobe* probe, int phase)
+{
+	unsigned long long now = get_ntime();
+	int i;
+
+	pthread_mutex_lock(&probe->lock);
+	if (phase == FFINPROBE_BEFORE) {
+		for (i = 0; i < N_FFINPROBE_PHASES; i++) {
+			memset(&probe->stats[i], 0, sizeof(probe->stats[i]));
+			ffhist_reset(&probe->stats[i].delivery_hist);
+		}
+	} else {
+		probe->stats[probe->phase].duration += now - probe->phase_start;
+	}
+	probe->phase = phase;
+	probe->phase_start = now;
+	pthread_mutex_unlock(&probe->lock);
+}
+
+void ffinprobe_get_stats(struct ffinprobe* probe, struct ffinprobe_stats stats[N_FFINPROBE_PHASES])
+{
+	int i;
+
+	pthread_mutex_lock(&probe->lock);
+	for (i = 0; i < N_FFINPROBE_PHASES; i++)
+		stats[i] = probe->stats[i];
+	/* Include the ongoing phase */
+	stats[probe->phase].duration += get_ntime() - probe->phase_start;
+	pthread_mutex_unlock(&probe->lock);
+}
+
+void ffinprobe_print(struct ffinprobe* probe)
+{
+	static struct ffinprobe_stats stats[N_FFINPROBE_PHASES];
+	double seconds;
+	int i;
+
+	ffinprobe_get_stats(probe, stats);
+
+	printf("Input reports (read by a separate thread):\n");
+	for (i = 0; i < N_FFINPROBE_PHASES; i++) {
+		seconds = stats[i].duration / 1e9;
+		if (!seconds)
+			continue;
+		printf("  %-6s  %8.1f reports/s, %8.1f events/s, %lu times SYN_DROPPED\n", ffinprobe_phase_names[i],
+				stats[i].n_reports / seconds, stats[i].n_events / seconds, stats[i].n_dropped);
+		if (stats[i].n_reports)
+			ffhist_print(&stats[i].delivery_hist, "    delivery");
+	}
+}
+
+void ffinprobe_stop(struct ffinprobe* probe)
+{
+	unsigned long long one = 1;
+
+	if (write(probe->stop_fd, &one, sizeof(one)) != sizeof(one))
+		perror("Stop input probe");
+	pthread_join(probe->thread, NULL);
+	pthread_mutex_destroy(&probe->lock);
+	close(probe->epoll_fd);
+	close(probe->stop_fd);
+	close(probe->fd);
+}
@@ -0,0 +1,74 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFINPROBE_H
+#define FFINPROBE_H
+
+#include <pthread.h>
+
+#include "ffhist.h"
+
+/*
+ * Input latency probe: a thread with its own file descriptor on the device, which drains its input events
+ * (e.g. the steering axis) while the force feedback path is being choked.
+ *
+ * The kernel timestamps each input report on CLOCK_MONOTONIC (set with EVIOCSCLOCKID) when it enters the input core,
+ * the probe measures how long it takes from there until userspace has read it, and the rate of the reports.
+ * With a virtual device that injects the reports itself (see ffemu), this is the exact delivery latency.
+ */
+
+enum ffinprobe_phase {
+	FFINPROBE_BEFORE,           /* before the choke-test */
+	FFINPROBE_DURING,
+	FFINPROBE_AFTER,
+	N_FFINPROBE_PHASES
+};
+
+extern const char* ffinprobe_phase_names[N_FFINPROBE_PHASES];
+
+struct ffinprobe_stats {
+	unsigned long n_reports;            /* SYN_REPORT frames */
+	unsigned long n_events;             /* events in those frames */
+	unsigned long n_dropped;            /* SYN_DROPPED: the reader fell behind and the kernel dropped events */
+	unsigned long long duration;        /* in nanoseconds */
+	struct ffhist delivery_hist;        /* read time minus kernel timestamp, per report, in nanoseconds */
+};
+
+struct ffinprobe {
+	int fd;
+	int epoll_fd;
+	int stop_fd;                        /* eventfd to wake up the thread when stopping */
+	pthread_t thread;
+
+	pthread_mutex_t lock;
+	int phase;
+	unsigned long long phase_start;
+	struct ffinprobe_stats stats[N_FFINPROBE_PHASES];
+};
+
+/* Open the device and start reading its input events. Returns 0 on success, -1 on error (errno is set). */
+int ffinprobe_start(struct ffinprobe* probe, const char* device_file_name);
+
+/* Switch to 'phase', switching to FFINPROBE_BEFORE starts a new measurement */
+void ffinprobe_set_phase(struct ffinprobe* probe, int phase);
+
+void ffinprobe_get_stats(struct ffinprobe* probe, struct ffinprobe_stats stats[N_FFINPROBE_PHASES]);
+void ffinprobe_print(struct ffinprobe* probe);
+
+void ffinprobe_stop(struct ffinprobe* probe);
+
+#endif /* FFINPROBE_H */
@@ -0,0 +1,304 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+
+#include "ffkmsg.h"
+
+/* Time for the marker of a calibration to show up in the kernel log, in milliseconds */
+#define CALIBRATION_TIMEOUT 100
+
+static unsigned long long get_ntime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+/* Messages of usbhid, the HID force feedback drivers, and the USB core, when output can't keep up */
+static const struct {
+	const char* name;
+	const char* text;                   /* matched case-insensitively anywhere in the message */
+} patterns[] = {
+	{ "output queue full",  "output queue full" },          /* usbhid: HID_OUTPUT_FIFO_SIZE overrun */
+	{ "control queue full", "control queue full" },
+	{ "output queue full",  "output queue is full" },       /* uhid: UHID_BUFSIZE overrun, e.g. under ffuhid */
+	{ "overrun",            "overrun" },
+	{ "URB submit failed",  "usb_submit_urb" },
+	{ "URB submit failed",  "submit urb" },
+	{ "URB status",         "urb status" },
+	{ "output irq status",  "irq status" },
+	{ "EPIPE",              "-epipe" },
+	{ "EPIPE",              "error -32" },
+	{ "EPIPE",              "failed: -32" },
+	{ "ENOSPC",             "-enospc" },
+	{ "ENOSPC",             "error -28" },
+	{ "ENOSPC",             "failed: -28" },
+};
+
+const char* ffkmsg_match(const char* text)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+		if (strcasestr(text, patterns[i].text))
+			return patterns[i].name;
+	}
+	return NULL;
+}
+
+int ffkmsg_parse(const char* line, struct ffkmsg_entry* entry)
+{
+	unsigned long long usec, sec;
+	const char* text;
+	char* end;
+	size_t len;
+	int prio;
+
+	memset(entry, 0, sizeof(*entry));
+	entry->level = -1;
+
+	if (line[0] == '[') {
+		/* dmesg: "[  123.456789] text" */
+		sec = strtoull(line + 1, &end, 10);
+		if (*end != '.')
+			return -1;
+		usec = strtoull(end + 1, &end, 10);
+		if (*end != ']')
+			return -1;
+		entry->time = 1000000000ull * sec + 1000ull * usec;
+		text = end + 1;
+		while (*text == ' ')
+			text++;
+	} else {
+		/* /dev/kmsg: "prio,seq,usec,flags;text", with continuation lines (" KEY=value") following */
+		if (sscanf(line, "%d,%*u,%llu", &prio, &usec) != 2)
+			return -1;
+		text = strchr(line, ';');
+		if (!text)
+			return -1;
+		text++;
+		entry->time = 1000ull * usec;
+		entry->level = prio & 7;
+	}
+
+	len = strcspn(text, "\n");
+	if (len >= sizeof(entry->text))
+		len = sizeof(entry->text) - 1;
+	memcpy(entry->text, text, len);
+	entry->text[len] = '\0';
+	entry->pattern = ffkmsg_match(entry->text);
+	return 0;
+}
+
+long ffkmsg_preceding(const struct fftrace_record* records, size_t n, unsigned long long time)
+{
+	size_t low = 0, high = n, mid;
+
+	/* First record sent after 'time' */
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (records[mid].send_time <= time)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return (long)low - 1;
+}
+
+
+
+static void* watch_thread(void* arg)
+{
+	struct ffkmsg_watch* watch = arg;
+	struct ffkmsg_entry entry;
+	struct pollfd pfds[2];
+	char record[8192];
+	ssize_t n;
+
+	pfds[0].fd = watch->fd;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = watch->stop_fd;
+	pfds[1].events = POLLIN;
+
+	for (;;) {
+		if (poll(pfds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("Kernel log poll error");
+			break;
+		}
+
+		/* One record per read */
+		while ((n = read(watch->fd, record, sizeof(record) - 1)) > 0 || (n < 0 && errno == EPIPE)) {
+			if (n < 0) {
+				/* Overwritten in the kernel ring buffer before we could read it */
+				pthread_mutex_lock(&watch->lock);
+				watch->n_lost++;
+				pthread_mutex_unlock(&watch->lock);
+				continue;
+			}
+			record[n] = '\0';
+			if (ffkmsg_parse(record, &entry) == -1 || !entry.pattern)
+				continue;
+
+			pthread_mutex_lock(&watch->lock);
+			if (watch->n_entries < watch->max_entries)
+				watch->entries[watch->n_entries++] = entry;
+			else
+				watch->n_lost++;
+			pthread_mutex_unlock(&watch->lock);
+		}
+
+		if (pfds[1].revents & POLLIN)
+			break;
+	}
+
+	return NULL;
+}
+
+int ffkmsg_watch_start(struct ffkmsg_watch* watch, int max_entries)
+{
+	int err;
+
+	memset(watch, 0, sizeof(*watch));
+	watch->max_entries = max_entries;
+	watch->entries = calloc(max_entries, sizeof(*watch->entries));
+	if (!watch->entries)
+		return -1;
+
+	watch->fd = open("/dev/kmsg", O_RDONLY | O_NONBLOCK);
+	if (watch->fd == -1)
+		goto error;
+	/* Skip the messages logged before */
+	if (lseek(watch->fd, 0, SEEK_END) == -1)
+		goto error_fd;
+	watch->stop_fd = eventfd(0, EFD_NONBLOCK);
+	if (watch->stop_fd == -1)
+		goto error_fd;
+
+	pthread_mutex_init(&watch->lock, NULL);
+	err = pthread_create(&watch->thread, NULL, watch_thread, watch);
+	if (err) {
+		pthread_mutex_destroy(&watch->lock);
+		close(watch->stop_fd);
+		errno = err;
+		goto error_fd;
+	}
+	/* Without it, the kernel log time is used as is */
+	ffkmsg_watch_calibrate(watch);
+	return 0;
+
+error_fd:
+	err = errno;
+	close(watch->fd);
+	errno = err;
+error:
+	err = errno;
+	free(watch->entries);
+	errno = err;
+	return -1;
+}
+
+int ffkmsg_watch_calibrate(struct ffkmsg_watch* watch)
+{
+	struct ffkmsg_entry entry;
+	struct pollfd pfd;
+	unsigned long long before, after;
+	char marker[64], record[8192];
+	ssize_t n;
+	int fd, log_fd, err, found = 0;
+
+	/* A reader of its own, the watch thread would take the marker */
+	fd = open("/dev/kmsg", O_RDONLY | O_NONBLOCK);
+	if (fd == -1)
+		return -1;
+	if (lseek(fd, 0, SEEK_END) == -1)
+		goto error;
+	log_fd = open("/dev/kmsg", O_WRONLY);
+	if (log_fd == -1)
+		goto error;
+	snprintf(marker, sizeof(marker), "ffkmsg: clock calibration %d.%u", (int)getpid(), watch->n_markers++);
+	before = get_ntime();
+	n = write(log_fd, marker, strlen(marker));
+	after = get_ntime();
+	close(log_fd);
+	if (n < 0)
+		goto error;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (!found && poll(&pfd, 1, CALIBRATION_TIMEOUT) > 0) {
+		while (!found && ((n = read(fd, record, sizeof(record) - 1)) > 0 || (n < 0 && errno == EPIPE))) {
+			if (n < 0)
+				continue;
+			record[n] = '\0';
+			found = (ffkmsg_parse(record, &entry) == 0 && strstr(entry.text, marker));
+		}
+	}
+	close(fd);
+	if (!found) {
+		errno = ETIMEDOUT;
+		return -1;
+	}
+
+	/* The marker was stamped while we were writing it */
+	watch->clock_offset = (long long)(before + (after - before) / 2) - (long long)entry.time;
+	watch->calibrated = 1;
+	return 0;
+
+error:
+	err = errno;
+	close(fd);
+	errno = err;
+	return -1;
+}
+
+int ffkmsg_watch_take(struct ffkmsg_watch* watch, struct ffkmsg_entry* entries, int max_entries)
+{
+	int n;
+
+	pthread_mutex_lock(&watch->lock);
+	n = (watch->n_entries < max_entries ? watch->n_entries : max_entries);
+	memcpy(entries, watch->entries, n * sizeof(*entries));
+	memmove(watch->entries, watch->entries + n, (watch->n_entries - n) * sizeof(*entries));
+	watch->n_entries -= n;
+	pthread_mutex_unlock(&watch->lock);
+	return n;
+}
+
+void ffkmsg_watch_stop(struct ffkmsg_watch* watch)
+{
+	unsigned long long one = 1;
+
+	if (write(watch->stop_fd, &one, sizeof(one)) != sizeof(one))
+		perror("Stop kernel log watch");
+	pthread_join(watch->thread, NULL);
+	pthread_mutex_destroy(&watch->lock);
+	close(watch->stop_fd);
+	close(watch->fd);
+	free(watch->entries);
+}
@@ -0,0 +1,94 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFKMSG_H
+#define FFKMSG_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "fftrace.h"
+
+/*
+ * Kernel log messages of drivers that can't keep up (USB buffer overruns, failed URB submissions, ...),
+ * read from /dev/kmsg while choking, or from a recorded file, and correlated with the commands that preceded them.
+ *
+ * Kernel log timestamps come from the scheduler clock (local_clock()), not from CLOCK_MONOTONIC:
+ * it has an offset, drifts, and stops during suspend. The watch calibrates it against CLOCK_MONOTONIC
+ * by logging a marker and reading back its timestamp, see ffkmsg_watch_calibrate();
+ * recorded logs (see ffkmsgscan) can't be calibrated, so their mapping onto a trace is approximate.
+ */
+
+#define FFKMSG_TEXT_SIZE 256
+
+struct ffkmsg_entry {
+	unsigned long long time;            /* in nanoseconds */
+	int level;                          /* syslog level, -1 if unknown */
+	const char* pattern;                /* the matching error pattern, see ffkmsg_match() */
+	char text[FFKMSG_TEXT_SIZE];
+};
+
+/*
+ * Parse a /dev/kmsg record ("<prio>,<seq>,<usec>,<flags>;<text>"),
+ * or a line of 'dmesg' ("[<sec>.<usec>] <text>"). Returns 0 on success, -1 if not recognized.
+ */
+int ffkmsg_parse(const char* line, struct ffkmsg_entry* entry);
+
+/* The name of the error pattern that 'text' matches, NULL if it isn't a driver error of interest */
+const char* ffkmsg_match(const char* text);
+
+/* Index of the last of the 'n' records (in time order) sent at or before 'time', -1 if none */
+long ffkmsg_preceding(const struct fftrace_record* records, size_t n, unsigned long long time);
+
+/* Tails /dev/kmsg from a separate thread, keeping the matching messages */
+struct ffkmsg_watch {
+	int fd;
+	int stop_fd;                        /* eventfd to wake up the thread when stopping */
+	pthread_t thread;
+
+	pthread_mutex_t lock;
+	struct ffkmsg_entry* entries;       /* matching messages, preallocated */
+	int n_entries, max_entries;
+	unsigned long n_lost;               /* matching messages that didn't fit, or lost by the kernel (EPIPE) */
+
+	long long clock_offset;             /* CLOCK_MONOTONIC minus kernel log time, in nanoseconds */
+	int calibrated;                     /* 'clock_offset' is known, otherwise it is 0 */
+	unsigned int n_markers;
+};
+
+/* Start reading messages logged from now on. Returns 0 on success, -1 on error (errno is set). */
+int ffkmsg_watch_start(struct ffkmsg_watch* watch, int max_entries);
+
+/*
+ * Measure the 'clock_offset' of the kernel log, by writing a marker to /dev/kmsg and reading back its timestamp;
+ * done when starting, and again before each salvo in case the system was suspended in-between.
+ * Returns 0 on success, -1 on error (errno is set, the previous offset is kept).
+ */
+int ffkmsg_watch_calibrate(struct ffkmsg_watch* watch);
+
+/* The CLOCK_MONOTONIC time of 'entry', read by 'watch', in nanoseconds */
+static inline unsigned long long ffkmsg_watch_time(const struct ffkmsg_watch* watch, const struct ffkmsg_entry* entry)
+{
+	return entry->time + watch->clock_offset;
+}
+
+/* Move the matching messages read so far to 'entries', returns their amount */
+int ffkmsg_watch_take(struct ffkmsg_watch* watch, struct ffkmsg_entry* entries, int max_entries);
+
+void ffkmsg_watch_stop(struct ffkmsg_watch* watch);
+
+#endif /* FFKMSG_H */
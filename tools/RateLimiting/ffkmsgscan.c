@@ -0,0 +1,123 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ffkmsg.h"
+
+/*
+ * Offline counterpart of the kmsg_watch of ffchoke: flag the driver errors in a recorded kernel log,
+ * and map them onto the commands of a trace of ffchoke, when given.
+ */
+
+int main(int argc, char** argv)
+{
+	const struct fftrace_header* header = NULL;
+	const struct fftrace_record* records = NULL;
+	const struct fftrace_record* r;
+	struct ffkmsg_entry entry;
+	struct stat st;
+	char line[8192];
+	void* map = NULL;
+	size_t n_records = 0;
+	unsigned long n_lines = 0, n_matches = 0;
+	long idx;
+	FILE* log;
+	int i, fd;
+
+	/* Show help message */
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--help", 64) == 0) {
+			printf("Usage: %s <kmsg_file> [<trace_file>]\n", argv[0]);
+			printf("Flags the force feedback driver and USB errors (e.g. USB buffer overruns) in a kernel log,\n");
+			printf("recorded with 'cat /dev/kmsg > kmsg_file' or 'dmesg > kmsg_file' ('-' reads stdin).\n");
+			printf("With a binary trace of ffchoke (see its 'trace_file'), each error is mapped onto the command\n");
+			printf("that preceded it; record the trace and the log during the same boot, without suspending.\n");
+			printf("The kernel log clock is not CLOCK_MONOTONIC, so unlike the live watch of ffchoke\n");
+			printf("this mapping is uncalibrated and only approximate.\n");
+			exit(1);
+		}
+	}
+	if (argc < 2) {
+		printf("Missing kmsg_file, see '%s --help'.\n", argv[0]);
+		exit(1);
+	}
+
+	log = (strcmp(argv[1], "-") == 0 ? stdin : fopen(argv[1], "r"));
+	if (!log) {
+		perror("Open kmsg file");
+		exit(1);
+	}
+
+	if (argc > 2) {
+		fd = open(argv[2], O_RDONLY);
+		if (fd == -1 || fstat(fd, &st) == -1) {
+			perror("Open trace file");
+			exit(1);
+		}
+		if (st.st_size >= sizeof(*header))
+			map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (!map || map == MAP_FAILED) {
+			printf("Could not read the trace file.\n");
+			exit(1);
+		}
+		header = map;
+		if (memcmp(header->magic, FFTRACE_MAGIC, sizeof(header->magic)) != 0 ||
+		    header->record_size != sizeof(struct fftrace_record) || header->header_size > st.st_size) {
+			printf("Not a binary trace file of this architecture.\n");
+			exit(1);
+		}
+		records = (const struct fftrace_record*)((const char*)map + header->header_size);
+		n_records = (st.st_size - header->header_size) / sizeof(*records);
+	}
+
+	while (fgets(line, sizeof(line), log)) {
+		n_lines++;
+		if (ffkmsg_parse(line, &entry) == -1 || !entry.pattern)
+			continue;
+		n_matches++;
+		printf("[%5llu.%06llu] %-18s %s\n", entry.time / 1000000000ull, entry.time % 1000000000ull / 1000,
+				entry.pattern, entry.text);
+		if (!records)
+			continue;
+
+		idx = ffkmsg_preceding(records, n_records, entry.time);
+		if (idx < 0) {
+			printf("\tbefore the trace\n");
+			continue;
+		}
+		r = &records[idx];
+		printf("\t%lluus after update %llu, %s", (entry.time - r->send_time) / 1000,
+				(unsigned long long)r->tick,
+				r->command < N_FFTRACE_COMMANDS ? fftrace_command_names[r->command] : "unknown");
+		if (r->slot >= 0)
+			printf(" of slot %d (effect id %d)", r->slot, r->effect_id);
+		printf(" with value %d\n", r->value);
+	}
+
+	printf("%lu of %lu kernel log lines flagged\n", n_matches, n_lines);
+	if (map)
+		munmap(map, st.st_size);
+	exit(0);
+}
@@ -0,0 +1,577 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ffktrace.h"
+
+const char* ffktrace_queue_names[N_FFKTRACE_QUEUES] = {
+	"uinput client",
+	"uhid client",
+	"usbhid URB",
+};
+
+enum probe_role {
+	SYNC,                   /* on the path of the command, in the choke thread */
+	ENQUEUE,                /* as SYNC, and the command is queued for another context */
+	DEQUEUE_ALL,            /* another context took all queued commands (a read() of the client) */
+	DEQUEUE_ONE,            /* another context completed the oldest queued command (an URB) */
+};
+
+static const struct probe {
+	const char* symbol;
+	int ret;                /* on the return of the function, instead of its entry */
+	int role;
+	int queue;
+} probes[] = {
+	/* evdev, and the force feedback core of the input subsystem */
+	{ "evdev_ioctl",                0, SYNC,        0 },
+	{ "evdev_ioctl",                1, SYNC,        0 },
+	{ "evdev_write",                0, SYNC,        0 },
+	{ "evdev_write",                1, SYNC,        0 },
+	{ "input_ff_upload",            0, SYNC,        0 },
+	{ "input_ff_upload",            1, SYNC,        0 },
+	{ "input_ff_event",             0, SYNC,        0 },
+	{ "input_ff_event",             1, SYNC,        0 },
+	/* uinput stand-in: commands are passed to the client as events, and uploads wait for its answer */
+	{ "uinput_dev_upload_effect",   0, SYNC,        0 },
+	{ "uinput_dev_event",           0, ENQUEUE,     FFKTRACE_UINPUT },
+	{ "uinput_read",                1, DEQUEUE_ALL, FFKTRACE_UINPUT },
+	/* HID output reports, of the HID force feedback drivers */
+	{ "hid_hw_request",             0, SYNC,        0 },
+	{ "hid_hw_raw_request",         0, SYNC,        0 },
+	{ "hid_hw_output_report",       0, SYNC,        0 },
+	/* uhid stand-in */
+	{ "uhid_hid_output_raw",        0, SYNC,        0 },
+	{ "uhid_queue_event",           0, ENQUEUE,     FFKTRACE_UHID },
+	{ "uhid_char_read",             1, DEQUEUE_ALL, FFKTRACE_UHID },
+	/* usbhid: reports are queued, and sent as interrupt or control URBs */
+	{ "__usbhid_submit_report",     0, ENQUEUE,     FFKTRACE_USBHID },
+	{ "usbhid_output_report",       0, SYNC,        0 },
+	{ "usb_submit_urb",             0, SYNC,        0 },
+	{ "hid_irq_out",                0, DEQUEUE_ONE, FFKTRACE_USBHID },
+	{ "hid_ctrl",                   0, DEQUEUE_ONE, FFKTRACE_USBHID },
+};
+#define N_PROBES (int)(sizeof(probes) / sizeof(probes[0]))
+
+#define GROUP           "ffktrace"
+#define MARKER          "ffktrace"
+#define BUFFER_SIZE_KB  "16384"     /* per CPU, for a salvo of about a million commands */
+
+static void probe_name(int probe, char* name, size_t size)
+{
+	snprintf(name, size, "%s%s", probes[probe].symbol, probes[probe].ret ? "__return" : "");
+}
+
+static int write_file(const char* path, const char* text, int flags)
+{
+	int fd, ret, err;
+
+	fd = open(path, O_WRONLY | O_CLOEXEC | flags);
+	if (fd == -1)
+		return -1;
+	ret = write(fd, text, strlen(text));
+	err = errno;
+	close(fd);
+	errno = err;
+	return (ret < 0 ? -1 : 0);
+}
+
+static int write_instance_file(const struct ffktrace* ktrace, const char* file, const char* text)
+{
+	char path[PATH_MAX + 256];
+
+	snprintf(path, sizeof(path), "%s/%s", ktrace->instance, file);
+	return write_file(path, text, O_TRUNC);
+}
+
+static int add_probe(const struct ffktrace* ktrace, int probe)
+{
+	char name[128], line[256];
+
+	probe_name(probe, name, sizeof(name));
+	snprintf(line, sizeof(line), "%c:%s/%s %s\n", probes[probe].ret ? 'r' : 'p', GROUP, name, probes[probe].symbol);
+	return write_file(ktrace->events, line, O_APPEND);
+}
+
+static void remove_probe(const struct ffktrace* ktrace, int probe)
+{
+	char name[128], line[256];
+
+	probe_name(probe, name, sizeof(name));
+	snprintf(line, sizeof(line), "-:%s/%s\n", GROUP, name);
+	write_file(ktrace->events, line, O_APPEND);
+}
+
+/* Events overwritten in the trace buffer of the instance, over all CPUs */
+static unsigned long read_overruns(const struct ffktrace* ktrace)
+{
+	char path[PATH_MAX + 128], line[128];
+	unsigned long overrun, total = 0;
+	FILE* file;
+	int cpu;
+
+	for (cpu = 0; ; cpu++) {
+		snprintf(path, sizeof(path), "%s/per_cpu/cpu%d/stats", ktrace->instance, cpu);
+		file = fopen(path, "r");
+		if (!file)
+			break;
+		while (fgets(line, sizeof(line), file))
+			if (sscanf(line, "overrun: %lu", &overrun) == 1)
+				total += overrun;
+		fclose(file);
+	}
+	return total;
+}
+
+int ffktrace_open(struct ffktrace* ktrace)
+{
+	const char* tracefs = "/sys/kernel/tracing";
+	char path[PATH_MAX + 16];
+	int i, err;
+
+	memset(ktrace, 0, sizeof(*ktrace));
+	ktrace->marker_fd = -1;
+
+	/* tracefs is also mounted in debugfs, on older systems only there */
+	snprintf(ktrace->events, sizeof(ktrace->events), "%s/kprobe_events", tracefs);
+	if (access(ktrace->events, W_OK) == -1) {
+		tracefs = "/sys/kernel/debug/tracing";
+		snprintf(ktrace->events, sizeof(ktrace->events), "%s/kprobe_events", tracefs);
+		if (access(ktrace->events, W_OK) == -1)
+			return -1;
+	}
+	snprintf(ktrace->instance, sizeof(ktrace->instance), "%s/instances/%s", tracefs, GROUP);
+
+	ktrace->available = calloc(N_PROBES, sizeof(*ktrace->available));
+	ktrace->stages = calloc(FFKTRACE_MAX_STAGES, sizeof(*ktrace->stages));
+	if (!ktrace->available || !ktrace->stages) {
+		errno = ENOMEM;
+		goto error;
+	}
+
+	/* Left over by a run that didn't end properly */
+	rmdir(ktrace->instance);
+
+	/* Functions that aren't in the running kernel, or in a loaded module, are left out */
+	for (i = 0; i < N_PROBES; i++) {
+		remove_probe(ktrace, i);
+		/* Still there if it is in use elsewhere, and then usable as well */
+		if (add_probe(ktrace, i) == 0 || errno == EEXIST) {
+			ktrace->available[i] = 1;
+			ktrace->n_available++;
+		}
+	}
+	if (!ktrace->n_available)
+		goto error;
+
+	if (mkdir(ktrace->instance, 0750) == -1 && errno != EEXIST)
+		goto error;
+	/* The same clock as the choke-test, see fftrace */
+	if (write_instance_file(ktrace, "trace_clock", "mono") == -1)
+		perror("Warning: set the trace clock of the kernel trace");
+	write_instance_file(ktrace, "buffer_size_kb", BUFFER_SIZE_KB);
+
+	snprintf(path, sizeof(path), "%s/trace_marker", ktrace->instance);
+	ktrace->marker_fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (ktrace->marker_fd == -1)
+		goto error;
+	return 0;
+
+error:
+	err = errno;
+	ffktrace_close(ktrace);
+	errno = err;
+	return -1;
+}
+
+int ffktrace_start(struct ffktrace* ktrace, int tid)
+{
+	char file[256], filter[64];
+	char name[128];
+	int i;
+
+	/* Only the commands of the choke thread, but their dequeueing from any context */
+	snprintf(filter, sizeof(filter), "common_pid == %d\n", tid);
+	for (i = 0; i < N_PROBES; i++) {
+		if (!ktrace->available[i])
+			continue;
+		probe_name(i, name, sizeof(name));
+		snprintf(file, sizeof(file), "events/%s/%s/filter", GROUP, name);
+		if (write_instance_file(ktrace, file, (probes[i].role == SYNC || probes[i].role == ENQUEUE ? filter : "0\n")) == -1)
+			return -1;
+	}
+
+	if (write_instance_file(ktrace, "trace", "") == -1)
+		return -1;
+	ktrace->n_lost = read_overruns(ktrace);
+	snprintf(file, sizeof(file), "events/%s/enable", GROUP);
+	return write_instance_file(ktrace, file, "1\n");
+}
+
+void ffktrace_mark(struct ffktrace* ktrace, unsigned long tick, int command, int slot)
+{
+	char text[64];
+	int len;
+
+	len = snprintf(text, sizeof(text), MARKER " %lu %d %d\n", tick, command, slot);
+	if (write(ktrace->marker_fd, text, len) < 0)
+		return;     /* the command is then attributed to the previous one, that's all */
+}
+
+
+
+/* State of the parsing of a trace */
+struct parse_state {
+	int tid;
+	int in_command;
+	struct ffktrace_command command;
+	int last_probe;
+	unsigned long long last_time;
+
+	/* Queued commands, by time */
+	unsigned long long* queued[N_FFKTRACE_QUEUES];
+	unsigned long head[N_FFKTRACE_QUEUES], tail[N_FFKTRACE_QUEUES];
+};
+
+static struct ffhist* stage_hist(struct ffktrace* ktrace, int command, int from, int to)
+{
+	struct ffktrace_stage* stage;
+	int i;
+
+	for (i = 0; i < ktrace->n_stages; i++) {
+		stage = &ktrace->stages[i];
+		if (stage->command == command && stage->from == from && stage->to == to)
+			return &stage->hist;
+	}
+	if (ktrace->n_stages == FFKTRACE_MAX_STAGES)
+		return NULL;
+	stage = &ktrace->stages[ktrace->n_stages++];
+	stage->command = command;
+	stage->from = from;
+	stage->to = to;
+	ffhist_reset(&stage->hist);
+	return &stage->hist;
+}
+
+static void end_command(struct ffktrace* ktrace, struct parse_state* state)
+{
+	struct ffktrace_command* command = &state->command;
+	unsigned long long duration = command->end - command->start;
+	int i;
+
+	if (!state->in_command || !command->n_steps)
+		return;
+	state->in_command = 0;
+	ktrace->n_commands++;
+	if (command->command >= 0 && command->command < N_FFTRACE_COMMANDS)
+		ffhist_add(&ktrace->total_hist[command->command], duration);
+
+	/* Keep the slowest commands, slowest first */
+	for (i = ktrace->n_slowest; i > 0; i--) {
+		if (ktrace->slowest[i - 1].end - ktrace->slowest[i - 1].start >= duration)
+			break;
+		if (i < FFKTRACE_N_SLOWEST)
+			ktrace->slowest[i] = ktrace->slowest[i - 1];
+	}
+	if (i < FFKTRACE_N_SLOWEST) {
+		ktrace->slowest[i] = *command;
+		if (ktrace->n_slowest < FFKTRACE_N_SLOWEST)
+			ktrace->n_slowest++;
+	}
+}
+
+static void handle_probe(struct ffktrace* ktrace, struct parse_state* state, int probe, int pid,
+                         unsigned long long time)
+{
+	const struct probe* p = &probes[probe];
+	struct ffktrace_command* command = &state->command;
+	struct ffhist* hist;
+	int q = p->queue;
+
+	if (p->role == DEQUEUE_ALL || p->role == DEQUEUE_ONE) {
+		if (state->head[q] == state->tail[q] && p->role == DEQUEUE_ONE)
+			ktrace->n_unmatched[q]++;
+		while (state->head[q] != state->tail[q] && state->queued[q][state->tail[q] % FFKTRACE_MAX_QUEUED] <= time) {
+			ffhist_add(&ktrace->queue_wait_hist[q], time - state->queued[q][state->tail[q] % FFKTRACE_MAX_QUEUED]);
+			state->tail[q]++;
+			if (p->role == DEQUEUE_ONE)
+				break;
+		}
+		return;
+	}
+
+	/* Only the path of a marked command of the choke thread */
+	if (pid != state->tid || !state->in_command)
+		return;
+	hist = stage_hist(ktrace, command->command, state->last_probe, probe);
+	if (hist)
+		ffhist_add(hist, time - state->last_time);
+	if (command->n_steps < FFKTRACE_MAX_STEPS) {
+		command->step_probe[command->n_steps] = probe;
+		command->step_time[command->n_steps] = time;
+	}
+	command->n_steps++;
+	command->end = time;
+	state->last_probe = probe;
+	state->last_time = time;
+
+	if (p->role == ENQUEUE) {
+		if (state->head[q] - state->tail[q] == FFKTRACE_MAX_QUEUED) {
+			ktrace->n_unmatched[q]++;
+			state->tail[q]++;
+		}
+		state->queued[q][state->head[q]++ % FFKTRACE_MAX_QUEUED] = time;
+	}
+}
+
+/*
+ * Parse a line of the trace, e.g.
+ *   "           ffchoke-1234    [001] d..1.   123.456789: input_ff_upload: (input_ff_upload+0x0/0x1f0)"
+ * The irq-info flags are optional, the timestamp is in seconds with microseconds.
+ */
+static int parse_line(char* line, int* pid, unsigned long long* time, char** event, char** payload)
+{
+	char *bracket, *p, *timestamp;
+	unsigned long sec, usec;
+
+	if (line[0] == '#')
+		return -1;
+	bracket = strstr(line, " [");
+	if (!bracket)
+		return -1;
+	for (p = bracket; p > line && p[-1] == ' '; p--)
+		;
+	*p = '\0';
+	p = strrchr(line, '-');
+	if (!p)
+		return -1;
+	*pid = atoi(p + 1);
+
+	p = strstr(bracket, ": ");
+	if (!p)
+		return -1;
+	for (timestamp = p; timestamp > bracket && timestamp[-1] != ' '; timestamp--)
+		;
+	if (sscanf(timestamp, "%lu.%lu", &sec, &usec) != 2)
+		return -1;
+	*time = 1000000000ull * sec + 1000ull * usec;
+
+	*event = p + 2;
+	p = strstr(*event, ": ");
+	if (!p)
+		return -1;
+	*p = '\0';
+	*payload = p + 2;
+	return 0;
+}
+
+int ffktrace_stop(struct ffktrace* ktrace)
+{
+	struct parse_state state;
+	char path[PATH_MAX + 16], line[512], name[128];
+	char *event, *payload;
+	unsigned long long time;
+	unsigned long tick;
+	int pid, command, slot;
+	int i, q, err, ret = 0;
+	FILE* file;
+
+	snprintf(name, sizeof(name), "events/%s/enable", GROUP);
+	write_instance_file(ktrace, name, "0\n");
+	ktrace->n_lost = read_overruns(ktrace) - ktrace->n_lost;
+
+	ktrace->n_commands = 0;
+	ktrace->n_events = 0;
+	ktrace->n_stages = 0;
+	ktrace->n_slowest = 0;
+	for (i = 0; i < N_FFTRACE_COMMANDS; i++)
+		ffhist_reset(&ktrace->total_hist[i]);
+	for (q = 0; q < N_FFKTRACE_QUEUES; q++) {
+		ffhist_reset(&ktrace->queue_wait_hist[q]);
+		ktrace->n_unmatched[q] = 0;
+	}
+
+	memset(&state, 0, sizeof(state));
+	state.tid = -1;
+	for (q = 0; q < N_FFKTRACE_QUEUES; q++) {
+		state.queued[q] = malloc(FFKTRACE_MAX_QUEUED * sizeof(*state.queued[q]));
+		if (!state.queued[q]) {
+			errno = ENOMEM;
+			ret = -1;
+			goto out;
+		}
+	}
+
+	snprintf(path, sizeof(path), "%s/trace", ktrace->instance);
+	file = fopen(path, "r");
+	if (!file) {
+		ret = -1;
+		goto out;
+	}
+	while (fgets(line, sizeof(line), file)) {
+		if (parse_line(line, &pid, &time, &event, &payload) == -1)
+			continue;
+		ktrace->n_events++;
+
+		if (strcmp(event, "tracing_mark_write") == 0) {
+			if (sscanf(payload, MARKER " %lu %d %d", &tick, &command, &slot) != 3)
+				continue;
+			end_command(ktrace, &state);
+			/* The markers tell which thread is the choke thread */
+			state.tid = pid;
+			state.in_command = 1;
+			memset(&state.command, 0, sizeof(state.command));
+			state.command.tick = tick;
+			state.command.command = command;
+			state.command.slot = slot;
+			state.command.start = time;
+			state.command.end = time;
+			state.last_probe = -1;
+			state.last_time = time;
+			continue;
+		}
+
+		for (i = 0; i < N_PROBES; i++) {
+			probe_name(i, name, sizeof(name));
+			if (ktrace->available[i] && strcmp(event, name) == 0)
+				break;
+		}
+		if (i < N_PROBES)
+			handle_probe(ktrace, &state, i, pid, time);
+	}
+	end_command(ktrace, &state);
+	err = errno;
+	if (ferror(file))
+		ret = -1;
+	fclose(file);
+	errno = err;
+
+	/* Never dequeued */
+	for (q = 0; q < N_FFKTRACE_QUEUES; q++)
+		ktrace->n_unmatched[q] += state.head[q] - state.tail[q];
+
+out:
+	for (q = 0; q < N_FFKTRACE_QUEUES; q++)
+		free(state.queued[q]);
+	return ret;
+}
+
+static void step_label(int probe, char* label, size_t size)
+{
+	if (probe < 0)
+		snprintf(label, size, "marker");
+	else
+		snprintf(label, size, "%s%s", probes[probe].symbol, probes[probe].ret ? " ret" : "");
+}
+
+/* Print a histogram, with its labels aligned */
+static void print_hist(const struct ffhist* hist, const char* text)
+{
+	char label[160];
+
+	snprintf(label, sizeof(label), "%-56s", text);
+	ffhist_print(hist, label);
+}
+
+void ffktrace_print(const struct ffktrace* ktrace)
+{
+	const struct ffktrace_stage* stage;
+	const struct ffktrace_command* command;
+	char label[160], from[64], to[64];
+	int c, i, j, last;
+
+	printf("Kernel stages (kprobes on %d functions): %lu commands, %lu trace events", ktrace->n_available,
+			ktrace->n_commands, ktrace->n_events);
+	if (ktrace->n_lost)
+		printf(", %lu LOST (the trace buffer was too small)", ktrace->n_lost);
+	printf("\n");
+
+	for (c = 0; c < N_FFTRACE_COMMANDS; c++) {
+		if (!ktrace->total_hist[c].n)
+			continue;
+		snprintf(label, sizeof(label), "  %s, marker to last probe", fftrace_command_names[c]);
+		print_hist(&ktrace->total_hist[c], label);
+		for (i = 0; i < ktrace->n_stages; i++) {
+			stage = &ktrace->stages[i];
+			if (stage->command != c)
+				continue;
+			step_label(stage->from, from, sizeof(from));
+			step_label(stage->to, to, sizeof(to));
+			snprintf(label, sizeof(label), "    %s -> %s", from, to);
+			print_hist(&stage->hist, label);
+		}
+	}
+
+	for (i = 0; i < N_FFKTRACE_QUEUES; i++) {
+		if (!ktrace->queue_wait_hist[i].n && !ktrace->n_unmatched[i])
+			continue;
+		snprintf(label, sizeof(label), "  queue wait, %s", ffktrace_queue_names[i]);
+		print_hist(&ktrace->queue_wait_hist[i], label);
+		if (ktrace->n_unmatched[i])
+			printf("    (%lu not matched)\n", ktrace->n_unmatched[i]);
+	}
+
+	if (ktrace->n_slowest)
+		printf("  Slowest commands (tick as in the trace_file):\n");
+	for (i = 0; i < ktrace->n_slowest; i++) {
+		command = &ktrace->slowest[i];
+		printf("    tick %lu, %s of slot %d: %.1fus:", command->tick,
+				(command->command >= 0 && command->command < N_FFTRACE_COMMANDS ?
+				 fftrace_command_names[command->command] : "?"),
+				command->slot, (command->end - command->start) / 1e3);
+		last = (command->n_steps < FFKTRACE_MAX_STEPS ? command->n_steps : FFKTRACE_MAX_STEPS);
+		for (j = 0; j < last; j++) {
+			step_label(command->step_probe[j], to, sizeof(to));
+			printf(" %s +%.0fus%s", to,
+					(command->step_time[j] - (j ? command->step_time[j - 1] : command->start)) / 1e3,
+					j + 1 < last ? "," : "");
+		}
+		if (command->n_steps > last)
+			printf(" ...");
+		printf("\n");
+	}
+}
+
+void ffktrace_close(struct ffktrace* ktrace)
+{
+	char name[64];
+	int i;
+
+	if (ktrace->marker_fd >= 0)
+		close(ktrace->marker_fd);
+	ktrace->marker_fd = -1;
+	if (ktrace->available) {
+		/* The events must be disabled in all instances before the probes can be removed */
+		snprintf(name, sizeof(name), "events/%s/enable", GROUP);
+		write_instance_file(ktrace, name, "0\n");
+		rmdir(ktrace->instance);
+		for (i = 0; i < N_PROBES; i++)
+			if (ktrace->available[i])
+				remove_probe(ktrace, i);
+	}
+	free(ktrace->available);
+	free(ktrace->stages);
+	ktrace->available = NULL;
+	ktrace->stages = NULL;
+}
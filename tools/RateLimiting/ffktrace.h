@@ -0,0 +1,113 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFKTRACE_H
+#define FFKTRACE_H
+
+#include <limits.h>
+
+#include "ffhist.h"
+#include "fftrace.h"
+
+/*
+ * Where the time of a force feedback command goes inside the kernel, with kprobes through tracefs
+ * (needs root, and a kernel with CONFIG_KPROBE_EVENTS, as most distributions have; no eBPF toolchain).
+ *
+ * Probes are put on the evdev ioctl and write paths, input_ff_upload() and input_ff_event(),
+ * the uinput and uhid stand-ins (see ffemu, ffuhid), and the HID output report and usbhid URB functions;
+ * those that don't exist in the running kernel (or aren't loaded) are left out.
+ * They record into a tracefs instance of their own, so the global trace buffer is left alone.
+ *
+ * Before each command, the choke thread writes a marker with its tick (update index), command and slot
+ * to the trace, and all probes hit by the choke thread until the next marker belong to that command.
+ * The buffer is only parsed after the salvo: the time between consecutive probes of a command is a stage,
+ * e.g. "evdev_ioctl -> input_ff_upload". Queues that are drained by another context (the uinput or uhid
+ * client reading the commands, the completion of the USB output URB) are matched first-in first-out,
+ * which gives the queue wait of each command. The trace has a resolution of a microsecond.
+ * The probes are filtered on the choke thread, so writes submitted through io_uring (which run in io-wq workers)
+ * can't be traced.
+ */
+
+#define FFKTRACE_MAX_STAGES     64
+#define FFKTRACE_MAX_STEPS      16      /* probes kept per command, for the slowest commands */
+#define FFKTRACE_N_SLOWEST      5
+#define FFKTRACE_MAX_QUEUED     4096    /* commands waiting in a queue */
+
+enum ffktrace_queue {
+	FFKTRACE_UINPUT,                    /* uinput_dev_event() until the uinput client's read() returns */
+	FFKTRACE_UHID,                      /* uhid_queue_event() until the uhid client's read() returns */
+	FFKTRACE_USBHID,                    /* __usbhid_submit_report() until the output or control URB completed */
+	N_FFKTRACE_QUEUES
+};
+
+extern const char* ffktrace_queue_names[N_FFKTRACE_QUEUES];
+
+/* Time between two consecutive probes of a command, -1 is the marker */
+struct ffktrace_stage {
+	int command;                        /* one of enum fftrace_command */
+	int from, to;                       /* probe index */
+	struct ffhist hist;                 /* in nanoseconds */
+};
+
+struct ffktrace_command {
+	unsigned long tick;
+	int command;
+	int slot;
+	unsigned long long start, end;      /* marker and last probe, CLOCK_MONOTONIC in nanoseconds */
+	int n_steps;
+	int step_probe[FFKTRACE_MAX_STEPS];
+	unsigned long long step_time[FFKTRACE_MAX_STEPS];
+};
+
+struct ffktrace {
+	char instance[PATH_MAX];            /* tracefs instance directory */
+	char events[PATH_MAX];              /* kprobe_events of tracefs */
+	int marker_fd;
+	int* available;                     /* per probe, the kprobe event could be created */
+	int n_available;
+
+	/* Results of the last salvo */
+	unsigned long n_commands;           /* commands that hit at least one probe */
+	unsigned long n_events;
+	unsigned long n_lost;               /* events overwritten in the trace buffer */
+	struct ffktrace_stage* stages;
+	int n_stages;
+	struct ffhist total_hist[N_FFTRACE_COMMANDS];   /* marker to last probe */
+	struct ffhist queue_wait_hist[N_FFKTRACE_QUEUES];
+	unsigned long n_unmatched[N_FFKTRACE_QUEUES];   /* dequeued without a queued command, or never dequeued */
+	struct ffktrace_command slowest[FFKTRACE_N_SLOWEST];
+	int n_slowest;
+};
+
+/* Create the probes and the trace instance. Returns 0 on success, -1 on error (errno is set). */
+int ffktrace_open(struct ffktrace* ktrace);
+
+/* Clear the trace, and enable the probes for the thread 'tid' (the dequeueing probes for all threads) */
+int ffktrace_start(struct ffktrace* ktrace, int tid);
+
+/* Mark the start of a command of the choke thread */
+void ffktrace_mark(struct ffktrace* ktrace, unsigned long tick, int command, int slot);
+
+/* Disable the probes, and compute the stages, queue waits and slowest commands from the trace */
+int ffktrace_stop(struct ffktrace* ktrace);
+
+void ffktrace_print(const struct ffktrace* ktrace);
+
+/* Remove the trace instance and the probes */
+void ffktrace_close(struct ffktrace* ktrace);
+
+#endif /* FFKTRACE_H */
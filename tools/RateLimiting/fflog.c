@@ -0,0 +1,232 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fflog.h"
+
+#define FFLOG_BUFFER_SIZE       65536
+#define FFLOG_RELEASE_CHUNK     (4 << 20)       /* release replayed pages per 4MB */
+
+static int write_all(int fd, const unsigned char* data, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, data, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		data += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int fflog_create(struct fflog_writer* writer, const char* path, const char* name, int fd, int n_effects,
+                 unsigned long long start_time)
+{
+	struct fflog_header header;
+	struct input_id id;
+	int err;
+
+	memset(writer, 0, sizeof(*writer));
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FFLOG_MAGIC, sizeof(header.magic));
+	header.header_size = sizeof(header);
+	header.effect_size = sizeof(struct ff_effect);
+	header.start_time = start_time;
+	strncpy(header.name, name, FFLOG_NAME_SIZE - 1);
+	header.n_effects = n_effects;
+	if (fd != -1) {
+		if (ioctl(fd, EVIOCGID, &id) == 0) {
+			header.bustype = id.bustype;
+			header.vendor = id.vendor;
+			header.product = id.product;
+			header.version = id.version;
+		}
+		ioctl(fd, EVIOCGEFFECTS, &header.n_effects);
+		ioctl(fd, EVIOCGBIT(EV_FF, sizeof(header.ff_bits)), header.ff_bits);
+	}
+
+	writer->buffer = malloc(FFLOG_BUFFER_SIZE);
+	if (!writer->buffer)
+		return -1;
+	writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if (writer->fd == -1 || write_all(writer->fd, (const unsigned char*)&header, sizeof(header)) == -1) {
+		err = errno;
+		if (writer->fd != -1)
+			close(writer->fd);
+		free(writer->buffer);
+		errno = err;
+		return -1;
+	}
+	writer->start_time = start_time;
+	writer->size = sizeof(header);
+
+	return 0;
+}
+
+int fflog_append(struct fflog_writer* writer, const struct ff_command* cmd)
+{
+	struct fflog_record record;
+	struct ff_effect effect;
+	size_t len = sizeof(record);
+
+	if (cmd->type == FF_CMD_UPLOAD)
+		len += sizeof(effect);
+	if (writer->buffer_used + len > FFLOG_BUFFER_SIZE && fflog_flush(writer) == -1)
+		return -1;
+
+	memset(&record, 0, sizeof(record));
+	record.time = (cmd->timestamp > writer->start_time ? cmd->timestamp - writer->start_time : 0);
+	record.type = cmd->type;
+	record.id = cmd->id;
+	record.value = cmd->value;
+	memcpy(writer->buffer + writer->buffer_used, &record, sizeof(record));
+
+	if (cmd->type == FF_CMD_UPLOAD) {
+		/* Custom waveforms point into the application's memory, they can't be replayed */
+		effect = cmd->effect;
+		if (effect.type == FF_PERIODIC)
+			effect.u.periodic.custom_data = NULL;
+		memcpy(writer->buffer + writer->buffer_used + sizeof(record), &effect, sizeof(effect));
+	}
+
+	writer->buffer_used += len;
+	writer->size += len;
+	writer->n_records++;
+	return 0;
+}
+
+int fflog_flush(struct fflog_writer* writer)
+{
+	if (!writer->buffer_used)
+		return 0;
+	if (write_all(writer->fd, writer->buffer, writer->buffer_used) == -1)
+		return -1;
+	writer->buffer_used = 0;
+	return 0;
+}
+
+int fflog_close(struct fflog_writer* writer)
+{
+	int ret = fflog_flush(writer);
+
+	if (close(writer->fd) == -1)
+		ret = -1;
+	free(writer->buffer);
+	return ret;
+}
+
+int fflog_open(struct fflog_reader* reader, const char* path)
+{
+	struct stat st;
+	void* map;
+	int err;
+
+	memset(reader, 0, sizeof(*reader));
+	reader->fd = open(path, O_RDONLY);
+	if (reader->fd == -1)
+		return -1;
+	if (fstat(reader->fd, &st) == -1)
+		goto error;
+	if ((size_t)st.st_size < sizeof(struct fflog_header)) {
+		errno = EINVAL;
+		goto error;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+	if (map == MAP_FAILED)
+		goto error;
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	reader->map = map;
+	reader->size = st.st_size;
+	reader->header = map;
+
+	if (memcmp(reader->header->magic, FFLOG_MAGIC, sizeof(reader->header->magic)) != 0 ||
+	    reader->header->header_size < sizeof(struct fflog_header) || reader->header->header_size > reader->size ||
+	    reader->header->effect_size != sizeof(struct ff_effect)) {
+		munmap(map, st.st_size);
+		errno = EINVAL;
+		goto error;
+	}
+	reader->pos = reader->header->header_size;
+
+	return 0;
+
+error:
+	err = errno;
+	close(reader->fd);
+	errno = err;
+	return -1;
+}
+
+int fflog_next(struct fflog_reader* reader, struct ff_command* cmd)
+{
+	struct fflog_record record;
+	size_t len, page_size, release_end;
+
+	if (reader->pos + sizeof(record) > reader->size)
+		return 0;
+	memcpy(&record, reader->map + reader->pos, sizeof(record));
+	if (record.type >= N_FF_CMD_TYPES)
+		return -1;
+
+	len = sizeof(record);
+	if (record.type == FF_CMD_UPLOAD)
+		len += sizeof(struct ff_effect);
+	if (reader->pos + len > reader->size)
+		return 0;   /* cut short while recording */
+
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->type = record.type;
+	cmd->id = record.id;
+	cmd->value = record.value;
+	cmd->timestamp = record.time;
+	if (record.type == FF_CMD_UPLOAD)
+		memcpy(&cmd->effect, reader->map + reader->pos + sizeof(record), sizeof(cmd->effect));
+	reader->pos += len;
+
+	/* Give the replayed pages back, the header stays mapped */
+	if (reader->pos - reader->released >= FFLOG_RELEASE_CHUNK) {
+		page_size = sysconf(_SC_PAGESIZE);
+		release_end = reader->pos / page_size * page_size;
+		if (!reader->released)
+			reader->released = page_size;
+		if (release_end > reader->released)
+			madvise((void*)(reader->map + reader->released), release_end - reader->released, MADV_DONTNEED);
+		reader->released = release_end;
+	}
+
+	return 1;
+}
+
+void fflog_close_reader(struct fflog_reader* reader)
+{
+	munmap((void*)reader->map, reader->size);
+	close(reader->fd);
+}
@@ -0,0 +1,109 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFLOG_H
+#define FFLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/input.h>
+
+#include "ffuinput.h"
+
+/*
+ * Binary log of force feedback commands, as recorded by ffrecord and replayed by ffreplay.
+ *
+ * The file is a header followed by records, appended in time order and never rewritten,
+ * so a log that was cut short (e.g. the recorder was killed) is still valid up to its last complete record.
+ * Every record is 16 bytes, uploads are followed by the uploaded struct ff_effect.
+ * Everything is stored in native byte order and layout, 'effect_size' guards against
+ * replaying a log on an architecture with a different struct ff_effect.
+ *
+ * Logs are read through mmap(), and pages that have been replayed are released again,
+ * so multi-hour logs don't have to fit in memory.
+ */
+
+#define FFLOG_MAGIC         "FFLOG01\n"
+#define FFLOG_NAME_SIZE     80
+
+struct fflog_header {
+	char magic[8];
+	uint32_t header_size;
+	uint32_t effect_size;               /* sizeof(struct ff_effect) of the recorder */
+	uint64_t start_time;                /* CLOCK_MONOTONIC time of the start of the recording, in nanoseconds */
+
+	/* The recorded device */
+	char name[FFLOG_NAME_SIZE];
+	uint16_t bustype, vendor, product, version;
+	int32_t n_effects;
+	uint8_t ff_bits[(FF_CNT + 7) / 8];
+	uint8_t reserved[12];
+};
+
+struct fflog_record {
+	uint64_t time;                      /* since the start of the recording, in nanoseconds */
+	uint16_t type;                      /* one of enum ff_command_type */
+	int16_t id;
+	int32_t value;
+};
+
+struct fflog_writer {
+	int fd;
+	unsigned long long start_time;
+	unsigned char* buffer;
+	size_t buffer_used;
+	unsigned long n_records;
+	unsigned long long size;            /* bytes written to the file so far, including the buffer */
+};
+
+struct fflog_reader {
+	int fd;
+	const unsigned char* map;
+	size_t size;
+	size_t pos;                         /* offset of the next record */
+	size_t released;                    /* pages below this offset have been released */
+	const struct fflog_header* header;
+};
+
+/*
+ * Create a log at 'path', describing the device opened as 'fd' (or a device with 'n_effects' effects if 'fd' is -1).
+ * Times of the appended commands are relative to 'start_time'. Returns 0 on success, -1 on error (errno is set).
+ */
+int fflog_create(struct fflog_writer* writer, const char* path, const char* name, int fd, int n_effects,
+                 unsigned long long start_time);
+
+/* Append a command, using its timestamp. Returns 0 on success, -1 on error (errno is set). */
+int fflog_append(struct fflog_writer* writer, const struct ff_command* cmd);
+
+/* Write the buffered records to the file */
+int fflog_flush(struct fflog_writer* writer);
+
+/* Flush and close the log */
+int fflog_close(struct fflog_writer* writer);
+
+/* Map the log at 'path' and check its header. Returns 0 on success, -1 on error (errno is set). */
+int fflog_open(struct fflog_reader* reader, const char* path);
+
+/*
+ * Read the next record into 'cmd', its timestamp is the time since the start of the recording.
+ * Returns 1 if a record was read, 0 at the end of the log, -1 if the rest of the log is corrupt.
+ */
+int fflog_next(struct fflog_reader* reader, struct ff_command* cmd);
+
+void fflog_close_reader(struct fflog_reader* reader);
+
+#endif /* FFLOG_H */
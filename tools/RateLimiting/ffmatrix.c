@@ -0,0 +1,220 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <linux/input.h>
+
+#include "ffeffects.h"
+#include "ffbench.h"
+#include "ffdiscover.h"
+
+/*
+ * Cost matrix of the effect types of a device: for each effect template it supports,
+ * the latency of uploading (updating) and of starting the effect, and the shortest sustainable update period.
+ * Drivers differ widely per effect type, e.g. when an effect is emulated on top of another one,
+ * or when a condition effect needs several output reports.
+ */
+
+/* Here are the interesting parameters' default values */
+const char* device_file_name = "auto";                    /* first force feedback device */
+unsigned long update_period = 2000;                       /*        2ms     */
+unsigned long choke_salvo_duration = 1000000;             /*    1 second    */
+int simultaneous_effects_amount = 1;
+int csv = 0;
+int emulate = 0;
+
+struct ffbench bench;
+
+/* Results of one effect template */
+struct matrix_row {
+	unsigned long long upload_p50, upload_p99;  /* in nanoseconds */
+	unsigned long long start_p50, start_p99;
+	unsigned long knee;                         /* shortest sustainable update period, in microseconds, 0 = none */
+	double update_rate, command_rate;           /* at that period */
+	int failed;
+};
+
+void make_scenario(int operation, int effect_idx, struct ffbench_scenario* scenario)
+{
+	ffbench_default_scenario(scenario, operation);
+	scenario->effect_idx = effect_idx;
+	scenario->n_effects = simultaneous_effects_amount;
+	scenario->update_period = update_period;
+	scenario->duration = choke_salvo_duration;
+	scenario->pacing = FFBENCH_ABSOLUTE;
+}
+
+void measure_effect(int effect_idx, struct matrix_row* row)
+{
+	struct ffbench_scenario scenario;
+	static struct ffbench_result result;
+
+	memset(row, 0, sizeof(*row));
+
+	/* Upload: update the parameters of the playing effects at update_period */
+	make_scenario(FFBENCH_UPDATE, effect_idx, &scenario);
+	if (ffbench_run(&bench, &scenario, &result) == -1 || result.n_errors) {
+		row->failed = 1;
+		return;
+	}
+	row->upload_p50 = ffhist_percentile(&result.upload_latency_hist, 0.50);
+	row->upload_p99 = ffhist_percentile(&result.upload_latency_hist, 0.99);
+
+	/* Start: restart the effects with unchanged parameters, i.e. without uploads */
+	make_scenario(FFBENCH_RESTART, effect_idx, &scenario);
+	scenario.change_params = 0;
+	if (ffbench_run(&bench, &scenario, &result) == -1 || result.n_errors) {
+		row->failed = 1;
+		return;
+	}
+	row->start_p50 = ffhist_percentile(&result.write_latency_hist, 0.50);
+	row->start_p99 = ffhist_percentile(&result.write_latency_hist, 0.99);
+
+	/* Sustainable rate of updates */
+	make_scenario(FFBENCH_UPDATE, effect_idx, &scenario);
+	row->knee = ffbench_find_knee(&bench, &scenario, &result);
+	if (row->knee && result.duration) {
+		row->update_rate = 1e6 * result.n_updates / result.duration;
+		row->command_rate = 1e6 * result.n_commands / result.duration;
+	}
+}
+
+void print_row(int effect_idx, const struct matrix_row* row)
+{
+	if (csv) {
+		printf("%d,%s,", effect_idx, effect_names[effect_idx]);
+		if (row->failed)
+			printf(",,,,,,\n");
+		else
+			printf("%.1f,%.1f,%.1f,%.1f,%lu,%.1f,%.1f\n", row->upload_p50 / 1e3, row->upload_p99 / 1e3,
+					row->start_p50 / 1e3, row->start_p99 / 1e3, row->knee, row->update_rate, row->command_rate);
+		fflush(stdout);
+		return;
+	}
+
+	printf("%2d %-24s ", effect_idx, effect_names[effect_idx]);
+	if (row->failed)
+		printf("%10s\n", "failed");
+	else if (!row->knee)
+		printf("%8.1fus %8.1fus %8.1fus %8.1fus %10s %10s %11s\n", row->upload_p50 / 1e3, row->upload_p99 / 1e3,
+				row->start_p50 / 1e3, row->start_p99 / 1e3, "-", "-", "-");
+	else
+		printf("%8.1fus %8.1fus %8.1fus %8.1fus %8luus %10.1f %11.1f\n", row->upload_p50 / 1e3, row->upload_p99 / 1e3,
+				row->start_p50 / 1e3, row->start_p99 / 1e3, row->knee, row->update_rate, row->command_rate);
+	fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+	struct ffdevsim_config config;
+	struct ffdiscover_device* devices;
+	struct matrix_row row;
+	char cache[PATH_MAX];
+	int i, j, n;
+
+	printf("Force feedback test program to measure the cost of each effect type.\n");
+	printf("HOLD FIRMLY YOUR WHEEL OR JOYSTICK TO PREVENT DAMAGES\n\n");
+
+	/* Show help message */
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--help", 64) == 0) {
+			printf("Usage: %s [--csv] [--emulate] [auto | /dev/input/eventXX \n", argv[0]);
+			printf("           \t\t[<update_period=%luus> \n", update_period);
+			printf("           \t\t[<choke_salvo_duration=%luus> \n", choke_salvo_duration);
+			printf("           \t\t[<simultaneous_effects_amount=%d> \n", simultaneous_effects_amount);
+			printf("           ]]] ]\n");
+			printf("For each effect type the device supports, reports the latency (p50 and p99) of uploading\n");
+			printf("(updating) the playing effects every 'update_period', and of restarting them without changes,\n");
+			printf("and the shortest sustainable update period (as 'ffchoke --sweep' finds it), with its rates.\n");
+			printf("Each measurement is a salvo of 'choke_salvo_duration', on absolute deadlines.\n\n");
+			printf("Effect types:\n");
+				for (j = 0; j < N_EFFECTS; ++j) printf("\t%d: %s\n", j, effect_names[j]);
+			printf("\n\t--csv:\t\t print the matrix as CSV, for plotting or comparing devices and kernels\n");
+			printf("\t--emulate:\t measure a virtual device (see ffemu) instead, e.g. to check the tool itself\n");
+			printf("\t'auto':\t\t use the first force feedback device (see 'ffchoke --devices')\n");
+			exit(1);
+		}
+	}
+
+	/* Strip the flags, the remaining arguments are positional */
+	for (i = 1, j = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--csv", 64) == 0)
+			csv = 1;
+		else if (strncmp(argv[i], "--emulate", 64) == 0)
+			emulate = 1;
+		else
+			argv[j++] = argv[i];
+	}
+	argc = j;
+
+	/* Parse cmd arguments and set parameters */
+	i=1; if (argc > i) device_file_name            = argv[i];
+	i++; if (argc > i) update_period               = strtoul(argv[i], NULL, 10);
+	i++; if (argc > i) choke_salvo_duration        = strtoul(argv[i], NULL, 10);
+	i++; if (argc > i) simultaneous_effects_amount = atoi(argv[i]);
+
+	/* Open device */
+	if (emulate) {
+		memset(&config, 0, sizeof(config));
+		config.name = "ffmatrix virtual device";
+		config.n_effects = 16;
+		config.service_period = 500;
+		config.queue_depth = 256;
+		config.overflow_policy = FFDEVSIM_DROP;
+		if (ffbench_open_emulated(&bench, &config) == -1) {
+			perror("Create virtual device");
+			exit(1);
+		}
+	} else {
+		if (strcmp(device_file_name, "auto") == 0) {
+			n = ffdiscover_scan(&devices, FFDISCOVER_DEFAULT_TIMEOUT, ffdiscover_default_cache(cache, sizeof(cache)));
+			if (n <= 0) {
+				printf("No force feedback device found.\n");
+				exit(1);
+			}
+			device_file_name = strdup(devices[0].path);
+			free(devices);
+		}
+		if (ffbench_open(&bench, device_file_name) == -1) {
+			perror("Open device file");
+			exit(1);
+		}
+	}
+	printf("Device %s opened, %d effect slots\n\n", bench.device, bench.slot_pool.n_slots);
+	if (simultaneous_effects_amount > bench.slot_pool.n_slots)
+		simultaneous_effects_amount = bench.slot_pool.n_slots;
+
+	if (csv)
+		printf("effect_type,effect,upload_p50_us,upload_p99_us,start_p50_us,start_p99_us,min_period_us,updates_per_s,commands_per_s\n");
+	else
+		printf("%2s %-24s %10s %10s %10s %10s %10s %10s %11s\n", "id", "effect", "upload p50", "upload p99",
+				"start p50", "start p99", "min_period", "updates/s", "commands/s");
+	for (i = 0; i < N_EFFECTS; i++) {
+		if (!effect_supported(i, bench.ff_features))
+			continue;
+		measure_effect(i, &row);
+		print_row(i, &row);
+	}
+	if (!csv)
+		printf("\n'-' means that even an update_period of %luus could not be sustained.\n", update_period);
+
+	ffbench_close(&bench);
+	exit(0);
+}
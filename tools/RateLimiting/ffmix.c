@@ -0,0 +1,184 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <linux/input.h>
+
+#include "ffeffects.h"
+#include "ffbench.h"
+#include "ffdiscover.h"
+
+/*
+ * Choke-test with the traffic of a game: each effect slot is updated at its own rate,
+ * e.g. a 1kHz constant force loop, 60Hz rumble, and spring and damper changes now and then.
+ * The achieved rate and lateness of each slot show whether high-rate slots starve low-rate ones.
+ */
+
+#define MAX_STREAMS 64
+
+/* Here are the interesting parameters' default values */
+const char* device_file_name = "auto";                    /* first force feedback device */
+unsigned long choke_salvo_duration = 10000000;            /*   10 seconds   */
+int realtime_priority = 0;                                /* no SCHED_FIFO  */
+unsigned long busy_spin_margin = 0;                       /*   never spin   */
+int emulate = 0;
+
+/* Default mix: force loop, rumble, and occasional condition changes */
+struct ffbench_stream streams[MAX_STREAMS] = {
+	/* effect  period  phase  jitter (us) */
+	{ 0,       1000,   0,     0      },     /* Constant Force at 1kHz */
+	{ 3,       16667,  0,     0      },     /* Strong and Weak Rumble at 60Hz */
+	{ 2,       100000, 3000,  50000  },     /* Spring Condition at ~10Hz */
+	{ 10,      250000, 7000,  100000 },     /* Damper Condition at ~4Hz */
+};
+int n_streams = 4;
+
+struct ffbench bench;
+
+/* Parse "effect_type:period[:phase[:jitter]]", in microseconds */
+int parse_stream(const char* spec, struct ffbench_stream* stream)
+{
+	memset(stream, 0, sizeof(*stream));
+	if (sscanf(spec, "%d:%lu:%lu:%lu", &stream->effect_idx, &stream->period, &stream->phase, &stream->jitter) < 2)
+		return -1;
+	if (stream->effect_idx < 0 || stream->effect_idx >= N_EFFECTS || !stream->period)
+		return -1;
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	struct ffdevsim_config config;
+	struct ffdiscover_device* devices;
+	struct ffbench_scenario scenario;
+	static struct ffbench_result result;
+	char cache[PATH_MAX];
+	int i, j, n;
+
+	printf("Force feedback test program to choke the device with a mix of update rates.\n");
+	printf("HOLD FIRMLY YOUR WHEEL OR JOYSTICK TO PREVENT DAMAGES\n\n");
+
+	/* Show help message */
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--help", 64) == 0) {
+			printf("Usage: %s [--emulate] [auto | /dev/input/eventXX \n", argv[0]);
+			printf("           \t\t[<choke_salvo_duration=%luus> \n", choke_salvo_duration);
+			printf("           \t\t[<realtime_priority=%d> \n", realtime_priority);
+			printf("           \t\t[<busy_spin_margin=%luus> \n", busy_spin_margin);
+			printf("           \t\t[<effect_type:period[:phase[:jitter]]> ...\n");
+			printf("           ]]]] ]\n");
+			printf("Starts an effect in a slot per stream, and updates each of them at its own period (in microseconds),\n");
+			printf("from a single thread on absolute deadlines: deadline n of a stream is 'phase + n * period'\n");
+			printf("after the start, delayed by a random amount up to 'jitter'.\n");
+			printf("Reports per slot the achieved rate, the lateness of the updates after their deadline\n");
+			printf("(missed: the deadline had already passed when the thread got to it, skipped: dropped to catch up),\n");
+			printf("and the upload latency of the slot, to see whether high-rate slots starve low-rate ones.\n\n");
+			printf("Default mix:\n");
+				for (j = 0; j < n_streams; ++j)
+					printf("\t%d:%lu:%lu:%lu\t(%s every %luus)\n", streams[j].effect_idx, streams[j].period,
+							streams[j].phase, streams[j].jitter, effect_names[streams[j].effect_idx], streams[j].period);
+			printf("Effect types:\n");
+				for (j = 0; j < N_EFFECTS; ++j) printf("\t%d: %s\n", j, effect_names[j]);
+			printf("\n\trealtime_priority:\t if not '0', run with SCHED_FIFO at this priority (1-99, needs root)\n");
+			printf("\tbusy_spin_margin:\t busy-wait instead of sleeping during the last microseconds before each deadline\n");
+			printf("\t--emulate:\t choke a virtual device (see ffemu) instead, which also measures the lag of a final effect\n");
+			printf("\t'auto':\t\t use the first force feedback device (see 'ffchoke --devices')\n");
+			exit(1);
+		}
+	}
+
+	/* Strip the flags, the remaining arguments are positional */
+	for (i = 1, j = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--emulate", 64) == 0)
+			emulate = 1;
+		else
+			argv[j++] = argv[i];
+	}
+	argc = j;
+
+	/* Parse cmd arguments and set parameters */
+	i=1; if (argc > i) device_file_name     = argv[i];
+	i++; if (argc > i) choke_salvo_duration = strtoul(argv[i], NULL, 10);
+	i++; if (argc > i) realtime_priority    = atoi(argv[i]);
+	i++; if (argc > i) busy_spin_margin     = strtoul(argv[i], NULL, 10);
+	i++; if (argc > i) {
+		if (argc - i > MAX_STREAMS) {
+			printf("At most %d streams.\n", MAX_STREAMS);
+			exit(1);
+		}
+		for (n_streams = 0; i < argc; i++, n_streams++) {
+			if (parse_stream(argv[i], &streams[n_streams]) == -1) {
+				printf("Invalid stream '%s', expected effect_type:period[:phase[:jitter]].\n", argv[i]);
+				exit(1);
+			}
+		}
+	}
+
+	/* Open device */
+	if (emulate) {
+		memset(&config, 0, sizeof(config));
+		config.name = "ffmix virtual device";
+		config.n_effects = 16;
+		config.service_period = 100;
+		config.queue_depth = 256;
+		config.overflow_policy = FFDEVSIM_DROP;
+		if (ffbench_open_emulated(&bench, &config) == -1) {
+			perror("Create virtual device");
+			exit(1);
+		}
+	} else {
+		if (strcmp(device_file_name, "auto") == 0) {
+			n = ffdiscover_scan(&devices, FFDISCOVER_DEFAULT_TIMEOUT, ffdiscover_default_cache(cache, sizeof(cache)));
+			if (n <= 0) {
+				printf("No force feedback device found.\n");
+				exit(1);
+			}
+			device_file_name = strdup(devices[0].path);
+			free(devices);
+		}
+		if (ffbench_open(&bench, device_file_name) == -1) {
+			perror("Open device file");
+			exit(1);
+		}
+	}
+	printf("Device %s opened, %d effect slots\n\n", bench.device, bench.slot_pool.n_slots);
+
+	ffbench_default_scenario(&scenario, FFBENCH_MIX);
+	scenario.streams = streams;
+	scenario.n_effects = n_streams;
+	scenario.duration = choke_salvo_duration;
+	scenario.effect_duration = 0;       /* infinite */
+	scenario.pacing = FFBENCH_ABSOLUTE;
+	scenario.realtime_priority = realtime_priority;
+	scenario.spin_margin = busy_spin_margin;
+	scenario.verbose = 1;
+	if (ffbench_run(&bench, &scenario, &result) == -1) {
+		if (errno == EOPNOTSUPP)
+			printf("The device doesn't support all effect types of the mix, or has less than %d slots.\n", n_streams);
+		else
+			perror("Choke-test");
+		ffbench_close(&bench);
+		exit(1);
+	}
+
+	ffbench_close(&bench);
+	exit(result.n_errors ? 1 : 0);
+}
@@ -0,0 +1,664 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <linux/input.h>
+
+#include "ffeffects.h"
+#include "ffhist.h"
+#include "ffslots.h"
+#include "ffdiscover.h"
+
+/*
+ * Multi-device choke runner: choke several devices (e.g. a wheel, pedals and a rumble seat) at the same time,
+ * each from its own worker thread pinned to its own CPU, to see whether the devices share a bottleneck
+ * (USB hub or host controller, HID core, input core) and how the aggregate command rate scales.
+ *
+ * Each worker waits on an epoll set with a timerfd for its ticks and the device itself,
+ * of which it drains the input events. Workers only touch their own statistics,
+ * which are merged once all workers finished.
+ *
+ * The same event node can be given several times, each with its own update period:
+ * every worker opens its own file descriptor, like a game and a telemetry tool sharing a wheel.
+ * This shows whether the rate limiting is per device or per client, and whether a greedy client starves the others.
+ */
+
+#define min( a, b )    ( ( (a) < (b)) ? (a) : (b) )
+
+/* Here are the interesting parameters' default values */
+int option = 1;                                           /* update an effect */
+unsigned long update_period = 2000;                       /*       2ms      */
+int simultaneous_effects_amount = 1;
+unsigned long choke_salvo_duration = 2000000;             /*    2 seconds   */
+int effect_type = 0;                                      /* Constant Force */
+/* Corresponding extended cmd-line: "./ffmulti 1 2000us 1 2000000us 0 /dev/input/event0 ..." */
+
+unsigned long safe_update_period = 50000; /* Used when we're not yet performing the choke test: 50ms */
+
+#define MAX_DEVICES 32
+
+unsigned long long get_ntime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+/* Test the bit with given index=offset in an unsigned char array */
+#define testBit(bit, array)    ((array[(bit) / 8] >> ((bit) % 8)) & 1)
+
+
+
+struct worker {
+	/* Set up by the main thread */
+	const char* device_file_name;
+	unsigned long update_period;        /* in microseconds */
+	char name[64];
+	int fd;
+	int cpu;
+	int effect_idx;                     /* effect used on this device, -1 for options 3 and 4 */
+	int n_effects;                      /* simultaneous effects used on this device */
+	struct ffslots slot_pool;
+	int* slots;
+	struct ff_effect* effect_slots;
+	pthread_t thread;
+
+	/* Results, only written by the worker thread itself */
+	int setup_failed;
+	unsigned long n_ticks;
+	unsigned long n_missed;             /* ticks that passed while the worker was still busy */
+	unsigned long n_commands;
+	unsigned long n_errors;
+	unsigned long n_input_events;
+	unsigned long n_stalls;             /* gaps between successful commands longer than STALL_PERIODS ticks */
+	unsigned long long max_gap;         /* longest gap between successful commands, in nanoseconds */
+	unsigned long long last_ok_time;
+	unsigned long long duration;        /* in nanoseconds */
+	struct ffhist latency_hist;         /* per syscall, in nanoseconds */
+};
+
+/* A client is starved while it can't get a command through during this many of its update periods */
+#define STALL_PERIODS 10
+
+struct worker* workers[MAX_DEVICES];
+int n_workers;
+
+/* All workers start choking at the same time */
+pthread_barrier_t start_barrier;
+
+/* Drain the input events of the device, the evdev buffer would overflow otherwise */
+void drain_input(struct worker* w)
+{
+	struct input_event events[64];
+	ssize_t n;
+
+	while ((n = read(w->fd, events, sizeof(events))) > 0)
+		w->n_input_events += n / sizeof(events[0]);
+}
+
+/* Upload and start the effects of option 1 and 2, outside of the measurement */
+int setup_effects(struct worker* w)
+{
+	struct input_event ie;
+	int i;
+
+	memset(&ie, 0, sizeof(ie));
+	ie.type = EV_FF;
+	ie.value = 1;
+	for (i = 0; i < w->n_effects; i++) {
+		w->slots[i] = ffslots_alloc(&w->slot_pool);
+		memcpy(&w->effect_slots[i], &effects[w->effect_idx], sizeof(effects[w->effect_idx]));
+		w->effect_slots[i].replay.length = 0;       /* infinite */
+		set_effect_parameters(&w->effect_slots[i], w->effect_idx, 0);
+		if (ffslots_upload(&w->slot_pool, w->slots[i], &w->effect_slots[i]) < 0)
+			return -1;
+		usleep(safe_update_period);
+
+		ie.code = w->effect_slots[i].id;
+		if (write(w->fd, &ie, sizeof(ie)) < 0)
+			return -1;
+		usleep(safe_update_period);
+	}
+	return 0;
+}
+
+void teardown_effects(struct worker* w)
+{
+	struct input_event ie;
+	int i;
+
+	memset(&ie, 0, sizeof(ie));
+	ie.type = EV_FF;
+	for (i = 0; i < w->n_effects; i++) {
+		if (w->slots[i] == -1)
+			continue;
+		ie.code = w->effect_slots[i].id;
+		if (w->effect_slots[i].id >= 0 && write(w->fd, &ie, sizeof(ie)) < 0)
+			perror("Stop effect error");
+		if (ffslots_release(&w->slot_pool, w->slots[i]) < 0)
+			perror("Remove effect error");
+		w->slots[i] = -1;
+		usleep(safe_update_period);
+	}
+}
+
+/* Send the commands of one tick, the scenarios are the options of ffchoke */
+void choke_tick(struct worker* w, unsigned long progress_counter)
+{
+	struct input_event ie;
+	unsigned long long start, end;
+	int i, ret;
+
+	memset(&ie, 0, sizeof(ie));
+	ie.type = EV_FF;
+
+	for (i = 0; i < (option <= 2 ? w->n_effects : 1); i++) {
+		start = get_ntime();
+		switch (option) {
+		case 1:
+			set_effect_parameters(&w->effect_slots[i], w->effect_idx, progress_counter);
+			ret = ffslots_upload(&w->slot_pool, w->slots[i], &w->effect_slots[i]);
+			break;
+		case 2:
+			ie.code = w->effect_slots[i].id;
+			ie.value = 1;
+			ret = write(w->fd, &ie, sizeof(ie));
+			break;
+		default:
+			ie.code = (option == 3 ? FF_GAIN : FF_AUTOCENTER);
+			ie.value = 0xFFFF - progress_counter;
+			ret = write(w->fd, &ie, sizeof(ie));
+			break;
+		}
+		end = get_ntime();
+		ffhist_add(&w->latency_hist, end - start);
+		w->n_commands++;
+		if (ret < 0) {
+			w->n_errors++;
+			continue;
+		}
+
+		/* Between completions, so time blocked in a syscall counts as a gap too */
+		if (end - w->last_ok_time > w->max_gap)
+			w->max_gap = end - w->last_ok_time;
+		if (end - w->last_ok_time > STALL_PERIODS * 1000ull * w->update_period)
+			w->n_stalls++;
+		w->last_ok_time = end;
+	}
+}
+
+void* worker_thread(void* arg)
+{
+	struct worker* w = arg;
+	struct epoll_event event, ready[2];
+	struct itimerspec timer;
+	cpu_set_t cpus;
+	unsigned long long start, now, deadline, expirations;
+	unsigned long long salvo_duration = 1000ull * choke_salvo_duration;
+	int timer_fd, epoll_fd, n_ready, i;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(w->cpu, &cpus);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+		fprintf(stderr, "Warning: could not pin the worker of %s to CPU %d\n", w->device_file_name, w->cpu);
+
+	w->n_ticks = w->n_missed = w->n_commands = w->n_errors = w->n_input_events = w->n_stalls = 0;
+	w->duration = w->max_gap = 0;
+	ffhist_reset(&w->latency_hist);
+
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	epoll_fd = epoll_create1(0);
+	w->setup_failed = (timer_fd == -1 || epoll_fd == -1);
+	if (!w->setup_failed) {
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.fd = timer_fd;
+		w->setup_failed |= (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event) == -1);
+		event.data.fd = w->fd;
+		w->setup_failed |= (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, w->fd, &event) == -1);
+	}
+	if (!w->setup_failed && option <= 2)
+		w->setup_failed = (setup_effects(w) == -1);
+	if (w->setup_failed)
+		perror(w->device_file_name);
+
+	pthread_barrier_wait(&start_barrier);
+
+	if (w->setup_failed)
+		goto out;
+
+	/* Ticks on absolute deadlines, starting one period from now */
+	start = get_ntime();
+	w->last_ok_time = start;
+	deadline = start + 1000ull * w->update_period;
+	memset(&timer, 0, sizeof(timer));
+	timer.it_value.tv_sec = deadline / 1000000000ull;
+	timer.it_value.tv_nsec = deadline % 1000000000ull;
+	timer.it_interval.tv_sec = w->update_period / 1000000;
+	timer.it_interval.tv_nsec = 1000ull * (w->update_period % 1000000);
+	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &timer, NULL) == -1) {
+		perror("Set timer");
+		w->setup_failed = 1;
+		goto out;
+	}
+
+	now = start;
+	while (now - start < salvo_duration) {
+		n_ready = epoll_wait(epoll_fd, ready, 2, -1);
+		if (n_ready < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("Worker poll error");
+			break;
+		}
+		now = get_ntime();
+		for (i = 0; i < n_ready; i++) {
+			if (ready[i].data.fd == w->fd) {
+				drain_input(w);
+				continue;
+			}
+			if (read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+				continue;
+			/* Ticks that expired meanwhile are missed, not caught up on */
+			w->n_missed += expirations - 1;
+			w->n_ticks++;
+			choke_tick(w, min(0xFFFFull, 0xFFFFull * (now - start) / salvo_duration));
+		}
+	}
+	w->duration = get_ntime() - start;
+	if (w->duration - (w->last_ok_time - start) > w->max_gap)
+		w->max_gap = w->duration - (w->last_ok_time - start);
+
+out:
+	if (option <= 2)
+		teardown_effects(w);
+	if (epoll_fd != -1)
+		close(epoll_fd);
+	if (timer_fd != -1)
+		close(timer_fd);
+	return NULL;
+}
+
+
+
+/* Open a device, and choose its effect. Returns NULL if it can't be used for the chosen option. */
+struct worker* create_worker(const char* device_file_name, unsigned long period, int cpu)
+{
+	unsigned char ff_bits[1 + FF_MAX / 8];
+	struct worker* w;
+	int i;
+
+	/* Separate cache lines for each worker, as they are written at every tick */
+	w = aligned_alloc(64, (sizeof(*w) + 63) / 64 * 64);
+	if (!w) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+	memset(w, 0, sizeof(*w));
+	w->device_file_name = device_file_name;
+	w->update_period = period;
+	w->cpu = cpu;
+	w->effect_idx = -1;
+
+	w->fd = open(device_file_name, O_RDWR | O_NONBLOCK);
+	if (w->fd == -1) {
+		perror(device_file_name);
+		free(w);
+		return NULL;
+	}
+	if (ioctl(w->fd, EVIOCGNAME(sizeof(w->name)), w->name) < 0)
+		strcpy(w->name, "Unknown");
+	memset(ff_bits, 0, sizeof(ff_bits));
+	if (ioctl(w->fd, EVIOCGBIT(EV_FF, sizeof(ff_bits)), ff_bits) < 0 ||
+	    ffslots_init(&w->slot_pool, w->fd, 0) == -1) {
+		perror(device_file_name);
+		goto error;
+	}
+
+	if (option == 1 || option == 2) {
+		/* The chosen effect_type if supported, otherwise the first one the device supports (e.g. rumble) */
+		if (effect_supported(effect_type, ff_bits))
+			w->effect_idx = effect_type;
+		for (i = 0; i < N_EFFECTS && w->effect_idx == -1; i++) {
+			if (effect_supported(i, ff_bits))
+				w->effect_idx = i;
+		}
+		w->n_effects = min(simultaneous_effects_amount, w->slot_pool.n_slots);
+		if (w->effect_idx == -1 || w->n_effects < 1) {
+			printf("Skipping %s (%s): no supported effect\n", device_file_name, w->name);
+			goto error;
+		}
+		w->slots = calloc(w->n_effects, sizeof(*w->slots));
+		w->effect_slots = calloc(w->n_effects, sizeof(*w->effect_slots));
+		if (!w->slots || !w->effect_slots) {
+			printf("Out of memory\n");
+			exit(1);
+		}
+		for (i = 0; i < w->n_effects; i++)
+			w->slots[i] = -1;
+	}
+	else if (!testBit(option == 3 ? FF_GAIN : FF_AUTOCENTER, ff_bits)) {
+		printf("Skipping %s (%s): setting %s is not supported\n", device_file_name, w->name,
+				option == 3 ? "gain" : "autocenter");
+		goto error;
+	}
+
+	return w;
+
+error:
+	ffslots_free(&w->slot_pool);
+	close(w->fd);
+	free(w);
+	return NULL;
+}
+
+void destroy_worker(struct worker* w)
+{
+	ffslots_free(&w->slot_pool);
+	close(w->fd);
+	free(w->slots);
+	free(w->effect_slots);
+	free(w);
+}
+
+/* Event nodes of all devices with force feedback, in 'names' (to be freed) */
+int discover_devices(char** names, int max_devices)
+{
+	struct ffdiscover_device* devices;
+	char cache[PATH_MAX];
+	int i, n;
+
+	n = ffdiscover_scan(&devices, FFDISCOVER_DEFAULT_TIMEOUT, ffdiscover_default_cache(cache, sizeof(cache)));
+	if (n < 0) {
+		perror("Scan /dev/input");
+		return 0;
+	}
+	ffdiscover_print(devices, n, 0);
+	n = min(n, max_devices);
+	for (i = 0; i < n; i++)
+		names[i] = strdup(devices[i].path);
+	free(devices);
+	return n;
+}
+
+
+
+/* Choke the first 'n' workers in parallel, and report their results. Returns the aggregate command rate. */
+double run_parallel(struct worker** run_workers, int n, int verbose)
+{
+	struct ffhist total_latency_hist;
+	unsigned long total_commands = 0;
+	double rate, target_rate, share, total_rate = 0, share_sum = 0, share_sum_sq = 0;
+	struct worker* w;
+	int i, n_shares = 0;
+
+	pthread_barrier_init(&start_barrier, NULL, n);
+	for (i = 0; i < n; i++) {
+		if (pthread_create(&run_workers[i]->thread, NULL, worker_thread, run_workers[i]) != 0) {
+			printf("Could not create worker thread\n");
+			exit(1);
+		}
+	}
+	for (i = 0; i < n; i++)
+		pthread_join(run_workers[i]->thread, NULL);
+	pthread_barrier_destroy(&start_barrier);
+
+	/* Merge the statistics of the workers, now that they're done */
+	ffhist_reset(&total_latency_hist);
+	if (verbose)
+		printf("  %-18s %-20s %3s %8s %11s %6s %7s %7s %9s %9s %9s %9s %6s\n",
+				"device", "name", "cpu", "period", "commands/s", "target", "missed", "errors",
+				"p50", "p99", "p99.9", "max gap", "stalls");
+	for (i = 0; i < n; i++) {
+		w = run_workers[i];
+		rate = (w->duration ? 1e9 * w->n_commands / w->duration : 0);
+		target_rate = 1e6 / w->update_period * (option <= 2 ? w->n_effects : 1);
+		total_rate += rate;
+		total_commands += w->n_commands;
+		ffhist_merge(&total_latency_hist, &w->latency_hist);
+		if (!w->setup_failed) {
+			/* Successful commands, relative to what the client asked for */
+			share = (w->duration ? 1e9 * (w->n_commands - w->n_errors) / w->duration : 0) / target_rate;
+			share_sum += share;
+			share_sum_sq += share * share;
+			n_shares++;
+		}
+		if (!verbose)
+			continue;
+		if (w->setup_failed) {
+			printf("  %-18s %-20.20s %3d %6luus   setup failed\n",
+					w->device_file_name, w->name, w->cpu, w->update_period);
+			continue;
+		}
+		printf("  %-18s %-20.20s %3d %6luus %11.1f %5.0f%% %7lu %7lu %7lluus %7lluus %7lluus %7llums %6lu\n",
+				w->device_file_name, w->name, w->cpu, w->update_period, rate, 100 * rate / target_rate,
+				w->n_missed, w->n_errors,
+				ffhist_percentile(&w->latency_hist, 0.50) / 1000,
+				ffhist_percentile(&w->latency_hist, 0.99) / 1000,
+				ffhist_percentile(&w->latency_hist, 0.999) / 1000,
+				w->max_gap / 1000000, w->n_stalls);
+	}
+	if (verbose && total_commands) {
+		printf("  Aggregate: %.1f commands/s\n", total_rate);
+		/* Jain's index: 1 if all clients got the same fraction of what they asked for, 1/n if one got everything */
+		if (n_shares > 1 && share_sum_sq > 0)
+			printf("  Fairness (Jain's index of the achieved/target ratios): %.3f\n",
+					share_sum * share_sum / (n_shares * share_sum_sq));
+		ffhist_print(&total_latency_hist, "  All syscalls");
+	}
+
+	return total_rate;
+}
+
+/*
+ * Choke each device alone, then the first 2, 3, ... devices together,
+ * and report how the rate and latency of each device degrade compared to running alone.
+ */
+void run_scaling()
+{
+	double alone_rate[MAX_DEVICES], alone_p99[MAX_DEVICES], total_rate;
+	struct worker* w;
+	int i, n;
+
+	printf("Each device alone:\n");
+	for (i = 0; i < n_workers; i++) {
+		run_parallel(&workers[i], 1, 1);
+		w = workers[i];
+		alone_rate[i] = (w->duration ? 1e9 * w->n_commands / w->duration : 0);
+		alone_p99[i] = ffhist_percentile(&w->latency_hist, 0.99);
+	}
+
+	printf("\n%8s %16s %16s %22s %22s\n",
+			"devices", "aggregate cmd/s", "ideal cmd/s", "worst rate vs alone", "worst p99 vs alone");
+	for (n = 1; n <= n_workers; n++) {
+		double ideal = 0, worst_rate = 1, worst_p99 = 1, ratio;
+
+		total_rate = run_parallel(workers, n, 0);
+		for (i = 0; i < n; i++) {
+			w = workers[i];
+			ideal += alone_rate[i];
+			if (alone_rate[i] > 0) {
+				ratio = (w->duration ? 1e9 * w->n_commands / w->duration : 0) / alone_rate[i];
+				if (ratio < worst_rate)
+					worst_rate = ratio;
+			}
+			if (alone_p99[i] > 0) {
+				ratio = ffhist_percentile(&w->latency_hist, 0.99) / alone_p99[i];
+				if (ratio > worst_p99)
+					worst_p99 = ratio;
+			}
+		}
+		printf("%8d %16.1f %16.1f %21.0f%% %21.1fx\n", n, total_rate, ideal, 100 * worst_rate, worst_p99);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	char* device_file_names[MAX_DEVICES];
+	unsigned long periods[MAX_DEVICES];
+	char* at;
+	int n_devices = 0, auto_discover = 0, scaling = 0;
+	long n_cpus;
+	int i, j;
+
+	printf("Force feedback test program to choke several devices in parallel.\n");
+	printf("HOLD FIRMLY YOUR WHEEL OR JOYSTICK TO PREVENT DAMAGES\n\n");
+
+	/* Show help message */
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--help", 64) == 0) {
+			printf("Usage: %s [--scale] [<option=%d> \n", argv[0], option);
+			printf("           \t\t[<update_period=%luus> \n", update_period);
+			printf("           \t\t[<simultaneous_effects_amount=%d> \n", simultaneous_effects_amount);
+			printf("           \t\t[<choke_salvo_duration=%luus> \n", choke_salvo_duration);
+			printf("           \t\t[<effect_type=%d> \n", effect_type);
+			printf("           ]]]]] (--auto | /dev/input/eventXX[@update_period] [/dev/input/eventYY[@update_period] ...])\n");
+			printf("Chokes all given devices at the same time, each from a worker thread pinned to its own CPU,\n");
+			printf("and reports the command rate and syscall latency of each device, and the aggregate rate.\n\n");
+
+			printf("Additional details on some parameters:\n");
+			printf("\toption:\t the choke-test to run on each device, as in ffchoke:\n");
+				printf("\t\t1: start an effect once, and repeatedly update it\n");
+				printf("\t\t2: repeatedly start an effect\n");
+				printf("\t\t3: repeatedly set the gain\n");
+				printf("\t\t4: repeatedly set the autocenter\n");
+			printf("\tupdate_period:\t (to choke), in microseconds\n");
+			printf("\tsimultaneous_effects_amount:\t effects per device, all sent at each update\n");
+			printf("\tchoke_salvo_duration:\t in microseconds\n");
+			printf("\teffect_type:\t the type id of an effect, should be one of the following:\n");
+				for (j=0; j<N_EFFECTS; ++j) printf("\t\t%d: %s\n", j, effect_names[j]);
+				printf("\t\tdevices that don't support it use the first effect type they support\n");
+			printf("\t--auto:\t use all devices with force feedback, instead of the given event nodes\n");
+			printf("\tevent nodes:\t each one is choked by its own client, with its own file descriptor;\n");
+				printf("\t\tgive the same event node several times to let clients compete for one device,\n");
+				printf("\t\tand append '@<update_period>' (in microseconds) to give a client its own rate;\n");
+				printf("\t\teach client reports the longest gap between its successful commands,\n");
+				printf("\t\tand how often it got none through during %d of its update periods (stalls)\n", STALL_PERIODS);
+			printf("\t--scale:\t first choke each device alone, then the first 2, 3, ... devices together,\n");
+				printf("\t\tand report how the aggregate rate scales, and the worst degradation of a device\n");
+				printf("\t\tcompared to running alone (a shared bottleneck shows up as a rate drop or latency rise)\n\n");
+
+			printf("Example (extended) usage: '%s %d %luus %d %luus %d /dev/input/event0 /dev/input/event1'\n",
+					argv[0], option, update_period, simultaneous_effects_amount, choke_salvo_duration, effect_type);
+				printf("\t(this corresponds to the default parameters)\n");
+
+			exit(1);
+		}
+	}
+
+	/* Strip the flags and event nodes, the remaining arguments are positional */
+	for (i = 1, j = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--auto", 64) == 0)
+			auto_discover = 1;
+		else if (strncmp(argv[i], "--scale", 64) == 0)
+			scaling = 1;
+		else if (strchr(argv[i], '/')) {
+			if (n_devices == MAX_DEVICES)
+				continue;
+			/* Optional update_period of this client, e.g. "/dev/input/event5@500" */
+			at = strrchr(argv[i], '@');
+			periods[n_devices] = 0;
+			if (at) {
+				*at = '\0';
+				periods[n_devices] = atoi(at + 1);
+			}
+			device_file_names[n_devices++] = argv[i];
+		}
+		else
+			argv[j++] = argv[i];
+	}
+	argc = j;
+
+	/* Parse cmd arguments and set parameters */
+	i=1; if (argc > i) option                      = atoi(argv[i]);
+	i++; if (argc > i) update_period               = atoi(argv[i]);
+	i++; if (argc > i) simultaneous_effects_amount = atoi(argv[i]);
+	i++; if (argc > i) choke_salvo_duration        = atoi(argv[i]);
+	i++; if (argc > i) effect_type                 = atoi(argv[i]);
+
+	if (!(option >= 1 && option <= 4)) {
+		printf("Invalid option.\n");
+		exit(1);
+	}
+	if (!(effect_type >= 0 && effect_type < N_EFFECTS)) {
+		printf("Invalid effect_type.\n");
+		exit(1);
+	}
+	if (!update_period) {
+		printf("Invalid update_period.\n");
+		exit(1);
+	}
+
+	if (auto_discover) {
+		n_devices = discover_devices(device_file_names, MAX_DEVICES);
+		memset(periods, 0, sizeof(periods));
+	}
+	if (!n_devices) {
+		printf("No devices, pass event nodes or --auto.\n");
+		exit(1);
+	}
+
+	init_effects();
+
+	n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n_cpus < 1)
+		n_cpus = 1;
+	if (n_devices > n_cpus)
+		printf("Warning: more devices than CPUs, some workers will share a CPU.\n");
+	for (i = 0; i < n_devices; i++) {
+		workers[n_workers] = create_worker(device_file_names[i], periods[i] ? periods[i] : update_period,
+		                                   n_workers % n_cpus);
+		if (workers[n_workers])
+			n_workers++;
+	}
+	/* Before the workers start: a step of the parameter trajectory per update */
+	for (i = 0; i < n_workers; i++) {
+		if (workers[i]->effect_idx >= 0)
+			prepare_effect_trajectory(workers[i]->effect_idx, choke_salvo_duration / workers[i]->update_period);
+	}
+	if (!n_workers) {
+		printf("None of the devices can be used.\n");
+		exit(1);
+	}
+
+	printf("Choking %d device(s), option %d, update_period %luus, during %.3f second(s)\n\n",
+			n_workers, option, update_period, choke_salvo_duration / 1e6);
+	if (scaling) {
+		run_scaling();
+	} else {
+		printf("All devices in parallel:\n");
+		run_parallel(workers, n_workers, 1);
+	}
+
+	for (i = 0; i < n_workers; i++)
+		destroy_worker(workers[i]);
+
+	exit(0);
+}
@@ -0,0 +1,283 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "ffpace.h"
+
+/* Updates per window when looking for a growing latency */
+#define WINDOW_LENGTH       8
+/* The baseline latency follows a higher latency this slowly, so it recovers after e.g. a change of device load */
+#define BASELINE_DRIFT      (1.0 / 1024)
+#define SMOOTHING           (1.0 / 8)
+
+static unsigned long long get_ntime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+void ffpace_default_config(struct ffpace_config* config)
+{
+	config->min_period = 0;
+	config->max_period = 100000;        /* 100ms */
+	config->initial_period = 20000;     /* 20ms */
+	config->increase = 100.0;
+	config->decrease = 0.5;
+	config->latency_ratio = 2.0;
+	config->latency_margin = 50;
+	config->trend_windows = 3;
+}
+
+int ffpace_init(struct ffpace* pace, int fd, int n_slots, const struct ffpace_config* config,
+                ffpace_sent_callback sent, void* sent_data)
+{
+	memset(pace, 0, sizeof(*pace));
+	pace->fd = fd;
+	pace->config = *config;
+	pace->n_slots = n_slots;
+	pace->slots = calloc(n_slots ? n_slots : 1, sizeof(*pace->slots));
+	if (!pace->slots)
+		return -1;
+	pace->sent = sent;
+	pace->sent_data = sent_data;
+
+	pace->max_rate = (config->min_period ? 1e6 / config->min_period : 1e9);
+	pace->min_rate = 1e6 / config->max_period;
+	pace->rate = 1e6 / config->initial_period;
+	if (pace->rate > pace->max_rate)
+		pace->rate = pace->max_rate;
+	pace->lowest_rate = pace->highest_rate = pace->rate;
+	pace->next_send_time = get_ntime();
+	pace->holdoff = WINDOW_LENGTH;
+	ffhist_reset(&pace->latency_hist);
+	ffhist_reset(&pace->staleness_hist);
+	return 0;
+}
+
+void ffpace_free(struct ffpace* pace)
+{
+	free(pace->slots);
+	pace->slots = NULL;
+}
+
+/* A new change is pending, 'was_pending' if it replaces one that wasn't sent yet */
+static void add_pending(struct ffpace* pace, int was_pending, unsigned long long now)
+{
+	if (was_pending) {
+		pace->n_coalesced++;
+		return;
+	}
+	if (!pace->n_pending)
+		pace->pending_since = now;
+	pace->n_pending++;
+}
+
+void ffpace_upload(struct ffpace* pace, int slot, const struct ff_effect* effect, unsigned long long now)
+{
+	add_pending(pace, pace->slots[slot].upload_pending, now);
+	pace->slots[slot].effect = *effect;
+	pace->slots[slot].upload_pending = 1;
+}
+
+void ffpace_play(struct ffpace* pace, int slot, int value, unsigned long long now)
+{
+	add_pending(pace, pace->slots[slot].play_pending, now);
+	pace->slots[slot].play_value = value;
+	pace->slots[slot].play_pending = 1;
+}
+
+void ffpace_set_gain(struct ffpace* pace, int gain, unsigned long long now)
+{
+	add_pending(pace, pace->gain_pending, now);
+	pace->gain = gain;
+	pace->gain_pending = 1;
+}
+
+void ffpace_set_autocenter(struct ffpace* pace, int autocenter, unsigned long long now)
+{
+	add_pending(pace, pace->autocenter_pending, now);
+	pace->autocenter = autocenter;
+	pace->autocenter_pending = 1;
+}
+
+static int write_event(struct ffpace* pace, int command, int slot, int code, int value)
+{
+	struct input_event ie;
+	unsigned long long send_time;
+	int ret;
+
+	memset(&ie, 0, sizeof(ie));
+	ie.type = EV_FF;
+	ie.code = code;
+	ie.value = value;
+	send_time = get_ntime();
+	ret = (write(pace->fd, &ie, sizeof(ie)) == sizeof(ie) ? 0 : -1);
+	if (pace->sent)
+		pace->sent(pace->sent_data, command, slot, code, value, ret, send_time);
+	return ret;
+}
+
+/* Adapt the rate to the latency of the update just sent */
+static void adapt_rate(struct ffpace* pace, double latency, int failed, unsigned long long now)
+{
+	double interval = (now - pace->last_send_time) / 1e9;
+	int saturated = failed;
+
+	if (!pace->n_updates) {
+		pace->baseline_latency = pace->smoothed_latency = latency;
+		interval = 0;
+	}
+	if (latency < pace->baseline_latency)
+		pace->baseline_latency = latency;
+	else
+		pace->baseline_latency += BASELINE_DRIFT * (latency - pace->baseline_latency);
+	pace->smoothed_latency += SMOOTHING * (latency - pace->smoothed_latency);
+
+	/* The latency is well above what the device does when idle */
+	if (pace->smoothed_latency > pace->config.latency_ratio * pace->baseline_latency +
+	                             1000.0 * pace->config.latency_margin)
+		saturated = 1;
+
+	/* The latency keeps growing: a queue is filling up, even if it is still low */
+	pace->window_latency += latency;
+	if (++pace->window_length == WINDOW_LENGTH) {
+		if (pace->prev_window_latency && pace->window_latency > 1.1 * pace->prev_window_latency)
+			pace->n_growing_windows++;
+		else
+			pace->n_growing_windows = 0;
+		if (pace->config.trend_windows && pace->n_growing_windows >= pace->config.trend_windows)
+			saturated = 1;
+		pace->prev_window_latency = pace->window_latency;
+		pace->window_latency = 0;
+		pace->window_length = 0;
+	}
+
+	if (pace->holdoff)
+		pace->holdoff--;
+	if (saturated && !pace->holdoff) {
+		/* Back off once, then give the device time to drain before judging again */
+		pace->rate *= pace->config.decrease;
+		pace->n_backoffs++;
+		pace->n_growing_windows = 0;
+		pace->smoothed_latency = pace->baseline_latency;
+		pace->holdoff = WINDOW_LENGTH;
+	} else if (!saturated) {
+		pace->rate += pace->config.increase * interval;
+	}
+
+	if (pace->rate < pace->min_rate)
+		pace->rate = pace->min_rate;
+	if (pace->rate > pace->max_rate)
+		pace->rate = pace->max_rate;
+	if (pace->rate < pace->lowest_rate)
+		pace->lowest_rate = pace->rate;
+	if (pace->rate > pace->highest_rate)
+		pace->highest_rate = pace->rate;
+}
+
+int ffpace_poll(struct ffpace* pace, unsigned long long now)
+{
+	struct ffpace_slot* slot;
+	unsigned long long start, send_time, period;
+	int i, ret, n_sent = 0, failed = 0, err = 0;
+
+	if (!pace->n_pending || now < pace->next_send_time)
+		return 0;
+
+	start = get_ntime();
+	ffhist_add(&pace->staleness_hist, start - pace->pending_since);
+	for (i = 0; i < pace->n_slots; i++) {
+		slot = &pace->slots[i];
+		if (slot->upload_pending) {
+			slot->upload_pending = 0;
+			send_time = get_ntime();
+			ret = ioctl(pace->fd, EVIOCSFF, &slot->effect);
+			if (ret < 0) {
+				failed = 1;
+				err = errno;
+			}
+			if (pace->sent)
+				pace->sent(pace->sent_data, FFPACE_UPLOAD, i, slot->effect.id, 0, ret, send_time);
+			n_sent++;
+		}
+		if (slot->play_pending) {
+			slot->play_pending = 0;
+			if (write_event(pace, FFPACE_PLAY, i, slot->effect.id, slot->play_value) < 0) {
+				failed = 1;
+				err = errno;
+			}
+			n_sent++;
+		}
+	}
+	if (pace->gain_pending) {
+		pace->gain_pending = 0;
+		if (write_event(pace, FFPACE_GAIN, -1, FF_GAIN, pace->gain) < 0) {
+			failed = 1;
+			err = errno;
+		}
+		n_sent++;
+	}
+	if (pace->autocenter_pending) {
+		pace->autocenter_pending = 0;
+		if (write_event(pace, FFPACE_AUTOCENTER, -1, FF_AUTOCENTER, pace->autocenter) < 0) {
+			failed = 1;
+			err = errno;
+		}
+		n_sent++;
+	}
+	pace->n_pending = 0;
+
+	now = get_ntime();
+	ffhist_add(&pace->latency_hist, now - start);
+	adapt_rate(pace, now - start, failed, now);
+	pace->n_updates++;
+	pace->n_commands += n_sent;
+	pace->last_send_time = now;
+	/* Paced from the previous deadline, so the rate depends neither on the latency nor on late polls,
+	 * unless we fell behind by more than a period */
+	period = (unsigned long long)(1e9 / pace->rate);
+	if (start - pace->next_send_time > period)
+		pace->next_send_time = start + period;
+	else
+		pace->next_send_time += period;
+
+	if (failed) {
+		pace->n_errors++;
+		errno = err;
+		return -1;
+	}
+	return n_sent;
+}
+
+void ffpace_print(const struct ffpace* pace)
+{
+	printf("Adaptive pacing: sent %lu updates (%lu commands), coalesced %lu changes, backed off %lu times, %lu failed updates;\n",
+			pace->n_updates, pace->n_commands, pace->n_coalesced, pace->n_backoffs, pace->n_errors);
+	printf("\trate %.1f updates/s (between %.1f and %.1f), latency baseline %.1fus, smoothed %.1fus\n",
+			pace->rate, pace->lowest_rate, pace->highest_rate,
+			pace->baseline_latency / 1000, pace->smoothed_latency / 1000);
+	ffhist_print(&pace->latency_hist, "Update latency");
+	ffhist_print(&pace->staleness_hist, "Staleness");
+}
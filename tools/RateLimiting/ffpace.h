@@ -0,0 +1,133 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFPACE_H
+#define FFPACE_H
+
+#include <linux/input.h>
+
+#include "ffhist.h"
+
+/*
+ * Adaptive client-side pacing, for an application to call instead of EVIOCSFF and write() directly.
+ *
+ * The application hands over the newest parameters of each effect whenever it likes;
+ * only the latest pending parameters of each effect are kept, so nothing stale is ever sent.
+ * The pending commands are sent as one update at most at the current rate, which adapts AIMD-style:
+ * it increases additively while the device keeps up, and is cut multiplicatively at the onset of saturation,
+ * detected from the submission latency of the updates (it rises above its baseline, or keeps growing
+ * as the queue in the driver fills up) and from failing syscalls.
+ */
+
+enum ffpace_command {
+	FFPACE_UPLOAD,
+	FFPACE_PLAY,
+	FFPACE_GAIN,
+	FFPACE_AUTOCENTER,
+	N_FFPACE_COMMANDS
+};
+
+struct ffpace_config {
+	unsigned long min_period;           /* fastest allowed update period, in microseconds, 0 = no limit */
+	unsigned long max_period;           /* slowest update period to back off to, in microseconds */
+	unsigned long initial_period;       /* in microseconds */
+	double increase;                    /* additive increase of the rate, in updates/s per second */
+	double decrease;                    /* multiplicative decrease of the rate on saturation, e.g. 0.5 */
+	double latency_ratio;               /* saturated when the smoothed latency exceeds 'latency_ratio' times */
+	unsigned long latency_margin;       /* the baseline plus 'latency_margin' microseconds */
+	int trend_windows;                  /* or when it grew during this many successive windows, 0 = don't check */
+};
+
+/* Called right after each syscall, with its return value; 'send_time' is when the syscall started */
+typedef void (*ffpace_sent_callback)(void* data, int command, int slot, int code, int value, int ret,
+                                     unsigned long long send_time);
+
+struct ffpace_slot {
+	struct ff_effect effect;            /* newest parameters, its id as returned by EVIOCSFF */
+	int upload_pending;
+	int play_pending, play_value;
+};
+
+struct ffpace {
+	int fd;
+	struct ffpace_config config;
+	struct ffpace_slot* slots;
+	int n_slots;
+	int gain_pending, gain;
+	int autocenter_pending, autocenter;
+	int n_pending;                      /* commands waiting to be sent */
+	unsigned long long pending_since;   /* when the oldest unsent change was made, in nanoseconds */
+
+	ffpace_sent_callback sent;
+	void* sent_data;
+
+	/* Rate control */
+	double rate, min_rate, max_rate;    /* in updates/s */
+	unsigned long long next_send_time;  /* in nanoseconds */
+	unsigned long long last_send_time;
+	double baseline_latency;            /* lowest update latency seen, slowly drifting up, in ns */
+	double smoothed_latency;
+	double window_latency, prev_window_latency;
+	int window_length, n_growing_windows;
+	int holdoff;                        /* updates to wait before backing off again */
+
+	/* Statistics */
+	unsigned long n_updates;            /* updates sent */
+	unsigned long n_commands;
+	unsigned long n_errors;
+	unsigned long n_coalesced;          /* changes overwritten by newer ones before being sent */
+	unsigned long n_backoffs;
+	double lowest_rate, highest_rate;
+	struct ffhist latency_hist;         /* of whole updates, in nanoseconds */
+	struct ffhist staleness_hist;       /* from the oldest change of an update until it was sent */
+};
+
+void ffpace_default_config(struct ffpace_config* config);
+
+/*
+ * Pace the commands to the device opened as 'fd', for effects of 'n_slots' slots,
+ * 'sent' (can be NULL) is called after each syscall. Returns 0 on success, -1 on error (errno is set).
+ */
+int ffpace_init(struct ffpace* pace, int fd, int n_slots, const struct ffpace_config* config,
+                ffpace_sent_callback sent, void* sent_data);
+
+void ffpace_free(struct ffpace* pace);
+
+/* Queue new parameters for the effect of 'slot', already uploaded once with EVIOCSFF to get its id */
+void ffpace_upload(struct ffpace* pace, int slot, const struct ff_effect* effect, unsigned long long now);
+
+/* Queue starting ('value' > 0, the amount of repetitions) or stopping the effect of 'slot' */
+void ffpace_play(struct ffpace* pace, int slot, int value, unsigned long long now);
+
+void ffpace_set_gain(struct ffpace* pace, int gain, unsigned long long now);
+void ffpace_set_autocenter(struct ffpace* pace, int autocenter, unsigned long long now);
+
+/*
+ * Send the pending commands as one update if it is due, and adapt the rate.
+ * Returns the amount of commands sent, or -1 if one of them failed (errno is set).
+ */
+int ffpace_poll(struct ffpace* pace, unsigned long long now);
+
+/* When the next update may be sent, in nanoseconds */
+static inline unsigned long long ffpace_next_send_time(const struct ffpace* pace)
+{
+	return pace->next_send_time;
+}
+
+void ffpace_print(const struct ffpace* pace);
+
+#endif /* FFPACE_H */
@@ -0,0 +1,119 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+
+#include "ffpacer.h"
+
+unsigned long long ffpacer_get_ntime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+void ffpacer_init(struct ffpacer* pacer, unsigned long long start_ntime,
+                  unsigned long period_us, unsigned long spin_margin_us)
+{
+	memset(pacer, 0, sizeof(*pacer));
+	pacer->period = 1000ull * period_us;
+	pacer->spin_margin = 1000ull * spin_margin_us;
+	pacer->next_deadline = start_ntime + pacer->period;
+	ffhist_reset(&pacer->wakeup_jitter_hist);
+}
+
+unsigned long long ffpacer_wait(struct ffpacer* pacer)
+{
+	unsigned long long deadline = pacer->next_deadline;
+	unsigned long long now = ffpacer_get_ntime();
+	struct timespec ts;
+
+	pacer->n_ticks++;
+
+	if (now >= deadline) {
+		pacer->n_missed++;
+	} else {
+		/* Sleep until shortly before the deadline, then spin for the remainder */
+		if (deadline - now > pacer->spin_margin) {
+			ts.tv_sec = (deadline - pacer->spin_margin) / 1000000000ull;
+			ts.tv_nsec = (deadline - pacer->spin_margin) % 1000000000ull;
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+				;
+		}
+		do {
+			now = ffpacer_get_ntime();
+		} while (now < deadline);
+	}
+	ffhist_add(&pacer->wakeup_jitter_hist, now - deadline);
+
+	/* Keep the original schedule, unless we're more than a period behind: don't burst to catch up */
+	pacer->next_deadline += pacer->period;
+	if (pacer->period && now >= pacer->next_deadline) {
+		pacer->n_skipped += (now - deadline) / pacer->period;
+		pacer->next_deadline = deadline + ((now - deadline) / pacer->period + 1) * pacer->period;
+	}
+
+	return now;
+}
+
+void ffpacer_print(const struct ffpacer* pacer)
+{
+	printf("Deadlines: %lu, missed: %lu (%.2f%%), skipped to catch up: %lu\n",
+			pacer->n_ticks, pacer->n_missed,
+			pacer->n_ticks ? 100.0 * pacer->n_missed / pacer->n_ticks : 0.0,
+			pacer->n_skipped);
+	ffhist_print(&pacer->wakeup_jitter_hist, "Wake-up jitter");
+}
+
+int ffpacer_enter_realtime(int priority)
+{
+	struct sched_param param;
+	int ret = 0;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+	if (sched_setscheduler(0, SCHED_FIFO, &param) == -1) {
+		perror("Set SCHED_FIFO scheduling policy");
+		ret = -1;
+	}
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+		perror("Lock memory");
+		ret = -1;
+	}
+	/* A timer slack of 0 means "use the default", 1ns is the minimum */
+	if (prctl(PR_SET_TIMERSLACK, 1ul, 0, 0, 0) == -1) {
+		perror("Set timer slack");
+		ret = -1;
+	}
+	return ret;
+}
+
+void ffpacer_leave_realtime()
+{
+	struct sched_param param;
+
+	memset(&param, 0, sizeof(param));
+	sched_setscheduler(0, SCHED_OTHER, &param);
+	munlockall();
+	prctl(PR_SET_TIMERSLACK, 0ul, 0, 0, 0);
+}
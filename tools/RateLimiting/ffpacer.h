@@ -0,0 +1,60 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFPACER_H
+#define FFPACER_H
+
+#include "ffhist.h"
+
+/*
+ * Fixed-rate pacing on absolute CLOCK_MONOTONIC deadlines.
+ *
+ * Unlike sleeping a relative amount of time after each update, errors don't accumulate:
+ * deadline n is always 'start + n * period'. The last 'spin_margin' of each wait is spent
+ * busy-waiting instead of sleeping, to hide the wake-up latency of the scheduler.
+ */
+
+struct ffpacer {
+	unsigned long long next_deadline;       /* in nanoseconds */
+	unsigned long long period;
+	unsigned long long spin_margin;
+
+	unsigned long n_ticks;
+	unsigned long n_missed;     /* deadlines which had already passed before we started waiting */
+	unsigned long n_skipped;    /* deadlines dropped to catch up after falling behind more than a period */
+	struct ffhist wakeup_jitter_hist;       /* wake-up time minus deadline, in nanoseconds */
+};
+
+unsigned long long ffpacer_get_ntime();
+
+void ffpacer_init(struct ffpacer* pacer, unsigned long long start_ntime,
+                  unsigned long period_us, unsigned long spin_margin_us);
+
+/* Wait until the next deadline, and return the wake-up time */
+unsigned long long ffpacer_wait(struct ffpacer* pacer);
+
+void ffpacer_print(const struct ffpacer* pacer);
+
+/*
+ * Take SCHED_FIFO with the given priority, lock all memory and minimize the timer slack.
+ * Returns 0 on success, -1 if one of them failed (the others are still applied).
+ * ffpacer_leave_realtime() reverts to SCHED_OTHER and the default timer slack.
+ */
+int ffpacer_enter_realtime(int priority);
+void ffpacer_leave_realtime();
+
+#endif /* FFPACER_H */
@@ -0,0 +1,201 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "ffperf.h"
+
+const char* ffperf_counter_names[N_FFPERF_COUNTERS] = {
+	"task-clock",
+	"cycles",
+	"instructions",
+	"context-switches",
+	"page-faults",
+};
+
+static const char* source_names[] = { "unavailable", "hardware", "software", "rusage" };
+
+/* The perf event of each counter */
+static const struct { unsigned int type; unsigned long long config; } events[N_FFPERF_COUNTERS] = {
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+static int open_counter(int counter, int exclude_kernel)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[counter].type;
+	attr.config = events[counter].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = exclude_kernel;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static int open_counters(struct ffperf* perf, int exclude_kernel)
+{
+	int i, n_opened = 0;
+
+	for (i = 0; i < N_FFPERF_COUNTERS; i++) {
+		perf->fd[i] = open_counter(i, exclude_kernel);
+		if (perf->fd[i] != -1)
+			n_opened++;
+	}
+	return n_opened;
+}
+
+int ffperf_open(struct ffperf* perf)
+{
+	int i, n_opened;
+
+	memset(perf, 0, sizeof(*perf));
+
+	/*
+	 * Counting the kernel needs kernel.perf_event_paranoid <= 1 (or CAP_PERFMON).
+	 * If more counters open for user space only, all of them count user space only, so they can be compared.
+	 * Counters that don't open either way (no PMU in a VM, or no perf at all) are simply missing.
+	 */
+	n_opened = open_counters(perf, 0);
+	if (n_opened < N_FFPERF_COUNTERS) {
+		ffperf_close(perf);
+		if (open_counters(perf, 1) > n_opened)
+			perf->user_only = 1;
+		else {
+			ffperf_close(perf);
+			open_counters(perf, 0);
+		}
+	}
+	n_opened = 0;
+
+	for (i = 0; i < N_FFPERF_COUNTERS; i++) {
+		if (perf->fd[i] != -1) {
+			perf->source[i] = (events[i].type == PERF_TYPE_HARDWARE ? FFPERF_HARDWARE : FFPERF_SOFTWARE);
+			n_opened++;
+		} else {
+			/* No PMU (e.g. in a VM) or no perf at all */
+			perf->source[i] = (events[i].type == PERF_TYPE_HARDWARE ? FFPERF_UNAVAILABLE : FFPERF_RUSAGE);
+		}
+	}
+	return n_opened;
+}
+
+void ffperf_start(struct ffperf* perf)
+{
+	int i;
+
+	for (i = 0; i < N_FFPERF_COUNTERS; i++) {
+		if (perf->fd[i] == -1)
+			continue;
+		ioctl(perf->fd[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(perf->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+	getrusage(RUSAGE_THREAD, &perf->start_usage);
+}
+
+void ffperf_stop(struct ffperf* perf, struct ffperf_counts* counts)
+{
+	unsigned long long data[3];         /* value, time enabled, time running */
+	struct rusage usage;
+	int i;
+
+	getrusage(RUSAGE_THREAD, &usage);
+	memset(counts, 0, sizeof(*counts));
+	for (i = 0; i < N_FFPERF_COUNTERS; i++) {
+		if (perf->fd[i] == -1)
+			continue;
+		ioctl(perf->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+		if (read(perf->fd[i], data, sizeof(data)) != sizeof(data))
+			continue;
+		counts->value[i] = data[0];
+		/* Too many counters for the PMU: scale up to the full time */
+		if (data[2] && data[2] < data[1]) {
+			counts->value[i] = (unsigned long long)((double)data[0] * data[1] / data[2]);
+			counts->multiplexed = 1;
+		}
+	}
+	memcpy(counts->source, perf->source, sizeof(counts->source));
+	counts->user_only = perf->user_only;
+
+	counts->voluntary_switches = usage.ru_nvcsw - perf->start_usage.ru_nvcsw;
+	counts->involuntary_switches = usage.ru_nivcsw - perf->start_usage.ru_nivcsw;
+	counts->minor_faults = usage.ru_minflt - perf->start_usage.ru_minflt;
+	counts->major_faults = usage.ru_majflt - perf->start_usage.ru_majflt;
+	counts->user_time = (1000000 * usage.ru_utime.tv_sec + usage.ru_utime.tv_usec) -
+	                    (1000000 * perf->start_usage.ru_utime.tv_sec + perf->start_usage.ru_utime.tv_usec);
+	counts->system_time = (1000000 * usage.ru_stime.tv_sec + usage.ru_stime.tv_usec) -
+	                      (1000000 * perf->start_usage.ru_stime.tv_sec + perf->start_usage.ru_stime.tv_usec);
+
+	/* Fall back to rusage for the software counters that couldn't be opened */
+	if (counts->source[FFPERF_TASK_CLOCK] == FFPERF_RUSAGE)
+		counts->value[FFPERF_TASK_CLOCK] = 1000ull * (counts->user_time + counts->system_time);
+	if (counts->source[FFPERF_CONTEXT_SWITCHES] == FFPERF_RUSAGE)
+		counts->value[FFPERF_CONTEXT_SWITCHES] = counts->voluntary_switches + counts->involuntary_switches;
+	if (counts->source[FFPERF_PAGE_FAULTS] == FFPERF_RUSAGE)
+		counts->value[FFPERF_PAGE_FAULTS] = counts->minor_faults + counts->major_faults;
+}
+
+void ffperf_print(const struct ffperf_counts* counts, unsigned long n_commands, unsigned long n_syscalls)
+{
+	double value;
+	int i;
+
+	printf("CPU cost of the choke thread%s%s:\n", counts->user_only ? " (user space only, kernel not allowed)" : "",
+			counts->multiplexed ? " (multiplexed counters are scaled)" : "");
+	printf("  %-17s %14s %14s %14s   %s\n", "counter", "total", "per command", "per syscall", "source");
+	for (i = 0; i < N_FFPERF_COUNTERS; i++) {
+		if (counts->source[i] == FFPERF_UNAVAILABLE) {
+			printf("  %-17s %14s %14s %14s   %s\n", ffperf_counter_names[i], "-", "-", "-", source_names[FFPERF_UNAVAILABLE]);
+			continue;
+		}
+		/* The task clock in microseconds */
+		value = counts->value[i] / (i == FFPERF_TASK_CLOCK ? 1e3 : 1.0);
+		printf("  %-12s%5s %14.1f %14.3f %14.3f   %s\n", ffperf_counter_names[i], i == FFPERF_TASK_CLOCK ? "(us)" : "", value,
+				n_commands ? value / n_commands : 0.0, n_syscalls ? value / n_syscalls : 0.0,
+				source_names[counts->source[i]]);
+	}
+	if (counts->source[FFPERF_CYCLES] != FFPERF_UNAVAILABLE && counts->source[FFPERF_INSTRUCTIONS] != FFPERF_UNAVAILABLE &&
+	    counts->value[FFPERF_CYCLES])
+		printf("  %.2f instructions per cycle\n", (double)counts->value[FFPERF_INSTRUCTIONS] / counts->value[FFPERF_CYCLES]);
+	printf("  rusage: %luus user, %luus system, %ld voluntary and %ld involuntary context switches, "
+	       "%ld minor and %ld major page faults\n",
+			counts->user_time, counts->system_time, counts->voluntary_switches, counts->involuntary_switches,
+			counts->minor_faults, counts->major_faults);
+}
+
+void ffperf_close(struct ffperf* perf)
+{
+	int i;
+
+	for (i = 0; i < N_FFPERF_COUNTERS; i++) {
+		if (perf->fd[i] != -1)
+			close(perf->fd[i]);
+		perf->fd[i] = -1;
+	}
+}
@@ -0,0 +1,85 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFPERF_H
+#define FFPERF_H
+
+#include <sys/resource.h>
+
+/*
+ * CPU cost of a stretch of code on the calling thread, to normalise per command and per syscall:
+ * perf_event_open counters where available, and getrusage(RUSAGE_THREAD) always.
+ *
+ * Hardware counters (cycles, instructions) are often missing in VMs, and perf_event_open may be
+ * forbidden altogether (kernel.perf_event_paranoid, seccomp): each counter that can't be opened
+ * falls back to the software counter or rusage equivalent, or is reported as unavailable.
+ * Kernel time is counted too if allowed, otherwise only user space ('user_only').
+ */
+
+enum ffperf_counter {
+	FFPERF_TASK_CLOCK,          /* in nanoseconds */
+	FFPERF_CYCLES,
+	FFPERF_INSTRUCTIONS,
+	FFPERF_CONTEXT_SWITCHES,
+	FFPERF_PAGE_FAULTS,
+	N_FFPERF_COUNTERS
+};
+
+extern const char* ffperf_counter_names[N_FFPERF_COUNTERS];
+
+enum ffperf_source {
+	FFPERF_UNAVAILABLE,
+	FFPERF_HARDWARE,            /* a hardware counter of the PMU */
+	FFPERF_SOFTWARE,            /* a software counter of perf */
+	FFPERF_RUSAGE,              /* derived from getrusage() */
+};
+
+struct ffperf_counts {
+	unsigned long long value[N_FFPERF_COUNTERS];
+	int source[N_FFPERF_COUNTERS];      /* one of enum ffperf_source */
+	int user_only;                      /* the perf counters exclude the kernel */
+	int multiplexed;                    /* a counter didn't run all the time, its value is scaled */
+
+	/* From getrusage(), always available */
+	long voluntary_switches;            /* e.g. waiting for a sleep, or a blocking syscall */
+	long involuntary_switches;          /* preempted */
+	long minor_faults, major_faults;
+	unsigned long user_time, system_time;   /* in microseconds */
+};
+
+struct ffperf {
+	int fd[N_FFPERF_COUNTERS];          /* -1 if not opened */
+	int source[N_FFPERF_COUNTERS];
+	int user_only;
+	struct rusage start_usage;
+};
+
+/* Open the counters for the calling thread. Returns the number of perf counters opened, 0 = rusage only. */
+int ffperf_open(struct ffperf* perf);
+
+/* Start counting (again from zero) */
+void ffperf_start(struct ffperf* perf);
+
+/* Stop counting, and store the counts since ffperf_start() */
+void ffperf_stop(struct ffperf* perf, struct ffperf_counts* counts);
+
+/* Print the counts, per command and per syscall */
+void ffperf_print(const struct ffperf_counts* counts, unsigned long n_commands, unsigned long n_syscalls);
+
+void ffperf_close(struct ffperf* perf);
+
+#endif /* FFPERF_H */
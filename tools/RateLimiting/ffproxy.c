@@ -0,0 +1,479 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <limits.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#include "ffuinput.h"
+#include "ffhist.h"
+
+/*
+ * Force feedback proxy: applications talk to a virtual (uinput) copy of the real device,
+ * and the proxy forwards their commands to the real device, at most one per 'output_period'.
+ *
+ * Commands waiting to be forwarded are coalesced: a newer upload of the same effect,
+ * a newer play/stop of the same effect, or a newer gain or autocenter value,
+ * replaces the pending one (keeping its place in the queue), so the device always gets the latest state
+ * and no queue can build up in the driver.
+ */
+
+unsigned long output_period = 0;                          /* auto-detect */
+#define DEFAULT_OUTPUT_PERIOD 2000                        /* 2ms, when auto-detection fails */
+
+volatile sig_atomic_t quit = 0;
+
+void handle_signal(int sig)
+{
+	quit = 1;
+}
+
+unsigned long long get_ntime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+
+
+/*
+ * Auto-detect the output rate of a USB device, from the interval of its interrupt OUT endpoint,
+ * falling back to its interrupt IN endpoint (HID devices without OUT endpoint use control transfers).
+ * Returns the period in microseconds, or 0 if unknown (e.g. not a USB device).
+ */
+unsigned long detect_output_period(const char* device_file_name)
+{
+	char path[2 * PATH_MAX], interface_dir[PATH_MAX], attr[32];
+	const char* event_name;
+	unsigned long period, in_period = 0;
+	DIR* dir;
+	struct dirent* entry;
+	FILE* f;
+	int is_out;
+
+	event_name = strrchr(device_file_name, '/');
+	event_name = (event_name ? event_name + 1 : device_file_name);
+
+	/* eventX -> inputY -> HID device -> USB interface */
+	snprintf(path, sizeof(path), "/sys/class/input/%s/device/device/..", event_name);
+	if (!realpath(path, interface_dir))
+		return 0;
+
+	dir = opendir(interface_dir);
+	if (!dir)
+		return 0;
+	while ((entry = readdir(dir))) {
+		if (strncmp(entry->d_name, "ep_", 3) != 0 || strcmp(entry->d_name, "ep_00") == 0)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s/type", interface_dir, entry->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		if (!fgets(attr, sizeof(attr), f) || strncmp(attr, "Interrupt", 9) != 0) {
+			fclose(f);
+			continue;
+		}
+		fclose(f);
+
+		snprintf(path, sizeof(path), "%s/%s/direction", interface_dir, entry->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		is_out = (fgets(attr, sizeof(attr), f) && strncmp(attr, "out", 3) == 0);
+		fclose(f);
+
+		/* Formatted as e.g. "2ms" or "125us" */
+		snprintf(path, sizeof(path), "%s/%s/interval", interface_dir, entry->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		period = 0;
+		if (fgets(attr, sizeof(attr), f)) {
+			period = strtoul(attr, NULL, 10);
+			if (strstr(attr, "ms"))
+				period *= 1000;
+		}
+		fclose(f);
+
+		if (is_out && period) {
+			closedir(dir);
+			return period;
+		}
+		if (!is_out && period)
+			in_period = period;
+	}
+	closedir(dir);
+
+	return in_period;
+}
+
+
+
+/* Pending operations, at most one per (type, effect id) */
+#define OP_UPLOAD(id)    (id)
+#define OP_PLAY(id)      (n_effects + (id))
+#define OP_ERASE(id)     (2 * n_effects + (id))
+#define OP_GAIN          (3 * n_effects)
+#define OP_AUTOCENTER    (3 * n_effects + 1)
+#define N_OPS            (3 * n_effects + 2)
+
+int n_effects;
+int real_fd, ufd;
+
+int* real_ids;                  /* real effect id, for each virtual effect id, -1 if not uploaded */
+struct ff_effect* pending_effects;
+int* pending_play_values;
+int pending_gain, pending_autocenter;
+unsigned long long* pending_times;      /* receipt time of the oldest command merged into each operation */
+
+char* queued;                   /* whether an operation is in the queue */
+int* queue;                     /* ring buffer of operations, in arrival order */
+int queue_head, queue_length;
+
+/* Statistics */
+unsigned long n_received[N_FF_CMD_TYPES];
+unsigned long n_forwarded[N_FF_CMD_TYPES];
+unsigned long n_failed;
+struct ffhist request_overhead_hist;    /* time the application is blocked by the proxy, per upload/erase */
+struct ffhist forward_delay_hist;       /* time from receipt until forwarding, per forwarded operation */
+struct ffhist forward_syscall_hist;     /* syscall time on the real device, per forwarded operation */
+
+void enqueue_op(int op, unsigned long long receipt_time)
+{
+	if (queued[op])
+		return;
+	queued[op] = 1;
+	pending_times[op] = receipt_time;
+	queue[(queue_head + queue_length) % N_OPS] = op;
+	queue_length++;
+}
+
+/* Remove an operation from the queue, keeping the order of the others */
+void cancel_op(int op)
+{
+	int i, j;
+
+	if (!queued[op])
+		return;
+	queued[op] = 0;
+	for (i = 0, j = 0; i < queue_length; i++) {
+		if (queue[(queue_head + i) % N_OPS] != op)
+			queue[(queue_head + j++) % N_OPS] = queue[(queue_head + i) % N_OPS];
+	}
+	queue_length = j;
+}
+
+void handle_command(const struct ff_command* cmd)
+{
+	int id = cmd->id;
+
+	n_received[cmd->type]++;
+
+	switch (cmd->type) {
+	case FF_CMD_UPLOAD:
+		if (id < 0 || id >= n_effects)
+			break;
+		pending_effects[id] = cmd->effect;
+		/* Custom waveforms point into the application's memory, not ours, as in ffrecord */
+		if (pending_effects[id].type == FF_PERIODIC)
+			pending_effects[id].u.periodic.custom_data = NULL;
+		enqueue_op(OP_UPLOAD(id), cmd->timestamp);
+		break;
+	case FF_CMD_PLAY:
+		if (id < 0 || id >= n_effects)
+			break;
+		pending_play_values[id] = cmd->value;
+		enqueue_op(OP_PLAY(id), cmd->timestamp);
+		break;
+	case FF_CMD_ERASE:
+		if (id < 0 || id >= n_effects)
+			break;
+		/* Nothing left to update or play, the effect is gone */
+		cancel_op(OP_UPLOAD(id));
+		cancel_op(OP_PLAY(id));
+		if (real_ids[id] != -1)
+			enqueue_op(OP_ERASE(id), cmd->timestamp);
+		break;
+	case FF_CMD_GAIN:
+		pending_gain = cmd->value;
+		enqueue_op(OP_GAIN, cmd->timestamp);
+		break;
+	case FF_CMD_AUTOCENTER:
+		pending_autocenter = cmd->value;
+		enqueue_op(OP_AUTOCENTER, cmd->timestamp);
+		break;
+	}
+}
+
+/* Forward the oldest pending operation to the real device, returns 0 if there was none */
+int forward_op()
+{
+	struct ff_effect effect;
+	struct input_event ie;
+	unsigned long long start;
+	int op, id, type, ret;
+
+	if (!queue_length)
+		return 0;
+	op = queue[queue_head];
+	queue_head = (queue_head + 1) % N_OPS;
+	queue_length--;
+	queued[op] = 0;
+
+	memset(&ie, 0, sizeof(ie));
+	ie.type = EV_FF;
+	id = op % n_effects;
+
+	start = get_ntime();
+	if (op == OP_GAIN) {
+		type = FF_CMD_GAIN;
+		ie.code = FF_GAIN;
+		ie.value = pending_gain;
+		ret = write(real_fd, &ie, sizeof(ie));
+	} else if (op == OP_AUTOCENTER) {
+		type = FF_CMD_AUTOCENTER;
+		ie.code = FF_AUTOCENTER;
+		ie.value = pending_autocenter;
+		ret = write(real_fd, &ie, sizeof(ie));
+	} else if (op == OP_UPLOAD(id)) {
+		type = FF_CMD_UPLOAD;
+		effect = pending_effects[id];
+		effect.id = real_ids[id];
+		ret = ioctl(real_fd, EVIOCSFF, &effect);
+		if (ret >= 0)
+			real_ids[id] = effect.id;
+	} else if (op == OP_PLAY(id)) {
+		type = FF_CMD_PLAY;
+		ie.code = real_ids[id];
+		ie.value = pending_play_values[id];
+		ret = (real_ids[id] == -1 ? -1 : write(real_fd, &ie, sizeof(ie)));
+	} else {
+		type = FF_CMD_ERASE;
+		ret = ioctl(real_fd, EVIOCRMFF, real_ids[id]);
+		real_ids[id] = -1;
+	}
+	ffhist_add(&forward_syscall_hist, get_ntime() - start);
+	ffhist_add(&forward_delay_hist, start - pending_times[op]);
+
+	if (ret < 0) {
+		n_failed++;
+		perror("Forward command error");
+	} else {
+		n_forwarded[type]++;
+	}
+	return 1;
+}
+
+void print_stats()
+{
+	unsigned long total_received = 0, total_forwarded = 0;
+	int i;
+
+	printf("%-12s %10s %10s\n", "command", "received", "forwarded");
+	for (i = 0; i < N_FF_CMD_TYPES; i++) {
+		printf("%-12s %10lu %10lu\n", ff_command_names[i], n_received[i], n_forwarded[i]);
+		total_received += n_received[i];
+		total_forwarded += n_forwarded[i];
+	}
+	printf("Coalesced: %lu, failed: %lu\n", total_received - total_forwarded - n_failed - queue_length, n_failed);
+	ffhist_print(&request_overhead_hist, "Request overhead");
+	ffhist_print(&forward_delay_hist, "Forward delay");
+	ffhist_print(&forward_syscall_hist, "Forward syscall");
+}
+
+int main(int argc, char** argv)
+{
+	const char* device_file_name = "/dev/input/event0";
+	char devnode[64], name[256], proxy_name[80];
+	struct ff_command cmd;
+	struct input_event events[64];
+	struct pollfd pfds[2];
+	struct timespec timeout;
+	unsigned long long now, next_output_time, wait_time, last_report_time;
+	unsigned long prev_total_received = 0, total_received;
+	ssize_t n;
+	int i, ret;
+
+	printf("Force feedback proxy, coalescing and rate-limiting commands to a device.\n\n");
+
+	/* Show help message */
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--help", 64) == 0) {
+			printf("Usage: %s [/dev/input/eventXX \n", argv[0]);
+			printf("           \t\t[<output_period=%luus> \n", output_period);
+			printf("           ] ]\n");
+			printf("Creates a virtual copy of the device, and forwards its force feedback commands to the device,\n");
+			printf("at most one command per 'output_period'. Pending updates of the same effect,\n");
+			printf("and repeated gain or autocenter changes, are coalesced (latest wins).\n");
+			printf("Input events of the device are passed through to the virtual copy. Press Ctrl-C to quit.\n\n");
+
+			printf("Additional details on some parameters:\n");
+			printf("\toutput_period:\t in microseconds, '0' detects it from the device's USB endpoint interval\n");
+				printf("\t\t(%dus if that fails)\n\n", DEFAULT_OUTPUT_PERIOD);
+
+			printf("To measure the overhead of the proxy, run the same ffchoke scenario against the device\n");
+			printf("and against the virtual copy, and compare the syscall latencies.\n");
+
+			exit(1);
+		}
+	}
+
+	/* Parse cmd arguments and set parameters */
+	i=1; if (argc > i) device_file_name = argv[i];
+	i++; if (argc > i) output_period    = atoi(argv[i]);
+
+	/* Open device */
+	real_fd = open(device_file_name, O_RDWR | O_NONBLOCK);
+	if (real_fd == -1) {
+		perror("Open device file");
+		exit(1);
+	}
+	memset(name, 0, sizeof(name));
+	ioctl(real_fd, EVIOCGNAME(sizeof(name) - 1), name);
+	printf("Device %s opened (%s)\n", device_file_name, name);
+
+	if (ioctl(real_fd, EVIOCGEFFECTS, &n_effects) == -1) {
+		perror("Ioctl number of effects");
+		exit(1);
+	}
+	if (n_effects < 1) {
+		printf("This device doesn't support force feedback.\n");
+		exit(1);
+	}
+
+	if (!output_period) {
+		output_period = detect_output_period(device_file_name);
+		if (output_period)
+			printf("Detected output period: %luus\n", output_period);
+		else
+			output_period = DEFAULT_OUTPUT_PERIOD;
+	}
+	printf("Forwarding at most one command every %luus\n", output_period);
+
+	/* Everything is allocated up front */
+	real_ids = malloc(n_effects * sizeof(*real_ids));
+	pending_effects = calloc(n_effects, sizeof(*pending_effects));
+	pending_play_values = calloc(n_effects, sizeof(*pending_play_values));
+	pending_times = calloc(N_OPS, sizeof(*pending_times));
+	queued = calloc(N_OPS, sizeof(*queued));
+	queue = calloc(N_OPS, sizeof(*queue));
+	if (!real_ids || !pending_effects || !pending_play_values || !pending_times || !queued || !queue) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < n_effects; i++)
+		real_ids[i] = -1;
+
+	/* Create the virtual copy */
+	snprintf(proxy_name, sizeof(proxy_name), "ffproxy: %.70s", name);
+	ufd = ffuinput_create_like(real_fd, proxy_name);
+	if (ufd == -1) {
+		perror("Create uinput device");
+		exit(1);
+	}
+	if (ffuinput_get_devnode(ufd, devnode, sizeof(devnode)) == -1) {
+		perror("Find uinput event node");
+		ffuinput_destroy(ufd);
+		exit(1);
+	}
+	printf("Virtual device created: %s\n\n", devnode);
+
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+
+	next_output_time = last_report_time = get_ntime();
+	while (!quit) {
+		now = get_ntime();
+		if (queue_length && now >= next_output_time) {
+			if (forward_op())
+				next_output_time = get_ntime() + 1000ull * output_period;
+			continue;
+		}
+
+		/* Report once every 5 seconds, whenever something happened */
+		if (now - last_report_time > 5000000000ull) {
+			for (total_received = 0, i = 0; i < N_FF_CMD_TYPES; i++)
+				total_received += n_received[i];
+			if (total_received != prev_total_received)
+				print_stats();
+			prev_total_received = total_received;
+			last_report_time = now;
+		}
+
+		wait_time = 100000000ull;
+		if (queue_length)
+			wait_time = next_output_time - now;
+		timeout.tv_sec = wait_time / 1000000000ull;
+		timeout.tv_nsec = wait_time % 1000000000ull;
+		pfds[0].fd = ufd;
+		pfds[0].events = POLLIN;
+		pfds[1].fd = real_fd;
+		pfds[1].events = POLLIN;
+		if (ppoll(pfds, 2, &timeout, NULL) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("Poll error");
+			break;
+		}
+
+		/* Commands from applications: complete them immediately, forward them later */
+		if (pfds[0].revents & POLLIN) {
+			while ((ret = ffuinput_read_command(ufd, &cmd)) >= 0) {
+				if (!ret)
+					continue;
+				handle_command(&cmd);
+				if (cmd.type == FF_CMD_UPLOAD || cmd.type == FF_CMD_ERASE) {
+					if (ffuinput_complete(ufd, &cmd, 0) < 0)
+						perror("Complete request error");
+					ffhist_add(&request_overhead_hist, get_ntime() - cmd.timestamp);
+				}
+			}
+		}
+
+		/* Input events from the device */
+		if (pfds[1].revents & POLLIN) {
+			n = read(real_fd, events, sizeof(events));
+			if (n > 0 && write(ufd, events, n) != n)
+				perror("Pass-through input events error");
+		}
+	}
+
+	/* Forward what is still pending, so the device ends up in the right state */
+	while (forward_op())
+		usleep(output_period);
+
+	printf("\nFinal statistics:\n");
+	print_stats();
+
+	ffuinput_destroy(ufd);
+	close(real_fd);
+
+	exit(0);
+}
@@ -0,0 +1,300 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#include "ffuinput.h"
+#include "fflog.h"
+
+/*
+ * Force feedback recorder: applications (e.g. a racing sim) talk to a virtual (uinput) copy of the device,
+ * and every command they send is appended to a log (see fflog.h), with its time of arrival.
+ * The commands are forwarded to the real device right away, so the session can be played as usual.
+ */
+
+int n_effects = 16;                                       /* for --standalone */
+
+volatile sig_atomic_t quit = 0;
+
+void handle_signal(int sig)
+{
+	quit = 1;
+}
+
+unsigned long long get_ntime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+int real_fd = -1, ufd;
+int* real_ids;                  /* real effect id, for each virtual effect id, -1 if not uploaded */
+
+unsigned long n_recorded[N_FF_CMD_TYPES];
+unsigned long n_failed;
+
+/* Send a command to the real device, returns the result for the application */
+int forward_command(const struct ff_command* cmd)
+{
+	struct ff_effect effect;
+	struct input_event ie;
+	int id = cmd->id;
+
+	if (real_fd == -1)
+		return 0;
+
+	memset(&ie, 0, sizeof(ie));
+	ie.type = EV_FF;
+	ie.value = cmd->value;
+
+	switch (cmd->type) {
+	case FF_CMD_UPLOAD:
+		if (id < 0 || id >= n_effects)
+			return -EINVAL;
+		effect = cmd->effect;
+		effect.id = real_ids[id];
+		if (ioctl(real_fd, EVIOCSFF, &effect) < 0)
+			return -errno;
+		real_ids[id] = effect.id;
+		return 0;
+	case FF_CMD_ERASE:
+		if (id < 0 || id >= n_effects || real_ids[id] == -1)
+			return -EINVAL;
+		if (ioctl(real_fd, EVIOCRMFF, real_ids[id]) < 0)
+			return -errno;
+		real_ids[id] = -1;
+		return 0;
+	case FF_CMD_PLAY:
+		if (id < 0 || id >= n_effects || real_ids[id] == -1)
+			return -EINVAL;
+		ie.code = real_ids[id];
+		break;
+	case FF_CMD_GAIN:
+		ie.code = FF_GAIN;
+		break;
+	case FF_CMD_AUTOCENTER:
+		ie.code = FF_AUTOCENTER;
+		break;
+	}
+	if (write(real_fd, &ie, sizeof(ie)) != sizeof(ie))
+		return -errno;
+	return 0;
+}
+
+void print_stats(const struct fflog_writer* log)
+{
+	int i;
+
+	printf("Recorded %lu commands (", log->n_records);
+	for (i = 0; i < N_FF_CMD_TYPES; i++)
+		printf("%s%s: %lu", i ? ", " : "", ff_command_names[i], n_recorded[i]);
+	printf("), %.1f KiB", log->size / 1024.0);
+	if (real_fd != -1)
+		printf(", %lu failed on the device", n_failed);
+	printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char* log_file_name = NULL;
+	const char* device_file_name = "/dev/input/event0";
+	char devnode[64], name[256], virtual_name[80];
+	struct fflog_writer log;
+	struct ff_command cmd;
+	struct input_event events[64];
+	struct pollfd pfds[2];
+	unsigned long long last_flush_time, now;
+	unsigned long prev_n_records = 0;
+	ssize_t n;
+	int standalone = 0;
+	int i, ret;
+
+	printf("Force feedback recorder, logging the commands sent to a device.\n\n");
+
+	/* Show help message */
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--help", 64) == 0) {
+			printf("Usage: %s <log_file> [/dev/input/eventXX] \n", argv[0]);
+			printf("   or: %s <log_file> --standalone [<n_effects=%d>] \n", argv[0], n_effects);
+			printf("Creates a virtual copy of the device, and records every force feedback command\n");
+			printf("that applications send to it in 'log_file', with its timing. The commands are forwarded\n");
+			printf("to the device, and input events of the device are passed through to the virtual copy,\n");
+			printf("so the application can be used as usual. Press Ctrl-C to stop recording.\n\n");
+
+			printf("With --standalone, no real device is used: a virtual device with 'n_effects' effects\n");
+			printf("accepts every command (e.g. to record a session without the device at hand).\n\n");
+
+			printf("Replay the log on a device with ffreplay.\n");
+
+			exit(1);
+		}
+	}
+	if (argc < 2) {
+		printf("Missing log_file, see --help.\n");
+		exit(1);
+	}
+
+	/* Parse cmd arguments and set parameters */
+	i=1; if (argc > i) log_file_name = argv[i];
+	i++; if (argc > i) device_file_name = argv[i];
+	i++; if (argc > i) n_effects        = atoi(argv[i]);
+
+	if (strncmp(device_file_name, "--standalone", 64) == 0)
+		standalone = 1;
+
+	memset(name, 0, sizeof(name));
+	if (!standalone) {
+		/* Open device */
+		real_fd = open(device_file_name, O_RDWR | O_NONBLOCK);
+		if (real_fd == -1) {
+			perror("Open device file");
+			exit(1);
+		}
+		ioctl(real_fd, EVIOCGNAME(sizeof(name) - 1), name);
+		printf("Device %s opened (%s)\n", device_file_name, name);
+
+		if (ioctl(real_fd, EVIOCGEFFECTS, &n_effects) == -1) {
+			perror("Ioctl number of effects");
+			exit(1);
+		}
+		if (n_effects < 1) {
+			printf("This device doesn't support force feedback.\n");
+			exit(1);
+		}
+
+		snprintf(virtual_name, sizeof(virtual_name), "ffrecord: %.69s", name);
+		ufd = ffuinput_create_like(real_fd, virtual_name);
+	} else {
+		if (n_effects < 1) {
+			printf("Invalid n_effects.\n");
+			exit(1);
+		}
+		snprintf(virtual_name, sizeof(virtual_name), "ffrecord virtual device");
+		snprintf(name, sizeof(name), "%s", virtual_name);
+		ufd = ffuinput_create(virtual_name, n_effects);
+	}
+	if (ufd == -1) {
+		perror("Create uinput device");
+		exit(1);
+	}
+	if (ffuinput_get_devnode(ufd, devnode, sizeof(devnode)) == -1) {
+		perror("Find uinput event node");
+		ffuinput_destroy(ufd);
+		exit(1);
+	}
+	printf("Virtual device created: %s\n", devnode);
+
+	real_ids = malloc(n_effects * sizeof(*real_ids));
+	if (!real_ids) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < n_effects; i++)
+		real_ids[i] = -1;
+
+	if (fflog_create(&log, log_file_name, name, real_fd, n_effects, get_ntime()) == -1) {
+		perror("Create log file");
+		ffuinput_destroy(ufd);
+		exit(1);
+	}
+	printf("Recording to %s\n\n", log_file_name);
+
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+
+	last_flush_time = get_ntime();
+	while (!quit) {
+		pfds[0].fd = ufd;
+		pfds[0].events = POLLIN;
+		pfds[1].fd = real_fd;
+		pfds[1].events = POLLIN;
+		if (poll(pfds, standalone ? 1 : 2, 1000) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("Poll error");
+			break;
+		}
+
+		/* Commands from applications: log them, then forward them */
+		if (pfds[0].revents & POLLIN) {
+			while ((ret = ffuinput_read_command(ufd, &cmd)) >= 0) {
+				if (!ret)
+					continue;
+				if (fflog_append(&log, &cmd) == -1) {
+					perror("Write log file");
+					quit = 1;
+				}
+				n_recorded[cmd.type]++;
+
+				ret = forward_command(&cmd);
+				if (ret < 0)
+					n_failed++;
+				if ((cmd.type == FF_CMD_UPLOAD || cmd.type == FF_CMD_ERASE) &&
+				    ffuinput_complete(ufd, &cmd, ret) < 0)
+					perror("Complete request error");
+			}
+		}
+
+		/* Input events from the device */
+		if (!standalone && (pfds[1].revents & POLLIN)) {
+			n = read(real_fd, events, sizeof(events));
+			if (n > 0 && write(ufd, events, n) != n)
+				perror("Pass-through input events error");
+		}
+
+		/* Don't lose more than a second of the session, if we get killed */
+		now = get_ntime();
+		if (now - last_flush_time > 1000000000ull) {
+			if (fflog_flush(&log) == -1) {
+				perror("Write log file");
+				break;
+			}
+			if (log.n_records != prev_n_records && (log.n_records / 10000) != (prev_n_records / 10000))
+				print_stats(&log);
+			prev_n_records = log.n_records;
+			last_flush_time = now;
+		}
+	}
+
+	if (fflog_close(&log) == -1)
+		perror("Close log file");
+	printf("\n");
+	print_stats(&log);
+
+	ffuinput_destroy(ufd);
+	if (real_fd != -1) {
+		for (i = 0; i < n_effects; i++) {
+			if (real_ids[i] != -1)
+				ioctl(real_fd, EVIOCRMFF, real_ids[i]);
+		}
+		close(real_fd);
+	}
+
+	exit(0);
+}
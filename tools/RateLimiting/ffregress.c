@@ -0,0 +1,197 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <linux/input.h>
+
+#include "ffeffects.h"
+#include "ffbench.h"
+
+/*
+ * A choke-test scenario against a virtual device, with the thresholds it has to meet.
+ * The thresholds are loose: they catch regressions of the tools (or of the kernel's uinput path),
+ * not the jitter of a loaded machine.
+ */
+struct regress_case {
+	const char* name;
+	unsigned long service_period;       /* of the virtual device, in microseconds */
+	int queue_depth;
+	int overflow_policy;
+	int operation;
+	int effect_idx;
+	int n_effects;
+	int burst;
+	int change_params;
+	int pacing;
+	int upload_cache;
+	unsigned long update_period;        /* in microseconds */
+	double min_update_rate;             /* updates/s the salvo has to achieve (sent by ffpace, with adaptive pacing) */
+	double max_lag;                     /* in milliseconds, of the final effect, 0 = not measured */
+};
+
+#define SALVO_DURATION 2000000  /* 2 seconds */
+
+const struct regress_case cases[] = {
+	/* name                       service queue policy         operation          effect n  burst change pacing             cache period min/s  lag(ms) */
+	{ "update-constant",          100,    256,  FFDEVSIM_DROP,  FFBENCH_UPDATE,     0,     1, 1,    1,     FFBENCH_ABSOLUTE,  0,    2000,  450,   5   },
+	{ "update-periodic-burst",    100,    256,  FFDEVSIM_DROP,  FFBENCH_UPDATE,     1,     4, 1,    1,     FFBENCH_ABSOLUTE,  0,    5000,  180,   10  },
+	{ "update-spring-roundrobin", 100,    256,  FFDEVSIM_DROP,  FFBENCH_UPDATE,     2,     4, 0,    1,     FFBENCH_DEADLINE,  0,    2000,  450,   10  },
+	{ "update-cached-slow-device", 2000,  256,  FFDEVSIM_DROP,  FFBENCH_UPDATE,     0,     1, 1,    0,     FFBENCH_ABSOLUTE,  1,    1000,  900,   10  },
+	{ "update-ramp",              100,    256,  FFDEVSIM_DROP,  FFBENCH_UPDATE,     9,     2, 1,    1,     FFBENCH_ABSOLUTE,  0,    2000,  450,   10  },
+	{ "update-damper",            100,    256,  FFDEVSIM_DROP,  FFBENCH_UPDATE,     10,    1, 1,    1,     FFBENCH_ABSOLUTE,  0,    2000,  450,   10  },
+	{ "update-envelope",          100,    256,  FFDEVSIM_DROP,  FFBENCH_UPDATE,     13,    1, 1,    1,     FFBENCH_ABSOLUTE,  0,    2000,  450,   10  },
+	{ "restart-rumble",           100,    256,  FFDEVSIM_DROP,  FFBENCH_RESTART,    3,     1, 1,    1,     FFBENCH_ABSOLUTE,  0,    5000,  180,   10  },
+	{ "adaptive-slow-device",     2000,   16,   FFDEVSIM_BLOCK, FFBENCH_UPDATE,     0,     1, 1,    1,     FFBENCH_ADAPTIVE,  0,    500,   300,   20  },
+	{ "gain",                     100,    256,  FFDEVSIM_DROP,  FFBENCH_GAIN,       -1,    1, 1,    1,     FFBENCH_ABSOLUTE,  0,    1000,  900,   0   },
+	{ "autocenter",               100,    256,  FFDEVSIM_DROP,  FFBENCH_AUTOCENTER, -1,    1, 1,    1,     FFBENCH_ABSOLUTE,  0,    1000,  900,   0   },
+};
+#define N_CASES (sizeof(cases) / sizeof(cases[0]))
+
+void print_help(char* program_name)
+{
+	printf("Usage: %s [--list] [--verbose] [case ...]\n", program_name);
+	printf("Runs choke-test scenarios against virtual devices (see ffemu, needs access to /dev/uinput),\n");
+	printf("and checks the achieved update rate and the lag of an effect sent right after each salvo.\n");
+	printf("Without cases, all of them are run. Exits with status 1 if any of them failed.\n\n");
+	printf("\t--list:\t\t print the cases with their thresholds, and exit\n");
+	printf("\t--verbose:\t print the full statistics of each salvo\n");
+	exit(1);
+}
+
+void print_case(const struct regress_case* c)
+{
+	printf("%-26s %-10s %-24s %d slot(s), every %5luus, device %4luus/%3d (%s): >= %.0f updates/s",
+			c->name, ffbench_pacing_names[c->pacing], c->effect_idx >= 0 ? effect_names[c->effect_idx] : "-",
+			c->n_effects, c->update_period, c->service_period, c->queue_depth,
+			ffdevsim_overflow_policy_names[c->overflow_policy], c->min_update_rate);
+	if (c->max_lag)
+		printf(", lag <= %.0fms", c->max_lag);
+	printf("\n");
+}
+
+/* Run a case, returns whether it passed */
+int run_case(const struct regress_case* c, int verbose)
+{
+	struct ffdevsim_config config;
+	struct ffbench_scenario scenario;
+	struct ffbench bench;
+	static struct ffbench_result result;
+	unsigned long n_updates;
+	double update_rate;
+	char reason[128] = "";
+	int ret;
+
+	memset(&config, 0, sizeof(config));
+	config.name = "ffregress virtual device";
+	config.n_effects = 16;
+	config.service_period = c->service_period;
+	config.queue_depth = c->queue_depth;
+	config.overflow_policy = c->overflow_policy;
+	if (ffbench_open_emulated(&bench, &config) == -1) {
+		printf("%-26s FAIL  create virtual device: %s\n", c->name, strerror(errno));
+		return 0;
+	}
+
+	ffbench_default_scenario(&scenario, c->operation);
+	scenario.effect_idx = c->effect_idx;
+	scenario.n_effects = c->n_effects;
+	scenario.burst = c->burst;
+	scenario.change_params = c->change_params;
+	scenario.update_period = c->update_period;
+	scenario.duration = SALVO_DURATION;
+	scenario.pacing = c->pacing;
+	scenario.upload_cache = c->upload_cache;
+	ret = ffbench_run(&bench, &scenario, &result);
+	if (ret == 0 && verbose)
+		ffbench_print_result(&bench, &scenario, &result);
+	ffbench_close(&bench);
+
+	if (ret == -1) {
+		printf("%-26s FAIL  %s\n", c->name, strerror(errno));
+		return 0;
+	}
+
+	/* With adaptive pacing, the producer ticks at update_period whatever ffpace actually sent */
+	n_updates = (c->pacing == FFBENCH_ADAPTIVE ? result.pace.n_updates : result.n_updates);
+	update_rate = (result.duration ? 1e6 * n_updates / result.duration : 0);
+	if (result.n_errors)
+		snprintf(reason, sizeof(reason), "%lu syscalls failed", result.n_errors);
+	else if (update_rate < c->min_update_rate)
+		snprintf(reason, sizeof(reason), "%.1f updates/s < %.0f", update_rate, c->min_update_rate);
+	else if (c->max_lag && result.lost)
+		snprintf(reason, sizeof(reason), "final effect lost");
+	else if (c->max_lag && result.applied_lag > c->max_lag)
+		snprintf(reason, sizeof(reason), "lag %.3fms > %.0fms", result.applied_lag, c->max_lag);
+
+	printf("%-26s %-4s  %10.1f updates/s", c->name, reason[0] ? "FAIL" : "PASS", update_rate);
+	if (c->max_lag && !result.lost)
+		printf(", lag %8.3fms (%lu stale, %lu dropped)", result.applied_lag, result.stale_updates, result.dropped);
+	if (reason[0])
+		printf("  <- %s", reason);
+	printf("\n");
+	fflush(stdout);
+	return !reason[0];
+}
+
+int main(int argc, char** argv)
+{
+	int list = 0, verbose = 0, n_selected = 0, n_run = 0, n_failed = 0;
+	int selected[N_CASES];
+	unsigned int i;
+	int j;
+
+	memset(selected, 0, sizeof(selected));
+	for (j = 1; j < argc; j++) {
+		if (strncmp(argv[j], "--help", 64) == 0)
+			print_help(argv[0]);
+		else if (strncmp(argv[j], "--list", 64) == 0)
+			list = 1;
+		else if (strncmp(argv[j], "--verbose", 64) == 0)
+			verbose = 1;
+		else {
+			for (i = 0; i < N_CASES && strcmp(argv[j], cases[i].name); i++)
+				;
+			if (i == N_CASES) {
+				printf("No such case: %s\n", argv[j]);
+				exit(1);
+			}
+			selected[i] = 1;
+			n_selected++;
+		}
+	}
+
+	init_effects();
+	for (i = 0; i < N_CASES; i++) {
+		if (n_selected && !selected[i])
+			continue;
+		if (list) {
+			print_case(&cases[i]);
+			continue;
+		}
+		n_run++;
+		if (!run_case(&cases[i], verbose))
+			n_failed++;
+	}
+	if (list)
+		exit(0);
+
+	printf("\n%d of %d cases passed.\n", n_run - n_failed, n_run);
+	exit(n_failed ? 1 : 0);
+}
@@ -0,0 +1,414 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ffrender.h"
+
+#define INFINITE_LENGTH     1e30f
+
+int ffrender_init(struct ffrender* r, int n_slots)
+{
+	memset(r, 0, sizeof(*r));
+	r->n_slots = n_slots;
+	r->axis = -1;
+	r->gain = 1.0f;
+
+	r->kind = calloc(n_slots, sizeof(*r->kind));
+	r->count = calloc(n_slots, sizeof(*r->count));
+	r->play_time = calloc(n_slots, sizeof(*r->play_time));
+	r->delay = calloc(n_slots, sizeof(*r->delay));
+	r->length = calloc(n_slots, sizeof(*r->length));
+	r->level = calloc(n_slots, sizeof(*r->level));
+	r->level_end = calloc(n_slots, sizeof(*r->level_end));
+	r->magnitude = calloc(n_slots, sizeof(*r->magnitude));
+	r->wave_period = calloc(n_slots, sizeof(*r->wave_period));
+	r->phase = calloc(n_slots, sizeof(*r->phase));
+	r->waveform = calloc(n_slots, sizeof(*r->waveform));
+	r->direction = calloc(n_slots, sizeof(*r->direction));
+	r->attack_length = calloc(n_slots, sizeof(*r->attack_length));
+	r->attack_level = calloc(n_slots, sizeof(*r->attack_level));
+	r->fade_length = calloc(n_slots, sizeof(*r->fade_length));
+	r->fade_level = calloc(n_slots, sizeof(*r->fade_level));
+	r->condition = calloc(n_slots, sizeof(*r->condition));
+	if (!r->kind || !r->count || !r->play_time || !r->delay || !r->length || !r->level || !r->level_end ||
+	    !r->magnitude || !r->wave_period || !r->phase || !r->waveform || !r->direction ||
+	    !r->attack_length || !r->attack_level || !r->fade_length || !r->fade_level || !r->condition) {
+		ffrender_free(r);
+		return -1;
+	}
+	return 0;
+}
+
+void ffrender_free(struct ffrender* r)
+{
+	free(r->kind);
+	free(r->count);
+	free(r->play_time);
+	free(r->delay);
+	free(r->length);
+	free(r->level);
+	free(r->level_end);
+	free(r->magnitude);
+	free(r->wave_period);
+	free(r->phase);
+	free(r->waveform);
+	free(r->direction);
+	free(r->attack_length);
+	free(r->attack_level);
+	free(r->fade_length);
+	free(r->fade_level);
+	free(r->condition);
+}
+
+static void set_envelope(struct ffrender* r, int s, const struct ff_envelope* envelope)
+{
+	r->attack_length[s] = envelope->attack_length;
+	r->attack_level[s] = envelope->attack_level / 32767.0f;
+	/* Effects without end don't fade */
+	r->fade_length[s] = (r->length[s] < INFINITE_LENGTH ? envelope->fade_length : 0);
+	r->fade_level[s] = envelope->fade_level / 32767.0f;
+}
+
+static void upload(struct ffrender* r, int s, const struct ff_effect* effect)
+{
+	float angle = effect->direction * (2 * M_PI / 65536);
+
+	r->kind[s] = FFRENDER_NONE;
+	r->delay[s] = effect->replay.delay;
+	r->length[s] = (effect->replay.length ? effect->replay.length : INFINITE_LENGTH);
+	r->direction[s] = (r->axis == -1 ? 1.0f : (r->axis == 0 ? sinf(angle) : -cosf(angle)));
+	r->attack_length[s] = r->fade_length[s] = 0;
+
+	switch (effect->type) {
+	case FF_CONSTANT:
+		r->kind[s] = FFRENDER_CONSTANT;
+		r->level[s] = effect->u.constant.level / 32767.0f;
+		set_envelope(r, s, &effect->u.constant.envelope);
+		break;
+	case FF_RAMP:
+		r->kind[s] = FFRENDER_RAMP;
+		r->level[s] = effect->u.ramp.start_level / 32767.0f;
+		r->level_end[s] = effect->u.ramp.end_level / 32767.0f;
+		set_envelope(r, s, &effect->u.ramp.envelope);
+		break;
+	case FF_PERIODIC:
+		r->kind[s] = FFRENDER_PERIODIC;
+		r->level[s] = effect->u.periodic.offset / 32767.0f;
+		/* Custom waveforms can't be rendered */
+		r->level_end[s] = (effect->u.periodic.waveform == FF_CUSTOM ? 0 : effect->u.periodic.magnitude / 32767.0f);
+		r->wave_period[s] = (effect->u.periodic.period ? effect->u.periodic.period : 1);
+		r->phase[s] = effect->u.periodic.phase / 65536.0f;
+		r->waveform[s] = effect->u.periodic.waveform;
+		set_envelope(r, s, &effect->u.periodic.envelope);
+		break;
+	case FF_SPRING:
+	case FF_DAMPER:
+	case FF_FRICTION:
+	case FF_INERTIA:
+		r->kind[s] = FFRENDER_CONDITION;
+		r->level[s] = effect->type;
+		r->condition[s] = effect->u.condition[r->axis == 1 ? 1 : 0];
+		break;
+	case FF_RUMBLE:
+		r->kind[s] = FFRENDER_RUMBLE;
+		r->magnitude[s] = effect->u.rumble.strong_magnitude / 65535.0f;
+		r->level_end[s] = effect->u.rumble.weak_magnitude / 65535.0f;
+		break;
+	}
+}
+
+void ffrender_apply(struct ffrender* r, const struct ff_command* cmd, unsigned long long time)
+{
+	int s = cmd->id;
+
+	switch (cmd->type) {
+	case FF_CMD_UPLOAD:
+		if (s < 0 || s >= r->n_slots)
+			return;
+		upload(r, s, &cmd->effect);
+		/* Updating a playing effect restarts it with the new parameters */
+		if (r->count[s])
+			r->play_time[s] = time / 1e6;
+		return;
+	case FF_CMD_ERASE:
+		if (s < 0 || s >= r->n_slots)
+			return;
+		r->kind[s] = FFRENDER_NONE;
+		r->count[s] = 0;
+		return;
+	case FF_CMD_PLAY:
+		if (s < 0 || s >= r->n_slots)
+			return;
+		r->count[s] = (cmd->value > 0 ? cmd->value : 0);
+		r->play_time[s] = time / 1e6;
+		return;
+	case FF_CMD_GAIN:
+		r->gain = cmd->value / 65535.0f;
+		return;
+	case FF_CMD_AUTOCENTER:
+		r->autocenter = cmd->value / 65535.0f;
+		return;
+	}
+}
+
+
+
+/*
+ * Timing of one effect during a render call. Times are in milliseconds, relative to the start
+ * of the repetition the first sample falls in, so they stay small enough for single precision.
+ */
+struct slot_timing {
+	float local0, step;
+	float rep_period, delay, length, count;
+	float inv_attack, attack_bias, attack_level;
+	float inv_fade, fade_bias, fade_level;
+};
+
+static inline float clamp01(float x)
+{
+	return (x < 0 ? 0 : (x > 1 ? 1 : x));
+}
+
+/* Returns 1.0 if the effect is playing at sample 'i', 0.0 otherwise, and the time since the start of its repetition */
+static inline float sample_timing(const struct slot_timing* t, int i, float* within, float* rel)
+{
+	float local = t->local0 + i * t->step;
+	float rep = (float)(int)(local / t->rep_period);
+
+	*within = local - rep * t->rep_period - t->delay;
+	*rel = i * t->step - rep * t->rep_period;
+	/* No short-circuit evaluation, which would stop the vectorization */
+	return (float)((local >= 0) & (rep < t->count) & (*within >= 0) & (*within < t->length));
+}
+
+/* Attack and fade of the absolute level, as ff-memless does */
+static inline float envelope(const struct slot_timing* t, float value, float within)
+{
+	float a = clamp01(within * t->inv_attack + t->attack_bias);
+	float f = clamp01((t->length - within) * t->inv_fade + t->fade_bias);
+	float magnitude = fabsf(value);
+
+	magnitude = t->attack_level + (magnitude - t->attack_level) * a;
+	magnitude = t->fade_level + (magnitude - t->fade_level) * f;
+	return copysignf(magnitude, value);
+}
+
+static float condition_force(const struct ffrender* r, int s)
+{
+	const struct ff_condition_effect* c = &r->condition[s];
+	float x, deadband = c->deadband / 65535.0f, force = 0;
+
+	switch ((int)r->level[s]) {
+	case FF_SPRING:
+		x = r->position - c->center / 32767.0f;
+		break;
+	case FF_DAMPER:
+		x = r->velocity;
+		break;
+	case FF_FRICTION:
+		x = (r->velocity > 0 ? 1.0f : (r->velocity < 0 ? -1.0f : 0.0f));
+		deadband = 0;
+		break;
+	default:
+		return 0;   /* inertia needs the acceleration */
+	}
+
+	if (x > deadband) {
+		force = -(c->right_coeff / 32767.0f) * (x - deadband);
+		if (force < -c->right_saturation / 65535.0f)
+			force = -c->right_saturation / 65535.0f;
+	} else if (x < -deadband) {
+		force = -(c->left_coeff / 32767.0f) * (x + deadband);
+		if (force > c->left_saturation / 65535.0f)
+			force = c->left_saturation / 65535.0f;
+	}
+	return force;
+}
+
+static void render_periodic(const struct slot_timing* t, float phase_base, float inv_period, int waveform,
+                            float offset, float magnitude, float direction, int n, float* force)
+{
+	float within, rel, on, f, w, x;
+	float saw_sign = (waveform == FF_SAW_UP ? 1.0f : -1.0f);
+	int i;
+
+	/* One loop per waveform, to keep the loops free of branches */
+	switch (waveform) {
+	case FF_SQUARE:
+		for (i = 0; i < n; i++) {
+			on = sample_timing(t, i, &within, &rel);
+			f = phase_base + rel * inv_period;
+			f -= (float)(int)f;
+			f += (float)(f < 0);
+			w = 1 - 2 * (float)(f >= 0.5f);
+			force[i] += on * direction * (offset + envelope(t, magnitude, within) * w);
+		}
+		break;
+	case FF_TRIANGLE:
+		for (i = 0; i < n; i++) {
+			on = sample_timing(t, i, &within, &rel);
+			f = phase_base + rel * inv_period + 0.25f;
+			f -= (float)(int)f;
+			f += (float)(f < 0);
+			w = 1 - 4 * fabsf(f - 0.5f);
+			force[i] += on * direction * (offset + envelope(t, magnitude, within) * w);
+		}
+		break;
+	case FF_SINE:
+		for (i = 0; i < n; i++) {
+			on = sample_timing(t, i, &within, &rel);
+			f = phase_base + rel * inv_period;
+			f -= (float)(int)f;
+			f += (float)(f < 0);
+			/* Parabolic approximation of sin(2 pi x) on [-0.5, 0.5], error below 0.1% */
+			x = f - 0.5f;
+			w = 8 * x - 16 * x * fabsf(x);
+			w = -(0.225f * (w * fabsf(w) - w) + w);
+			force[i] += on * direction * (offset + envelope(t, magnitude, within) * w);
+		}
+		break;
+	case FF_SAW_UP:
+	case FF_SAW_DOWN:
+		for (i = 0; i < n; i++) {
+			on = sample_timing(t, i, &within, &rel);
+			f = phase_base + rel * inv_period;
+			f -= (float)(int)f;
+			f += (float)(f < 0);
+			w = saw_sign * (2 * f - 1);
+			force[i] += on * direction * (offset + envelope(t, magnitude, within) * w);
+		}
+		break;
+	}
+}
+
+void ffrender_render(const struct ffrender* r, unsigned long long start, unsigned long long step, int n,
+                     float* force, float* rumble)
+{
+	struct slot_timing t;
+	double local0, reps, phase_base;
+	float within, rel, on, level, slope, c, magnitude;
+	int s, i;
+
+	memset(force, 0, n * sizeof(*force));
+	if (rumble)
+		memset(rumble, 0, n * sizeof(*rumble));
+
+	t.step = step / 1e6;
+	for (s = 0; s < r->n_slots; s++) {
+		if (r->kind[s] == FFRENDER_NONE || !r->count[s])
+			continue;
+
+		t.delay = r->delay[s];
+		t.length = r->length[s];
+		t.rep_period = t.delay + t.length;
+
+		/* Skip ahead to the repetition of the first sample */
+		local0 = start / 1e6 - r->play_time[s];
+		if (local0 + n * (double)t.step < 0)
+			continue;
+		reps = 0;
+		if (local0 > 0 && t.length < INFINITE_LENGTH)
+			reps = floor(local0 / t.rep_period);
+		if (reps >= r->count[s])
+			continue;
+		local0 -= reps * t.rep_period;
+		t.local0 = local0;
+		t.count = r->count[s] - reps;
+
+		t.attack_level = r->attack_level[s];
+		t.fade_level = r->fade_level[s];
+		t.inv_attack = (r->attack_length[s] > 0 ? 1 / r->attack_length[s] : 0);
+		t.attack_bias = (r->attack_length[s] > 0 ? 0 : 1);
+		t.inv_fade = (r->fade_length[s] > 0 ? 1 / r->fade_length[s] : 0);
+		t.fade_bias = (r->fade_length[s] > 0 ? 0 : 1);
+
+		switch (r->kind[s]) {
+		case FFRENDER_CONSTANT:
+			level = r->level[s] * r->direction[s];
+			for (i = 0; i < n; i++) {
+				on = sample_timing(&t, i, &within, &rel);
+				force[i] += on * envelope(&t, level, within);
+			}
+			break;
+		case FFRENDER_RAMP:
+			level = r->level[s];
+			slope = (t.length < INFINITE_LENGTH ? (r->level_end[s] - level) / t.length : 0);
+			for (i = 0; i < n; i++) {
+				on = sample_timing(&t, i, &within, &rel);
+				force[i] += on * r->direction[s] * envelope(&t, level + slope * within, within);
+			}
+			break;
+		case FFRENDER_PERIODIC:
+			phase_base = (local0 - t.delay) / r->wave_period[s] + r->phase[s];
+			phase_base -= floor(phase_base);
+			render_periodic(&t, phase_base, 1 / r->wave_period[s], r->waveform[s],
+					r->level[s], r->level_end[s], r->direction[s], n, force);
+			break;
+		case FFRENDER_CONDITION:
+			c = condition_force(r, s);
+			for (i = 0; i < n; i++)
+				force[i] += sample_timing(&t, i, &within, &rel) * c;
+			break;
+		case FFRENDER_RUMBLE:
+			if (!rumble)
+				break;
+			magnitude = (r->magnitude[s] > r->level_end[s] ? r->magnitude[s] : r->level_end[s]);
+			for (i = 0; i < n; i++)
+				rumble[i] += sample_timing(&t, i, &within, &rel) * magnitude;
+			break;
+		}
+	}
+
+	c = -r->autocenter * r->position;
+	for (i = 0; i < n; i++) {
+		level = (force[i] + c) * r->gain;
+		force[i] = (level < -1 ? -1 : (level > 1 ? 1 : level));
+	}
+	if (rumble) {
+		for (i = 0; i < n; i++) {
+			level = rumble[i] * r->gain;
+			rumble[i] = (level > 1 ? 1 : level);
+		}
+	}
+}
+
+int ffrender_estimate_lag(const float* expected, const float* delivered, int n, int max_lag)
+{
+	float lowest = expected[0], highest = expected[0], sad, best_sad = 0;
+	int i, lag, best_lag = -1;
+
+	for (i = 1; i < n; i++) {
+		lowest = (expected[i] < lowest ? expected[i] : lowest);
+		highest = (expected[i] > highest ? expected[i] : highest);
+	}
+	if (highest - lowest < 0.01f)
+		return -1;
+
+	for (lag = 0; lag <= max_lag; lag++) {
+		sad = 0;
+		for (i = 0; i < n; i++)
+			sad += fabsf(expected[i] - delivered[i + lag]);
+		if (best_lag == -1 || sad < best_sad) {
+			best_lag = lag;
+			best_sad = sad;
+		}
+	}
+	return best_lag;
+}
@@ -0,0 +1,90 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFRENDER_H
+#define FFRENDER_H
+
+#include "ffuinput.h"
+
+/*
+ * Software renderer of force feedback effects: the force a device should be applying at a given time,
+ * given the commands it received. This is the ground truth to compare a (virtual) device with.
+ *
+ * Replay delay, length and play count, envelopes, constant, ramp and periodic effects,
+ * condition effects (for a given axis position and velocity), rumble, gain and autocenter are rendered.
+ * Forces are normalized: 1.0 is the maximum force, the sum of all effects is clipped to [-1, 1].
+ *
+ * The effect parameters are kept as a structure of arrays, one array per parameter,
+ * and each kind of effect is rendered by a branch-free loop over the samples, which the compiler vectorizes.
+ */
+
+enum ffrender_kind {
+	FFRENDER_NONE,              /* no effect uploaded in this slot */
+	FFRENDER_CONSTANT,
+	FFRENDER_RAMP,
+	FFRENDER_PERIODIC,
+	FFRENDER_CONDITION,
+	FFRENDER_RUMBLE,
+	N_FFRENDER_KINDS
+};
+
+struct ffrender {
+	int n_slots;
+	int axis;                           /* force along: -1 = ignore the direction (wheels), 0 = X, 1 = Y */
+	float gain;
+	float autocenter;
+	float position, velocity;           /* axis state for condition effects and autocenter, -1.0 to 1.0 (per second) */
+
+	/* Per effect slot */
+	int* kind;                          /* one of enum ffrender_kind */
+	int* count;                         /* remaining play count, 0 = stopped */
+	double* play_time;                  /* in milliseconds */
+	float* delay;                       /* in milliseconds */
+	float* length;                      /* in milliseconds, huge for infinite effects */
+	float* level;                       /* constant level, ramp start level, periodic offset, condition type */
+	float* level_end;                   /* ramp end level, periodic magnitude, rumble weak magnitude */
+	float* magnitude;                   /* rumble strong magnitude */
+	float* wave_period;                 /* periodic period, in milliseconds */
+	float* phase;                       /* periodic phase, 0.0 to 1.0 */
+	int* waveform;
+	float* direction;                   /* projection of the effect's direction on 'axis' */
+	float* attack_length, * attack_level, * fade_length, * fade_level;
+	struct ff_condition_effect* condition;
+};
+
+/* Returns 0 on success, -1 when out of memory */
+int ffrender_init(struct ffrender* r, int n_slots);
+void ffrender_free(struct ffrender* r);
+
+/* Apply a command received at 'time' (in nanoseconds), as a device would */
+void ffrender_apply(struct ffrender* r, const struct ff_command* cmd, unsigned long long time);
+
+/*
+ * Render 'n' samples, the first at 'start' and then every 'step' (in nanoseconds).
+ * The force is stored in 'force', the rumble magnitude (0.0 to 1.0) in 'rumble' (may be NULL).
+ */
+void ffrender_render(const struct ffrender* r, unsigned long long start, unsigned long long step, int n,
+                     float* force, float* rumble);
+
+/*
+ * Estimate by how many samples 'delivered' lags behind 'expected', as the shift with the smallest
+ * mean absolute difference. 'expected' has 'n' samples, 'delivered' has 'n + max_lag' samples (from the same start).
+ * Returns -1 if 'expected' doesn't change enough to tell.
+ */
+int ffrender_estimate_lag(const float* expected, const float* delivered, int n, int max_lag);
+
+#endif /* FFRENDER_H */
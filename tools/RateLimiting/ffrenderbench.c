@@ -0,0 +1,165 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "ffrender.h"
+
+/* Here are the interesting parameters' default values */
+int n_effects = 1024;
+unsigned long render_time = 10000000;                     /*   10 seconds   */
+unsigned long sample_period = 1000;                       /*  1ms = 1kHz    */
+int block_size = 1000;                                    /* samples per render call */
+/* Corresponding extended cmd-line: "./ffrenderbench 1024 10000000us 1000us 1000" */
+
+unsigned long long get_ntime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+/* Effect 'i' of a mix of every kind of effect, with envelopes, finite and infinite lengths */
+void make_effect(struct ff_effect* effect, int i)
+{
+	static const int waveforms[] = { FF_SQUARE, FF_TRIANGLE, FF_SINE, FF_SAW_UP, FF_SAW_DOWN };
+
+	memset(effect, 0, sizeof(*effect));
+	effect->id = i;
+	effect->direction = 0x4000;
+	effect->replay.length = (i % 3 ? 0 : 500 + i % 1000);
+	effect->replay.delay = i % 100;
+
+	switch (i % 5) {
+	case 0:
+		effect->type = FF_CONSTANT;
+		effect->u.constant.level = 0x7FFF - i;
+		effect->u.constant.envelope.attack_length = 200;
+		effect->u.constant.envelope.fade_length = 200;
+		break;
+	case 1:
+		effect->type = FF_RAMP;
+		effect->u.ramp.start_level = -0x4000;
+		effect->u.ramp.end_level = 0x4000;
+		break;
+	case 2:
+		effect->type = FF_PERIODIC;
+		effect->u.periodic.waveform = waveforms[(i / 5) % 5];
+		effect->u.periodic.period = 10 + i % 200;
+		effect->u.periodic.magnitude = 0x4000;
+		effect->u.periodic.phase = i * 1000;
+		effect->u.periodic.envelope.attack_length = 100;
+		break;
+	case 3:
+		effect->type = FF_SPRING;
+		effect->u.condition[0].right_coeff = 0x4000;
+		effect->u.condition[0].left_coeff = 0x4000;
+		effect->u.condition[0].right_saturation = 0xFFFF;
+		effect->u.condition[0].left_saturation = 0xFFFF;
+		break;
+	case 4:
+		effect->type = FF_RUMBLE;
+		effect->u.rumble.strong_magnitude = 0x8000;
+		effect->u.rumble.weak_magnitude = 0x4000;
+		break;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	struct ffrender r;
+	struct ff_command cmd;
+	float* force, * rumble;
+	unsigned long long start_time, stop_time, t, end;
+	unsigned long n_samples = 0;
+	double checksum = 0, elapsed;
+	int i;
+
+	printf("Benchmark of the software force feedback renderer.\n\n");
+
+	/* Show help message */
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--help", 64) == 0) {
+			printf("Usage: %s [<n_effects=%d> \n", argv[0], n_effects);
+			printf("           \t\t[<render_time=%luus> \n", render_time);
+			printf("           \t\t[<sample_period=%luus> \n", sample_period);
+			printf("           \t\t[<block_size=%d> \n", block_size);
+			printf("           ]]]]\n");
+			printf("Uploads and plays 'n_effects' effects of every kind at once (constant, ramp, all periodic waveforms,\n");
+			printf("spring and rumble, with envelopes and replay delays), and renders 'render_time' of force,\n");
+			printf("one sample every 'sample_period', 'block_size' samples per call.\n");
+			printf("Reports the rendering speed, and how much faster than real time it is.\n");
+
+			exit(1);
+		}
+	}
+
+	/* Parse cmd arguments and set parameters */
+	i=1; if (argc > i) n_effects     = atoi(argv[i]);
+	i++; if (argc > i) render_time   = atoi(argv[i]);
+	i++; if (argc > i) sample_period = atoi(argv[i]);
+	i++; if (argc > i) block_size    = atoi(argv[i]);
+
+	if (n_effects < 1 || !sample_period || block_size < 1) {
+		printf("Invalid parameters.\n");
+		exit(1);
+	}
+
+	force = malloc(block_size * sizeof(*force));
+	rumble = malloc(block_size * sizeof(*rumble));
+	if (!force || !rumble || ffrender_init(&r, n_effects) == -1) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+	r.axis = 0;
+	r.position = 0.25f;
+
+	for (i = 0; i < n_effects; i++) {
+		memset(&cmd, 0, sizeof(cmd));
+		cmd.type = FF_CMD_UPLOAD;
+		cmd.id = i;
+		make_effect(&cmd.effect, i);
+		ffrender_apply(&r, &cmd, 0);
+
+		cmd.type = FF_CMD_PLAY;
+		cmd.value = 3;
+		ffrender_apply(&r, &cmd, 0);
+	}
+
+	start_time = get_ntime();
+	end = 1000ull * render_time;
+	for (t = 0; t < end; t += 1000ull * sample_period * block_size) {
+		ffrender_render(&r, t, 1000ull * sample_period, block_size, force, rumble);
+		n_samples += block_size;
+		checksum += force[0] + rumble[0];
+	}
+	stop_time = get_ntime();
+	elapsed = (stop_time - start_time) / 1e9;
+
+	printf("Rendered %d effects x %lu samples in %.3fs (checksum %.3f)\n", n_effects, n_samples, elapsed, checksum);
+	printf("%.1f million effect-samples/s, %.1fx faster than real time\n",
+			(double)n_effects * n_samples / elapsed / 1e6, render_time / 1e6 / elapsed);
+
+	ffrender_free(&r);
+	free(force);
+	free(rumble);
+
+	exit(0);
+}
@@ -0,0 +1,524 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <linux/input.h>
+
+#include "ffuinput.h"
+#include "ffdevsim.h"
+#include "fflog.h"
+#include "ffhist.h"
+#include "ffrender.h"
+
+/* Here are the interesting parameters' default values */
+double speed = 1.0;                                       /* original timing */
+unsigned long service_period = 2000;                      /*       2ms      */
+int queue_depth = 256;
+int overflow_policy = FFDEVSIM_DROP;
+/* Corresponding extended cmd-line: "./ffreplay session.fflog /dev/input/eventXX 1.0" */
+
+/* Virtual device, to measure when the replayed commands are applied (when using --emulate) */
+struct ffdevsim sim;
+int emulate = 0;
+struct ffhist device_lag_hist;      /* time from receipt until applied by the virtual device */
+struct ff_command* delivered;       /* commands as applied by the virtual device, logged after the replay */
+size_t n_delivered, max_delivered;
+unsigned long n_delivered_lost = 0; /* didn't fit in 'delivered' */
+
+/* Comparison of the expected and delivered force */
+#define SAMPLE_PERIOD       1000000ull  /* 1ms, in nanoseconds */
+#define LAG_WINDOW          1000        /* samples per lag estimation */
+#define MAX_LAG             2000        /* in samples */
+
+volatile sig_atomic_t quit = 0;
+
+void handle_signal(int sig)
+{
+	quit = 1;
+}
+
+unsigned long long get_ntime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+void sleep_until(unsigned long long deadline)
+{
+	struct timespec ts;
+
+	ts.tv_sec = deadline / 1000000000ull;
+	ts.tv_nsec = deadline % 1000000000ull;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !quit)
+		;
+}
+
+/* Called from the thread of the virtual device: no I/O here, that would disturb the timing we measure */
+void on_device_apply(void* data, const struct ff_command* cmd, unsigned long long apply_time)
+{
+	ffhist_add(&device_lag_hist, apply_time - cmd->timestamp);
+
+	if (n_delivered == max_delivered) {
+		n_delivered_lost++;
+		return;
+	}
+	delivered[n_delivered] = *cmd;
+	delivered[n_delivered++].timestamp = apply_time;
+}
+
+/* Amount of records of the log at 'path', -1 on error */
+long count_log_records(const char* path)
+{
+	struct fflog_reader log;
+	struct ff_command cmd;
+	long n = 0;
+
+	if (fflog_open(&log, path) == -1)
+		return -1;
+	while (fflog_next(&log, &cmd) == 1)
+		n++;
+	fflog_close_reader(&log);
+	return n;
+}
+
+/* Write the commands applied by the virtual device to a log at 'path', with times relative to 'start_time' */
+int write_delivered_log(const char* path, int n_effects, unsigned long long start_time)
+{
+	struct fflog_writer writer;
+	size_t i;
+
+	if (fflog_create(&writer, path, "delivered", -1, n_effects, start_time) == -1)
+		return -1;
+	for (i = 0; i < n_delivered; i++) {
+		if (fflog_append(&writer, &delivered[i]) == -1) {
+			fflog_close(&writer);
+			return -1;
+		}
+	}
+	return fflog_close(&writer);
+}
+
+/* Renders the force of a log, as the device should apply it, in consecutive blocks */
+struct log_renderer {
+	struct fflog_reader log;
+	struct ffrender r;
+	struct ff_command next;
+	int has_next;
+	double speed;
+	unsigned long long time;            /* of the next sample, in nanoseconds */
+};
+
+int log_renderer_open(struct log_renderer* lr, const char* path, int n_effects, double speed)
+{
+	if (fflog_open(&lr->log, path) == -1)
+		return -1;
+	if (ffrender_init(&lr->r, n_effects) == -1) {
+		fflog_close_reader(&lr->log);
+		return -1;
+	}
+	lr->has_next = (fflog_next(&lr->log, &lr->next) == 1);
+	lr->speed = speed;
+	lr->time = 0;
+	return 0;
+}
+
+void log_renderer_close(struct log_renderer* lr)
+{
+	ffrender_free(&lr->r);
+	fflog_close_reader(&lr->log);
+}
+
+/* Render the next 'n' samples: the force, plus the rumble magnitude for rumble devices */
+void render_log(struct log_renderer* lr, float* force, int n)
+{
+	static float rumble[LAG_WINDOW + MAX_LAG];
+	unsigned long long next_time;
+	int done, i, k;
+
+	for (done = 0; done < n; done += k) {
+		/* Commands are applied from the first sample at or after their time */
+		while (lr->has_next && (next_time = lr->next.timestamp / lr->speed) <= lr->time) {
+			ffrender_apply(&lr->r, &lr->next, next_time);
+			lr->has_next = (fflog_next(&lr->log, &lr->next) == 1);
+		}
+
+		k = n - done;
+		if (lr->has_next) {
+			next_time = lr->next.timestamp / lr->speed;
+			if ((next_time - lr->time + SAMPLE_PERIOD - 1) / SAMPLE_PERIOD < k)
+				k = (next_time - lr->time + SAMPLE_PERIOD - 1) / SAMPLE_PERIOD;
+		}
+		ffrender_render(&lr->r, lr->time, SAMPLE_PERIOD, k, force + done, rumble);
+		for (i = 0; i < k; i++)
+			force[done + i] += rumble[i];
+		lr->time += k * SAMPLE_PERIOD;
+	}
+}
+
+/*
+ * Render the force the log asked for, and the force the virtual device applied, over 'duration',
+ * and report by how much the applied force lags behind, per window of LAG_WINDOW samples.
+ */
+void print_force_lag(const char* log_file_name, const char* delivered_file_name, int n_effects,
+                     unsigned long long duration)
+{
+	static float expected[LAG_WINDOW], delivered[LAG_WINDOW + MAX_LAG];
+	struct log_renderer expected_lr, delivered_lr;
+	struct ffhist force_lag_hist;
+	unsigned long long t;
+	unsigned long n_flat = 0;
+	int lag;
+
+	if (log_renderer_open(&expected_lr, log_file_name, n_effects, speed) == -1) {
+		perror("Render force");
+		return;
+	}
+	if (log_renderer_open(&delivered_lr, delivered_file_name, n_effects, 1.0) == -1) {
+		perror("Render force");
+		log_renderer_close(&expected_lr);
+		return;
+	}
+
+	ffhist_reset(&force_lag_hist);
+	render_log(&delivered_lr, delivered, MAX_LAG);
+	for (t = 0; t < duration; t += LAG_WINDOW * SAMPLE_PERIOD) {
+		render_log(&expected_lr, expected, LAG_WINDOW);
+		render_log(&delivered_lr, delivered + MAX_LAG, LAG_WINDOW);
+
+		lag = ffrender_estimate_lag(expected, delivered, LAG_WINDOW, MAX_LAG);
+		if (lag == -1)
+			n_flat++;
+		else
+			ffhist_add(&force_lag_hist, lag * SAMPLE_PERIOD);
+
+		memmove(delivered, delivered + LAG_WINDOW, MAX_LAG * sizeof(*delivered));
+	}
+
+	ffhist_print(&force_lag_hist, "Force lag");
+	printf("(per %dms window, up to %dms, %lu windows without force changes)\n",
+			(int)(LAG_WINDOW * SAMPLE_PERIOD / 1000000), (int)(MAX_LAG * SAMPLE_PERIOD / 1000000), n_flat);
+
+	log_renderer_close(&expected_lr);
+	log_renderer_close(&delivered_lr);
+}
+
+int fd;
+int n_log_effects;
+int* replay_ids;                /* effect id on the device, for each recorded effect id, -1 if not uploaded */
+
+unsigned long n_replayed[N_FF_CMD_TYPES];
+unsigned long n_failed, n_skipped;
+struct ffhist lateness_hist;        /* time the command was sent after its (scaled) original time */
+struct ffhist syscall_hist;
+
+/* Send a recorded command to the device, returns -1 on error */
+int replay_command(const struct ff_command* cmd)
+{
+	struct ff_effect effect;
+	struct input_event ie;
+	int id = cmd->id;
+
+	memset(&ie, 0, sizeof(ie));
+	ie.type = EV_FF;
+	ie.value = cmd->value;
+
+	switch (cmd->type) {
+	case FF_CMD_UPLOAD:
+		effect = cmd->effect;
+		effect.id = replay_ids[id];
+		if (ioctl(fd, EVIOCSFF, &effect) < 0)
+			return -1;
+		replay_ids[id] = effect.id;
+		return 0;
+	case FF_CMD_ERASE:
+		if (ioctl(fd, EVIOCRMFF, replay_ids[id]) < 0)
+			return -1;
+		replay_ids[id] = -1;
+		return 0;
+	case FF_CMD_PLAY:
+		ie.code = replay_ids[id];
+		break;
+	case FF_CMD_GAIN:
+		ie.code = FF_GAIN;
+		break;
+	case FF_CMD_AUTOCENTER:
+		ie.code = FF_AUTOCENTER;
+		break;
+	}
+	return (write(fd, &ie, sizeof(ie)) == sizeof(ie) ? 0 : -1);
+}
+
+void dump_log(struct fflog_reader* log)
+{
+	struct ff_command cmd;
+	int ret;
+
+	while ((ret = fflog_next(log, &cmd)) == 1) {
+		printf("%14.6f %-10s id=%-3d", cmd.timestamp / 1e9, ff_command_names[cmd.type], cmd.id);
+		if (cmd.type == FF_CMD_UPLOAD)
+			printf(" type=0x%02x length=%ums delay=%ums",
+					cmd.effect.type, cmd.effect.replay.length, cmd.effect.replay.delay);
+		else if (cmd.type != FF_CMD_ERASE)
+			printf(" value=%d", cmd.value);
+		printf("\n");
+	}
+	if (ret == -1)
+		printf("Corrupt record at offset %lu\n", (unsigned long)log->pos);
+}
+
+void print_stats()
+{
+	struct rusage usage;
+	int i;
+
+	printf("%-12s %10s\n", "command", "replayed");
+	for (i = 0; i < N_FF_CMD_TYPES; i++)
+		printf("%-12s %10lu\n", ff_command_names[i], n_replayed[i]);
+	printf("Failed: %lu, skipped (unknown effect id): %lu\n", n_failed, n_skipped);
+	ffhist_print(&lateness_hist, "Lateness");
+	ffhist_print(&syscall_hist, "Syscall");
+
+	getrusage(RUSAGE_SELF, &usage);
+	printf("Peak memory usage: %.1f MiB\n", usage.ru_maxrss / 1024.0);
+}
+
+int main(int argc, char** argv)
+{
+	const char* log_file_name = NULL;
+	char device_file_name[64];
+	char name[FFLOG_NAME_SIZE + 1];
+	char delivered_file_name[] = "/tmp/ffreplay-XXXXXX";
+	struct ffdevsim_config config;
+	struct fflog_reader log;
+	struct ff_command cmd;
+	unsigned long long start_time, deadline, now, last_report_time;
+	long n_records;
+	int dump = 0;
+	int i, ret = 0;
+
+	printf("Force feedback replayer, sending recorded commands to a device with their original timing.\n\n");
+
+	strncpy(device_file_name, "/dev/input/event0", 64);
+
+	/* Show help message */
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--help", 64) == 0) {
+			printf("Usage: %s <log_file> [/dev/input/eventXX [<speed=%.1f> \n", argv[0], speed);
+			printf("   or: %s <log_file> --emulate [<speed=%.1f> [<service_period=%luus> [<queue_depth=%d> [<overflow_policy=%d>\n",
+					argv[0], speed, service_period, queue_depth, overflow_policy);
+			printf("           ]]]]]\n");
+			printf("   or: %s <log_file> --dump\n", argv[0]);
+			printf("Replays a log recorded by ffrecord on the device, at the original timing multiplied by 'speed'\n");
+			printf("(e.g. '2' replays twice as fast), and reports how late the commands could be sent,\n");
+			printf("and how long the device's driver blocked on them. Press Ctrl-C to stop.\n\n");
+
+			printf("With --emulate, a virtual device (see ffemu) is created instead of opening a real one,\n");
+			printf("and the lag of the commands in its queue is reported as well. The force the log asks for,\n");
+			printf("and the force the virtual device applies, are then rendered and compared, to report the lag\n");
+			printf("of the applied force as a time offset.\n");
+			printf("With --dump, the log is printed instead of replayed.\n\n");
+
+			printf("Additional details on some parameters:\n");
+			printf("\tservice_period:\t time the virtual device needs per command, in microseconds\n");
+			printf("\toverflow_policy:\t what the virtual device does when its queue is full:\n");
+				for (i = 0; i < N_FFDEVSIM_OVERFLOW_POLICIES; ++i)
+					printf("\t\t%d: %s\n", i, ffdevsim_overflow_policy_names[i]);
+
+			printf("HOLD FIRMLY YOUR WHEEL OR JOYSTICK TO PREVENT DAMAGES\n");
+
+			exit(1);
+		}
+	}
+	if (argc < 2) {
+		printf("Missing log_file, see --help.\n");
+		exit(1);
+	}
+
+	/* Parse cmd arguments and set parameters */
+	i=1; if (argc > i) log_file_name = argv[i];
+	i++; if (argc > i) strncpy(device_file_name, argv[i], 63);
+	i++; if (argc > i) speed           = atof(argv[i]);
+	i++; if (argc > i) service_period  = atoi(argv[i]);
+	i++; if (argc > i) queue_depth     = atoi(argv[i]);
+	i++; if (argc > i) overflow_policy = atoi(argv[i]);
+
+	if (strncmp(device_file_name, "--emulate", 64) == 0)
+		emulate = 1;
+	if (strncmp(device_file_name, "--dump", 64) == 0)
+		dump = 1;
+	if (!(speed > 0)) {
+		printf("Invalid speed.\n");
+		exit(1);
+	}
+	if (!(overflow_policy >= 0 && overflow_policy < N_FFDEVSIM_OVERFLOW_POLICIES)) {
+		printf("Invalid overflow_policy.\n");
+		exit(1);
+	}
+
+	/* Open log */
+	if (fflog_open(&log, log_file_name) == -1) {
+		perror("Open log file");
+		exit(1);
+	}
+	memset(name, 0, sizeof(name));
+	memcpy(name, log.header->name, FFLOG_NAME_SIZE);
+	printf("Log %s: recorded on '%s' (%04x:%04x), %d effects\n", log_file_name, name,
+			log.header->vendor, log.header->product, log.header->n_effects);
+
+	if (dump) {
+		dump_log(&log);
+		fflog_close_reader(&log);
+		exit(0);
+	}
+
+	n_log_effects = log.header->n_effects;
+	if (n_log_effects < 1) {
+		printf("The log has no force feedback effects.\n");
+		exit(1);
+	}
+	replay_ids = malloc(n_log_effects * sizeof(*replay_ids));
+	if (!replay_ids) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < n_log_effects; i++)
+		replay_ids[i] = -1;
+
+	/* Create the virtual device */
+	if (emulate) {
+		/* Room for every command of the log, plus the erases when closing the device */
+		n_records = count_log_records(log_file_name);
+		max_delivered = (n_records > 0 ? n_records : 0) + n_log_effects;
+		delivered = malloc(max_delivered * sizeof(*delivered));
+		if (!delivered) {
+			printf("Out of memory\n");
+			exit(1);
+		}
+
+		memset(&config, 0, sizeof(config));
+		config.name = "ffreplay virtual device";
+		config.n_effects = n_log_effects;
+		config.service_period = service_period;
+		config.queue_depth = queue_depth;
+		config.overflow_policy = overflow_policy;
+		if (ffdevsim_create(&sim, &config) == -1) {
+			perror("Create virtual device");
+			exit(1);
+		}
+		sim.on_apply = on_device_apply;
+		if (ffdevsim_start(&sim) == -1) {
+			perror("Start virtual device");
+			exit(1);
+		}
+		strncpy(device_file_name, sim.devnode, 64);
+		printf("Virtual device: service period %luus, queue depth %d, overflow policy '%s'\n",
+				service_period, sim.config.queue_depth, ffdevsim_overflow_policy_names[overflow_policy]);
+	}
+
+	/* Open device */
+	fd = open(device_file_name, O_RDWR);
+	if (fd == -1) {
+		perror("Open device file");
+		exit(1);
+	}
+	printf("Device %s opened, replaying at %gx speed\n\n", device_file_name, speed);
+
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+
+	memset(&cmd, 0, sizeof(cmd));
+	start_time = last_report_time = get_ntime();
+	while (!quit && (ret = fflog_next(&log, &cmd)) == 1) {
+		if (cmd.type != FF_CMD_GAIN && cmd.type != FF_CMD_AUTOCENTER &&
+		    (cmd.id < 0 || cmd.id >= n_log_effects ||
+		     (cmd.type != FF_CMD_UPLOAD && replay_ids[cmd.id] == -1))) {
+			n_skipped++;
+			continue;
+		}
+
+		/* Never skip commands to catch up, only the timing may differ from the recording */
+		deadline = start_time + (unsigned long long)(cmd.timestamp / speed);
+		if (get_ntime() < deadline)
+			sleep_until(deadline);
+
+		now = get_ntime();
+		ffhist_add(&lateness_hist, now - deadline);
+		if (replay_command(&cmd) == -1) {
+			n_failed++;
+			if (n_failed == 1)
+				perror("Replay command error");
+		} else {
+			n_replayed[cmd.type]++;
+		}
+		ffhist_add(&syscall_hist, get_ntime() - now);
+
+		if (now - last_report_time > 5000000000ull) {
+			printf("At %.1fs of the log: ", cmd.timestamp / 1e9);
+			ffhist_print(&lateness_hist, "lateness");
+			last_report_time = now;
+		}
+	}
+	if (ret == -1)
+		printf("Corrupt record at offset %lu, stopping.\n", (unsigned long)log.pos);
+
+	/* Leave the device as we found it */
+	for (i = 0; i < n_log_effects; i++) {
+		if (replay_ids[i] != -1)
+			ioctl(fd, EVIOCRMFF, replay_ids[i]);
+	}
+
+	printf("\nReplayed %.3fs of the log in %.3fs\n", cmd.timestamp / 1e9, (get_ntime() - start_time) / 1e9);
+	print_stats();
+
+	close(fd);
+	fflog_close_reader(&log);
+	if (emulate) {
+		/* Let the virtual device drain its queue */
+		usleep(queue_depth * service_period);
+		ffdevsim_stop(&sim);
+		printf("\nVirtual device:\n");
+		ffdevsim_print_stats(&sim);
+		ffhist_print(&device_lag_hist, "Device lag");
+		ffdevsim_destroy(&sim);
+
+		if (n_delivered_lost)
+			printf("Warning: %lu applied commands didn't fit in the delivered log.\n", n_delivered_lost);
+		i = mkstemp(delivered_file_name);
+		if (i == -1 || write_delivered_log(delivered_file_name, n_log_effects, start_time) == -1) {
+			perror("Log the delivered commands");
+		} else {
+			print_force_lag(log_file_name, delivered_file_name, n_log_effects, cmd.timestamp / speed);
+		}
+		if (i != -1) {
+			close(i);
+			unlink(delivered_file_name);
+		}
+		free(delivered);
+	}
+
+	exit(0);
+}
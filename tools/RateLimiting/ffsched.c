@@ -0,0 +1,162 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "ffpacer.h"
+#include "ffsched.h"
+
+int ffsched_init(struct ffsched* sched, int n_streams, unsigned long spin_margin_us)
+{
+	memset(sched, 0, sizeof(*sched));
+	if (n_streams < 1) {
+		errno = EINVAL;
+		return -1;
+	}
+	sched->streams = calloc(n_streams, sizeof(*sched->streams));
+	sched->heap = calloc(n_streams, sizeof(*sched->heap));
+	if (!sched->streams || !sched->heap) {
+		ffsched_free(sched);
+		errno = ENOMEM;
+		return -1;
+	}
+	sched->n_streams = n_streams;
+	sched->spin_margin = 1000ull * spin_margin_us;
+	sched->seed = 1;
+	return 0;
+}
+
+void ffsched_set_stream(struct ffsched* sched, int idx, unsigned long period_us, unsigned long phase_us,
+                        unsigned long jitter_us)
+{
+	struct ffsched_stream* stream = &sched->streams[idx];
+
+	stream->period = 1000ull * period_us;
+	stream->phase = 1000ull * phase_us;
+	stream->jitter = 1000ull * jitter_us;
+}
+
+/* Deadline 'stream->n' of the stream, with a new random jitter */
+static void schedule(struct ffsched* sched, struct ffsched_stream* stream)
+{
+	stream->deadline = sched->start + stream->phase + stream->n * stream->period;
+	if (stream->jitter)
+		stream->deadline += 1000ull * (rand_r(&sched->seed) % (stream->jitter / 1000 + 1));
+}
+
+static int earlier(const struct ffsched* sched, int a, int b)
+{
+	const struct ffsched_stream* sa = &sched->streams[a];
+	const struct ffsched_stream* sb = &sched->streams[b];
+
+	/* Ties go to the lowest stream, to keep the order deterministic */
+	return (sa->deadline < sb->deadline || (sa->deadline == sb->deadline && a < b));
+}
+
+static void sift_down(struct ffsched* sched, int pos)
+{
+	int child, tmp;
+
+	while ((child = 2 * pos + 1) < sched->n_streams) {
+		if (child + 1 < sched->n_streams && earlier(sched, sched->heap[child + 1], sched->heap[child]))
+			child++;
+		if (!earlier(sched, sched->heap[child], sched->heap[pos]))
+			break;
+		tmp = sched->heap[pos];
+		sched->heap[pos] = sched->heap[child];
+		sched->heap[child] = tmp;
+		pos = child;
+	}
+}
+
+void ffsched_start(struct ffsched* sched, unsigned long long start_ntime)
+{
+	struct ffsched_stream* stream;
+	int i;
+
+	sched->start = start_ntime;
+	for (i = 0; i < sched->n_streams; i++) {
+		stream = &sched->streams[i];
+		stream->n = 1;
+		stream->n_dispatched = 0;
+		stream->n_missed = 0;
+		stream->n_skipped = 0;
+		ffhist_reset(&stream->lateness_hist);
+		schedule(sched, stream);
+		sched->heap[i] = i;
+	}
+	for (i = sched->n_streams / 2 - 1; i >= 0; i--)
+		sift_down(sched, i);
+}
+
+unsigned long long ffsched_next_deadline(const struct ffsched* sched)
+{
+	return sched->streams[sched->heap[0]].deadline;
+}
+
+int ffsched_wait(struct ffsched* sched, unsigned long long* now_ntime)
+{
+	int idx = sched->heap[0];
+	struct ffsched_stream* stream = &sched->streams[idx];
+	unsigned long long deadline = stream->deadline;
+	unsigned long long now = ffpacer_get_ntime();
+	unsigned long long behind;
+	struct timespec ts;
+
+	if (now >= deadline) {
+		stream->n_missed++;
+	} else {
+		/* Sleep until shortly before the deadline, then spin for the remainder */
+		if (deadline - now > sched->spin_margin) {
+			ts.tv_sec = (deadline - sched->spin_margin) / 1000000000ull;
+			ts.tv_nsec = (deadline - sched->spin_margin) % 1000000000ull;
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+				;
+		}
+		do {
+			now = ffpacer_get_ntime();
+		} while (now < deadline);
+	}
+	ffhist_add(&stream->lateness_hist, now - deadline);
+	stream->n_dispatched++;
+
+	/* Keep the original schedule, unless we're more than a period behind: don't burst to catch up */
+	stream->n++;
+	behind = now - (sched->start + stream->phase);
+	if (stream->period && behind >= stream->n * stream->period) {
+		stream->n_skipped += behind / stream->period + 1 - stream->n;
+		stream->n = behind / stream->period + 1;
+	}
+	schedule(sched, stream);
+	sift_down(sched, 0);
+
+	if (now_ntime)
+		*now_ntime = now;
+	return idx;
+}
+
+void ffsched_free(struct ffsched* sched)
+{
+	free(sched->streams);
+	free(sched->heap);
+	sched->streams = NULL;
+	sched->heap = NULL;
+	sched->n_streams = 0;
+}
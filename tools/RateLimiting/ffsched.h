@@ -0,0 +1,74 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFSCHED_H
+#define FFSCHED_H
+
+#include "ffhist.h"
+
+/*
+ * Single-threaded multi-rate scheduler on absolute CLOCK_MONOTONIC deadlines.
+ *
+ * Each stream has its own period and phase: deadline n of a stream is 'start + phase + n * period',
+ * delayed by a random amount of at most 'jitter' (which doesn't accumulate), like the traffic of a game
+ * mixing e.g. a 1kHz force loop, 60Hz rumble and occasional condition changes.
+ * The next deadlines of all streams are kept in a min-heap, and ffsched_wait() waits for the earliest one,
+ * as ffpacer_wait() does for a single stream; a stream that falls more than a period behind skips deadlines
+ * instead of bursting to catch up.
+ */
+
+struct ffsched_stream {
+	unsigned long long period;              /* in nanoseconds */
+	unsigned long long phase;
+	unsigned long long jitter;
+
+	unsigned long long n;                   /* index of the next deadline, without jitter */
+	unsigned long long deadline;            /* next deadline, with jitter */
+
+	unsigned long n_dispatched;
+	unsigned long n_missed;     /* deadlines which had already passed before we started waiting */
+	unsigned long n_skipped;    /* deadlines dropped to catch up after falling behind more than a period */
+	struct ffhist lateness_hist;            /* dispatch time minus deadline, in nanoseconds */
+};
+
+struct ffsched {
+	struct ffsched_stream* streams;
+	int n_streams;
+	int* heap;                  /* stream indices, ordered by deadline */
+	unsigned long long start;
+	unsigned long long spin_margin;
+	unsigned int seed;          /* of the jitter, fixed to make runs repeatable */
+};
+
+/* Returns 0 on success, -1 on error (errno is set) */
+int ffsched_init(struct ffsched* sched, int n_streams, unsigned long spin_margin_us);
+
+void ffsched_set_stream(struct ffsched* sched, int idx, unsigned long period_us, unsigned long phase_us,
+                        unsigned long jitter_us);
+
+/* Schedule the first deadline of each stream after 'start_ntime', and reset the statistics */
+void ffsched_start(struct ffsched* sched, unsigned long long start_ntime);
+
+/* Wait until the earliest deadline, and return its stream. The wake-up time is stored in 'now' if not NULL. */
+int ffsched_wait(struct ffsched* sched, unsigned long long* now);
+
+/* Deadline of the stream that will be returned by the next ffsched_wait() */
+unsigned long long ffsched_next_deadline(const struct ffsched* sched);
+
+void ffsched_free(struct ffsched* sched);
+
+#endif /* FFSCHED_H */
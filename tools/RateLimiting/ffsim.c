@@ -0,0 +1,420 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffeffects.h"
+#include "ffsim.h"
+
+#define min( a, b )    ( ( (a) < (b)) ? (a) : (b) )
+#define max( a, b )    ( ( (a) > (b)) ? (a) : (b) )
+
+#define NEVER (~0ull)
+
+const char* ffsim_policy_names[N_FFSIM_POLICIES] = {
+	"no limit",
+	"token bucket",
+	"min interval",
+	"latest wins",
+	"deadline coalescing",
+};
+
+/* Burst size of the token bucket */
+#define TOKEN_BUCKET_SIZE 4
+
+int ffsim_generate_stream(struct ffsim_stream* stream, const struct ffsim_stream_params* params)
+{
+	struct ff_effect effect;
+	unsigned long n_ticks, tick, n, progress_counter;
+	unsigned long long time;
+	int cmds_per_slot, slots_per_tick, slot, j, value;
+
+	memset(stream, 0, sizeof(*stream));
+	stream->n_slots = max(params->n_slots, 1);
+	n_ticks = params->duration / max(params->update_period, 1ul);
+
+	cmds_per_slot = 1;
+	if (params->option == 2 && params->continually_change_efct_params)
+		cmds_per_slot = 2;     /* upload directly before start */
+	slots_per_tick = 1;
+	if (params->option <= 2 && params->burstmode)
+		slots_per_tick = stream->n_slots;
+
+	stream->cmds = malloc(n_ticks * slots_per_tick * cmds_per_slot * sizeof(*stream->cmds));
+	if (!stream->cmds && n_ticks)
+		return -1;
+
+	if (params->option <= 2) {
+		effect = effects[params->effect_idx];
+		prepare_effect_trajectory(params->effect_idx, n_ticks);
+	}
+
+	slot = 0;
+	n = 0;
+	for (tick = 0; tick < n_ticks; tick++) {
+		time = 1000ull * params->update_period * (tick + 1);
+		progress_counter = min(0xFFFFul, 0xFFFFul * (tick * params->update_period) / params->duration);
+
+		if (params->option >= 3) {
+			value = (params->continually_change_efct_params ? 0xFFFF - (int)progress_counter : 0xFFFF);
+			stream->cmds[n].time = time;
+			stream->cmds[n].key = (params->option == 3 ? FFSIM_KEY_GAIN(stream->n_slots)
+			                                           : FFSIM_KEY_AUTOCENTER(stream->n_slots));
+			stream->cmds[n].value = value;
+			n++;
+			continue;
+		}
+
+		if (params->continually_change_efct_params)
+			set_effect_parameters(&effect, params->effect_idx, progress_counter);
+		value = get_effect_parameter(&effect, params->effect_idx);
+
+		if (params->burstmode)
+			slot = 0;
+		for (j = 0; j < slots_per_tick; j++, slot = (slot + 1) % stream->n_slots) {
+			if (params->option == 1 || cmds_per_slot == 2) {
+				stream->cmds[n].time = time;
+				stream->cmds[n].key = FFSIM_KEY_PARAMS(slot);
+				stream->cmds[n].value = value;
+				n++;
+			}
+			if (params->option == 2) {
+				stream->cmds[n].time = time;
+				stream->cmds[n].key = FFSIM_KEY_PLAY(slot);
+				stream->cmds[n].value = 1;
+				n++;
+			}
+		}
+	}
+	stream->n_cmds = n;
+
+	return 0;
+}
+
+void ffsim_free_stream(struct ffsim_stream* stream)
+{
+	free(stream->cmds);
+	stream->cmds = NULL;
+	stream->n_cmds = 0;
+}
+
+
+
+struct ffsim {
+	unsigned long long now;
+	unsigned long long interval, service_cost;
+	int n_keys;
+	struct ffsim_result* result;
+
+	/* URB queue and device */
+	struct ffsim_cmd* urbs;
+	int urb_head, urb_length, urb_depth;
+	unsigned long long device_free_time, next_transfer_time;
+
+	/* Token bucket */
+	unsigned long long tokens_time;
+	double tokens;
+
+	/* Minimum interval: FIFO of held commands */
+	struct ffsim_cmd* fifo;
+	unsigned long fifo_head, fifo_length;
+	unsigned long long last_release_time;
+
+	/* Coalescing: latest pending command per key, and the order in which keys became pending */
+	struct ffsim_cmd* pending;
+	unsigned long long* pending_since;
+	char* is_pending;
+	int* pending_order;
+	int pending_head, n_pending;
+
+	/* Per key: submission time of the newest command, and of the last applied command */
+	unsigned long long* latest_submit_time;
+	unsigned long long* applied_submit_time;
+	unsigned long long* applied_time;
+};
+
+static unsigned long long align_to_interval(const struct ffsim* sim, unsigned long long time)
+{
+	if (!sim->interval)
+		return time;
+	return (time + sim->interval - 1) / sim->interval * sim->interval;
+}
+
+static void push_urb(struct ffsim* sim, const struct ffsim_cmd* cmd)
+{
+	if (sim->urb_length == sim->urb_depth) {
+		sim->result->n_dropped++;
+		return;
+	}
+	sim->urbs[(sim->urb_head + sim->urb_length) % sim->urb_depth] = *cmd;
+	if (!sim->urb_length)
+		sim->next_transfer_time = align_to_interval(sim, max(sim->now, sim->device_free_time));
+	sim->urb_length++;
+	sim->result->max_urb_queue_length = max(sim->result->max_urb_queue_length, sim->urb_length);
+}
+
+static void device_transfer(struct ffsim* sim)
+{
+	const struct ffsim_cmd* cmd = &sim->urbs[sim->urb_head];
+	unsigned long long apply_time = sim->now + sim->service_cost;
+
+	ffhist_add(&sim->result->staleness_hist, apply_time - cmd->time);
+	if (cmd->time < sim->latest_submit_time[cmd->key])
+		sim->result->n_superseded++;
+	sim->applied_submit_time[cmd->key] = cmd->time;
+	sim->applied_time[cmd->key] = apply_time;
+	sim->result->n_delivered++;
+
+	sim->urb_head = (sim->urb_head + 1) % sim->urb_depth;
+	sim->urb_length--;
+
+	/* The device NAKs until it has applied the command */
+	sim->device_free_time = max(sim->now + sim->interval, apply_time);
+	if (sim->urb_length)
+		sim->next_transfer_time = align_to_interval(sim, sim->device_free_time);
+}
+
+/* Policy: no limit */
+
+static void no_limit_arrival(struct ffsim* sim, const struct ffsim_cmd* cmd)
+{
+	push_urb(sim, cmd);
+}
+
+/* Policy: token bucket */
+
+static void token_bucket_arrival(struct ffsim* sim, const struct ffsim_cmd* cmd)
+{
+	if (sim->interval) {
+		sim->tokens += (double)(sim->now - sim->tokens_time) / sim->interval;
+		sim->tokens = min(sim->tokens, (double)TOKEN_BUCKET_SIZE);
+		sim->tokens_time = sim->now;
+	} else {
+		sim->tokens = TOKEN_BUCKET_SIZE;
+	}
+
+	if (sim->tokens < 1.0) {
+		sim->result->n_dropped++;
+		return;
+	}
+	sim->tokens -= 1.0;
+	push_urb(sim, cmd);
+}
+
+/* Policy: minimum interval */
+
+static void min_interval_arrival(struct ffsim* sim, const struct ffsim_cmd* cmd)
+{
+	sim->fifo[sim->fifo_head + sim->fifo_length++] = *cmd;
+	sim->result->max_held = max(sim->result->max_held, sim->fifo_length);
+}
+
+static unsigned long long min_interval_next_release(struct ffsim* sim)
+{
+	if (!sim->fifo_length)
+		return NEVER;
+	return max(sim->fifo[sim->fifo_head].time, sim->last_release_time + sim->interval);
+}
+
+static void min_interval_release(struct ffsim* sim)
+{
+	push_urb(sim, &sim->fifo[sim->fifo_head]);
+	sim->fifo_head++;
+	sim->fifo_length--;
+	sim->last_release_time = sim->now;
+}
+
+/* Policies: latest wins, and deadline coalescing */
+
+static void coalescing_arrival(struct ffsim* sim, const struct ffsim_cmd* cmd)
+{
+	if (sim->is_pending[cmd->key]) {
+		sim->result->n_coalesced++;
+	} else {
+		sim->is_pending[cmd->key] = 1;
+		sim->pending_since[cmd->key] = cmd->time;
+		sim->pending_order[(sim->pending_head + sim->n_pending) % sim->n_keys] = cmd->key;
+		sim->n_pending++;
+		sim->result->max_held = max(sim->result->max_held, (unsigned long)sim->n_pending);
+	}
+	sim->pending[cmd->key] = *cmd;
+}
+
+/* Only hand over a command when the URB queue is empty, so the latest value is sent */
+static unsigned long long coalescing_next_release(struct ffsim* sim)
+{
+	if (!sim->n_pending || sim->urb_length)
+		return NEVER;
+	return sim->now;
+}
+
+static void release_key(struct ffsim* sim, int key)
+{
+	int i, j;
+
+	/* Remove the key from the pending order, keeping the order of the others */
+	for (i = 0, j = 0; i < sim->n_pending; i++) {
+		if (sim->pending_order[(sim->pending_head + i) % sim->n_keys] != key)
+			sim->pending_order[(sim->pending_head + j++) % sim->n_keys] =
+					sim->pending_order[(sim->pending_head + i) % sim->n_keys];
+	}
+	sim->n_pending = j;
+	sim->is_pending[key] = 0;
+	push_urb(sim, &sim->pending[key]);
+}
+
+static void latest_wins_release(struct ffsim* sim)
+{
+	int key = sim->pending_order[sim->pending_head];
+
+	sim->pending_head = (sim->pending_head + 1) % sim->n_keys;
+	sim->n_pending--;
+	sim->is_pending[key] = 0;
+	push_urb(sim, &sim->pending[key]);
+}
+
+/*
+ * How long a pending key may wait: starting/stopping an effect is urgent,
+ * parameter updates can wait a few intervals, gain and autocenter even longer.
+ */
+static unsigned long long key_tolerance(const struct ffsim* sim, int key)
+{
+	if (key >= sim->n_keys - 2)
+		return 8 * sim->interval;
+	if (key % 2)
+		return 0;
+	return 2 * sim->interval;
+}
+
+static void deadline_release(struct ffsim* sim)
+{
+	unsigned long long deadline, earliest = NEVER;
+	int i, key, earliest_key = -1;
+
+	for (i = 0; i < sim->n_pending; i++) {
+		key = sim->pending_order[(sim->pending_head + i) % sim->n_keys];
+		deadline = sim->pending_since[key] + key_tolerance(sim, key);
+		if (deadline < earliest) {
+			earliest = deadline;
+			earliest_key = key;
+		}
+	}
+	release_key(sim, earliest_key);
+}
+
+struct ffsim_policy {
+	void (*arrival)(struct ffsim* sim, const struct ffsim_cmd* cmd);
+	unsigned long long (*next_release)(struct ffsim* sim);     /* NULL if the policy never holds commands */
+	void (*release)(struct ffsim* sim);
+};
+
+static const struct ffsim_policy policies[N_FFSIM_POLICIES] = {
+	{ no_limit_arrival, NULL, NULL },
+	{ token_bucket_arrival, NULL, NULL },
+	{ min_interval_arrival, min_interval_next_release, min_interval_release },
+	{ coalescing_arrival, coalescing_next_release, latest_wins_release },
+	{ coalescing_arrival, coalescing_next_release, deadline_release },
+};
+
+int ffsim_run(int policy_id, const struct ffsim_device* device, const struct ffsim_stream* stream,
+              struct ffsim_result* result)
+{
+	const struct ffsim_policy* policy = &policies[policy_id];
+	struct ffsim sim;
+	unsigned long i;
+	unsigned long long arrival_time, transfer_time, release_time, last_submit_time, last_apply_time;
+	int key, ret = -1;
+
+	memset(result, 0, sizeof(*result));
+	memset(&sim, 0, sizeof(sim));
+	sim.interval = 1000ull * device->usb_interval;
+	sim.service_cost = 1000ull * device->service_cost;
+	sim.n_keys = FFSIM_N_KEYS(stream->n_slots);
+	sim.urb_depth = max(device->urb_queue_depth, 1);
+	sim.tokens = TOKEN_BUCKET_SIZE;
+	sim.result = result;
+
+	/* Allocate everything up front */
+	sim.urbs = malloc(sim.urb_depth * sizeof(*sim.urbs));
+	sim.fifo = malloc(max(stream->n_cmds, 1ul) * sizeof(*sim.fifo));
+	sim.pending = calloc(sim.n_keys, sizeof(*sim.pending));
+	sim.pending_since = calloc(sim.n_keys, sizeof(*sim.pending_since));
+	sim.is_pending = calloc(sim.n_keys, sizeof(*sim.is_pending));
+	sim.pending_order = calloc(sim.n_keys, sizeof(*sim.pending_order));
+	sim.latest_submit_time = calloc(sim.n_keys, sizeof(*sim.latest_submit_time));
+	sim.applied_submit_time = calloc(sim.n_keys, sizeof(*sim.applied_submit_time));
+	sim.applied_time = calloc(sim.n_keys, sizeof(*sim.applied_time));
+	if (!sim.urbs || !sim.fifo || !sim.pending || !sim.pending_since || !sim.is_pending || !sim.pending_order ||
+	    !sim.latest_submit_time || !sim.applied_submit_time || !sim.applied_time)
+		goto out;
+	for (key = 0; key < sim.n_keys; key++) {
+		sim.latest_submit_time[key] = NEVER;
+		sim.applied_submit_time[key] = NEVER;
+	}
+
+	/* Process events in time order: device transfers first, then policy releases, then arrivals */
+	i = 0;
+	for (;;) {
+		arrival_time = (i < stream->n_cmds ? stream->cmds[i].time : NEVER);
+		transfer_time = (sim.urb_length ? sim.next_transfer_time : NEVER);
+		release_time = (policy->next_release ? policy->next_release(&sim) : NEVER);
+
+		sim.now = min(arrival_time, min(transfer_time, release_time));
+		if (sim.now == NEVER)
+			break;
+
+		if (transfer_time == sim.now) {
+			device_transfer(&sim);
+		} else if (release_time == sim.now) {
+			policy->release(&sim);
+		} else {
+			sim.latest_submit_time[stream->cmds[i].key] = arrival_time;
+			result->n_submitted++;
+			policy->arrival(&sim, &stream->cmds[i++]);
+		}
+	}
+
+	/* The device state has settled once it applied the newest submitted value of every key */
+	last_submit_time = (stream->n_cmds ? stream->cmds[stream->n_cmds - 1].time : 0);
+	last_apply_time = last_submit_time;
+	for (key = 0; key < sim.n_keys; key++) {
+		if (sim.latest_submit_time[key] == NEVER)
+			continue;
+		if (sim.applied_submit_time[key] != sim.latest_submit_time[key]) {
+			last_apply_time = NEVER;
+			break;
+		}
+		last_apply_time = max(last_apply_time, sim.applied_time[key]);
+	}
+	result->settle_time = (last_apply_time == NEVER ? NEVER : last_apply_time - last_submit_time);
+	if (last_submit_time && result->n_delivered)
+		result->throughput = 1e9 * result->n_delivered / max(last_submit_time, sim.device_free_time);
+	ret = 0;
+
+out:
+	free(sim.urbs);
+	free(sim.fifo);
+	free(sim.pending);
+	free(sim.pending_since);
+	free(sim.is_pending);
+	free(sim.pending_order);
+	free(sim.latest_submit_time);
+	free(sim.applied_submit_time);
+	free(sim.applied_time);
+	return ret;
+}
@@ -0,0 +1,101 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFSIM_H
+#define FFSIM_H
+
+#include "ffhist.h"
+
+/*
+ * Discrete-event simulation of a rate-limiting policy in a force feedback driver.
+ *
+ * An application submits a stream of commands; the policy decides which of them are put
+ * in the bounded URB queue, and when. The device takes one URB per USB interval,
+ * and needs 'service_cost' to apply it before it can take the next one.
+ *
+ * Each command sets one "key" of the device state: the parameters or the play state of an effect slot,
+ * the gain or the autocenter. Coalescing policies only keep the latest pending value of each key.
+ */
+
+#define FFSIM_KEY_PARAMS(slot)          (2 * (slot))
+#define FFSIM_KEY_PLAY(slot)            (2 * (slot) + 1)
+#define FFSIM_KEY_GAIN(n_slots)         (2 * (n_slots))
+#define FFSIM_KEY_AUTOCENTER(n_slots)   (2 * (n_slots) + 1)
+#define FFSIM_N_KEYS(n_slots)           (2 * (n_slots) + 2)
+
+struct ffsim_cmd {
+	unsigned long long time;            /* submission time, in nanoseconds */
+	int key;
+	int value;
+};
+
+struct ffsim_stream {
+	int n_slots;
+	unsigned long n_cmds;
+	struct ffsim_cmd* cmds;             /* sorted by submission time */
+};
+
+/* A stream as ffchoke's choke loop would send it, with ideal timing (compensate_delays=1) */
+struct ffsim_stream_params {
+	int option;                         /* 1-4, as in ffchoke's menu */
+	int effect_idx;                     /* effect template, for options 1 and 2 */
+	int n_slots;                        /* simultaneous_effects_amount */
+	int burstmode;                      /* simultaneous_effects_burstmode */
+	int continually_change_efct_params;
+	unsigned long update_period;        /* in microseconds */
+	unsigned long duration;             /* in microseconds */
+};
+
+struct ffsim_device {
+	unsigned long usb_interval;         /* in microseconds */
+	int urb_queue_depth;
+	unsigned long service_cost;         /* in microseconds */
+};
+
+enum ffsim_policy_id {
+	FFSIM_NO_LIMIT,                 /* every command goes straight to the URB queue */
+	FFSIM_TOKEN_BUCKET,             /* one token per USB interval, commands without a token are dropped */
+	FFSIM_MIN_INTERVAL,             /* commands wait in a FIFO, released at most one per USB interval */
+	FFSIM_LATEST_WINS,              /* latest pending value per key, oldest key first, URB queue kept empty */
+	FFSIM_DEADLINE_COALESCING,      /* like latest-wins, but the key with the earliest deadline first */
+	N_FFSIM_POLICIES
+};
+
+extern const char* ffsim_policy_names[N_FFSIM_POLICIES];
+
+struct ffsim_result {
+	unsigned long n_submitted;
+	unsigned long n_delivered;          /* applied by the device */
+	unsigned long n_coalesced;          /* replaced by a newer value of the same key before delivery */
+	unsigned long n_dropped;            /* by the policy, or because the URB queue was full */
+	unsigned long n_superseded;         /* delivered while a newer value of the same key was already submitted */
+	int max_urb_queue_length;
+	unsigned long max_held;             /* maximum number of commands held by the policy */
+	double throughput;                  /* delivered commands per simulated second */
+	/* Time after the last submission until the device applied the latest value of every key, ~0 = never */
+	unsigned long long settle_time;
+	struct ffhist staleness_hist;       /* age of each applied value, from submission until applied, in ns */
+};
+
+int ffsim_generate_stream(struct ffsim_stream* stream, const struct ffsim_stream_params* params);
+void ffsim_free_stream(struct ffsim_stream* stream);
+
+/* Run 'policy' on 'stream'. Returns 0 on success, -1 when out of memory. */
+int ffsim_run(int policy, const struct ffsim_device* device, const struct ffsim_stream* stream,
+              struct ffsim_result* result);
+
+#endif /* FFSIM_H */
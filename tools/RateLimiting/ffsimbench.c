@@ -0,0 +1,196 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "ffeffects.h"
+#include "ffsim.h"
+
+/* Here are the interesting parameters' default values */
+unsigned long usb_interval = 2000;                        /*       2ms      */
+int urb_queue_depth = 256;                                /* usbhid's output FIFO */
+unsigned long service_cost = 0;                           /* device applies immediately */
+unsigned long stream_duration = 10000000;                 /*   10 seconds   */
+int effect_type = 0;                                      /* Constant Force */
+/* Corresponding extended cmd-line: "./ffsimbench 2000us 256 0us 10000000us 0" */
+
+/* Streams to generate, as ffchoke would send them */
+unsigned long update_periods[] = { 500, 1000, 2000, 5000, 20000 };
+#define N_UPDATE_PERIODS (sizeof(update_periods) / sizeof(update_periods[0]))
+int slot_amounts[] = { 1, 4 };
+#define N_SLOT_AMOUNTS (sizeof(slot_amounts) / sizeof(slot_amounts[0]))
+
+unsigned long long get_ntime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+void print_result(int policy, const struct ffsim_result* result)
+{
+	char settle[32];
+
+	if (result->settle_time == ~0ull)
+		snprintf(settle, sizeof(settle), "never");
+	else
+		snprintf(settle, sizeof(settle), "%.2f", result->settle_time / 1e6);
+
+	printf("  %-20s %11.1f %9lu %9lu %7d %8lu %9.2f %9.2f %9.2f %9.1f%% %9s\n",
+			ffsim_policy_names[policy], result->throughput, result->n_coalesced, result->n_dropped,
+			result->max_urb_queue_length, result->max_held,
+			ffhist_percentile(&result->staleness_hist, 0.5) / 1e6,
+			ffhist_percentile(&result->staleness_hist, 0.99) / 1e6,
+			result->staleness_hist.max / 1e6,
+			result->n_delivered ? 100.0 * result->n_superseded / result->n_delivered : 0.0,
+			settle);
+}
+
+/* Run every policy against one stream */
+unsigned long run_stream(const struct ffsim_device* device, const struct ffsim_stream_params* params)
+{
+	struct ffsim_stream stream;
+	struct ffsim_result result;
+	unsigned long n_simulated = 0;
+	int policy;
+
+	if (ffsim_generate_stream(&stream, params) == -1) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+
+	printf("\nOption %d", params->option);
+	if (params->option <= 2)
+		printf(", %s, %d slot(s), burstmode %d", effect_names[params->effect_idx], params->n_slots, params->burstmode);
+	printf(", update_period %luus: %lu commands\n", params->update_period, stream.n_cmds);
+
+	for (policy = 0; policy < N_FFSIM_POLICIES; policy++) {
+		if (ffsim_run(policy, device, &stream, &result) == -1) {
+			printf("Out of memory\n");
+			exit(1);
+		}
+		print_result(policy, &result);
+		n_simulated += stream.n_cmds;
+	}
+
+	ffsim_free_stream(&stream);
+	return n_simulated;
+}
+
+int main(int argc, char** argv)
+{
+	struct ffsim_device device;
+	struct ffsim_stream_params params;
+	unsigned long long start_time, stop_time;
+	unsigned long n_simulated = 0;
+	unsigned int p, a;
+	int i, option, burstmode;
+
+	printf("Offline benchmark of force feedback rate-limiting policies.\n\n");
+
+	/* Show help message */
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--help", 64) == 0) {
+			printf("Usage: %s [<usb_interval=%luus> \n", argv[0], usb_interval);
+			printf("           \t\t[<urb_queue_depth=%d> \n", urb_queue_depth);
+			printf("           \t\t[<service_cost=%luus> \n", service_cost);
+			printf("           \t\t[<stream_duration=%luus> \n", stream_duration);
+			printf("           \t\t[<effect_type=%d> \n", effect_type);
+			printf("           ]]]]]\n");
+			printf("Simulates a device that takes one command per 'usb_interval', with a driver queue of 'urb_queue_depth',\n");
+			printf("and runs every rate-limiting policy against the command streams of ffchoke's options 1-4,\n");
+			printf("for several update periods, amounts of simultaneous effects and burst modes.\n\n");
+
+			printf("Reported per policy:\n");
+			printf("\tdelivered/s:\t commands applied by the device per second\n");
+			printf("\tcoalesced:\t commands replaced by a newer value before being sent\n");
+			printf("\tdropped:\t commands dropped by the policy, or because the driver queue was full\n");
+			printf("\tmax_urb, max_held:\t maximum length of the driver queue, and of the policy's own queue\n");
+			printf("\tstale p50/p99/max:\t age of the applied values (from submission until applied), in ms\n");
+			printf("\tsuperseded:\t applied values that had already been replaced by the application\n");
+			printf("\tsettle:\t time after the last command until the device has the latest state, in ms\n\n");
+
+			printf("Additional details on some parameters:\n");
+			printf("\tservice_cost:\t time the device needs to apply a command, in microseconds\n");
+			printf("\teffect_type:\t the effect template used for options 1 and 2, should be one of the following:\n");
+				for (i = 0; i < N_EFFECTS; ++i) printf("\t\t%d: %s\n", i, effect_names[i]);
+
+			exit(1);
+		}
+	}
+
+	/* Parse cmd arguments and set parameters */
+	i=1; if (argc > i) usb_interval    = atoi(argv[i]);
+	i++; if (argc > i) urb_queue_depth = atoi(argv[i]);
+	i++; if (argc > i) service_cost    = atoi(argv[i]);
+	i++; if (argc > i) stream_duration = atoi(argv[i]);
+	i++; if (argc > i) effect_type     = atoi(argv[i]);
+
+	if (!(effect_type >= 0 && effect_type < N_EFFECTS)) {
+		printf("Invalid effect_type.\n");
+		exit(1);
+	}
+
+	init_effects();
+
+	memset(&device, 0, sizeof(device));
+	device.usb_interval = usb_interval;
+	device.urb_queue_depth = urb_queue_depth;
+	device.service_cost = service_cost;
+
+	printf("Device: USB interval %luus, URB queue depth %d, service cost %luus\n",
+			usb_interval, urb_queue_depth, service_cost);
+	printf("  %-20s %11s %9s %9s %7s %8s %9s %9s %9s %10s %9s\n",
+			"policy", "delivered/s", "coalesced", "dropped", "max_urb", "max_held",
+			"stale_p50", "stale_p99", "stale_max", "superseded", "settle");
+
+	start_time = get_ntime();
+	for (option = 1; option <= 4; option++) {
+		for (p = 0; p < N_UPDATE_PERIODS; p++) {
+			memset(&params, 0, sizeof(params));
+			params.option = option;
+			params.effect_idx = effect_type;
+			params.continually_change_efct_params = 1;
+			params.update_period = update_periods[p];
+			params.duration = stream_duration;
+
+			if (option >= 3) {
+				params.n_slots = 1;
+				n_simulated += run_stream(&device, &params);
+				continue;
+			}
+
+			for (a = 0; a < N_SLOT_AMOUNTS; a++) {
+				/* Burst mode makes no difference for a single effect */
+				for (burstmode = 1; burstmode >= (slot_amounts[a] > 1 ? 0 : 1); burstmode--) {
+					params.n_slots = slot_amounts[a];
+					params.burstmode = burstmode;
+					n_simulated += run_stream(&device, &params);
+				}
+			}
+		}
+	}
+	stop_time = get_ntime();
+
+	printf("\nSimulated %lu commands in %.3fs (%.1f million commands/s)\n",
+			n_simulated, (stop_time - start_time) / 1e9, n_simulated / ((stop_time - start_time) / 1e3));
+
+	exit(0);
+}
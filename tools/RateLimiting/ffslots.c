@@ -0,0 +1,115 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+
+#include "ffslots.h"
+
+int ffslots_init(struct ffslots* pool, int fd, int cache_enabled)
+{
+	int i;
+
+	memset(pool, 0, sizeof(*pool));
+	pool->fd = fd;
+	pool->cache_enabled = cache_enabled;
+	if (ioctl(fd, EVIOCGEFFECTS, &pool->n_slots) == -1)
+		return -1;
+	if (pool->n_slots < 0)
+		pool->n_slots = 0;
+
+	pool->ids = malloc(pool->n_slots * sizeof(*pool->ids));
+	pool->uploaded = calloc(pool->n_slots, sizeof(*pool->uploaded));
+	pool->free_slots = malloc(pool->n_slots * sizeof(*pool->free_slots));
+	if (pool->n_slots && (!pool->ids || !pool->uploaded || !pool->free_slots)) {
+		free(pool->ids);
+		free(pool->uploaded);
+		free(pool->free_slots);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	/* Slot 0 is allocated first */
+	for (i = 0; i < pool->n_slots; i++) {
+		pool->ids[i] = -1;
+		pool->free_slots[i] = pool->n_slots - 1 - i;
+	}
+	pool->n_free = pool->n_slots;
+
+	return 0;
+}
+
+void ffslots_free(struct ffslots* pool)
+{
+	int i;
+
+	for (i = 0; i < pool->n_slots; i++) {
+		if (pool->ids[i] != -1)
+			ioctl(pool->fd, EVIOCRMFF, pool->ids[i]);
+	}
+	free(pool->ids);
+	free(pool->uploaded);
+	free(pool->free_slots);
+}
+
+int ffslots_alloc(struct ffslots* pool)
+{
+	if (!pool->n_free)
+		return -1;
+	return pool->free_slots[--pool->n_free];
+}
+
+int ffslots_release(struct ffslots* pool, int slot)
+{
+	int ret = 0;
+
+	if (pool->ids[slot] != -1)
+		ret = ioctl(pool->fd, EVIOCRMFF, pool->ids[slot]);
+	pool->ids[slot] = -1;
+	/* Most recently used slots are reused first */
+	pool->free_slots[pool->n_free++] = slot;
+	return (ret < 0 ? -1 : 0);
+}
+
+int ffslots_upload(struct ffslots* pool, int slot, struct ff_effect* effect)
+{
+	pool->n_uploads++;
+	effect->id = pool->ids[slot];
+
+	if (pool->cache_enabled && pool->ids[slot] != -1 &&
+	    memcmp(effect, &pool->uploaded[slot], sizeof(*effect)) == 0) {
+		pool->n_skipped++;
+		return 0;
+	}
+
+	if (ioctl(pool->fd, EVIOCSFF, effect) < 0) {
+		/* The device may have kept either version, don't trust the cache anymore */
+		memset(&pool->uploaded[slot], 0, sizeof(pool->uploaded[slot]));
+		pool->uploaded[slot].id = -1;
+		return -1;
+	}
+	pool->ids[slot] = effect->id;
+	pool->uploaded[slot] = *effect;
+	return 1;
+}
+
+int ffslots_id(const struct ffslots* pool, int slot)
+{
+	return pool->ids[slot];
+}
@@ -0,0 +1,71 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFSLOTS_H
+#define FFSLOTS_H
+
+#include <linux/input.h>
+
+/*
+ * Pool of the effect slots of a device, sized from EVIOCGEFFECTS.
+ *
+ * Slots are allocated from a free list, and their effect id is handed back to the device when released.
+ * The pool remembers what was last uploaded in each slot: with the upload cache enabled,
+ * an upload whose payload is byte-identical to the previous one of the slot is skipped,
+ * as the device already has it. This is the cheapest way for an application to cut driver traffic.
+ */
+
+struct ffslots {
+	int fd;
+	int n_slots;
+	int cache_enabled;
+
+	int* ids;                           /* effect id on the device, per slot, -1 if not uploaded */
+	struct ff_effect* uploaded;         /* last uploaded payload, per slot */
+	int* free_slots;                    /* stack of free slots */
+	int n_free;
+
+	unsigned long n_uploads;            /* upload requests */
+	unsigned long n_skipped;            /* uploads skipped because identical, i.e. syscalls saved */
+};
+
+/*
+ * Create the pool for the device opened as 'fd', the pool is empty if the device has no effect slots.
+ * Returns 0 on success, -1 on error (errno is set).
+ */
+int ffslots_init(struct ffslots* pool, int fd, int cache_enabled);
+
+/* Erase the effects of all allocated slots, and free the pool */
+void ffslots_free(struct ffslots* pool);
+
+/* Returns a free slot, or -1 if all slots are in use */
+int ffslots_alloc(struct ffslots* pool);
+
+/* Erase the slot's effect from the device, and free the slot. Returns 0 on success, -1 on error (errno is set). */
+int ffslots_release(struct ffslots* pool, int slot);
+
+/*
+ * Upload 'effect' in 'slot', and set its id to the slot's effect id, as EVIOCSFF does.
+ * The whole struct is compared, so clear unused fields (e.g. with memset) before filling it in.
+ * Returns 1 if the effect was uploaded, 0 if the upload was skipped, -1 on error (errno is set).
+ */
+int ffslots_upload(struct ffslots* pool, int slot, struct ff_effect* effect);
+
+/* The slot's effect id on the device, -1 if nothing was uploaded yet */
+int ffslots_id(const struct ffslots* pool, int slot);
+
+#endif /* FFSLOTS_H */
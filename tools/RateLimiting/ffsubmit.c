@@ -0,0 +1,304 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "ffsubmit.h"
+
+const char* ffsubmit_backend_names[N_FFSUBMIT_BACKENDS] = {
+	"write per event",
+	"write per batch",
+	"writev per batch",
+	"io_uring",
+};
+
+static int io_uring_setup(unsigned entries, struct io_uring_params* p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_init(struct ffsubmit* s)
+{
+	struct io_uring_params p;
+	int i;
+
+	memset(&p, 0, sizeof(p));
+	s->ring_fd = io_uring_setup(FFSUBMIT_URING_DEPTH, &p);
+	if (s->ring_fd < 0)
+		return -1;
+
+	s->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	s->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (s->cq_ring_size > s->sq_ring_size)
+			s->sq_ring_size = s->cq_ring_size;
+		s->cq_ring_size = s->sq_ring_size;
+	}
+	s->sq_ring = mmap(NULL, s->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+	                  s->ring_fd, IORING_OFF_SQ_RING);
+	if (s->sq_ring == MAP_FAILED)
+		goto error;
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		s->cq_ring = s->sq_ring;
+	} else {
+		s->cq_ring = mmap(NULL, s->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		                  s->ring_fd, IORING_OFF_CQ_RING);
+		if (s->cq_ring == MAP_FAILED)
+			goto error_sq;
+	}
+	s->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+	               MAP_SHARED | MAP_POPULATE, s->ring_fd, IORING_OFF_SQES);
+	if (s->sqes == MAP_FAILED)
+		goto error_cq;
+
+	s->sq_tail = (unsigned*)((char*)s->sq_ring + p.sq_off.tail);
+	s->sq_mask = (unsigned*)((char*)s->sq_ring + p.sq_off.ring_mask);
+	s->sq_array = (unsigned*)((char*)s->sq_ring + p.sq_off.array);
+	s->cq_head = (unsigned*)((char*)s->cq_ring + p.cq_off.head);
+	s->cq_tail = (unsigned*)((char*)s->cq_ring + p.cq_off.tail);
+	s->cq_mask = (unsigned*)((char*)s->cq_ring + p.cq_off.ring_mask);
+	s->cqes = (struct io_uring_cqe*)((char*)s->cq_ring + p.cq_off.cqes);
+
+	/* Never more batches in flight than the submission queue holds, so it can't overflow */
+	s->batches = calloc(p.sq_entries, sizeof(*s->batches));
+	s->free_batches = malloc(p.sq_entries * sizeof(*s->free_batches));
+	if (!s->batches || !s->free_batches) {
+		free(s->batches);
+		free(s->free_batches);
+		errno = ENOMEM;
+		goto error_sqes;
+	}
+	s->n_batches = p.sq_entries;
+	for (i = 0; i < s->n_batches; i++)
+		s->free_batches[i] = i;
+	s->n_free_batches = s->n_batches;
+
+	return 0;
+
+error_sqes:
+	munmap(s->sqes, p.sq_entries * sizeof(struct io_uring_sqe));
+error_cq:
+	if (s->cq_ring != s->sq_ring)
+		munmap(s->cq_ring, s->cq_ring_size);
+error_sq:
+	munmap(s->sq_ring, s->sq_ring_size);
+error:
+	i = errno;
+	close(s->ring_fd);
+	errno = i;
+	return -1;
+}
+
+/* Collect the completed writes, without a syscall */
+static void uring_reap(struct ffsubmit* s)
+{
+	unsigned head = *s->cq_head;
+	struct io_uring_cqe* cqe;
+
+	while (head != __atomic_load_n(s->cq_tail, __ATOMIC_ACQUIRE)) {
+		cqe = &s->cqes[head & *s->cq_mask];
+		if (cqe->res < 0) {
+			s->n_errors++;
+			s->n_unreported++;
+			s->last_error = -cqe->res;
+		}
+		s->free_batches[s->n_free_batches++] = cqe->user_data;
+		head++;
+	}
+	__atomic_store_n(s->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* Wait for at least one write to complete, and collect the completed writes */
+static int uring_wait(struct ffsubmit* s)
+{
+	int ret;
+
+	s->n_syscalls++;
+	ret = io_uring_enter(s->ring_fd, s->n_unsubmitted, 1, IORING_ENTER_GETEVENTS);
+	if (ret < 0 && errno != EINTR)
+		return -1;
+	if (ret > 0)
+		s->n_unsubmitted -= ret;
+	uring_reap(s);
+	return 0;
+}
+
+static int uring_submit(struct ffsubmit* s)
+{
+	struct io_uring_sqe* sqe;
+	unsigned tail, index;
+	int batch, ret;
+
+	uring_reap(s);
+	while (!s->n_free_batches) {
+		if (uring_wait(s) < 0)
+			return -1;
+	}
+
+	/* The buffer has to stay valid until the write completed */
+	batch = s->free_batches[--s->n_free_batches];
+	memcpy(s->batches[batch], s->events, s->n_events * sizeof(s->events[0]));
+
+	tail = *s->sq_tail;
+	index = tail & *s->sq_mask;
+	sqe = &s->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->fd = s->fd;
+	sqe->addr = (unsigned long)s->batches[batch];
+	sqe->len = s->n_events * sizeof(s->events[0]);
+	sqe->off = -1;                      /* current file position, evdev is not seekable */
+	sqe->user_data = batch;
+	s->sq_array[index] = index;
+	__atomic_store_n(s->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	s->n_unsubmitted++;
+
+	/* Entries the kernel didn't consume (e.g. EAGAIN) stay in the ring, and are retried with the next batch */
+	s->n_syscalls++;
+	ret = io_uring_enter(s->ring_fd, s->n_unsubmitted, 0, 0);
+	if (ret < 0)
+		return -1;
+	s->n_unsubmitted -= ret;
+	return 0;
+}
+
+/* Fail once for the writes that failed asynchronously since the last report (they are already in n_errors) */
+static int report_completions(struct ffsubmit* s)
+{
+	if (!s->n_unreported)
+		return 0;
+	s->n_unreported = 0;
+	errno = s->last_error;
+	return -1;
+}
+
+int ffsubmit_init(struct ffsubmit* s, int fd, int backend)
+{
+	memset(s, 0, sizeof(*s));
+	s->fd = fd;
+	s->backend = backend;
+	s->ring_fd = -1;
+	if (backend < 0 || backend >= N_FFSUBMIT_BACKENDS) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (backend == FFSUBMIT_IO_URING)
+		return uring_init(s);
+	return 0;
+}
+
+int ffsubmit_add(struct ffsubmit* s, int type, int code, int value)
+{
+	struct input_event* ie;
+
+	if (s->n_events == FFSUBMIT_MAX_EVENTS && ffsubmit_flush(s) < 0)
+		return -1;
+	ie = &s->events[s->n_events++];
+	memset(ie, 0, sizeof(*ie));
+	ie->type = type;
+	ie->code = code;
+	ie->value = value;
+
+	if (s->backend == FFSUBMIT_WRITE_EACH)
+		return ffsubmit_flush(s);
+	return 0;
+}
+
+int ffsubmit_flush(struct ffsubmit* s)
+{
+	struct iovec iov[FFSUBMIT_MAX_EVENTS];
+	ssize_t ret = 0;
+	int i, n = s->n_events;
+
+	if (!n)
+		return 0;
+	s->n_events = 0;
+	s->n_submitted += n;
+
+	switch (s->backend) {
+	case FFSUBMIT_WRITE_EACH:
+		for (i = 0; i < n && ret >= 0; i++) {
+			s->n_syscalls++;
+			ret = write(s->fd, &s->events[i], sizeof(s->events[i]));
+		}
+		break;
+	case FFSUBMIT_WRITE:
+		s->n_syscalls++;
+		ret = write(s->fd, s->events, n * sizeof(s->events[0]));
+		break;
+	case FFSUBMIT_WRITEV:
+		for (i = 0; i < n; i++) {
+			iov[i].iov_base = &s->events[i];
+			iov[i].iov_len = sizeof(s->events[i]);
+		}
+		s->n_syscalls++;
+		ret = writev(s->fd, iov, n);
+		break;
+	case FFSUBMIT_IO_URING:
+		s->n_events = n;
+		ret = uring_submit(s);
+		s->n_events = 0;
+		if (ret == 0 && report_completions(s) < 0)
+			return -1;
+		break;
+	}
+
+	if (ret < 0) {
+		s->n_errors++;
+		return -1;
+	}
+	return 0;
+}
+
+int ffsubmit_drain(struct ffsubmit* s)
+{
+	if (s->backend != FFSUBMIT_IO_URING)
+		return 0;
+	uring_reap(s);
+	while (s->n_free_batches < s->n_batches) {
+		if (uring_wait(s) < 0)
+			return -1;
+	}
+	return report_completions(s);
+}
+
+void ffsubmit_free(struct ffsubmit* s)
+{
+	if (s->backend != FFSUBMIT_IO_URING)
+		return;
+	ffsubmit_drain(s);
+	munmap(s->sqes, s->n_batches * sizeof(struct io_uring_sqe));
+	if (s->cq_ring != s->sq_ring)
+		munmap(s->cq_ring, s->cq_ring_size);
+	munmap(s->sq_ring, s->sq_ring_size);
+	close(s->ring_fd);
+	free(s->batches);
+	free(s->free_batches);
+}
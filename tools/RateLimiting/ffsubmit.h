@@ -0,0 +1,96 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFSUBMIT_H
+#define FFSUBMIT_H
+
+#include <linux/input.h>
+
+/*
+ * Submission of input events (effect starts and stops, gain, autocenter) to an evdev device.
+ *
+ * Events are queued with ffsubmit_add(), and sent with ffsubmit_flush(), e.g. once per update.
+ * evdev accepts several events per write, so the backends differ in how many syscalls a batch costs:
+ * one per event, one per batch, or, with io_uring, one per batch without waiting for the write itself.
+ */
+
+enum ffsubmit_backend {
+	FFSUBMIT_WRITE_EACH,                /* one write() per event, sent right away */
+	FFSUBMIT_WRITE,                     /* one write() per batch */
+	FFSUBMIT_WRITEV,                    /* one writev() per batch, with an iovec per event */
+	FFSUBMIT_IO_URING,                  /* one io_uring write per batch, completions are reaped later */
+	N_FFSUBMIT_BACKENDS
+};
+
+extern const char* ffsubmit_backend_names[N_FFSUBMIT_BACKENDS];
+
+#define FFSUBMIT_MAX_EVENTS     64      /* per batch, a full batch is flushed automatically */
+#define FFSUBMIT_URING_DEPTH    64      /* batches in flight */
+
+struct ffsubmit {
+	int fd;
+	int backend;
+
+	struct input_event events[FFSUBMIT_MAX_EVENTS];
+	int n_events;
+
+	unsigned long n_syscalls;
+	unsigned long n_submitted;          /* events */
+	unsigned long n_errors;             /* failed writes, for io_uring only known once completed */
+	int last_error;                     /* errno of the last failed io_uring write */
+	unsigned long n_unreported;         /* failed io_uring writes not reported by ffsubmit_flush() or ffsubmit_drain() yet */
+
+	/* io_uring, set up without liburing */
+	int ring_fd;
+	void* sq_ring;
+	void* cq_ring;
+	size_t sq_ring_size, cq_ring_size;
+	struct io_uring_sqe* sqes;
+	struct io_uring_cqe* cqes;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	unsigned n_unsubmitted;             /* queued in the submission ring, but not consumed by the kernel yet */
+	struct input_event (*batches)[FFSUBMIT_MAX_EVENTS];     /* buffers of the writes in flight */
+	int n_batches;
+	int* free_batches;
+	int n_free_batches;
+};
+
+/* Returns 0 on success, -1 on error (errno is set), e.g. when io_uring is not available */
+int ffsubmit_init(struct ffsubmit* s, int fd, int backend);
+
+/* Queue an event, or send it right away with FFSUBMIT_WRITE_EACH. Returns 0 on success, -1 on error. */
+int ffsubmit_add(struct ffsubmit* s, int type, int code, int value);
+
+/* Number of queued events */
+static inline int ffsubmit_pending(const struct ffsubmit* s)
+{
+	return s->n_events;
+}
+
+/*
+ * Send the queued events. Returns 0 on success, -1 on error (errno is set);
+ * with io_uring, also -1 if earlier writes failed since the last report.
+ */
+int ffsubmit_flush(struct ffsubmit* s);
+
+/* Wait until all writes in flight completed. Returns 0 if none of the unreported ones failed, -1 otherwise (errno is set). */
+int ffsubmit_drain(struct ffsubmit* s);
+
+void ffsubmit_free(struct ffsubmit* s);
+
+#endif /* FFSUBMIT_H */
@@ -16,37 +16,100 @@
  */
 
 #include <stdio.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <time.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
 #include <linux/input.h>
 
-enum {
-	FORCE_DEV,
-	RUMBLE_DEV
-} device_type;
+#include "ffeffects.h"
+#include "ffbench.h"
 
-void print_help(char *device_file_name, unsigned long update_period, unsigned long total_time)
+/* The device, or a virtual device to measure when the final effect arrives (when using --emulate) */
+struct ffbench bench;
+int emulate = 0;
+unsigned long service_period = 2000;    /* 2 ms */
+int queue_depth = 256;
+int overflow_policy = FFDEVSIM_DROP;
+
+void print_help(char *program_name, unsigned long update_period, unsigned long total_time)
 {
-	printf("Usage: %s /dev/input/eventXX [updatePeriodMicros (default=%d) [totalTimeMicros (default=%d)]]\n",
-			device_file_name, update_period, total_time);
-	printf("Tests the force feedback driver\n");
+	printf("Usage: %s [--sweep] /dev/input/eventXX [updatePeriodMicros (default=%lu) [totalTimeMicros (default=%lu)]]\n",
+			program_name, update_period, total_time);
+	printf("   or: %s [--sweep] --emulate [updatePeriodMicros (default=%lu) [totalTimeMicros (default=%lu)\n",
+			program_name, update_period, total_time);
+	printf("           [servicePeriodMicros (default=%lu) [queueDepth (default=%d) [overflowPolicy (default=%d)]]]]]\n",
+			service_period, queue_depth, overflow_policy);
+	printf("Tests the force feedback driver\n\n");
+	printf("With --emulate, a virtual device (see ffemu) is created instead of opening a real one,\n");
+	printf("and the lag of the final effect is measured: in milliseconds,\n");
+	printf("and as the number of bogus updates that were processed by the device before it.\n");
+	printf("With --sweep, the test is repeated for update periods from updatePeriodMicros to 16 times as long,\n");
+	printf("and only the lag is reported (needs --emulate).\n");
 	exit(1);
 }
 
+/*
+ * Play an effect, flood the device with bogus updates every 'update_period' during 'total_time',
+ * then send the actual useful effect and hold it during 'total_time'. When emulating, its lag is stored in 'result'.
+ */
+void run_test(unsigned long update_period, unsigned long total_time, int verbose, struct ffbench_result* result)
+{
+	struct ffbench_scenario scenario;
+
+	/* A constant effect (force devices), or a rumble effect (rumble devices) */
+	ffbench_default_scenario(&scenario, FFBENCH_UPDATE);
+	scenario.effect_idx = 0;
+	if (!ffbench_supported(&bench, &scenario))
+		scenario.effect_idx = 3;
+	scenario.n_effects = 1;
+	scenario.direction = 0x6000;        /* 135 degrees, so that devices with only an X axis feel it too */
+	scenario.update_period = update_period;
+	scenario.duration = total_time;
+	scenario.effect_duration = 0;       /* infinite */
+	scenario.pacing = FFBENCH_SLEEP;
+	scenario.quiet_updates = 1;
+	scenario.final_effect = 1;
+	scenario.final_hold = (verbose ? total_time : 0);   /* nothing to feel during a sweep */
+	scenario.removal_delay = scenario.final_hold;
+
+	/* Attempt to choke the device by sending bogus effects (with low magnitude)
+	 * at a rate higher than the device can handle,
+	 * then send the actual useful effect at maximum magnitude:
+	 * if the driver works properly, this one should be noticed almost immediately,
+	 * i.e. there should be no lag */
+	if (verbose)
+		printf("Now Playing %s effect with almost unnoticeable magnitude, followed by one with large magnitude...\n",
+				effect_names[scenario.effect_idx]);
+
+	if (ffbench_run(&bench, &scenario, result) == -1) {
+		perror("Upload effect");
+		exit(1);
+	}
+	if (result->n_errors) {
+		printf("%lu updates failed.\n", result->n_errors);
+		exit(1);
+	}
+
+	if (verbose && result->lag_measured && result->lost)
+		printf("The device never processed the effect with large magnitude, %lu commands were dropped.\n",
+				result->dropped);
+	else if (verbose && result->lag_measured)
+		printf("The device received it after %.3fms, and processed it after %.3fms,\n"
+		       "\tafter first processing %lu stale updates (%lu commands were dropped).\n",
+				result->received_lag, result->applied_lag, result->stale_updates, result->dropped);
+
+	if (verbose)
+		printf("The %s effect has been stopped.\n", effect_names[scenario.effect_idx]);
+}
+
 int main(int argc, char **argv)
 {
-	struct ff_effect effect;
-	struct input_event play, stop;
+	struct ffdevsim_config config;
+	static struct ffbench_result result;
 	unsigned long update_period, total_time;
-	int fd;
 	char device_file_name[64];
-	int i;
+	int sweep = 0;
+	int i, j;
 
 	printf("Force feedback test program.\n");
 	printf("HOLD FIRMLY YOUR WHEEL OR JOYSTICK TO PREVENT DAMAGES\n\n");
@@ -58,12 +121,19 @@ int main(int argc, char **argv)
 	/* Parse command-line arguments */
 	if (argc == 1)
 		print_help(argv[0], update_period, total_time);
-	for (i = 1; i < argc; ++i) {
+	for (i = 1, j = 1; i < argc; ++i) {
 		if (strncmp(argv[i], "--help", 64) == 0)
 			print_help(argv[0], update_period, total_time);
-		switch (i) {
+		if (strncmp(argv[i], "--sweep", 64) == 0) {
+			sweep = 1;
+			continue;
+		}
+		switch (j++) {
 		case 1:
-			strncpy(device_file_name, argv[i], 64);
+			if (strncmp(argv[i], "--emulate", 64) == 0)
+				emulate = 1;
+			else
+				snprintf(device_file_name, sizeof(device_file_name), "%s", argv[i]);
 			break;
 		case 2:
 			update_period = atol(argv[i]);
@@ -71,111 +141,62 @@ int main(int argc, char **argv)
 		case 3:
 			total_time = atol(argv[i]);
 			break;
+		case 4:
+			service_period = atol(argv[i]);
+			break;
+		case 5:
+			queue_depth = atoi(argv[i]);
+			break;
+		case 6:
+			overflow_policy = atoi(argv[i]);
+			break;
 		}
 	}
-
-	/* Open device */
-	fd = open(device_file_name, O_RDWR);
-	if (fd == -1) {
-		perror("Open device file");
+	if (!(overflow_policy >= 0 && overflow_policy < N_FFDEVSIM_OVERFLOW_POLICIES)) {
+		printf("Invalid overflowPolicy.\n");
 		exit(1);
 	}
-	printf("Device %s opened\n", device_file_name);
-
-	/* Upload a constant effect (force devices) */
-	device_type = FORCE_DEV;
-	memset(&effect, 0, sizeof(effect));
-	effect.type = FF_CONSTANT;
-	effect.id = -1;
-	effect.direction = 0x6000;	/* 135 degrees */
-
-	if (ioctl(fd, EVIOCSFF, &effect) < 0) {
-		/* Upload a rumble effect (rumble devices) */
-		device_type = RUMBLE_DEV;
-		memset(&effect, 0, sizeof(effect));
-		effect.type = FF_RUMBLE;
-		effect.id = -1;
-		
-		if (ioctl(fd, EVIOCSFF, &effect) < 0) {
-			perror("Upload effect");
-			exit(1);
-		}
-	}
-
-	/* Play the effect */
-	play.type = EV_FF;
-	play.code = effect.id;
-	play.value = 1;
-
-	if (write(fd, (const void*) &play, sizeof(play)) == -1) {
-		perror("Play effect");
+	if (sweep && !emulate) {
+		printf("--sweep needs --emulate, the lag can't be measured on a real device.\n");
 		exit(1);
 	}
 
-	/* Attempt to choke the device by sending bogus effects (with low magnitude) 
-	 * at a rate higher than the device can handle */
-	printf("Now Playing CONSTANT/RUMBLE effect with almost unnoticable magnitude...\n");
-
-	for (i = 0; i < total_time / update_period; ++i) {
-		usleep(update_period);
-
-		switch (device_type) {
-		case (FORCE_DEV):
-			effect.u.constant.level = i % 2;
-			break;
-		case (RUMBLE_DEV):
-			effect.u.rumble.strong_magnitude = i % 2;
-			effect.u.rumble.weak_magnitude = i % 2;
-			break;
-		}
-
-		if (ioctl(fd, EVIOCSFF, &effect) < 0) {
-			perror("Upload effect");
+	/* Create the virtual device, or open the real one */
+	if (emulate) {
+		memset(&config, 0, sizeof(config));
+		config.name = "fftest_buffer_overrun virtual device";
+		config.n_effects = 16;
+		config.service_period = service_period;
+		config.queue_depth = queue_depth;
+		config.overflow_policy = overflow_policy;
+		if (ffbench_open_emulated(&bench, &config) == -1) {
+			perror("Create virtual device");
 			exit(1);
 		}
-	}
-
-	/* Send the actual useful effect,
-	 * if the driver works properly, this one should be noticed almost immediately,
-	 * i.e. there should be no lag */
-	printf("Now Playing CONSTANT/RUMBLE effect with large magnitude...\n");
-
-	switch (device_type) {
-	case (FORCE_DEV):
-		effect.u.constant.level = 0x7FFF;
-		break;
-	case (RUMBLE_DEV):
-		effect.u.rumble.strong_magnitude = 0xFFFF;
-		effect.u.rumble.weak_magnitude = 0xFFFF;
-		break;
-	}
-
-	if (ioctl(fd, EVIOCSFF, &effect) < 0) {
-		perror("Upload effect");
+		printf("Virtual device: service period %luus, queue depth %d, overflow policy '%s'\n",
+				service_period, bench.sim->config.queue_depth, ffdevsim_overflow_policy_names[overflow_policy]);
+	} else if (ffbench_open(&bench, device_file_name) == -1) {
+		perror("Open device file");
 		exit(1);
 	}
-
-	usleep(total_time);
-
-	/* Stop the effect */
-	stop.type = EV_FF;
-	stop.code = effect.id;
-	stop.value = 0;
-
-	if (write(fd, (const void*) &stop, sizeof(stop)) == -1) {
-		perror("Stop effect");
-		exit(1);
+	printf("Device %s opened\n", bench.device);
+
+	if (!sweep) {
+		run_test(update_period, total_time, 1, &result);
+	} else {
+		/* Lag versus update rate */
+		printf("\n%14s %14s %14s %14s %10s\n", "update_period", "received(ms)", "processed(ms)", "stale_updates", "dropped");
+		for (i = 0; i <= 4; i++) {
+			run_test(update_period << i, total_time, 0, &result);
+			if (result.lost)
+				printf("%12luus %14s %14s %14s %10lu\n", update_period << i, "lost", "lost", "-", result.dropped);
+			else
+				printf("%12luus %14.3f %14.3f %14lu %10lu\n", update_period << i,
+						result.received_lag, result.applied_lag, result.stale_updates, result.dropped);
+		}
 	}
 
-	printf("The CONSTANT/RUMBLE effect has been stopped.\n");
-
-	usleep(total_time);
-
-	/* Clear the effect */
-	if (ioctl(fd, EVIOCRMFF, effect.id) < 0) {
-		perror("Erase effect");
-		exit(1);
-	}
+	ffbench_close(&bench);
 
 	exit(0);
 }
@@ -0,0 +1,141 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "fftrace.h"
+
+const char* fftrace_command_names[N_FFTRACE_COMMANDS] = {
+	"upload",
+	"play",
+	"gain",
+	"autocenter",
+	"flush",
+};
+
+/* How often the writer thread drains the ring, the ring holds about a second at 64kHz */
+#define WRITER_PERIOD 10000000ull       /* 10ms */
+
+void fftrace_print_csv_header(FILE* file)
+{
+	fprintf(file, "tick,scheduled_time,send_time,syscall_duration,command,slot,effect_id,value,flags\n");
+}
+
+void fftrace_print_csv(FILE* file, const struct fftrace_record* record)
+{
+	fprintf(file, "%llu,%llu,%llu,%u,%s,%d,%d,%d,%u\n",
+			(unsigned long long)record->tick, (unsigned long long)record->scheduled_time,
+			(unsigned long long)record->send_time, record->syscall_duration,
+			record->command < N_FFTRACE_COMMANDS ? fftrace_command_names[record->command] : "unknown",
+			record->slot, record->effect_id, record->value, record->flags);
+}
+
+/* Write all records in the ring to the file */
+static void drain(struct fftrace* trace)
+{
+	unsigned long head = trace->head;
+	unsigned long tail = __atomic_load_n(&trace->tail, __ATOMIC_ACQUIRE);
+	struct fftrace_record* record;
+
+	for (; head != tail; head++) {
+		record = &trace->ring[head & (FFTRACE_RING_SIZE - 1)];
+		if (trace->csv)
+			fftrace_print_csv(trace->file, record);
+		else
+			fwrite(record, sizeof(*record), 1, trace->file);
+	}
+	__atomic_store_n(&trace->head, head, __ATOMIC_RELEASE);
+}
+
+static void* writer_thread(void* arg)
+{
+	struct fftrace* trace = arg;
+	struct timespec period;
+
+	period.tv_sec = 0;
+	period.tv_nsec = WRITER_PERIOD;
+	while (!trace->stopping) {
+		nanosleep(&period, NULL);
+		drain(trace);
+	}
+	drain(trace);
+	return NULL;
+}
+
+int fftrace_open(struct fftrace* trace, const char* path, unsigned long long start_time)
+{
+	struct fftrace_header header;
+	size_t len = strlen(path);
+	int err;
+
+	memset(trace, 0, sizeof(*trace));
+	trace->start_time = start_time;
+	trace->csv = (len >= 4 && strcmp(path + len - 4, ".csv") == 0);
+
+	/* Touch the whole ring up front, so adding a record never page-faults */
+	trace->ring = malloc(FFTRACE_RING_SIZE * sizeof(*trace->ring));
+	if (!trace->ring)
+		return -1;
+	memset(trace->ring, 0, FFTRACE_RING_SIZE * sizeof(*trace->ring));
+	mlock(trace->ring, FFTRACE_RING_SIZE * sizeof(*trace->ring));
+
+	trace->file = fopen(path, "w");
+	if (!trace->file)
+		goto error;
+	if (trace->csv) {
+		fftrace_print_csv_header(trace->file);
+	} else {
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, FFTRACE_MAGIC, sizeof(header.magic));
+		header.header_size = sizeof(header);
+		header.record_size = sizeof(struct fftrace_record);
+		header.start_time = start_time;
+		fwrite(&header, sizeof(header), 1, trace->file);
+	}
+
+	err = pthread_create(&trace->thread, NULL, writer_thread, trace);
+	if (err) {
+		fclose(trace->file);
+		errno = err;
+		goto error;
+	}
+	return 0;
+
+error:
+	err = errno;
+	free(trace->ring);
+	errno = err;
+	return -1;
+}
+
+int fftrace_close(struct fftrace* trace)
+{
+	int ret;
+
+	trace->stopping = 1;
+	pthread_join(trace->thread, NULL);
+	ret = (ferror(trace->file) ? -1 : 0);
+	if (fclose(trace->file) == EOF)
+		ret = -1;
+	munlock(trace->ring, FFTRACE_RING_SIZE * sizeof(*trace->ring));
+	free(trace->ring);
+	return ret;
+}
@@ -0,0 +1,113 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFTRACE_H
+#define FFTRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Trace of every command sent during a choke-test, to align it with e.g. a USB capture.
+ *
+ * The measurement loop puts fixed-size records in a preallocated single-producer single-consumer ring,
+ * and a background thread writes them to the file, so the loop never allocates nor waits for the disk.
+ * When the writer can't keep up, records are dropped (and counted) instead.
+ *
+ * The file is either binary (a header followed by the records, in native byte order), or CSV,
+ * when its name ends with ".csv". Convert binary traces with fftrace2csv.
+ */
+
+#define FFTRACE_MAGIC       "FFTRC01\n"
+#define FFTRACE_RING_SIZE   (1 << 16)   /* records, a power of two */
+
+enum fftrace_command {
+	FFTRACE_UPLOAD,
+	FFTRACE_PLAY,
+	FFTRACE_GAIN,
+	FFTRACE_AUTOCENTER,
+	FFTRACE_FLUSH,                      /* batched writes sent, 'value' is the amount of events */
+	N_FFTRACE_COMMANDS
+};
+
+extern const char* fftrace_command_names[N_FFTRACE_COMMANDS];
+
+#define FFTRACE_ERROR       (1 << 0)    /* the syscall failed */
+#define FFTRACE_SKIPPED     (1 << 1)    /* not sent, e.g. an identical upload skipped by the upload cache */
+#define FFTRACE_QUEUED      (1 << 2)    /* queued, sent by the next FFTRACE_FLUSH */
+
+struct fftrace_header {
+	char magic[8];
+	uint32_t header_size;
+	uint32_t record_size;
+	uint64_t start_time;                /* CLOCK_MONOTONIC time of the start of the trace, in nanoseconds */
+};
+
+struct fftrace_record {
+	uint64_t tick;                      /* update index */
+	uint64_t scheduled_time;            /* when the update should have been sent, CLOCK_MONOTONIC in ns */
+	uint64_t send_time;                 /* when the syscall started, CLOCK_MONOTONIC in ns */
+	uint32_t syscall_duration;          /* in nanoseconds */
+	int32_t value;                      /* effect parameter, gain or autocenter */
+	int16_t slot;                       /* simultaneous effect index, -1 if none */
+	int16_t effect_id;                  /* -1 if none */
+	uint8_t command;                    /* one of enum fftrace_command */
+	uint8_t flags;
+	uint16_t reserved;
+};
+
+struct fftrace {
+	FILE* file;
+	int csv;
+	unsigned long long start_time;
+
+	struct fftrace_record* ring;
+	unsigned long head;                 /* written by the writer thread */
+	unsigned long tail;                 /* written by the measurement loop */
+	unsigned long n_records;
+	unsigned long n_dropped;
+
+	pthread_t thread;
+	volatile int stopping;
+};
+
+/* Create the file, and start the writer thread. Returns 0 on success, -1 on error (errno is set). */
+int fftrace_open(struct fftrace* trace, const char* path, unsigned long long start_time);
+
+/* Add a record, never blocks: if the ring is full, the record is dropped */
+static inline void fftrace_add(struct fftrace* trace, const struct fftrace_record* record)
+{
+	unsigned long tail = trace->tail;
+
+	if (tail - __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE) == FFTRACE_RING_SIZE) {
+		trace->n_dropped++;
+		return;
+	}
+	trace->ring[tail & (FFTRACE_RING_SIZE - 1)] = *record;
+	__atomic_store_n(&trace->tail, tail + 1, __ATOMIC_RELEASE);
+	trace->n_records++;
+}
+
+/* Write the remaining records, stop the writer thread, and close the file. Returns 0 on success, -1 on error. */
+int fftrace_close(struct fftrace* trace);
+
+/* Write 'record' as a CSV line, after a header line written with fftrace_print_csv_header() */
+void fftrace_print_csv_header(FILE* file);
+void fftrace_print_csv(FILE* file, const struct fftrace_record* record);
+
+#endif /* FFTRACE_H */
@@ -0,0 +1,101 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fftrace.h"
+
+void print_json(const struct fftrace_record* record, int first)
+{
+	printf("%s  {\"tick\": %llu, \"scheduled_time\": %llu, \"send_time\": %llu, \"syscall_duration\": %u, "
+	       "\"command\": \"%s\", \"slot\": %d, \"effect_id\": %d, \"value\": %d, \"flags\": %u}",
+			first ? "" : ",\n",
+			(unsigned long long)record->tick, (unsigned long long)record->scheduled_time,
+			(unsigned long long)record->send_time, record->syscall_duration,
+			record->command < N_FFTRACE_COMMANDS ? fftrace_command_names[record->command] : "unknown",
+			record->slot, record->effect_id, record->value, record->flags);
+}
+
+int main(int argc, char** argv)
+{
+	struct fftrace_header header;
+	struct fftrace_record records[1024];
+	const char* trace_file_name = NULL;
+	unsigned long n_records = 0;
+	size_t i, n;
+	int json = 0;
+	FILE* file;
+
+	/* Show help message */
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--help", 64) == 0) {
+			printf("Usage: %s [--json] <trace_file>\n", argv[0]);
+			printf("Converts a binary trace of ffchoke to CSV (or JSON with --json) on stdout, for plotting.\n");
+			printf("Times are CLOCK_MONOTONIC, in nanoseconds; flags: 1 = failed, 2 = skipped, 4 = queued.\n");
+			exit(1);
+		}
+		else if (strncmp(argv[i], "--json", 64) == 0)
+			json = 1;
+		else
+			trace_file_name = argv[i];
+	}
+	if (!trace_file_name) {
+		printf("Missing trace_file, see '%s --help'.\n", argv[0]);
+		exit(1);
+	}
+
+	file = fopen(trace_file_name, "r");
+	if (!file) {
+		perror("Open trace file");
+		exit(1);
+	}
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+	    memcmp(header.magic, FFTRACE_MAGIC, sizeof(header.magic)) != 0) {
+		fprintf(stderr, "Not a binary trace file.\n");
+		exit(1);
+	}
+	if (header.record_size != sizeof(struct fftrace_record)) {
+		fprintf(stderr, "Trace written with a different record size (%u instead of %zu).\n",
+				header.record_size, sizeof(struct fftrace_record));
+		exit(1);
+	}
+	fseek(file, header.header_size, SEEK_SET);
+
+	if (json)
+		printf("{\"start_time\": %llu, \"records\": [\n", (unsigned long long)header.start_time);
+	else
+		fftrace_print_csv_header(stdout);
+
+	/* A trace that was cut short is valid up to its last complete record */
+	while ((n = fread(records, sizeof(records[0]), sizeof(records) / sizeof(records[0]), file)) > 0) {
+		for (i = 0; i < n; i++, n_records++) {
+			if (json)
+				print_json(&records[i], !n_records);
+			else
+				fftrace_print_csv(stdout, &records[i]);
+		}
+	}
+
+	if (json)
+		printf("\n]}\n");
+	fclose(file);
+	fprintf(stderr, "%lu records\n", n_records);
+
+	exit(0);
+}
@@ -0,0 +1,592 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include <linux/uhid.h>
+
+#include "ffhist.h"
+
+/*
+ * Virtual HID device, created through /dev/uhid, so that the kernel's own HID force feedback driver binds to it.
+ * Unlike the uinput devices of ffemu, the force feedback commands go through the real driver,
+ * which turns them into output reports (UHID_OUTPUT) or synchronous SET_REPORT requests (UHID_SET_REPORT).
+ * These are timestamped when read, and consumed at the rate of the simulated device.
+ */
+
+#define MAX_DESCRIPTOR_SIZE HID_MAX_DESCRIPTOR_SIZE
+#define DISCOVERY_TIMEOUT   3000000000ull   /* time for a driver to bind and create the event node: 3s */
+
+struct profile {
+	const char* name;
+	const char* driver;
+	unsigned int bus, vendor, product;
+	const unsigned char* descriptor;
+	size_t descriptor_size;
+};
+
+/*
+ * Xbox One S controller over Bluetooth (hid-microsoft, rumble through an output report with id 3).
+ * Bluetooth HID devices are created through uhid by BlueZ as well, so the driver accepts this transport.
+ */
+static const unsigned char xbox_descriptor[] = {
+	0x05, 0x01,                     /* Usage Page (Generic Desktop) */
+	0x09, 0x05,                     /* Usage (Game Pad) */
+	0xa1, 0x01,                     /* Collection (Application) */
+	0x85, 0x01,                     /*   Report ID (1) */
+	0x09, 0x30, 0x09, 0x31,         /*   Usage (X), Usage (Y) */
+	0x09, 0x32, 0x09, 0x35,         /*   Usage (Z), Usage (Rz) */
+	0x15, 0x00,                     /*   Logical Minimum (0) */
+	0x27, 0xff, 0xff, 0x00, 0x00,   /*   Logical Maximum (65535) */
+	0x75, 0x10, 0x95, 0x04,         /*   Report Size (16), Report Count (4) */
+	0x81, 0x02,                     /*   Input (Data, Variable, Absolute) */
+	0x05, 0x09,                     /*   Usage Page (Button) */
+	0x19, 0x01, 0x29, 0x10,         /*   Usage Minimum (1), Usage Maximum (16) */
+	0x25, 0x01,                     /*   Logical Maximum (1) */
+	0x75, 0x01, 0x95, 0x10,         /*   Report Size (1), Report Count (16) */
+	0x81, 0x02,                     /*   Input (Data, Variable, Absolute) */
+	0x05, 0x0f,                     /*   Usage Page (Physical Interface Device) */
+	0x09, 0x21,                     /*   Usage (Set Effect Report) */
+	0xa1, 0x02,                     /*   Collection (Logical) */
+	0x85, 0x03,                     /*     Report ID (3) */
+	0x09, 0x97,                     /*     Usage (DC Enable Actuators) */
+	0x26, 0xff, 0x00,               /*     Logical Maximum (255) */
+	0x75, 0x08, 0x95, 0x08,         /*     Report Size (8), Report Count (8) */
+	0x91, 0x02,                     /*     Output (Data, Variable, Absolute) */
+	0xc0,                           /*   End Collection */
+	0xc0,                           /* End Collection */
+};
+
+/*
+ * Logitech G29 wheel (hid-logitech with lg4ff, 7-byte output reports without report id).
+ * Since Linux 5.16, hid-logitech only binds to USB devices, so on recent kernels no event node will appear.
+ */
+static const unsigned char g29_descriptor[] = {
+	0x05, 0x01,                     /* Usage Page (Generic Desktop) */
+	0x09, 0x04,                     /* Usage (Joystick) */
+	0xa1, 0x01,                     /* Collection (Application) */
+	0x09, 0x30,                     /*   Usage (X) */
+	0x15, 0x00,                     /*   Logical Minimum (0) */
+	0x27, 0xff, 0xff, 0x00, 0x00,   /*   Logical Maximum (65535) */
+	0x75, 0x10, 0x95, 0x01,         /*   Report Size (16), Report Count (1) */
+	0x81, 0x02,                     /*   Input (Data, Variable, Absolute) */
+	0x09, 0x31, 0x09, 0x32,         /*   Usage (Y), Usage (Z) */
+	0x09, 0x35,                     /*   Usage (Rz) */
+	0x26, 0xff, 0x00,               /*   Logical Maximum (255) */
+	0x75, 0x08, 0x95, 0x03,         /*   Report Size (8), Report Count (3) */
+	0x81, 0x02,                     /*   Input (Data, Variable, Absolute) */
+	0x05, 0x09,                     /*   Usage Page (Button) */
+	0x19, 0x01, 0x29, 0x18,         /*   Usage Minimum (1), Usage Maximum (24) */
+	0x25, 0x01,                     /*   Logical Maximum (1) */
+	0x75, 0x01, 0x95, 0x18,         /*   Report Size (1), Report Count (24) */
+	0x81, 0x02,                     /*   Input (Data, Variable, Absolute) */
+	0x06, 0x00, 0xff,               /*   Usage Page (Vendor Defined) */
+	0x09, 0x01,                     /*   Usage (1) */
+	0x26, 0xff, 0x00,               /*   Logical Maximum (255) */
+	0x75, 0x08, 0x95, 0x07,         /*   Report Size (8), Report Count (7) */
+	0x91, 0x02,                     /*   Output (Data, Variable, Absolute) */
+	0xc0,                           /* End Collection */
+};
+
+static const struct profile profiles[] = {
+	{ "xbox", "hid-microsoft", BUS_BLUETOOTH, 0x045e, 0x02fd, xbox_descriptor, sizeof(xbox_descriptor) },
+	{ "g29",  "hid-logitech",  BUS_USB,       0x046d, 0xc24f, g29_descriptor,  sizeof(g29_descriptor) },
+};
+#define N_PROFILES (sizeof(profiles) / sizeof(profiles[0]))
+
+enum overflow_policy {
+	OVERFLOW_DROP,      /* drop reports when the queue is full, fail SET_REPORT requests */
+	OVERFLOW_BLOCK,     /* stop reading /dev/uhid when the queue is full, the kernel's uhid queue fills up instead */
+	N_OVERFLOW_POLICIES
+};
+
+/* Default device: consumes one report per 2ms, like a wheel polled at 500Hz */
+char profile_name[64] = "xbox";
+unsigned long service_period = 2000;                      /*       2ms      */
+int queue_depth = 32;
+int overflow_policy = OVERFLOW_DROP;
+char descriptor_file[256] = "-";                          /* profile's descriptor */
+char log_file[256] = "-";                                 /*     no log     */
+/* Corresponding extended cmd-line: "./ffuhid xbox 2000us 32 0 - -" */
+
+/* A report waiting to be consumed by the device */
+struct report {
+	unsigned long long arrival_time;
+	unsigned int id;                    /* SET_REPORT request id, to reply to */
+	unsigned char type;                 /* UHID_OUTPUT or UHID_SET_REPORT */
+	unsigned char report_id;
+	unsigned short size;
+};
+
+struct stats {
+	unsigned long received[2];          /* output reports, SET_REPORT requests */
+	unsigned long consumed;
+	unsigned long dropped;
+	unsigned long get_reports;
+	int max_queue_length;
+};
+
+int ufd;
+struct report* queue;
+int queue_head, queue_length;
+unsigned long long next_service_time;
+struct stats stats, prev_stats;
+struct ffhist delay_hist;                   /* from reading a report to its consumption */
+struct ffhist gap_hist;                     /* between successive reports, the rate of the driver */
+unsigned long long last_arrival_time;
+FILE* log_stream;
+
+volatile sig_atomic_t quit = 0;
+
+void handle_signal(int sig)
+{
+	quit = 1;
+}
+
+unsigned long long get_ntime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+int send_event(const struct uhid_event* ev)
+{
+	if (write(ufd, ev, sizeof(*ev)) != sizeof(*ev))
+		return -1;
+	return 0;
+}
+
+/* Load a binary report descriptor, as found in /sys/bus/hid/devices/<device>/report_descriptor */
+size_t load_descriptor(const char* path, unsigned char* descriptor)
+{
+	FILE* file;
+	size_t size;
+
+	file = fopen(path, "r");
+	if (!file) {
+		perror("Open descriptor file");
+		exit(1);
+	}
+	size = fread(descriptor, 1, MAX_DESCRIPTOR_SIZE, file);
+	fclose(file);
+	if (!size) {
+		printf("Empty descriptor file.\n");
+		exit(1);
+	}
+	return size;
+}
+
+/* Parse "xbox", "g29", or "<vendor>:<product>[:usb|:bt]" (in hexadecimal), which needs a descriptor_file */
+void parse_profile(const char* name, struct profile* profile)
+{
+	unsigned int vendor, product;
+	char bus[8] = "usb";
+	size_t i;
+
+	for (i = 0; i < N_PROFILES; i++) {
+		if (strcmp(name, profiles[i].name) == 0) {
+			*profile = profiles[i];
+			return;
+		}
+	}
+	if (sscanf(name, "%x:%x:%7s", &vendor, &product, bus) < 2 || (strcmp(bus, "usb") && strcmp(bus, "bt"))) {
+		printf("Invalid profile, see '--help'.\n");
+		exit(1);
+	}
+	memset(profile, 0, sizeof(*profile));
+	profile->name = name;
+	profile->driver = "custom";
+	profile->bus = (strcmp(bus, "bt") == 0 ? BUS_BLUETOOTH : BUS_USB);
+	profile->vendor = vendor;
+	profile->product = product;
+}
+
+/* Find the event node of the input device created by the driver, by the unique id we gave to the HID device */
+int find_devnode(const char* uniq, char* devnode, size_t len)
+{
+	char path[300], value[128];
+	struct dirent* entry;
+	FILE* file;
+	DIR* dir;
+	int found = 0;
+
+	dir = opendir("/sys/class/input");
+	if (!dir)
+		return 0;
+	while (!found && (entry = readdir(dir))) {
+		if (strncmp(entry->d_name, "event", 5) != 0)
+			continue;
+		snprintf(path, sizeof(path), "/sys/class/input/%s/device/uniq", entry->d_name);
+		file = fopen(path, "r");
+		if (!file)
+			continue;
+		if (fgets(value, sizeof(value), file) && strncmp(value, uniq, strlen(uniq)) == 0 &&
+		    (value[strlen(uniq)] == '\n' || value[strlen(uniq)] == '\0')) {
+			snprintf(devnode, len, "/dev/input/%s", entry->d_name);
+			found = 1;
+		}
+		fclose(file);
+	}
+	closedir(dir);
+	return found;
+}
+
+void print_ff_support(const char* devnode)
+{
+	int fd, n_effects;
+
+	fd = open(devnode, O_RDWR);
+	if (fd == -1 || ioctl(fd, EVIOCGEFFECTS, &n_effects) == -1 || !n_effects)
+		printf("Event node %s has no force feedback, is the driver built with force feedback support?\n", devnode);
+	else
+		printf("Event node %s supports %d simultaneous effects.\n", devnode, n_effects);
+	if (fd != -1)
+		close(fd);
+}
+
+void reply_set_report(unsigned int id, unsigned short err)
+{
+	struct uhid_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_SET_REPORT_REPLY;
+	ev.u.set_report_reply.id = id;
+	ev.u.set_report_reply.err = err;
+	if (send_event(&ev) == -1)
+		perror("Reply to SET_REPORT");
+}
+
+/* The device doesn't know the sizes of the reports of the descriptor, it returns a zeroed report */
+void reply_get_report(unsigned int id, unsigned char report_id)
+{
+	struct uhid_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_GET_REPORT_REPLY;
+	ev.u.get_report_reply.id = id;
+	ev.u.get_report_reply.err = 0;
+	ev.u.get_report_reply.size = 64;
+	ev.u.get_report_reply.data[0] = report_id;
+	if (send_event(&ev) == -1)
+		perror("Reply to GET_REPORT");
+}
+
+void log_report(const struct report* report, unsigned long long consume_time, int dropped)
+{
+	if (!log_stream)
+		return;
+	fprintf(log_stream, "%llu,%llu,%s,%u,%u,%d\n", report->arrival_time, consume_time,
+			report->type == UHID_OUTPUT ? "output" : "set_report",
+			report->report_id, report->size, dropped);
+}
+
+void enqueue_report(const struct report* report)
+{
+	stats.received[report->type == UHID_SET_REPORT]++;
+	if (last_arrival_time)
+		ffhist_add(&gap_hist, report->arrival_time - last_arrival_time);
+	last_arrival_time = report->arrival_time;
+
+	if (queue_length == queue_depth) {
+		/* Only with OVERFLOW_DROP, as we stop reading otherwise */
+		stats.dropped++;
+		log_report(report, 0, 1);
+		if (report->type == UHID_SET_REPORT)
+			reply_set_report(report->id, EIO);
+		return;
+	}
+
+	/* An idle device starts consuming right away */
+	if (!queue_length && next_service_time < report->arrival_time)
+		next_service_time = report->arrival_time;
+	queue[(queue_head + queue_length) % queue_depth] = *report;
+	queue_length++;
+	if (queue_length > stats.max_queue_length)
+		stats.max_queue_length = queue_length;
+}
+
+/* Consume the reports whose turn has come, a SET_REPORT request only returns in the driver once consumed */
+void service_queue(unsigned long long now)
+{
+	struct report* report;
+
+	while (queue_length && next_service_time + 1000ull * service_period <= now) {
+		next_service_time += 1000ull * service_period;
+		report = &queue[queue_head];
+		ffhist_add(&delay_hist, next_service_time - report->arrival_time);
+		log_report(report, next_service_time, 0);
+		if (report->type == UHID_SET_REPORT)
+			reply_set_report(report->id, 0);
+		queue_head = (queue_head + 1) % queue_depth;
+		queue_length--;
+		stats.consumed++;
+	}
+}
+
+void handle_event(const struct uhid_event* ev, unsigned long long now)
+{
+	struct report report;
+
+	memset(&report, 0, sizeof(report));
+	report.arrival_time = now;
+	switch (ev->type) {
+	case UHID_OUTPUT:
+		report.type = UHID_OUTPUT;
+		report.size = ev->u.output.size;
+		report.report_id = (ev->u.output.size ? ev->u.output.data[0] : 0);
+		enqueue_report(&report);
+		break;
+	case UHID_SET_REPORT:
+		report.type = UHID_SET_REPORT;
+		report.id = ev->u.set_report.id;
+		report.report_id = ev->u.set_report.rnum;
+		report.size = ev->u.set_report.size;
+		enqueue_report(&report);
+		break;
+	case UHID_GET_REPORT:
+		stats.get_reports++;
+		reply_get_report(ev->u.get_report.id, ev->u.get_report.rnum);
+		break;
+	case UHID_START:
+		printf("Driver started the device.\n");
+		break;
+	case UHID_OPEN:
+		printf("Device opened.\n");
+		break;
+	case UHID_CLOSE:
+		printf("Device closed.\n");
+		break;
+	default:
+		break;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned char descriptor[MAX_DESCRIPTOR_SIZE];
+	unsigned long long now, start_time, last_print_time, timeout;
+	struct uhid_event ev;
+	struct profile profile;
+	struct pollfd pfd;
+	char uniq[64], devnode[64] = "";
+	int discovering = 1;
+	int i, n;
+
+	printf("Virtual HID device, to test the kernel's force feedback drivers without hardware.\n\n");
+
+	/* Show help message */
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--help", 64) == 0) {
+			printf("Usage: %s [<profile=%s> \n", argv[0], profile_name);
+			printf("           \t\t[<service_period=%luus> \n", service_period);
+			printf("           \t\t[<queue_depth=%d> \n", queue_depth);
+			printf("           \t\t[<overflow_policy=%d> \n", overflow_policy);
+			printf("           \t\t[<descriptor_file=%s> \n", descriptor_file);
+			printf("           \t\t[<log_file=%s> \n", log_file);
+			printf("           ]]]]]]\n");
+			printf("Creates a HID device through /dev/uhid (needs root), so that the kernel's HID force feedback driver\n");
+			printf("binds to it, and consumes its output reports at a limited rate.\n");
+			printf("Point ffchoke or fftest_buffer_overrun to the printed event node, press Ctrl-C to quit.\n\n");
+
+			printf("Additional details on some parameters:\n");
+			printf("\tprofile:\t the device to pretend to be, should be one of the following:\n");
+			for (n = 0; n < N_PROFILES; n++) {
+				printf("\t\t%s: %04x:%04x over %s, for %s\n", profiles[n].name, profiles[n].vendor, profiles[n].product,
+						profiles[n].bus == BUS_USB ? "USB" : "Bluetooth", profiles[n].driver);
+			}
+				printf("\t\t<vendor>:<product>[:usb|:bt]: any other device (in hexadecimal), with a descriptor_file\n");
+				printf("\t\tnote: hid-logitech only binds to USB devices since Linux 5.16, and hid-pidff is part of usbhid,\n");
+				printf("\t\tso neither binds to a uhid device on recent kernels\n");
+			printf("\tservice_period:\t time the device needs to consume one report, in microseconds,\n");
+				printf("\t\t'0' consumes all reports immediately\n");
+			printf("\tqueue_depth:\t number of reports the device can buffer\n");
+			printf("\toverflow_policy:\t what happens when the queue is full, should be one of the following:\n");
+				printf("\t\t0: drop the report (and fail SET_REPORT requests), like a device that overruns\n");
+				printf("\t\t1: stop reading, so the kernel's uhid queue fills up (it then drops reports itself)\n");
+			printf("\tdescriptor_file:\t binary HID report descriptor to use instead of the profile's,\n");
+				printf("\t\te.g. a copy of /sys/bus/hid/devices/<device>/report_descriptor of a real device\n");
+			printf("\tlog_file:\t if not '-', every report is logged as CSV:\n");
+				printf("\t\tarrival_time,consume_time,type,report_id,size,dropped (CLOCK_MONOTONIC, in ns)\n\n");
+
+			printf("Example (extended) usage: '%s %s %luus %d %d %s %s'\n", argv[0],
+					profile_name, service_period, queue_depth, overflow_policy, descriptor_file, log_file);
+				printf("\t(this corresponds to the default parameters)\n");
+
+			exit(1);
+		}
+	}
+
+	/* Parse cmd arguments and set parameters */
+	i=1; if (argc > i) snprintf(profile_name, sizeof(profile_name), "%s", argv[i]);
+	i++; if (argc > i) service_period  = atoi(argv[i]);
+	i++; if (argc > i) queue_depth     = atoi(argv[i]);
+	i++; if (argc > i) overflow_policy = atoi(argv[i]);
+	i++; if (argc > i) snprintf(descriptor_file, sizeof(descriptor_file), "%s", argv[i]);
+	i++; if (argc > i) snprintf(log_file, sizeof(log_file), "%s", argv[i]);
+
+	if (!(overflow_policy >= 0 && overflow_policy < N_OVERFLOW_POLICIES)) {
+		printf("Invalid overflow_policy.\n");
+		exit(1);
+	}
+	if (queue_depth < 1) {
+		printf("Invalid queue_depth.\n");
+		exit(1);
+	}
+
+	parse_profile(profile_name, &profile);
+	if (strcmp(descriptor_file, "-") != 0) {
+		profile.descriptor_size = load_descriptor(descriptor_file, descriptor);
+		profile.descriptor = descriptor;
+	} else if (!profile.descriptor) {
+		printf("A custom profile needs a descriptor_file.\n");
+		exit(1);
+	}
+
+	queue = malloc(queue_depth * sizeof(*queue));
+	if (!queue) {
+		perror("Allocate queue");
+		exit(1);
+	}
+	if (strcmp(log_file, "-") != 0) {
+		log_stream = fopen(log_file, "w");
+		if (!log_stream) {
+			perror("Open log file");
+			exit(1);
+		}
+		fprintf(log_stream, "arrival_time,consume_time,type,report_id,size,dropped\n");
+	}
+
+	ufd = open("/dev/uhid", O_RDWR | O_CLOEXEC);
+	if (ufd == -1) {
+		perror("Open /dev/uhid");
+		exit(1);
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_CREATE2;
+	snprintf((char*)ev.u.create2.name, sizeof(ev.u.create2.name), "ffuhid %s (%s)", profile.name, profile.driver);
+	snprintf((char*)ev.u.create2.phys, sizeof(ev.u.create2.phys), "ffuhid/%d", getpid());
+	snprintf(uniq, sizeof(uniq), "ffuhid-%d", getpid());
+	snprintf((char*)ev.u.create2.uniq, sizeof(ev.u.create2.uniq), "%s", uniq);
+	memcpy(ev.u.create2.rd_data, profile.descriptor, profile.descriptor_size);
+	ev.u.create2.rd_size = profile.descriptor_size;
+	ev.u.create2.bus = profile.bus;
+	ev.u.create2.vendor = profile.vendor;
+	ev.u.create2.product = profile.product;
+	if (send_event(&ev) == -1) {
+		perror("Create uhid device");
+		exit(1);
+	}
+	printf("Device created: %04x:%04x over %s, for %s\n", profile.vendor, profile.product,
+			profile.bus == BUS_USB ? "USB" : "Bluetooth", profile.driver);
+	printf("Service period: %luus (%.1f reports/s), queue depth: %d, overflow policy: %s\n",
+			service_period, service_period ? 1e6 / service_period : 0.0, queue_depth,
+			overflow_policy == OVERFLOW_DROP ? "drop" : "block");
+
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+
+	ffhist_reset(&delay_hist);
+	ffhist_reset(&gap_hist);
+	start_time = get_ntime();
+	last_print_time = start_time;
+	next_service_time = start_time;
+	memset(&prev_stats, 0, sizeof(prev_stats));
+	pfd.fd = ufd;
+	while (!quit) {
+		now = get_ntime();
+		service_queue(now);
+
+		/* The driver probes asynchronously */
+		if (discovering) {
+			if (find_devnode(uniq, devnode, sizeof(devnode))) {
+				print_ff_support(devnode);
+				printf("Try: './ffchoke %s'\n\n", devnode);
+				discovering = 0;
+			} else if (now - start_time > DISCOVERY_TIMEOUT) {
+				printf("No event node appeared, the %s driver didn't bind (check dmesg).\n", profile.driver);
+				discovering = 0;
+			}
+		}
+
+		/* Report once per second, whenever something happened */
+		if (now - last_print_time >= 1000000000ull) {
+			last_print_time = now;
+			if (memcmp(&stats, &prev_stats, sizeof(stats)) != 0) {
+				printf("Received %lu output reports (%+ld), %lu SET_REPORTs (%+ld); consumed %lu; dropped %lu; max queue length %d\n",
+						stats.received[0], (long)(stats.received[0] - prev_stats.received[0]),
+						stats.received[1], (long)(stats.received[1] - prev_stats.received[1]),
+						stats.consumed, stats.dropped, stats.max_queue_length);
+				prev_stats = stats;
+			}
+		}
+
+		/* Wake up for the next consumption, or to poll for the event node and statistics */
+		timeout = 100;
+		if (queue_length) {
+			now = get_ntime();
+			if (next_service_time + 1000ull * service_period > now)
+				timeout = (next_service_time + 1000ull * service_period - now + 999999) / 1000000;
+			else
+				timeout = 0;
+			if (timeout > 100)
+				timeout = 100;
+		}
+		pfd.events = (overflow_policy == OVERFLOW_BLOCK && queue_length == queue_depth ? 0 : POLLIN);
+		n = poll(&pfd, 1, timeout);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("Poll /dev/uhid");
+			break;
+		}
+		if (n && (pfd.revents & POLLIN)) {
+			if (read(ufd, &ev, sizeof(ev)) <= 0) {
+				perror("Read /dev/uhid");
+				break;
+			}
+			handle_event(&ev, get_ntime());
+		}
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_DESTROY;
+	send_event(&ev);
+	close(ufd);
+	if (log_stream)
+		fclose(log_stream);
+
+	printf("\nFinal statistics:\n");
+	printf("Received %lu output reports, %lu SET_REPORTs, %lu GET_REPORTs; consumed %lu; dropped %lu; max queue length %d\n",
+			stats.received[0], stats.received[1], stats.get_reports, stats.consumed, stats.dropped,
+			stats.max_queue_length);
+	ffhist_print(&gap_hist, "Report interval");
+	ffhist_print(&delay_hist, "Queue delay");
+
+	exit(0);
+}
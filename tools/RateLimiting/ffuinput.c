@@ -0,0 +1,296 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+
+#include "ffuinput.h"
+
+const char* ff_command_names[N_FF_CMD_TYPES] = {
+	"upload",
+	"erase",
+	"play",
+	"gain",
+	"autocenter",
+};
+
+static const int supported_ff_bits[] = {
+	FF_CONSTANT, FF_PERIODIC, FF_RAMP, FF_SPRING, FF_FRICTION, FF_DAMPER, FF_INERTIA, FF_RUMBLE,
+	FF_SQUARE, FF_TRIANGLE, FF_SINE, FF_SAW_UP, FF_SAW_DOWN, FF_CUSTOM,
+	FF_GAIN, FF_AUTOCENTER,
+};
+
+static unsigned long long get_ntime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+/* Enable force feedback on the uinput device, and create it */
+static int create_ff_device(int ufd, const char* name, const struct input_id* id, int n_effects)
+{
+	struct uinput_setup setup;
+
+	memset(&setup, 0, sizeof(setup));
+	setup.id = *id;
+	strncpy(setup.name, name, UINPUT_MAX_NAME_SIZE - 1);
+	setup.ff_effects_max = n_effects;
+	if (ioctl(ufd, UI_SET_EVBIT, EV_FF) == -1 ||
+	    ioctl(ufd, UI_DEV_SETUP, &setup) == -1 ||
+	    ioctl(ufd, UI_DEV_CREATE) == -1)
+		return -1;
+	return 0;
+}
+
+int ffuinput_create(const char* name, int n_effects)
+{
+	struct uinput_abs_setup abs_setup;
+	struct input_id id;
+	unsigned int i;
+	int ufd;
+
+	ufd = open("/dev/uinput", O_RDWR | O_NONBLOCK);
+	if (ufd == -1)
+		return -1;
+
+	/* A wheel needs at least a steering axis and a button to be recognized as a joystick */
+	if (ioctl(ufd, UI_SET_EVBIT, EV_KEY) == -1 ||
+	    ioctl(ufd, UI_SET_KEYBIT, BTN_TRIGGER) == -1 ||
+	    ioctl(ufd, UI_SET_EVBIT, EV_ABS) == -1 ||
+	    ioctl(ufd, UI_SET_ABSBIT, ABS_X) == -1)
+		goto error;
+	for (i = 0; i < sizeof(supported_ff_bits) / sizeof(supported_ff_bits[0]); i++) {
+		if (ioctl(ufd, UI_SET_FFBIT, supported_ff_bits[i]) == -1)
+			goto error;
+	}
+
+	memset(&abs_setup, 0, sizeof(abs_setup));
+	abs_setup.code = ABS_X;
+	abs_setup.absinfo.minimum = -32768;
+	abs_setup.absinfo.maximum = 32767;
+	if (ioctl(ufd, UI_ABS_SETUP, &abs_setup) == -1)
+		goto error;
+
+	memset(&id, 0, sizeof(id));
+	id.bustype = BUS_VIRTUAL;
+	id.vendor = 0x1209;   /* pid.codes, reserved for testing */
+	id.product = 0x0001;
+	id.version = 1;
+	if (create_ff_device(ufd, name, &id, n_effects) == -1)
+		goto error;
+
+	return ufd;
+
+error:
+	i = errno;
+	close(ufd);
+	errno = i;
+	return -1;
+}
+
+int ffuinput_create_like(int fd, const char* name)
+{
+	unsigned char key_bits[KEY_MAX / 8 + 1], abs_bits[ABS_MAX / 8 + 1], ff_bits[FF_MAX / 8 + 1];
+	struct uinput_abs_setup abs_setup;
+	struct input_id id;
+	int n_effects, code, ufd, err;
+
+	memset(key_bits, 0, sizeof(key_bits));
+	memset(abs_bits, 0, sizeof(abs_bits));
+	memset(ff_bits, 0, sizeof(ff_bits));
+	if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(key_bits)), key_bits) < 0 ||
+	    ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits) < 0 ||
+	    ioctl(fd, EVIOCGBIT(EV_FF, sizeof(ff_bits)), ff_bits) < 0 ||
+	    ioctl(fd, EVIOCGEFFECTS, &n_effects) < 0 ||
+	    ioctl(fd, EVIOCGID, &id) < 0)
+		return -1;
+
+	ufd = open("/dev/uinput", O_RDWR | O_NONBLOCK);
+	if (ufd == -1)
+		return -1;
+
+	for (code = 0; code <= KEY_MAX; code++) {
+		if (!((key_bits[code / 8] >> (code % 8)) & 1))
+			continue;
+		if (ioctl(ufd, UI_SET_EVBIT, EV_KEY) == -1 ||
+		    ioctl(ufd, UI_SET_KEYBIT, code) == -1)
+			goto error;
+	}
+	for (code = 0; code <= ABS_MAX; code++) {
+		if (!((abs_bits[code / 8] >> (code % 8)) & 1))
+			continue;
+		memset(&abs_setup, 0, sizeof(abs_setup));
+		abs_setup.code = code;
+		if (ioctl(fd, EVIOCGABS(code), &abs_setup.absinfo) < 0 ||
+		    ioctl(ufd, UI_SET_EVBIT, EV_ABS) == -1 ||
+		    ioctl(ufd, UI_SET_ABSBIT, code) == -1 ||
+		    ioctl(ufd, UI_ABS_SETUP, &abs_setup) == -1)
+			goto error;
+	}
+	for (code = 0; code <= FF_MAX; code++) {
+		if (((ff_bits[code / 8] >> (code % 8)) & 1) && ioctl(ufd, UI_SET_FFBIT, code) == -1)
+			goto error;
+	}
+
+	if (create_ff_device(ufd, name, &id, n_effects) == -1)
+		goto error;
+
+	return ufd;
+
+error:
+	err = errno;
+	close(ufd);
+	errno = err;
+	return -1;
+}
+
+int ffuinput_get_devnode(int ufd, char* devnode, size_t len)
+{
+	char sysname[64], sysdir[128];
+	DIR* dir;
+	struct dirent* entry;
+	int tries;
+
+	memset(sysname, 0, sizeof(sysname));
+	if (ioctl(ufd, UI_GET_SYSNAME(sizeof(sysname) - 1), sysname) < 0)
+		return -1;
+	snprintf(sysdir, sizeof(sysdir), "/sys/devices/virtual/input/%s", sysname);
+
+	dir = opendir(sysdir);
+	if (!dir)
+		return -1;
+	devnode[0] = '\0';
+	while ((entry = readdir(dir))) {
+		if (strncmp(entry->d_name, "event", 5) == 0) {
+			snprintf(devnode, len, "/dev/input/%s", entry->d_name);
+			break;
+		}
+	}
+	closedir(dir);
+	if (!devnode[0]) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	/* Give udev up to 2 seconds to create the node and set its permissions */
+	for (tries = 0; tries < 200; tries++) {
+		if (access(devnode, R_OK | W_OK) == 0)
+			return 0;
+		usleep(10000);
+	}
+	errno = ENOENT;
+	return -1;
+}
+
+int ffuinput_read_command(int ufd, struct ff_command* cmd)
+{
+	struct input_event ev;
+	struct uinput_ff_upload upload;
+	struct uinput_ff_erase erase;
+
+	if (read(ufd, &ev, sizeof(ev)) != sizeof(ev))
+		return -1;
+
+	cmd->timestamp = get_ntime();
+
+	if (ev.type == EV_UINPUT && ev.code == UI_FF_UPLOAD) {
+		memset(&upload, 0, sizeof(upload));
+		upload.request_id = ev.value;
+		if (ioctl(ufd, UI_BEGIN_FF_UPLOAD, &upload) < 0)
+			return -1;
+		cmd->type = FF_CMD_UPLOAD;
+		cmd->request_id = upload.request_id;
+		cmd->id = upload.effect.id;
+		cmd->value = 0;
+		cmd->effect = upload.effect;
+		return 1;
+	}
+	if (ev.type == EV_UINPUT && ev.code == UI_FF_ERASE) {
+		memset(&erase, 0, sizeof(erase));
+		erase.request_id = ev.value;
+		if (ioctl(ufd, UI_BEGIN_FF_ERASE, &erase) < 0)
+			return -1;
+		cmd->type = FF_CMD_ERASE;
+		cmd->request_id = erase.request_id;
+		cmd->id = erase.effect_id;
+		cmd->value = 0;
+		return 1;
+	}
+	if (ev.type == EV_FF) {
+		if (ev.code == FF_GAIN)
+			cmd->type = FF_CMD_GAIN;
+		else if (ev.code == FF_AUTOCENTER)
+			cmd->type = FF_CMD_AUTOCENTER;
+		else
+			cmd->type = FF_CMD_PLAY;
+		cmd->id = ev.code;
+		cmd->value = ev.value;
+		return 1;
+	}
+
+	return 0;
+}
+
+int ffuinput_complete(int ufd, const struct ff_command* cmd, int retval)
+{
+	struct uinput_ff_upload upload;
+	struct uinput_ff_erase erase;
+
+	switch (cmd->type) {
+	case FF_CMD_UPLOAD:
+		memset(&upload, 0, sizeof(upload));
+		upload.request_id = cmd->request_id;
+		upload.retval = retval;
+		return ioctl(ufd, UI_END_FF_UPLOAD, &upload);
+	case FF_CMD_ERASE:
+		memset(&erase, 0, sizeof(erase));
+		erase.request_id = cmd->request_id;
+		erase.retval = retval;
+		return ioctl(ufd, UI_END_FF_ERASE, &erase);
+	}
+	return 0;
+}
+
+int ffuinput_report_axis(int ufd, int code, int value)
+{
+	struct input_event events[2];
+
+	/* The kernel timestamps the events itself */
+	memset(events, 0, sizeof(events));
+	events[0].type = EV_ABS;
+	events[0].code = code;
+	events[0].value = value;
+	events[1].type = EV_SYN;
+	events[1].code = SYN_REPORT;
+	if (write(ufd, events, sizeof(events)) != sizeof(events))
+		return -1;
+	return 0;
+}
+
+void ffuinput_destroy(int ufd)
+{
+	ioctl(ufd, UI_DEV_DESTROY);
+	close(ufd);
+}
@@ -0,0 +1,87 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FFUINPUT_H
+#define FFUINPUT_H
+
+#include <stddef.h>
+#include <linux/input.h>
+
+/*
+ * Thin layer around /dev/uinput to create a virtual force feedback device,
+ * and to translate what the kernel sends to it into force feedback commands.
+ */
+
+enum ff_command_type {
+	FF_CMD_UPLOAD,
+	FF_CMD_ERASE,
+	FF_CMD_PLAY,
+	FF_CMD_GAIN,
+	FF_CMD_AUTOCENTER,
+	N_FF_CMD_TYPES
+};
+
+extern const char* ff_command_names[N_FF_CMD_TYPES];
+
+struct ff_command {
+	int type;                           /* one of enum ff_command_type */
+	int id;                             /* effect id (upload, erase, play) */
+	int value;                          /* play count, gain or autocenter */
+	unsigned int request_id;            /* uinput request to complete (upload, erase) */
+	unsigned long long timestamp;       /* CLOCK_MONOTONIC receipt time, in nanoseconds */
+	struct ff_effect effect;            /* uploaded effect (upload) */
+};
+
+/*
+ * Create a virtual device advertising all force feedback effect types (and all periodic waveforms),
+ * FF_GAIN and FF_AUTOCENTER, with room for 'n_effects' effects, and a steering axis.
+ * Returns the uinput file descriptor, or -1 on error (errno is set).
+ */
+int ffuinput_create(const char* name, int n_effects);
+
+/*
+ * Create a virtual device with the same identity, buttons, axes and force feedback capabilities
+ * as the evdev device opened as 'fd'. Returns the uinput file descriptor, or -1 on error (errno is set).
+ */
+int ffuinput_create_like(int fd, const char* name);
+
+/*
+ * Store the path of the event node (e.g. "/dev/input/event5") of the device in 'devnode',
+ * waiting for udev to create it. Returns 0 on success, -1 on error.
+ */
+int ffuinput_get_devnode(int ufd, char* devnode, size_t len);
+
+/*
+ * Read one event from the device and translate it into 'cmd'.
+ * Returns 1 if a command was read, 0 if the event was not a command, -1 on error (errno is set).
+ * Upload and erase commands have to be completed with ffuinput_complete() afterwards,
+ * the application that sent them is blocked until then.
+ */
+int ffuinput_read_command(int ufd, struct ff_command* cmd);
+
+/*
+ * Report a new value of the absolute axis 'code', followed by SYN_REPORT, in a single write.
+ * The input core drops values that didn't change. Returns 0 on success, -1 on error (errno is set).
+ */
+int ffuinput_report_axis(int ufd, int code, int value);
+
+/* Complete an upload or erase command, with 'retval' as result for the application */
+int ffuinput_complete(int ufd, const struct ff_command* cmd, int retval);
+
+void ffuinput_destroy(int ufd);
+
+#endif /* FFUINPUT_H */